@@ -0,0 +1,688 @@
+/***********************************************************************/
+/*                                                                     */
+/*                      The Cryptokit library                          */
+/*                                                                     */
+/*            Xavier Leroy, Collège de France and Inria                */
+/*                                                                     */
+/*  Copyright 2026 Institut National de Recherche en Informatique et   */
+/*  en Automatique.  All rights reserved.  This file is distributed    */
+/*  under the terms of the GNU Library General Public License, with    */
+/*  the special exception on linking described in file LICENSE.        */
+/*                                                                     */
+/***********************************************************************/
+
+/* One-shot authenticated encryption: AES-GCM and Chacha20-Poly1305 */
+
+/* This file must be included after the AES, GHASH, Chacha20 and
+   Poly1305 implementations: rijndael-alg-fst.c, aesni.c, ghash.c,
+   pclmul.c, chacha20.c, poly1305-donna.c. */
+
+#include <stdint.h>
+#include <string.h>
+#include "aead.h"
+
+/* Number of messages or blocks processed in parallel */
+#define AEAD_LANES 4
+
+static inline void store_uint64_be(uint8_t * b, uint64_t n)
+{
+  b[0] = n >> 56; b[1] = n >> 48; b[2] = n >> 40; b[3] = n >> 32;
+  b[4] = n >> 24; b[5] = n >> 16; b[6] = n >> 8;  b[7] = n;
+}
+
+static inline void store_uint64_le(uint8_t * b, uint64_t n)
+{
+  b[0] = n;       b[1] = n >> 8;  b[2] = n >> 16; b[3] = n >> 24;
+  b[4] = n >> 32; b[5] = n >> 40; b[6] = n >> 48; b[7] = n >> 56;
+}
+
+/* Constant-time comparison of two authentication tags */
+
+static int aead_tag_equal(const uint8_t a[16], const uint8_t b[16])
+{
+  uint8_t d = 0;
+  int i;
+  for (i = 0; i < 16; i++) d |= a[i] ^ b[i];
+  return d == 0;
+}
+
+/* AES-GCM */
+
+EXPORT void aes_gcm_init_key(struct aes_gcm_key * k,
+                             const uint8_t * key, size_t keylen)
+{
+  if (aesni_available == -1) aesni_check_available();
+  if (pclmul_available == -1) pclmul_check_available();
+  memset(k, 0, sizeof(struct aes_gcm_key));
+  k->aesni = aesni_available;
+  k->pclmul = pclmul_available;
+  if (k->aesni)
+    k->nrounds = aesniKeySetupEnc((u8 *) k->ckey, key, 8 * keylen);
+  else
+    k->nrounds = rijndaelKeySetupEnc(k->ckey, key, 8 * keylen);
+  /* The GHASH multiplier is the encryption of the all-zero block */
+  if (k->aesni)
+    aesniEncrypt((const u8 *) k->ckey, k->nrounds, k->h, k->h);
+  else
+    rijndaelEncrypt(k->ckey, k->nrounds, k->h, k->h);
+  if (! k->pclmul) ghash_init(&k->ghash, k->h);
+}
+
+static inline void aes_gcm_block(const struct aes_gcm_key * k,
+                                 const uint8_t in[16], uint8_t out[16])
+{
+  if (k->aesni)
+    aesniEncrypt((const u8 *) k->ckey, k->nrounds, in, out);
+  else
+    rijndaelEncrypt(k->ckey, k->nrounds, in, out);
+}
+
+static inline void aes_gcm_mult(const struct aes_gcm_key * k, uint8_t x[16])
+{
+  if (k->pclmul)
+    pclmul_mult(x, x, k->h);
+  else
+    ghash_mult(&k->ghash, x, x);
+}
+
+/* Hash [len] bytes into the running MAC, padding the last block
+   with zeros. */
+
+static void aes_gcm_ghash(const struct aes_gcm_key * k, uint8_t mac[16],
+                          const uint8_t * data, size_t len)
+{
+  size_t i;
+  while (len >= 16) {
+    for (i = 0; i < 16; i++) mac[i] ^= data[i];
+    aes_gcm_mult(k, mac);
+    data += 16; len -= 16;
+  }
+  if (len > 0) {
+    for (i = 0; i < len; i++) mac[i] ^= data[i];
+    aes_gcm_mult(k, mac);
+  }
+}
+
+/* Hash the final block containing the lengths, and produce the tag */
+
+static void aes_gcm_final(const struct aes_gcm_key * k, uint8_t mac[16],
+                          uint64_t hdrlen, uint64_t len,
+                          const uint8_t e0[16], uint8_t tag[16])
+{
+  uint8_t lens[16];
+  int i;
+  store_uint64_be(lens, hdrlen * 8);     /* in bits */
+  store_uint64_be(lens + 8, len * 8);    /* in bits */
+  aes_gcm_ghash(k, mac, lens, 16);
+  for (i = 0; i < 16; i++) tag[i] = mac[i] ^ e0[i];
+}
+
+/* Initial value of the counter */
+
+static void aes_gcm_counter0(const struct aes_gcm_key * k,
+                             const uint8_t * iv, size_t ivlen,
+                             uint8_t ctr[16])
+{
+  if (ivlen == 12) {
+    memcpy(ctr, iv, 12);
+    ctr[12] = 0; ctr[13] = 0; ctr[14] = 0; ctr[15] = 1;
+  } else {
+    uint8_t lens[16];
+    memset(ctr, 0, 16);
+    aes_gcm_ghash(k, ctr, iv, ivlen);
+    memset(lens, 0, 8);
+    store_uint64_be(lens + 8, (uint64_t) ivlen * 8);
+    aes_gcm_ghash(k, ctr, lens, 16);
+  }
+}
+
+/* Increment the low 32 bits of the counter, big-endian, with wrap-around */
+
+static inline void aes_gcm_incr(uint8_t ctr[16])
+{
+  if (++ctr[15] != 0) return;
+  if (++ctr[14] != 0) return;
+  if (++ctr[13] != 0) return;
+  ++ctr[12];
+}
+
+/* Encrypt the [n] blocks [in[0]], ..., [in[n-1]], where [n <= AEAD_LANES],
+   block [i] being encrypted with key [k[i]].  With AES-NI, the rounds
+   for the [n] blocks are interleaved, so that the blocks go through
+   the AES pipeline in parallel. */
+
+static void aes_gcm_blocks(const struct aes_gcm_key * const * k,
+                           uint8_t in[][16], uint8_t out[][16], int n)
+{
+  int i;
+#ifdef __AES__
+  if (k[0]->aesni) {
+    __m128i t[AEAD_LANES];
+    int nr = k[0]->nrounds, j;
+    for (i = 1; i < n; i++) if (k[i]->nrounds != nr) goto generic;
+    for (i = 0; i < n; i++)
+      t[i] = _mm_xor_si128(_mm_loadu_si128((__m128i *) in[i]),
+                           _mm_loadu_si128((const __m128i *) k[i]->ckey));
+    for (j = 1; j < nr; j++)
+      for (i = 0; i < n; i++)
+        t[i] = _mm_aesenc_si128(t[i],
+                 _mm_loadu_si128((const __m128i *) k[i]->ckey + j));
+    for (i = 0; i < n; i++)
+      _mm_storeu_si128((__m128i *) out[i],
+        _mm_aesenclast_si128(t[i],
+          _mm_loadu_si128((const __m128i *) k[i]->ckey + nr)));
+    return;
+  }
+ generic:
+#endif
+  for (i = 0; i < n; i++) aes_gcm_block(k[i], in[i], out[i]);
+}
+
+/* CTR encryption / decryption.  [src] and [dst] can be equal.
+   Up to AEAD_LANES consecutive blocks are encrypted together. */
+
+static void aes_gcm_ctr(const struct aes_gcm_key * k, uint8_t ctr[16],
+                        const uint8_t * src, uint8_t * dst, size_t len)
+{
+  const struct aes_gcm_key * keys[AEAD_LANES];
+  uint8_t cb[AEAD_LANES][16], ks[AEAD_LANES][16];
+  size_t i, m;
+  int n;
+  for (n = 0; n < AEAD_LANES; n++) keys[n] = k;
+  while (len > 0) {
+    for (n = 0; n < AEAD_LANES && 16 * n < len; n++) {
+      aes_gcm_incr(ctr);
+      memcpy(cb[n], ctr, 16);
+    }
+    aes_gcm_blocks(keys, cb, ks, n);
+    m = len < 16 * n ? len : 16 * n;
+    for (i = 0; i < m; i++) dst[i] = src[i] ^ ((uint8_t *) ks)[i];
+    src += m; dst += m; len -= m;
+  }
+  memset(ks, 0, sizeof(ks));
+}
+
+EXPORT void aes_gcm_encrypt(const struct aes_gcm_key * k,
+                            const uint8_t * iv, size_t ivlen,
+                            const uint8_t * hdr, size_t hdrlen,
+                            const uint8_t * src, uint8_t * dst, size_t len,
+                            uint8_t tag[16])
+{
+  uint8_t ctr[16], e0[16], mac[16];
+
+  aes_gcm_counter0(k, iv, ivlen, ctr);
+  aes_gcm_block(k, ctr, e0);
+  memset(mac, 0, 16);
+  aes_gcm_ghash(k, mac, hdr, hdrlen);
+  aes_gcm_ctr(k, ctr, src, dst, len);
+  aes_gcm_ghash(k, mac, dst, len);
+  aes_gcm_final(k, mac, hdrlen, len, e0, tag);
+  memset(e0, 0, 16);
+  memset(mac, 0, 16);
+}
+
+EXPORT int aes_gcm_decrypt(const struct aes_gcm_key * k,
+                           const uint8_t * iv, size_t ivlen,
+                           const uint8_t * hdr, size_t hdrlen,
+                           const uint8_t * src, uint8_t * dst, size_t len,
+                           const uint8_t tag[16])
+{
+  uint8_t ctr[16], e0[16], mac[16];
+  int ok;
+
+  aes_gcm_counter0(k, iv, ivlen, ctr);
+  aes_gcm_block(k, ctr, e0);
+  memset(mac, 0, 16);
+  aes_gcm_ghash(k, mac, hdr, hdrlen);
+  /* Authenticate the ciphertext before decrypting anything */
+  aes_gcm_ghash(k, mac, src, len);
+  aes_gcm_final(k, mac, hdrlen, len, e0, mac);
+  ok = aead_tag_equal(mac, tag);
+  if (ok) aes_gcm_ctr(k, ctr, src, dst, len);
+  memset(e0, 0, 16);
+  memset(mac, 0, 16);
+  return ok;
+}
+
+/* Chacha20-Poly1305 */
+
+static void chacha20_poly1305_pad(poly1305_context * p, size_t len)
+{
+  static const uint8_t zeros[16] = { 0 };
+  if ((len & 0xF) != 0) poly1305_update(p, zeros, 16 - (len & 0xF));
+}
+
+static void chacha20_poly1305_start(chacha20_ctx * c, poly1305_context * p,
+                                    const uint8_t * key, size_t keylen,
+                                    const uint8_t * iv, size_t ivlen,
+                                    const uint8_t * hdr, size_t hdrlen)
+{
+  uint8_t block[64];
+  chacha20_init(c, key, keylen, iv, ivlen, 0);
+  /* The Poly1305 key is the first 32 bytes of the first keystream block.
+     The remaining 32 bytes are discarded. */
+  chacha20_extract(c, block, 64);
+  poly1305_init(p, block);
+  memset(block, 0, 64);
+  poly1305_update(p, hdr, hdrlen);
+  chacha20_poly1305_pad(p, hdrlen);
+}
+
+static void chacha20_poly1305_finish(poly1305_context * p,
+                                     uint64_t hdrlen, uint64_t len,
+                                     uint8_t tag[16])
+{
+  uint8_t lens[16];
+  chacha20_poly1305_pad(p, len);
+  store_uint64_le(lens, hdrlen);
+  store_uint64_le(lens + 8, len);
+  poly1305_update(p, lens, 16);
+  poly1305_finish(p, tag);
+}
+
+EXPORT void chacha20_poly1305_encrypt(const uint8_t * key, size_t keylen,
+                                      const uint8_t * iv, size_t ivlen,
+                                      const uint8_t * hdr, size_t hdrlen,
+                                      const uint8_t * src, uint8_t * dst,
+                                      size_t len,
+                                      uint8_t tag[16])
+{
+  chacha20_ctx c;
+  poly1305_context p;
+
+  chacha20_poly1305_start(&c, &p, key, keylen, iv, ivlen, hdr, hdrlen);
+  chacha20_transform(&c, src, dst, len);
+  poly1305_update(&p, dst, len);
+  chacha20_poly1305_finish(&p, hdrlen, len, tag);
+  memset(&c, 0, sizeof(c));
+  memset(&p, 0, sizeof(p));
+}
+
+EXPORT int chacha20_poly1305_decrypt(const uint8_t * key, size_t keylen,
+                                     const uint8_t * iv, size_t ivlen,
+                                     const uint8_t * hdr, size_t hdrlen,
+                                     const uint8_t * src, uint8_t * dst,
+                                     size_t len,
+                                     const uint8_t tag[16])
+{
+  chacha20_ctx c;
+  poly1305_context p;
+  uint8_t mac[16];
+  int ok;
+
+  chacha20_poly1305_start(&c, &p, key, keylen, iv, ivlen, hdr, hdrlen);
+  /* Authenticate the ciphertext before decrypting anything */
+  poly1305_update(&p, src, len);
+  chacha20_poly1305_finish(&p, hdrlen, len, mac);
+  ok = aead_tag_equal(mac, tag);
+  if (ok) chacha20_transform(&c, src, dst, len);
+  memset(&c, 0, sizeof(c));
+  memset(&p, 0, sizeof(p));
+  memset(mac, 0, 16);
+  return ok;
+}
+
+/* Batch encryption and decryption of independent packets.
+   Packets are processed in groups of AEAD_LANES, and the processing
+   of the packets in a group is interleaved block by block:
+   the AES or Chacha20 computations of the packets run in parallel,
+   and so do the GHASH or Poly1305 computations. */
+
+/* Hash the [n] messages [data[i]] of lengths [len[i]] into the [n] MACs
+   [mac[i]], one block of each message at a time. */
+
+static void aes_gcm_ghash_lanes(const struct aead_packet * p, int n,
+                                uint8_t mac[][16],
+                                const uint8_t * const * data,
+                                const size_t * len)
+{
+  size_t pos, maxlen = 0, b, j;
+  int i;
+  for (i = 0; i < n; i++) if (len[i] > maxlen) maxlen = len[i];
+  for (pos = 0; pos < maxlen; pos += 16) {
+    for (i = 0; i < n; i++) {
+      if (len[i] <= pos) continue;
+      b = len[i] - pos < 16 ? len[i] - pos : 16;
+      for (j = 0; j < b; j++) mac[i][j] ^= data[i][pos + j];
+      aes_gcm_mult(p[i].key, mac[i]);
+    }
+  }
+}
+
+/* CTR encryption or decryption of the data of the packets [i] such that
+   [active[i]] is true, one block of each packet at a time.
+   If [mac] is not NULL, the resulting blocks are also hashed into [mac]. */
+
+static void aes_gcm_ctr_lanes(const struct aead_packet * p, int n,
+                              const int * active,
+                              uint8_t ctr[][16], uint8_t mac[][16])
+{
+  const struct aes_gcm_key * keys[AEAD_LANES];
+  uint8_t cb[AEAD_LANES][16], ks[AEAD_LANES][16];
+  int lane[AEAD_LANES];
+  size_t pos, maxlen = 0, b, j;
+  int i, m, l;
+  for (i = 0; i < n; i++)
+    if (active[i] && p[i].len > maxlen) maxlen = p[i].len;
+  for (pos = 0; pos < maxlen; pos += 16) {
+    for (i = 0, m = 0; i < n; i++) {
+      if (! active[i] || p[i].len <= pos) continue;
+      aes_gcm_incr(ctr[i]);
+      memcpy(cb[m], ctr[i], 16);
+      keys[m] = p[i].key;
+      lane[m] = i;
+      m++;
+    }
+    aes_gcm_blocks(keys, cb, ks, m);
+    for (l = 0; l < m; l++) {
+      i = lane[l];
+      b = p[i].len - pos < 16 ? p[i].len - pos : 16;
+      for (j = 0; j < b; j++) p[i].data[pos + j] ^= ks[l][j];
+      if (mac != NULL) {
+        for (j = 0; j < b; j++) mac[i][j] ^= p[i].data[pos + j];
+        aes_gcm_mult(p[i].key, mac[i]);
+      }
+    }
+  }
+  memset(ks, 0, sizeof(ks));
+}
+
+/* Common initialization: initial counters, their encryptions,
+   and MACs of the headers. */
+
+static void aes_gcm_start_lanes(const struct aead_packet * p, int n,
+                                uint8_t ctr[][16], uint8_t e0[][16],
+                                uint8_t mac[][16])
+{
+  const struct aes_gcm_key * keys[AEAD_LANES];
+  const uint8_t * hdr[AEAD_LANES];
+  size_t hdrlen[AEAD_LANES];
+  int i;
+  for (i = 0; i < n; i++) {
+    keys[i] = p[i].key;
+    aes_gcm_counter0(p[i].key, p[i].iv, p[i].ivlen, ctr[i]);
+    memset(mac[i], 0, 16);
+    hdr[i] = p[i].hdr;
+    hdrlen[i] = p[i].hdrlen;
+  }
+  aes_gcm_blocks(keys, ctr, e0, n);
+  aes_gcm_ghash_lanes(p, n, mac, hdr, hdrlen);
+}
+
+EXPORT void aes_gcm_encrypt_lanes(const struct aead_packet * p, int n)
+{
+  uint8_t ctr[AEAD_LANES][16], e0[AEAD_LANES][16], mac[AEAD_LANES][16];
+  int active[AEAD_LANES];
+  int i;
+  aes_gcm_start_lanes(p, n, ctr, e0, mac);
+  for (i = 0; i < n; i++) active[i] = 1;
+  aes_gcm_ctr_lanes(p, n, active, ctr, mac);
+  for (i = 0; i < n; i++)
+    aes_gcm_final(p[i].key, mac[i], p[i].hdrlen, p[i].len, e0[i], p[i].tag);
+  memset(e0, 0, sizeof(e0));
+  memset(mac, 0, sizeof(mac));
+}
+
+EXPORT void aes_gcm_decrypt_lanes(const struct aead_packet * p, int n,
+                                  int * ok)
+{
+  uint8_t ctr[AEAD_LANES][16], e0[AEAD_LANES][16], mac[AEAD_LANES][16];
+  const uint8_t * data[AEAD_LANES];
+  size_t len[AEAD_LANES];
+  int i;
+  aes_gcm_start_lanes(p, n, ctr, e0, mac);
+  /* Authenticate all ciphertexts before decrypting anything */
+  for (i = 0; i < n; i++) { data[i] = p[i].data; len[i] = p[i].len; }
+  aes_gcm_ghash_lanes(p, n, mac, data, len);
+  for (i = 0; i < n; i++) {
+    aes_gcm_final(p[i].key, mac[i], p[i].hdrlen, p[i].len, e0[i], mac[i]);
+    ok[i] = aead_tag_equal(mac[i], p[i].tag);
+  }
+  aes_gcm_ctr_lanes(p, n, ok, ctr, NULL);
+  memset(e0, 0, sizeof(e0));
+  memset(mac, 0, sizeof(mac));
+}
+
+/* Compute the next keystream block for the [n] Chacha20 states [c[i]].
+   The computations are written lane-wise so that the compiler can
+   vectorize them. */
+
+#define QUARTERROUND_LANES(a,b,c,d) \
+  for (l = 0; l < AEAD_LANES; l++) { \
+    x[a][l] += x[b][l]; x[d][l] = ROTATE(x[d][l] ^ x[a][l], 16); \
+    x[c][l] += x[d][l]; x[b][l] = ROTATE(x[b][l] ^ x[c][l], 12); \
+    x[a][l] += x[b][l]; x[d][l] = ROTATE(x[d][l] ^ x[a][l], 8); \
+    x[c][l] += x[d][l]; x[b][l] = ROTATE(x[b][l] ^ x[c][l], 7); \
+  }
+
+static void chacha20_block_lanes(chacha20_ctx * const * c, int n)
+{
+  uint32_t x[16][AEAD_LANES];
+  int i, l, r;
+
+  for (i = 0; i < 16; i++)
+    for (l = 0; l < AEAD_LANES; l++)
+      x[i][l] = c[l < n ? l : 0]->input[i];
+  for (r = 10; r > 0; r--) {
+    QUARTERROUND_LANES( 0, 4, 8,12)
+    QUARTERROUND_LANES( 1, 5, 9,13)
+    QUARTERROUND_LANES( 2, 6,10,14)
+    QUARTERROUND_LANES( 3, 7,11,15)
+    QUARTERROUND_LANES( 0, 5,10,15)
+    QUARTERROUND_LANES( 1, 6,11,12)
+    QUARTERROUND_LANES( 2, 7, 8,13)
+    QUARTERROUND_LANES( 3, 4, 9,14)
+  }
+  for (l = 0; l < n; l++) {
+    for (i = 0; i < 16; i++)
+      U32TO8_LITTLE(c[l]->output + 4 * i, x[i][l] + c[l]->input[i]);
+    /* Increment the 32- or 64-bit counter */
+    if (++ c[l]->input[12] == 0) {
+      if (c[l]->iv_length == 8) ++ c[l]->input[13];
+    }
+    c[l]->next = 64;
+  }
+  memset(x, 0, sizeof(x));
+}
+
+#undef QUARTERROUND_LANES
+
+/* Initial keystream block and Poly1305 initialization */
+
+static void chacha20_poly1305_start_lanes(const struct aead_packet * p, int n,
+                                          chacha20_ctx * c,
+                                          poly1305_context * h)
+{
+  chacha20_ctx * cp[AEAD_LANES];
+  int i;
+  for (i = 0; i < AEAD_LANES; i++) cp[i] = &c[i];
+  for (i = 0; i < n; i++)
+    chacha20_init(&c[i], p[i].key, p[i].keylen, p[i].iv, p[i].ivlen, 0);
+  chacha20_block_lanes(cp, n);
+  for (i = 0; i < n; i++) {
+    poly1305_init(&h[i], c[i].output);
+    poly1305_update(&h[i], p[i].hdr, p[i].hdrlen);
+    chacha20_poly1305_pad(&h[i], p[i].hdrlen);
+  }
+}
+
+/* Chacha20 encryption or decryption of the data of the packets [i] such
+   that [active[i]] is true, one 64-byte block of each packet at a time.
+   If [h] is not NULL, the resulting blocks are also hashed into [h]. */
+
+static void chacha20_lanes(const struct aead_packet * p, int n,
+                           const int * active,
+                           chacha20_ctx * c, poly1305_context * h)
+{
+  chacha20_ctx * cp[AEAD_LANES];
+  int lane[AEAD_LANES];
+  size_t pos, maxlen = 0, b, j;
+  int i, m, l;
+  for (i = 0; i < n; i++)
+    if (active[i] && p[i].len > maxlen) maxlen = p[i].len;
+  for (pos = 0; pos < maxlen; pos += 64) {
+    for (i = 0, m = 0; i < n; i++) {
+      if (! active[i] || p[i].len <= pos) continue;
+      cp[m] = &c[i];
+      lane[m] = i;
+      m++;
+    }
+    chacha20_block_lanes(cp, m);
+    for (l = 0; l < m; l++) {
+      i = lane[l];
+      b = p[i].len - pos < 64 ? p[i].len - pos : 64;
+      for (j = 0; j < b; j++) p[i].data[pos + j] ^= c[i].output[j];
+      if (h != NULL) poly1305_update(&h[i], p[i].data + pos, b);
+    }
+  }
+}
+
+EXPORT void chacha20_poly1305_encrypt_lanes(const struct aead_packet * p,
+                                            int n)
+{
+  chacha20_ctx c[AEAD_LANES];
+  poly1305_context h[AEAD_LANES];
+  int active[AEAD_LANES];
+  int i;
+  chacha20_poly1305_start_lanes(p, n, c, h);
+  for (i = 0; i < n; i++) active[i] = 1;
+  chacha20_lanes(p, n, active, c, h);
+  for (i = 0; i < n; i++)
+    chacha20_poly1305_finish(&h[i], p[i].hdrlen, p[i].len, p[i].tag);
+  memset(c, 0, sizeof(c));
+  memset(h, 0, sizeof(h));
+}
+
+EXPORT void chacha20_poly1305_decrypt_lanes(const struct aead_packet * p,
+                                            int n, int * ok)
+{
+  chacha20_ctx c[AEAD_LANES];
+  poly1305_context h[AEAD_LANES];
+  uint8_t mac[16];
+  size_t pos, maxlen = 0, b;
+  int i;
+  chacha20_poly1305_start_lanes(p, n, c, h);
+  /* Authenticate all ciphertexts before decrypting anything */
+  for (i = 0; i < n; i++) if (p[i].len > maxlen) maxlen = p[i].len;
+  for (pos = 0; pos < maxlen; pos += 256) {
+    for (i = 0; i < n; i++) {
+      if (p[i].len <= pos) continue;
+      b = p[i].len - pos < 256 ? p[i].len - pos : 256;
+      poly1305_update(&h[i], p[i].data + pos, b);
+    }
+  }
+  for (i = 0; i < n; i++) {
+    chacha20_poly1305_finish(&h[i], p[i].hdrlen, p[i].len, mac);
+    ok[i] = aead_tag_equal(mac, p[i].tag);
+  }
+  chacha20_lanes(p, n, ok, c, NULL);
+  memset(c, 0, sizeof(c));
+  memset(h, 0, sizeof(h));
+  memset(mac, 0, sizeof(mac));
+}
+
+/* Segments of a stream, split between several POSIX threads.
+   Each thread processes a contiguous range of segments. */
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#define AEAD_MAX_THREADS 256
+
+static const uint8_t aead_no_header[1] = { 0 };
+
+struct aead_segment_job {
+  const struct aead_segments * s;
+  size_t first, end;            /* range of segments */
+  int decrypt;
+  int ok;
+};
+
+static void * aead_segment_job_run(void * arg)
+{
+  struct aead_segment_job * job = arg;
+  const struct aead_segments * s = job->s;
+  const uint8_t * iv;
+  uint8_t * p;
+  size_t i, len;
+
+  job->ok = 1;
+  for (i = job->first; i < job->end; i++) {
+    p = s->buf + i * (s->seglen + 16);
+    len = i == s->n - 1 ? s->lastlen : s->seglen;
+    iv = s->nonces + 12 * i;
+    if (s->keylen == 0) {
+      if (job->decrypt)
+        job->ok &= aes_gcm_decrypt(s->key, iv, 12, aead_no_header, 0,
+                                   p, p, len, p + len);
+      else
+        aes_gcm_encrypt(s->key, iv, 12, aead_no_header, 0,
+                        p, p, len, p + len);
+    } else {
+      if (job->decrypt)
+        job->ok &= chacha20_poly1305_decrypt(s->key, s->keylen, iv, 12,
+                                             aead_no_header, 0,
+                                             p, p, len, p + len);
+      else
+        chacha20_poly1305_encrypt(s->key, s->keylen, iv, 12,
+                                  aead_no_header, 0, p, p, len, p + len);
+    }
+  }
+  return NULL;
+}
+
+static int aead_segments_run(const struct aead_segments * s, int threads,
+                             int decrypt)
+{
+  struct aead_segment_job jobs[AEAD_MAX_THREADS];
+#ifdef HAVE_PTHREAD
+  pthread_t tids[AEAD_MAX_THREADS];
+  int started[AEAD_MAX_THREADS];
+#endif
+  size_t m, first;
+  int i, t, ok;
+
+  if (threads > AEAD_MAX_THREADS) threads = AEAD_MAX_THREADS;
+  if (threads < 1 || (size_t) threads > s->n) threads = s->n > 0 ? s->n : 1;
+#ifndef HAVE_PTHREAD
+  threads = 1;
+#endif
+  /* Segments per thread */
+  m = (s->n + threads - 1) / threads;
+  for (t = 0, first = 0; s->n - first > m; t++, first += m) {
+    jobs[t].s = s;
+    jobs[t].first = first;
+    jobs[t].end = first + m;
+    jobs[t].decrypt = decrypt;
+#ifdef HAVE_PTHREAD
+    started[t] =
+      pthread_create(&tids[t], NULL, aead_segment_job_run, &jobs[t]) == 0;
+    if (! started[t])
+#endif
+      aead_segment_job_run(&jobs[t]);
+  }
+  jobs[t].s = s;
+  jobs[t].first = first;
+  jobs[t].end = s->n;
+  jobs[t].decrypt = decrypt;
+  aead_segment_job_run(&jobs[t]);
+  ok = jobs[t].ok;
+  for (i = 0; i < t; i++) {
+#ifdef HAVE_PTHREAD
+    if (started[i]) pthread_join(tids[i], NULL);
+#endif
+    ok &= jobs[i].ok;
+  }
+  return ok;
+}
+
+EXPORT void aead_seal_segments(const struct aead_segments * s, int threads)
+{
+  aead_segments_run(s, threads, 0);
+}
+
+EXPORT int aead_open_segments(const struct aead_segments * s, int threads)
+{
+  return aead_segments_run(s, threads, 1);
+}
@@ -0,0 +1,108 @@
+/***********************************************************************/
+/*                                                                     */
+/*                      The Cryptokit library                          */
+/*                                                                     */
+/*            Xavier Leroy, Collège de France and Inria                */
+/*                                                                     */
+/*  Copyright 2026 Institut National de Recherche en Informatique et   */
+/*  en Automatique.  All rights reserved.  This file is distributed    */
+/*  under the terms of the GNU Library General Public License, with    */
+/*  the special exception on linking described in file LICENSE.        */
+/*                                                                     */
+/***********************************************************************/
+
+/* One-shot authenticated encryption: AES-GCM and Chacha20-Poly1305 */
+
+/* A cooked AES-GCM key: the AES key schedule plus the GHASH multiplier */
+
+struct aes_gcm_key {
+  uint32_t ckey[4 * (MAXNR + 1)]; /* AES key schedule */
+  int nrounds;                    /* number of AES rounds */
+  int aesni;                      /* 1 if the key schedule is in AES-NI format */
+  int pclmul;                     /* 1 if GHASH uses PCLMUL */
+  uint8_t h[16];                  /* the GHASH multiplier */
+  struct ghash_context ghash;     /* tables for software GHASH */
+};
+
+EXPORT void aes_gcm_init_key(struct aes_gcm_key * k,
+                             const uint8_t * key, size_t keylen);
+
+EXPORT void aes_gcm_encrypt(const struct aes_gcm_key * k,
+                            const uint8_t * iv, size_t ivlen,
+                            const uint8_t * hdr, size_t hdrlen,
+                            const uint8_t * src, uint8_t * dst, size_t len,
+                            uint8_t tag[16]);
+
+/* Returns 1 if the tag is correct, 0 otherwise.  In the latter case,
+   [dst] is not modified. */
+EXPORT int aes_gcm_decrypt(const struct aes_gcm_key * k,
+                           const uint8_t * iv, size_t ivlen,
+                           const uint8_t * hdr, size_t hdrlen,
+                           const uint8_t * src, uint8_t * dst, size_t len,
+                           const uint8_t tag[16]);
+
+EXPORT void chacha20_poly1305_encrypt(const uint8_t * key, size_t keylen,
+                                      const uint8_t * iv, size_t ivlen,
+                                      const uint8_t * hdr, size_t hdrlen,
+                                      const uint8_t * src, uint8_t * dst,
+                                      size_t len,
+                                      uint8_t tag[16]);
+
+/* Returns 1 if the tag is correct, 0 otherwise.  In the latter case,
+   [dst] is not modified. */
+EXPORT int chacha20_poly1305_decrypt(const uint8_t * key, size_t keylen,
+                                     const uint8_t * iv, size_t ivlen,
+                                     const uint8_t * hdr, size_t hdrlen,
+                                     const uint8_t * src, uint8_t * dst,
+                                     size_t len,
+                                     const uint8_t tag[16]);
+
+/* Batch processing of independent packets.  Each packet has its own key,
+   IV and header.  Its data is encrypted or decrypted in place. */
+
+struct aead_packet {
+  const void * key;       /* a [struct aes_gcm_key] or a Chacha20 key */
+  size_t keylen;          /* length of the Chacha20 key */
+  const uint8_t * iv;
+  size_t ivlen;
+  const uint8_t * hdr;
+  size_t hdrlen;
+  uint8_t * data;
+  size_t len;
+  uint8_t * tag;          /* 16 bytes, written or checked */
+};
+
+/* [n] must be at most 4.  For decryption, [ok[i]] is set to 1 if
+   the tag of packet [i] is correct, and to 0 otherwise.  In the latter
+   case, the data of packet [i] is not modified. */
+
+EXPORT void aes_gcm_encrypt_lanes(const struct aead_packet * p, int n);
+EXPORT void aes_gcm_decrypt_lanes(const struct aead_packet * p, int n,
+                                  int * ok);
+EXPORT void chacha20_poly1305_encrypt_lanes(const struct aead_packet * p,
+                                            int n);
+EXPORT void chacha20_poly1305_decrypt_lanes(const struct aead_packet * p,
+                                            int n, int * ok);
+
+/* The segments of a stream (Streaming_AEAD), sealed or opened in place.
+   Segment [i] starts at [buf + i * (seglen + 16)] and consists of
+   [seglen] bytes of data, or [lastlen] bytes for segment [n - 1],
+   followed by the 16-byte tag.  Its nonce is the 12 bytes at
+   [nonces + 12 * i].  There is no associated data. */
+
+struct aead_segments {
+  const void * key;       /* a [struct aes_gcm_key] or a Chacha20 key */
+  size_t keylen;          /* length of the Chacha20 key, 0 for AES-GCM */
+  const uint8_t * nonces;
+  uint8_t * buf;
+  size_t seglen, lastlen;
+  size_t n;
+};
+
+/* The segments are split between up to [threads] POSIX threads.
+   [aead_open_segments] returns 1 if all segments were successfully
+   authenticated, and 0 otherwise.  A segment that fails authentication
+   is not modified. */
+
+EXPORT void aead_seal_segments(const struct aead_segments * s, int threads);
+EXPORT int aead_open_segments(const struct aead_segments * s, int threads);
@@ -239,6 +239,7 @@ EXPORT int aesniKeySetupEnc(unsigned char * ckey,
   return nrounds;
 }
 
+#ifndef AES_ENCRYPT_ONLY
 EXPORT int aesniKeySetupDec(unsigned char * ckey,
                      const unsigned char * key,
                      int keylength)
@@ -256,7 +257,8 @@ EXPORT int aesniKeySetupDec(unsigned char * ckey,
   _mm_storeu_si128((__m128i*) ckey + nrounds, key_schedule[0]);
   return nrounds;
 }
-                     
+#endif
+
 EXPORT void aesniEncrypt(const unsigned char * key, int nrounds,
                   const unsigned char * in,
                   unsigned char * out)
@@ -278,6 +280,7 @@ EXPORT void aesniEncrypt(const unsigned char * key, int nrounds,
   _mm_storeu_si128 ((__m128i*) out, t);
 }
   
+#ifndef AES_ENCRYPT_ONLY
 EXPORT void aesniDecrypt(const unsigned char * key, int nrounds,
                   const unsigned char * in,
                   unsigned char * out)
@@ -298,7 +301,8 @@ EXPORT void aesniDecrypt(const unsigned char * key, int nrounds,
   t = _mm_aesdeclast_si128 (t, k);
   _mm_storeu_si128 ((__m128i*) out, t);
 }
-  
+#endif
+
 #else
 
 EXPORT int aesni_available = 0;
@@ -310,20 +314,24 @@ EXPORT int aesniKeySetupEnc(unsigned char * ckey,
                      int keylength)
 { abort(); }
 
+#ifndef AES_ENCRYPT_ONLY
 EXPORT int aesniKeySetupDec(unsigned char * ckey,
                      const unsigned char * key,
                      int keylength)
 { abort(); }
+#endif
 
 EXPORT void aesniEncrypt(const unsigned char * key, int nrounds,
                   const unsigned char * in,
                   unsigned char * out)
 { abort(); }
 
+#ifndef AES_ENCRYPT_ONLY
 EXPORT void aesniDecrypt(const unsigned char * key, int nrounds,
                   const unsigned char * in,
                   unsigned char * out)
 { abort(); }
+#endif
 
 #endif
 
@@ -25,16 +25,20 @@ EXPORT int aesniKeySetupEnc(unsigned char * ckey,
                             const unsigned char * key,
                             int keylength);
 
+#ifndef AES_ENCRYPT_ONLY
 EXPORT int aesniKeySetupDec(unsigned char * ckey,
                             const unsigned char * key,
                             int keylength);
+#endif
 
 EXPORT void aesniEncrypt(const unsigned char * key, int nrounds,
                          const unsigned char * in,
                          unsigned char * out);
 
+#ifndef AES_ENCRYPT_ONLY
 EXPORT void aesniDecrypt(const unsigned char * key, int nrounds,
                          const unsigned char * in,
                          unsigned char * out);
+#endif
     
 
@@ -0,0 +1,197 @@
+/***********************************************************************/
+/*                                                                     */
+/*                      The Cryptokit library                          */
+/*                                                                     */
+/*            Xavier Leroy, Collège de France and Inria                */
+/*                                                                     */
+/*  Copyright 2026 Institut National de Recherche en Informatique et   */
+/*  en Automatique.  All rights reserved.  This file is distributed    */
+/*  under the terms of the GNU Library General Public License, with    */
+/*  the special exception on linking described in file LICENSE.        */
+/*                                                                     */
+/***********************************************************************/
+
+/* Bao outboard encoding of BLAKE3 hash trees.
+
+   The outboard encoding of a content of [n] bytes is the content
+   length as a 64-bit little-endian integer, followed by the [c - 1]
+   parent nodes of the BLAKE3 tree in pre-order, where [c] is the
+   number of 1024-byte chunks (at least 1).  Each parent node is the
+   concatenation of the chaining values of its two children.
+   The shape of the tree is that of BLAKE3: the left subtree of a node
+   contains the largest power of 2 number of chunks that leaves at
+   least one byte for the right subtree. */
+
+#include "blake3_impl.h"
+#include <stdio.h>
+
+#define BAO_HEADER_LEN 8
+#define BAO_PARENT_LEN (2 * BLAKE3_OUT_LEN)
+
+/* Chunks are hashed by groups of MAX_SIMD_DEGREE, so as to use
+   blake3_hash_many */
+#define BAO_GROUP_LEN (MAX_SIMD_DEGREE * BLAKE3_CHUNK_LEN)
+
+struct bao_encoder {
+  const uint8_t * input;        /* the content, or NULL if read from [file] */
+  FILE * file;
+  uint8_t * outboard;           /* the outboard encoding being produced */
+  uint64_t next_parent;         /* index of the next parent node */
+  int eof;                      /* set if [file] is shorter than expected */
+  uint8_t buf[BAO_GROUP_LEN];
+};
+
+EXPORT uint64_t bao_outboard_size(uint64_t content_len)
+{
+  uint64_t chunks = (content_len + BLAKE3_CHUNK_LEN - 1) / BLAKE3_CHUNK_LEN;
+  if (chunks == 0) chunks = 1;
+  return BAO_HEADER_LEN + BAO_PARENT_LEN * (chunks - 1);
+}
+
+/* Chaining value of a chunk or of a parent node, or root hash if [root]
+   is set.  These are also used to verify slices. */
+
+EXPORT void bao_chunk_cv(const uint8_t * input, size_t len,
+                         uint64_t chunk_counter, int root,
+                         uint8_t cv[BLAKE3_OUT_LEN])
+{
+  blake3_chunk_state chunk;
+  output_t output;
+  chunk_state_init(&chunk, IV, 0);
+  chunk.chunk_counter = chunk_counter;
+  chunk_state_update(&chunk, input, len);
+  output = chunk_state_output(&chunk);
+  if (root)
+    output_root_bytes(&output, 0, cv, BLAKE3_OUT_LEN);
+  else
+    output_chaining_value(&output, cv);
+}
+
+EXPORT void bao_parent_cv(const uint8_t block[BAO_PARENT_LEN], int root,
+                          uint8_t cv[BLAKE3_OUT_LEN])
+{
+  output_t output = parent_output(block, IV, 0);
+  if (root)
+    output_root_bytes(&output, 0, cv, BLAKE3_OUT_LEN);
+  else
+    output_chaining_value(&output, cv);
+}
+
+/* Chaining values of the [n] parent nodes stored consecutively at
+   [input], none of which is the root.  A whole level of a tree is
+   hashed by groups of MAX_SIMD_DEGREE parents. */
+
+EXPORT void bao_parents_cv(const uint8_t * input, size_t n, uint8_t * out)
+{
+  const uint8_t * parents[MAX_SIMD_DEGREE_OR_2];
+  size_t i, k;
+
+  while (n > 0) {
+    k = n < MAX_SIMD_DEGREE_OR_2 ? n : MAX_SIMD_DEGREE_OR_2;
+    for (i = 0; i < k; i++) parents[i] = input + i * BAO_PARENT_LEN;
+    blake3_hash_many(parents, k, 1, IV, 0, false, PARENT, 0, 0, out);
+    input += k * BAO_PARENT_LEN; out += k * BLAKE3_OUT_LEN; n -= k;
+  }
+}
+
+static const uint8_t * bao_read(struct bao_encoder * e,
+                                uint64_t start, size_t len)
+{
+  if (e->input != NULL) return e->input + start;
+  if (fread(e->buf, 1, len, e->file) != len) {
+    e->eof = 1;
+    memset(e->buf, 0, len);
+  }
+  return e->buf;
+}
+
+/* Store a parent node in the outboard encoding */
+
+static void bao_parent(struct bao_encoder * e, uint64_t index,
+                       const uint8_t block[BAO_PARENT_LEN],
+                       int root, uint8_t cv[BLAKE3_OUT_LEN])
+{
+  memcpy(e->outboard + BAO_HEADER_LEN + BAO_PARENT_LEN * index,
+         block, BAO_PARENT_LEN);
+  bao_parent_cv(block, root, cv);
+}
+
+/* The subtree formed by [n] consecutive chunks of a group, given
+   their chaining values [cvs] */
+
+static void bao_group_subtree(struct bao_encoder * e,
+                              const uint8_t * cvs, size_t n,
+                              int root, uint8_t cv[BLAKE3_OUT_LEN])
+{
+  uint8_t block[BAO_PARENT_LEN];
+  uint64_t index;
+  size_t l;
+
+  if (n == 1) {
+    memcpy(cv, cvs, BLAKE3_OUT_LEN);
+    return;
+  }
+  index = e->next_parent++;
+  l = round_down_to_power_of_2(n - 1);
+  bao_group_subtree(e, cvs, l, 0, block);
+  bao_group_subtree(e, cvs + l * BLAKE3_OUT_LEN, n - l, 0,
+                    block + BLAKE3_OUT_LEN);
+  bao_parent(e, index, block, root, cv);
+}
+
+/* The subtree covering [len] bytes of content starting at [start] */
+
+static void bao_subtree(struct bao_encoder * e,
+                        uint64_t start, uint64_t len,
+                        int root, uint8_t cv[BLAKE3_OUT_LEN])
+{
+  uint8_t block[BAO_PARENT_LEN];
+  uint8_t cvs[MAX_SIMD_DEGREE * BLAKE3_OUT_LEN];
+  const uint8_t * p;
+  uint64_t index, l;
+  size_t n;
+
+  if (len <= BLAKE3_CHUNK_LEN) {
+    /* A single chunk, possibly empty */
+    p = bao_read(e, start, len);
+    bao_chunk_cv(p, len, start / BLAKE3_CHUNK_LEN, root, cv);
+  }
+  else if (len <= BAO_GROUP_LEN) {
+    p = bao_read(e, start, len);
+    n = compress_chunks_parallel(p, len, IV, start / BLAKE3_CHUNK_LEN, 0, cvs);
+    bao_group_subtree(e, cvs, n, root, cv);
+  }
+  else {
+    index = e->next_parent++;
+    l = left_len(len);
+    bao_subtree(e, start, l, 0, block);
+    bao_subtree(e, start + l, len - l, 0, block + BLAKE3_OUT_LEN);
+    bao_parent(e, index, block, root, cv);
+  }
+}
+
+/* Produce the outboard encoding of [content_len] bytes of content,
+   read from [input] if not NULL, or from [file] otherwise, in
+   [outboard], which must have size [bao_outboard_size(content_len)],
+   and the root hash in [hash].  Return 0 on success, -1 if [file]
+   is too short. */
+
+EXPORT int bao_encode_outboard(const uint8_t * input, FILE * file,
+                               uint64_t content_len,
+                               uint8_t * outboard,
+                               uint8_t hash[BLAKE3_OUT_LEN])
+{
+  struct bao_encoder e;
+  int i;
+
+  e.input = input;
+  e.file = file;
+  e.outboard = outboard;
+  e.next_parent = 0;
+  e.eof = 0;
+  for (i = 0; i < BAO_HEADER_LEN; i++)
+    outboard[i] = (uint8_t) (content_len >> (8 * i));
+  bao_subtree(&e, 0, content_len, 1, hash);
+  memset(e.buf, 0, sizeof(e.buf));
+  return e.eof ? -1 : 0;
+}
@@ -17,6 +17,7 @@
 #include <stdint.h>
 #include <string.h>
 #include "blake2.h"
+#include "cpufeatures.h"
 
 static const uint8_t BLAKE2_sigma[12][16] = {
   {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
@@ -35,7 +36,7 @@ static const uint8_t BLAKE2_sigma[12][16] = {
 
 /* BLAKE2b */
 
-static inline uint64_t U8TO64LE(unsigned char * src)
+static inline uint64_t U8TO64LE(const unsigned char * src)
 {
   return (uint64_t) src[0]         | ((uint64_t) src[1] << 8)
        | ((uint64_t) src[2] << 16) | ((uint64_t) src[3] << 24)
@@ -71,63 +72,270 @@ static const uint64_t blake2b_iv[8] = {
     b = ROTR64(b ^ c, 63);                                                  \
   } while(0)                                                                \
 
-static void blake2b_compress(struct blake2b * s, unsigned char * data,
-                             unsigned int numbytes, int is_last_block)
+/* Compress [nblocks] consecutive blocks of [data], each containing
+   [numbytes] bytes of input.  Only a single block can be the last block. */
+
+static void blake2b_compress_generic(struct blake2b * s,
+                                     const unsigned char * data,
+                                     size_t nblocks, unsigned int numbytes,
+                                     int is_last_block)
 {
   uint64_t v0, v1, v2, v3, v4, v5, v6, v7, v8, v9, v10, v11, v12, v13, v14, v15;
   uint64_t m[16];
   int i;
   const uint8_t * sigma;
 
-  /* Update the length */
-  s->len[0] += numbytes;
-  if (s->len[0] < numbytes) s->len[1]++; /* carry */
-  /* Initialize work space */
-  v0 = s->h[0];  v1 = s->h[1];
-  v2 = s->h[2];  v3 = s->h[3];
-  v4 = s->h[4];  v5 = s->h[5];
-  v6 = s->h[6];  v7 = s->h[7];
-  v8 = blake2b_iv[0];  v9 = blake2b_iv[1];
-  v10 = blake2b_iv[2]; v11 = blake2b_iv[3];
-  v12 = blake2b_iv[4] ^ s->len[0];
-  v13 = blake2b_iv[5] ^ s->len[1];
-  v14 = is_last_block ? ~ blake2b_iv[6] : blake2b_iv[6];
-  v15 = blake2b_iv[7];
-  /* Convert data to 16 64-bit words */
-  for (i = 0; i < 16; i++) {
-    m[i] = U8TO64LE(data + i * 8);
-  }
-  /* Twelve rounds of mixing */
-  for (i = 0; i < 12; i++) {
-    sigma = BLAKE2_sigma[i];
-    MIX2B(v0, v4, v8,  v12, m[sigma[0]], m[sigma[1]]);
-    MIX2B(v1, v5, v9,  v13, m[sigma[2]], m[sigma[3]]);
-    MIX2B(v2, v6, v10, v14, m[sigma[4]], m[sigma[5]]);
-    MIX2B(v3, v7, v11, v15, m[sigma[6]], m[sigma[7]]);
-    MIX2B(v0, v5, v10, v15, m[sigma[8]],  m[sigma[9]]);
-    MIX2B(v1, v6, v11, v12, m[sigma[10]], m[sigma[11]]);
-    MIX2B(v2, v7, v8,  v13, m[sigma[12]], m[sigma[13]]);
-    MIX2B(v3, v4, v9,  v14, m[sigma[14]], m[sigma[15]]);
-  }
-  /* Update state  */
-  s->h[0] ^= v0 ^ v8;   s->h[1] ^= v1 ^ v9;
-  s->h[2] ^= v2 ^ v10;  s->h[3] ^= v3 ^ v11;
-  s->h[4] ^= v4 ^ v12;  s->h[5] ^= v5 ^ v13;
-  s->h[6] ^= v6 ^ v14;  s->h[7] ^= v7 ^ v15;
+  for (; nblocks > 0; nblocks--, data += BLAKE2b_BLOCKSIZE) {
+    /* Update the length */
+    s->len[0] += numbytes;
+    if (s->len[0] < numbytes) s->len[1]++; /* carry */
+    /* Initialize work space */
+    v0 = s->h[0];  v1 = s->h[1];
+    v2 = s->h[2];  v3 = s->h[3];
+    v4 = s->h[4];  v5 = s->h[5];
+    v6 = s->h[6];  v7 = s->h[7];
+    v8 = blake2b_iv[0];  v9 = blake2b_iv[1];
+    v10 = blake2b_iv[2]; v11 = blake2b_iv[3];
+    v12 = blake2b_iv[4] ^ s->len[0];
+    v13 = blake2b_iv[5] ^ s->len[1];
+    v14 = is_last_block ? ~ blake2b_iv[6] : blake2b_iv[6];
+    v15 = is_last_block && s->last_node ? ~ blake2b_iv[7] : blake2b_iv[7];
+    /* Convert data to 16 64-bit words */
+    for (i = 0; i < 16; i++) {
+      m[i] = U8TO64LE(data + i * 8);
+    }
+    /* Twelve rounds of mixing */
+    for (i = 0; i < 12; i++) {
+      sigma = BLAKE2_sigma[i];
+      MIX2B(v0, v4, v8,  v12, m[sigma[0]], m[sigma[1]]);
+      MIX2B(v1, v5, v9,  v13, m[sigma[2]], m[sigma[3]]);
+      MIX2B(v2, v6, v10, v14, m[sigma[4]], m[sigma[5]]);
+      MIX2B(v3, v7, v11, v15, m[sigma[6]], m[sigma[7]]);
+      MIX2B(v0, v5, v10, v15, m[sigma[8]],  m[sigma[9]]);
+      MIX2B(v1, v6, v11, v12, m[sigma[10]], m[sigma[11]]);
+      MIX2B(v2, v7, v8,  v13, m[sigma[12]], m[sigma[13]]);
+      MIX2B(v3, v4, v9,  v14, m[sigma[14]], m[sigma[15]]);
+    }
+    /* Update state  */
+    s->h[0] ^= v0 ^ v8;   s->h[1] ^= v1 ^ v9;
+    s->h[2] ^= v2 ^ v10;  s->h[3] ^= v3 ^ v11;
+    s->h[4] ^= v4 ^ v12;  s->h[5] ^= v5 ^ v13;
+    s->h[6] ^= v6 ^ v14;  s->h[7] ^= v7 ^ v15;
+  }
 }
 
+#ifdef HAVE_X86_DISPATCH
+
+#include <immintrin.h>
+
+/* SIMD implementations, following the SSE and AVX2 implementations of
+   BLAKE2 by Samuel Neves.  The state is held by rows, so that the four
+   column mixings run in parallel; the diagonal mixings are performed
+   by rotating rows 2, 3 and 4 so that diagonals become columns.
+   Rotations by multiples of 8 bits are byte shuffles. */
+
+/* AVX2: one 256-bit register per row */
+
+#define B2B_ROTR32(x) _mm256_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1))
+#define B2B_ROTR24(x) _mm256_shuffle_epi8(x, r24)
+#define B2B_ROTR16(x) _mm256_shuffle_epi8(x, r16)
+#define B2B_ROTR63(x) \
+  _mm256_or_si256(_mm256_srli_epi64(x, 63), _mm256_add_epi64(x, x))
+
+#define B2B_G(a, b, c, d, x, y) \
+  a = _mm256_add_epi64(_mm256_add_epi64(a, b), x); \
+  d = B2B_ROTR32(_mm256_xor_si256(d, a)); \
+  c = _mm256_add_epi64(c, d); \
+  b = B2B_ROTR24(_mm256_xor_si256(b, c)); \
+  a = _mm256_add_epi64(_mm256_add_epi64(a, b), y); \
+  d = B2B_ROTR16(_mm256_xor_si256(d, a)); \
+  c = _mm256_add_epi64(c, d); \
+  b = B2B_ROTR63(_mm256_xor_si256(b, c))
+
+__attribute__((target("avx2")))
+static void blake2b_compress_avx2(struct blake2b * s,
+                                  const unsigned char * data,
+                                  size_t nblocks, unsigned int numbytes,
+                                  int is_last_block)
+{
+  const __m256i r24 =
+    _mm256_setr_epi8(3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10,
+                     3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10);
+  const __m256i r16 =
+    _mm256_setr_epi8(2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9,
+                     2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9);
+  const __m256i iv0 = _mm256_loadu_si256((const __m256i *) &blake2b_iv[0]);
+  const __m256i iv1 = _mm256_loadu_si256((const __m256i *) &blake2b_iv[4]);
+  const uint64_t f0 = is_last_block ? ~ (uint64_t) 0 : 0;
+  const uint64_t f1 = is_last_block && s->last_node ? ~ (uint64_t) 0 : 0;
+  __m256i h0 = _mm256_loadu_si256((const __m256i *) &s->h[0]);
+  __m256i h1 = _mm256_loadu_si256((const __m256i *) &s->h[4]);
+  __m256i a, b, c, d;
+  uint64_t m[16];
+  const uint8_t * sigma;
+  int i;
+
+  for (; nblocks > 0; nblocks--, data += BLAKE2b_BLOCKSIZE) {
+    s->len[0] += numbytes;
+    if (s->len[0] < numbytes) s->len[1]++; /* carry */
+    memcpy(m, data, BLAKE2b_BLOCKSIZE);
+    a = h0;
+    b = h1;
+    c = iv0;
+    d = _mm256_xor_si256(iv1, _mm256_set_epi64x(f1, f0, s->len[1], s->len[0]));
+    for (i = 0; i < 12; i++) {
+      sigma = BLAKE2_sigma[i];
+      B2B_G(a, b, c, d,
+            _mm256_set_epi64x(m[sigma[6]], m[sigma[4]], m[sigma[2]], m[sigma[0]]),
+            _mm256_set_epi64x(m[sigma[7]], m[sigma[5]], m[sigma[3]], m[sigma[1]]));
+      b = _mm256_permute4x64_epi64(b, _MM_SHUFFLE(0, 3, 2, 1));
+      c = _mm256_permute4x64_epi64(c, _MM_SHUFFLE(1, 0, 3, 2));
+      d = _mm256_permute4x64_epi64(d, _MM_SHUFFLE(2, 1, 0, 3));
+      B2B_G(a, b, c, d,
+            _mm256_set_epi64x(m[sigma[14]], m[sigma[12]], m[sigma[10]], m[sigma[8]]),
+            _mm256_set_epi64x(m[sigma[15]], m[sigma[13]], m[sigma[11]], m[sigma[9]]));
+      b = _mm256_permute4x64_epi64(b, _MM_SHUFFLE(2, 1, 0, 3));
+      c = _mm256_permute4x64_epi64(c, _MM_SHUFFLE(1, 0, 3, 2));
+      d = _mm256_permute4x64_epi64(d, _MM_SHUFFLE(0, 3, 2, 1));
+    }
+    h0 = _mm256_xor_si256(h0, _mm256_xor_si256(a, c));
+    h1 = _mm256_xor_si256(h1, _mm256_xor_si256(b, d));
+  }
+  _mm256_storeu_si256((__m256i *) &s->h[0], h0);
+  _mm256_storeu_si256((__m256i *) &s->h[4], h1);
+}
+
+/* SSE4.1: each row is split in two 128-bit registers */
+
+#define B2B_ROTR32_128(x) _mm_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1))
+#define B2B_ROTR24_128(x) _mm_shuffle_epi8(x, r24)
+#define B2B_ROTR16_128(x) _mm_shuffle_epi8(x, r16)
+#define B2B_ROTR63_128(x) \
+  _mm_or_si128(_mm_srli_epi64(x, 63), _mm_add_epi64(x, x))
+
+#define B2B_G_128(a, b, c, d, x, y) \
+  a = _mm_add_epi64(_mm_add_epi64(a, b), x); \
+  d = B2B_ROTR32_128(_mm_xor_si128(d, a)); \
+  c = _mm_add_epi64(c, d); \
+  b = B2B_ROTR24_128(_mm_xor_si128(b, c)); \
+  a = _mm_add_epi64(_mm_add_epi64(a, b), y); \
+  d = B2B_ROTR16_128(_mm_xor_si128(d, a)); \
+  c = _mm_add_epi64(c, d); \
+  b = B2B_ROTR63_128(_mm_xor_si128(b, c))
+
+__attribute__((target("sse4.1")))
+static void blake2b_compress_sse41(struct blake2b * s,
+                                   const unsigned char * data,
+                                   size_t nblocks, unsigned int numbytes,
+                                   int is_last_block)
+{
+  const __m128i r24 =
+    _mm_setr_epi8(3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10);
+  const __m128i r16 =
+    _mm_setr_epi8(2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9);
+  const uint64_t f0 = is_last_block ? ~ (uint64_t) 0 : 0;
+  const uint64_t f1 = is_last_block && s->last_node ? ~ (uint64_t) 0 : 0;
+  __m128i h[4], al, ah, bl, bh, cl, ch, dl, dh, t0, t1;
+  uint64_t m[16];
+  const uint8_t * sigma;
+  int i;
+
+  for (i = 0; i < 4; i++) h[i] = _mm_loadu_si128((const __m128i *) &s->h[2 * i]);
+  for (; nblocks > 0; nblocks--, data += BLAKE2b_BLOCKSIZE) {
+    s->len[0] += numbytes;
+    if (s->len[0] < numbytes) s->len[1]++; /* carry */
+    memcpy(m, data, BLAKE2b_BLOCKSIZE);
+    al = h[0]; ah = h[1];
+    bl = h[2]; bh = h[3];
+    cl = _mm_loadu_si128((const __m128i *) &blake2b_iv[0]);
+    ch = _mm_loadu_si128((const __m128i *) &blake2b_iv[2]);
+    dl = _mm_xor_si128(_mm_loadu_si128((const __m128i *) &blake2b_iv[4]),
+                       _mm_set_epi64x(s->len[1], s->len[0]));
+    dh = _mm_xor_si128(_mm_loadu_si128((const __m128i *) &blake2b_iv[6]),
+                       _mm_set_epi64x(f1, f0));
+    for (i = 0; i < 12; i++) {
+      sigma = BLAKE2_sigma[i];
+      B2B_G_128(al, bl, cl, dl,
+                _mm_set_epi64x(m[sigma[2]], m[sigma[0]]),
+                _mm_set_epi64x(m[sigma[3]], m[sigma[1]]));
+      B2B_G_128(ah, bh, ch, dh,
+                _mm_set_epi64x(m[sigma[6]], m[sigma[4]]),
+                _mm_set_epi64x(m[sigma[7]], m[sigma[5]]));
+      /* Diagonalize: rows 2, 3, 4 rotated left by 1, 2, 3 words */
+      t0 = _mm_alignr_epi8(bh, bl, 8);
+      t1 = _mm_alignr_epi8(bl, bh, 8);
+      bl = t0; bh = t1;
+      t0 = cl; cl = ch; ch = t0;
+      t0 = _mm_alignr_epi8(dl, dh, 8);
+      t1 = _mm_alignr_epi8(dh, dl, 8);
+      dl = t0; dh = t1;
+      B2B_G_128(al, bl, cl, dl,
+                _mm_set_epi64x(m[sigma[10]], m[sigma[8]]),
+                _mm_set_epi64x(m[sigma[11]], m[sigma[9]]));
+      B2B_G_128(ah, bh, ch, dh,
+                _mm_set_epi64x(m[sigma[14]], m[sigma[12]]),
+                _mm_set_epi64x(m[sigma[15]], m[sigma[13]]));
+      /* Undiagonalize */
+      t0 = _mm_alignr_epi8(bl, bh, 8);
+      t1 = _mm_alignr_epi8(bh, bl, 8);
+      bl = t0; bh = t1;
+      t0 = cl; cl = ch; ch = t0;
+      t0 = _mm_alignr_epi8(dh, dl, 8);
+      t1 = _mm_alignr_epi8(dl, dh, 8);
+      dl = t0; dh = t1;
+    }
+    h[0] = _mm_xor_si128(h[0], _mm_xor_si128(al, cl));
+    h[1] = _mm_xor_si128(h[1], _mm_xor_si128(ah, ch));
+    h[2] = _mm_xor_si128(h[2], _mm_xor_si128(bl, dl));
+    h[3] = _mm_xor_si128(h[3], _mm_xor_si128(bh, dh));
+  }
+  for (i = 0; i < 4; i++) _mm_storeu_si128((__m128i *) &s->h[2 * i], h[i]);
+}
+
+#endif
+
+static void blake2b_compress(struct blake2b * s,
+                             const unsigned char * data,
+                             size_t nblocks, unsigned int numbytes,
+                             int is_last_block)
+{
+#ifdef HAVE_X86_DISPATCH
+  int features = cpu_features();
+  if (features & CPU_AVX2) {
+    blake2b_compress_avx2(s, data, nblocks, numbytes, is_last_block); return;
+  }
+  if (features & CPU_SSE41) {
+    blake2b_compress_sse41(s, data, nblocks, numbytes, is_last_block); return;
+  }
+#endif
+  blake2b_compress_generic(s, data, nblocks, numbytes, is_last_block);
+}
 EXPORT void blake2b_init(struct blake2b * s,
-                  int hashlen, int keylen, unsigned char * key)
+                  int hashlen, int keylen, unsigned char * key,
+                  const struct blake2_tree * t)
 {
   int i;
   assert (0 < hashlen && hashlen <= 64);
   assert (0 <= keylen && keylen <= 64);
   for (i = 0; i < 8; i++) s->h[i] = blake2b_iv[i];
-  s->h[0] ^= 0x01010000 | (keylen << 8) | hashlen;
+  /* XOR the parameter block: digest length, key length, fanout, depth,
+     leaf length, node offset, node depth, inner length */
+  if (t == NULL) {
+    s->h[0] ^= 0x01010000 | (keylen << 8) | hashlen;
+    s->last_node = 0;
+  } else {
+    s->h[0] ^= (uint64_t) hashlen | ((uint64_t) keylen << 8)
+               | ((uint64_t) t->fanout << 16) | ((uint64_t) t->depth << 24)
+               | ((uint64_t) t->leaf_length << 32);
+    s->h[1] ^= t->node_offset;
+    s->h[2] ^= (uint64_t) t->node_depth | ((uint64_t) t->inner_length << 8);
+    s->last_node = t->last_node;
+  }
   s->len[0] = s->len[1] = 0;
   s->numbytes = 0;
-  /* If key was supplied, pad to 128 bytes and prepend to message */
-  if (keylen > 0) {
+  /* If key was supplied, pad to 128 bytes and prepend to message.
+     The roots of BLAKE2bp record the key length but are not keyed. */
+  if (keylen > 0 && key != NULL) {
     memset(s->buffer, 0, BLAKE2b_BLOCKSIZE);
     memcpy(s->buffer, key, keylen);
     s->numbytes = BLAKE2b_BLOCKSIZE;
@@ -138,6 +346,7 @@ EXPORT void blake2b_add_data(struct blake2b * s,
                       unsigned char * data, size_t len)
 {
   int n;
+  size_t nblocks;
   /* If data was left in buffer, pad it with fresh data and compress */
   if (s->numbytes > 0) {
     n = BLAKE2b_BLOCKSIZE - s->numbytes;
@@ -148,13 +357,15 @@ EXPORT void blake2b_add_data(struct blake2b * s,
       return;
     }
     memcpy(s->buffer + s->numbytes, data, n);
-    blake2b_compress(s, s->buffer, BLAKE2b_BLOCKSIZE, 0);
+    blake2b_compress(s, s->buffer, 1, BLAKE2b_BLOCKSIZE, 0);
     data += n; len -= n;
   }
-  /* Process data by blocks of BLAKE2b_BLOCKSIZE */
-  while (len > BLAKE2b_BLOCKSIZE) {
-    blake2b_compress(s, data, BLAKE2b_BLOCKSIZE, 0);
-    data += BLAKE2b_BLOCKSIZE; len -= BLAKE2b_BLOCKSIZE;
+  /* Process data by blocks of BLAKE2b_BLOCKSIZE, read directly from [data].
+     The last block is kept in the buffer, since it may be the final block. */
+  if (len > BLAKE2b_BLOCKSIZE) {
+    nblocks = (len - 1) / BLAKE2b_BLOCKSIZE;
+    blake2b_compress(s, data, nblocks, BLAKE2b_BLOCKSIZE, 0);
+    data += nblocks * BLAKE2b_BLOCKSIZE; len -= nblocks * BLAKE2b_BLOCKSIZE;
   }
   /* Save remaining data */
   memcpy(s->buffer, data, len);
@@ -167,7 +378,7 @@ EXPORT void blake2b_final(struct blake2b * s, int hashlen, unsigned char * hash)
   assert (0 < hashlen && hashlen <= 64);
   /* The final block is composed of the remaining data padded with zeros. */
   memset(s->buffer + s->numbytes, 0, BLAKE2b_BLOCKSIZE - s->numbytes);
-  blake2b_compress(s, s->buffer, s->numbytes, 1);
+  blake2b_compress(s, s->buffer, 1, s->numbytes, 1);
   /* Extract the hash */
   for (i = 0; i < hashlen; i++) {
     hash[i] = s->h[i / 8] >> (8 * (i % 8));
@@ -176,7 +387,7 @@ EXPORT void blake2b_final(struct blake2b * s, int hashlen, unsigned char * hash)
 
 /* BLAKE2s */
 
-static inline uint32_t U8TO32LE(unsigned char * src)
+static inline uint32_t U8TO32LE(const unsigned char * src)
 {
   return (uint32_t) src[0]         | ((uint32_t) src[1] << 8)
        | ((uint32_t) src[2] << 16) | ((uint32_t) src[3] << 24);
@@ -210,63 +421,170 @@ static const uint32_t blake2s_iv[8] = {
     b = ROTR32(b ^ c,  7);                                                  \
   } while(0)                                                                \
 
-static void blake2s_compress(struct blake2s * s, unsigned char * data,
-                             unsigned int numbytes, int is_last_block)
+/* Compress [nblocks] consecutive blocks of [data], each containing
+   [numbytes] bytes of input.  Only a single block can be the last block. */
+
+static void blake2s_compress_generic(struct blake2s * s,
+                                     const unsigned char * data,
+                                     size_t nblocks, unsigned int numbytes,
+                                     int is_last_block)
 {
   uint32_t v0, v1, v2, v3, v4, v5, v6, v7, v8, v9, v10, v11, v12, v13, v14, v15;
   uint32_t m[16];
   int i;
   const uint8_t * sigma;
 
-  /* Update the length */
-  s->len[0] += numbytes;
-  if (s->len[0] < numbytes) s->len[1]++; /* carry */
-  /* Initialize work space */
-  v0 = s->h[0];  v1 = s->h[1];
-  v2 = s->h[2];  v3 = s->h[3];
-  v4 = s->h[4];  v5 = s->h[5];
-  v6 = s->h[6];  v7 = s->h[7];
-  v8 = blake2s_iv[0];  v9 = blake2s_iv[1];
-  v10 = blake2s_iv[2]; v11 = blake2s_iv[3];
-  v12 = blake2s_iv[4] ^ s->len[0];
-  v13 = blake2s_iv[5] ^ s->len[1];
-  v14 = is_last_block ? ~ blake2s_iv[6] : blake2s_iv[6];
-  v15 = blake2s_iv[7];
-  /* Convert data to 16 32-bit words */
-  for (i = 0; i < 16; i++) {
-    m[i] = U8TO32LE(data + i * 4);
-  }
-  /* Ten rounds of mixing */
-  for (i = 0; i < 10; i++) {
-    sigma = BLAKE2_sigma[i];
-    MIX2S(v0, v4, v8,  v12, m[sigma[0]], m[sigma[1]]);
-    MIX2S(v1, v5, v9,  v13, m[sigma[2]], m[sigma[3]]);
-    MIX2S(v2, v6, v10, v14, m[sigma[4]], m[sigma[5]]);
-    MIX2S(v3, v7, v11, v15, m[sigma[6]], m[sigma[7]]);
-    MIX2S(v0, v5, v10, v15, m[sigma[8]],  m[sigma[9]]);
-    MIX2S(v1, v6, v11, v12, m[sigma[10]], m[sigma[11]]);
-    MIX2S(v2, v7, v8,  v13, m[sigma[12]], m[sigma[13]]);
-    MIX2S(v3, v4, v9,  v14, m[sigma[14]], m[sigma[15]]);
-  }
-  /* Update state  */
-  s->h[0] ^= v0 ^ v8;   s->h[1] ^= v1 ^ v9;
-  s->h[2] ^= v2 ^ v10;  s->h[3] ^= v3 ^ v11;
-  s->h[4] ^= v4 ^ v12;  s->h[5] ^= v5 ^ v13;
-  s->h[6] ^= v6 ^ v14;  s->h[7] ^= v7 ^ v15;
+  for (; nblocks > 0; nblocks--, data += BLAKE2s_BLOCKSIZE) {
+    /* Update the length */
+    s->len[0] += numbytes;
+    if (s->len[0] < numbytes) s->len[1]++; /* carry */
+    /* Initialize work space */
+    v0 = s->h[0];  v1 = s->h[1];
+    v2 = s->h[2];  v3 = s->h[3];
+    v4 = s->h[4];  v5 = s->h[5];
+    v6 = s->h[6];  v7 = s->h[7];
+    v8 = blake2s_iv[0];  v9 = blake2s_iv[1];
+    v10 = blake2s_iv[2]; v11 = blake2s_iv[3];
+    v12 = blake2s_iv[4] ^ s->len[0];
+    v13 = blake2s_iv[5] ^ s->len[1];
+    v14 = is_last_block ? ~ blake2s_iv[6] : blake2s_iv[6];
+    v15 = is_last_block && s->last_node ? ~ blake2s_iv[7] : blake2s_iv[7];
+    /* Convert data to 16 32-bit words */
+    for (i = 0; i < 16; i++) {
+      m[i] = U8TO32LE(data + i * 4);
+    }
+    /* Ten rounds of mixing */
+    for (i = 0; i < 10; i++) {
+      sigma = BLAKE2_sigma[i];
+      MIX2S(v0, v4, v8,  v12, m[sigma[0]], m[sigma[1]]);
+      MIX2S(v1, v5, v9,  v13, m[sigma[2]], m[sigma[3]]);
+      MIX2S(v2, v6, v10, v14, m[sigma[4]], m[sigma[5]]);
+      MIX2S(v3, v7, v11, v15, m[sigma[6]], m[sigma[7]]);
+      MIX2S(v0, v5, v10, v15, m[sigma[8]],  m[sigma[9]]);
+      MIX2S(v1, v6, v11, v12, m[sigma[10]], m[sigma[11]]);
+      MIX2S(v2, v7, v8,  v13, m[sigma[12]], m[sigma[13]]);
+      MIX2S(v3, v4, v9,  v14, m[sigma[14]], m[sigma[15]]);
+    }
+    /* Update state  */
+    s->h[0] ^= v0 ^ v8;   s->h[1] ^= v1 ^ v9;
+    s->h[2] ^= v2 ^ v10;  s->h[3] ^= v3 ^ v11;
+    s->h[4] ^= v4 ^ v12;  s->h[5] ^= v5 ^ v13;
+    s->h[6] ^= v6 ^ v14;  s->h[7] ^= v7 ^ v15;
+  }
+}
+
+#ifdef HAVE_X86_DISPATCH
+
+/* SSE4.1: one 128-bit register per row */
+
+#define B2S_ROTR16(x) _mm_shuffle_epi8(x, r16)
+#define B2S_ROTR12(x) _mm_or_si128(_mm_srli_epi32(x, 12), _mm_slli_epi32(x, 20))
+#define B2S_ROTR8(x) _mm_shuffle_epi8(x, r8)
+#define B2S_ROTR7(x) _mm_or_si128(_mm_srli_epi32(x, 7), _mm_slli_epi32(x, 25))
+
+#define B2S_G(a, b, c, d, x, y) \
+  a = _mm_add_epi32(_mm_add_epi32(a, b), x); \
+  d = B2S_ROTR16(_mm_xor_si128(d, a)); \
+  c = _mm_add_epi32(c, d); \
+  b = B2S_ROTR12(_mm_xor_si128(b, c)); \
+  a = _mm_add_epi32(_mm_add_epi32(a, b), y); \
+  d = B2S_ROTR8(_mm_xor_si128(d, a)); \
+  c = _mm_add_epi32(c, d); \
+  b = B2S_ROTR7(_mm_xor_si128(b, c))
+
+__attribute__((target("sse4.1")))
+static void blake2s_compress_sse41(struct blake2s * s,
+                                   const unsigned char * data,
+                                   size_t nblocks, unsigned int numbytes,
+                                   int is_last_block)
+{
+  const __m128i r16 =
+    _mm_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+  const __m128i r8 =
+    _mm_setr_epi8(1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12);
+  const __m128i iv0 = _mm_loadu_si128((const __m128i *) &blake2s_iv[0]);
+  const __m128i iv1 = _mm_loadu_si128((const __m128i *) &blake2s_iv[4]);
+  const uint32_t f0 = is_last_block ? ~ (uint32_t) 0 : 0;
+  const uint32_t f1 = is_last_block && s->last_node ? ~ (uint32_t) 0 : 0;
+  __m128i h0 = _mm_loadu_si128((const __m128i *) &s->h[0]);
+  __m128i h1 = _mm_loadu_si128((const __m128i *) &s->h[4]);
+  __m128i a, b, c, d;
+  uint32_t m[16];
+  const uint8_t * sigma;
+  int i;
+
+  for (; nblocks > 0; nblocks--, data += BLAKE2s_BLOCKSIZE) {
+    s->len[0] += numbytes;
+    if (s->len[0] < numbytes) s->len[1]++; /* carry */
+    memcpy(m, data, BLAKE2s_BLOCKSIZE);
+    a = h0;
+    b = h1;
+    c = iv0;
+    d = _mm_xor_si128(iv1, _mm_set_epi32(f1, f0, s->len[1], s->len[0]));
+    for (i = 0; i < 10; i++) {
+      sigma = BLAKE2_sigma[i];
+      B2S_G(a, b, c, d,
+            _mm_set_epi32(m[sigma[6]], m[sigma[4]], m[sigma[2]], m[sigma[0]]),
+            _mm_set_epi32(m[sigma[7]], m[sigma[5]], m[sigma[3]], m[sigma[1]]));
+      b = _mm_shuffle_epi32(b, _MM_SHUFFLE(0, 3, 2, 1));
+      c = _mm_shuffle_epi32(c, _MM_SHUFFLE(1, 0, 3, 2));
+      d = _mm_shuffle_epi32(d, _MM_SHUFFLE(2, 1, 0, 3));
+      B2S_G(a, b, c, d,
+            _mm_set_epi32(m[sigma[14]], m[sigma[12]], m[sigma[10]], m[sigma[8]]),
+            _mm_set_epi32(m[sigma[15]], m[sigma[13]], m[sigma[11]], m[sigma[9]]));
+      b = _mm_shuffle_epi32(b, _MM_SHUFFLE(2, 1, 0, 3));
+      c = _mm_shuffle_epi32(c, _MM_SHUFFLE(1, 0, 3, 2));
+      d = _mm_shuffle_epi32(d, _MM_SHUFFLE(0, 3, 2, 1));
+    }
+    h0 = _mm_xor_si128(h0, _mm_xor_si128(a, c));
+    h1 = _mm_xor_si128(h1, _mm_xor_si128(b, d));
+  }
+  _mm_storeu_si128((__m128i *) &s->h[0], h0);
+  _mm_storeu_si128((__m128i *) &s->h[4], h1);
 }
 
+#endif
+
+static void blake2s_compress(struct blake2s * s,
+                             const unsigned char * data,
+                             size_t nblocks, unsigned int numbytes,
+                             int is_last_block)
+{
+#ifdef HAVE_X86_DISPATCH
+  if (cpu_features() & CPU_SSE41) {
+    blake2s_compress_sse41(s, data, nblocks, numbytes, is_last_block); return;
+  }
+#endif
+  blake2s_compress_generic(s, data, nblocks, numbytes, is_last_block);
+}
 EXPORT void blake2s_init(struct blake2s * s,
-                  int hashlen, int keylen, unsigned char * key)
+                  int hashlen, int keylen, unsigned char * key,
+                  const struct blake2_tree * t)
 {
   int i;
   assert (0 < hashlen && hashlen <= 32);
   assert (0 <= keylen && keylen <= 32);
   for (i = 0; i < 8; i++) s->h[i] = blake2s_iv[i];
-  s->h[0] ^= 0x01010000 | (keylen << 8) | hashlen;
+  /* XOR the parameter block: digest length, key length, fanout, depth,
+     leaf length, node offset (48 bits), node depth, inner length */
+  if (t == NULL) {
+    s->h[0] ^= 0x01010000 | (keylen << 8) | hashlen;
+    s->last_node = 0;
+  } else {
+    s->h[0] ^= (uint32_t) hashlen | ((uint32_t) keylen << 8)
+               | ((uint32_t) t->fanout << 16) | ((uint32_t) t->depth << 24);
+    s->h[1] ^= t->leaf_length;
+    s->h[2] ^= (uint32_t) t->node_offset;
+    s->h[3] ^= (uint32_t) ((t->node_offset >> 32) & 0xFFFF)
+               | ((uint32_t) t->node_depth << 16)
+               | ((uint32_t) t->inner_length << 24);
+    s->last_node = t->last_node;
+  }
   s->len[0] = s->len[1] = 0;
   s->numbytes = 0;
-  /* If key was supplied, pad to 64 bytes and prepend to message */
-  if (keylen > 0) {
+  /* If key was supplied, pad to 64 bytes and prepend to message.
+     The roots of BLAKE2sp record the key length but are not keyed. */
+  if (keylen > 0 && key != NULL) {
     memset(s->buffer, 0, BLAKE2s_BLOCKSIZE);
     memcpy(s->buffer, key, keylen);
     s->numbytes = BLAKE2s_BLOCKSIZE;
@@ -277,6 +595,7 @@ EXPORT void blake2s_add_data(struct blake2s * s,
                       unsigned char * data, size_t len)
 {
   int n;
+  size_t nblocks;
   /* If data was left in buffer, pad it with fresh data and compress */
   if (s->numbytes > 0) {
     n = BLAKE2s_BLOCKSIZE - s->numbytes;
@@ -287,13 +606,15 @@ EXPORT void blake2s_add_data(struct blake2s * s,
       return;
     }
     memcpy(s->buffer + s->numbytes, data, n);
-    blake2s_compress(s, s->buffer, BLAKE2s_BLOCKSIZE, 0);
+    blake2s_compress(s, s->buffer, 1, BLAKE2s_BLOCKSIZE, 0);
     data += n; len -= n;
   }
-  /* Process data by blocks of BLAKE2s_BLOCKSIZE */
-  while (len > BLAKE2s_BLOCKSIZE) {
-    blake2s_compress(s, data, BLAKE2s_BLOCKSIZE, 0);
-    data += BLAKE2s_BLOCKSIZE; len -= BLAKE2s_BLOCKSIZE;
+  /* Process data by blocks of BLAKE2s_BLOCKSIZE, read directly from [data].
+     The last block is kept in the buffer, since it may be the final block. */
+  if (len > BLAKE2s_BLOCKSIZE) {
+    nblocks = (len - 1) / BLAKE2s_BLOCKSIZE;
+    blake2s_compress(s, data, nblocks, BLAKE2s_BLOCKSIZE, 0);
+    data += nblocks * BLAKE2s_BLOCKSIZE; len -= nblocks * BLAKE2s_BLOCKSIZE;
   }
   /* Save remaining data */
   memcpy(s->buffer, data, len);
@@ -306,9 +627,424 @@ EXPORT void blake2s_final(struct blake2s * s, int hashlen, unsigned char * hash)
   assert (0 < hashlen && hashlen <= 32);
   /* The final block is composed of the remaining data padded with zeros. */
   memset(s->buffer + s->numbytes, 0, BLAKE2s_BLOCKSIZE - s->numbytes);
-  blake2s_compress(s, s->buffer, s->numbytes, 1);
+  blake2s_compress(s, s->buffer, 1, s->numbytes, 1);
   /* Extract the hash */
   for (i = 0; i < hashlen; i++) {
     hash[i] = s->h[i / 4] >> (8 * (i % 4));
   }
 }
+
+/* BLAKE2bp and BLAKE2sp */
+
+#ifdef HAVE_X86_DISPATCH
+
+/* AVX2: the leaves are hashed in parallel, one leaf per lane.
+   Block [i] of a stripe goes to leaf [i]. */
+
+__attribute__((target("avx2")))
+static void blake2bp_stripes_avx2(struct blake2b leaf[BLAKE2bp_LEAVES],
+                                  const unsigned char * data,
+                                  size_t nstripes)
+{
+  const __m256i r24 =
+    _mm256_setr_epi8(3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10,
+                     3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10);
+  const __m256i r16 =
+    _mm256_setr_epi8(2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9,
+                     2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9);
+  __m256i h[8], v[16], m[16];
+  uint64_t t[16][BLAKE2bp_LEAVES];
+  const uint8_t * sigma;
+  int i, l;
+
+  for (i = 0; i < 8; i++)
+    for (l = 0; l < BLAKE2bp_LEAVES; l++) t[i][l] = leaf[l].h[i];
+  memcpy(h, t, sizeof(h));
+  for (; nstripes > 0; nstripes--, data += BLAKE2bp_STRIPE) {
+    for (l = 0; l < BLAKE2bp_LEAVES; l++) {
+      leaf[l].len[0] += BLAKE2b_BLOCKSIZE;
+      if (leaf[l].len[0] < BLAKE2b_BLOCKSIZE) leaf[l].len[1]++; /* carry */
+    }
+    /* Transpose the blocks so that [m[i]] contains word [i] of all leaves */
+    for (l = 0; l < BLAKE2bp_LEAVES; l++)
+      for (i = 0; i < 16; i++)
+        t[i][l] = U8TO64LE(data + l * BLAKE2b_BLOCKSIZE + 8 * i);
+    memcpy(m, t, sizeof(m));
+    for (i = 0; i < 8; i++) v[i] = h[i];
+    for (i = 0; i < 4; i++) v[8 + i] = _mm256_set1_epi64x(blake2b_iv[i]);
+    v[12] = _mm256_xor_si256(_mm256_set1_epi64x(blake2b_iv[4]),
+                             _mm256_set_epi64x(leaf[3].len[0], leaf[2].len[0],
+                                               leaf[1].len[0], leaf[0].len[0]));
+    v[13] = _mm256_xor_si256(_mm256_set1_epi64x(blake2b_iv[5]),
+                             _mm256_set_epi64x(leaf[3].len[1], leaf[2].len[1],
+                                               leaf[1].len[1], leaf[0].len[1]));
+    v[14] = _mm256_set1_epi64x(blake2b_iv[6]);
+    v[15] = _mm256_set1_epi64x(blake2b_iv[7]);
+    for (i = 0; i < 12; i++) {
+      sigma = BLAKE2_sigma[i];
+      B2B_G(v[0], v[4], v[8],  v[12], m[sigma[0]], m[sigma[1]]);
+      B2B_G(v[1], v[5], v[9],  v[13], m[sigma[2]], m[sigma[3]]);
+      B2B_G(v[2], v[6], v[10], v[14], m[sigma[4]], m[sigma[5]]);
+      B2B_G(v[3], v[7], v[11], v[15], m[sigma[6]], m[sigma[7]]);
+      B2B_G(v[0], v[5], v[10], v[15], m[sigma[8]],  m[sigma[9]]);
+      B2B_G(v[1], v[6], v[11], v[12], m[sigma[10]], m[sigma[11]]);
+      B2B_G(v[2], v[7], v[8],  v[13], m[sigma[12]], m[sigma[13]]);
+      B2B_G(v[3], v[4], v[9],  v[14], m[sigma[14]], m[sigma[15]]);
+    }
+    for (i = 0; i < 8; i++)
+      h[i] = _mm256_xor_si256(h[i], _mm256_xor_si256(v[i], v[i + 8]));
+  }
+  memcpy(t, h, sizeof(h));
+  for (i = 0; i < 8; i++)
+    for (l = 0; l < BLAKE2bp_LEAVES; l++) leaf[l].h[i] = t[i][l];
+}
+
+#define B2S_ROTR16_256(x) _mm256_shuffle_epi8(x, r16)
+#define B2S_ROTR12_256(x) \
+  _mm256_or_si256(_mm256_srli_epi32(x, 12), _mm256_slli_epi32(x, 20))
+#define B2S_ROTR8_256(x) _mm256_shuffle_epi8(x, r8)
+#define B2S_ROTR7_256(x) \
+  _mm256_or_si256(_mm256_srli_epi32(x, 7), _mm256_slli_epi32(x, 25))
+
+#define B2S_G_256(a, b, c, d, x, y) \
+  a = _mm256_add_epi32(_mm256_add_epi32(a, b), x); \
+  d = B2S_ROTR16_256(_mm256_xor_si256(d, a)); \
+  c = _mm256_add_epi32(c, d); \
+  b = B2S_ROTR12_256(_mm256_xor_si256(b, c)); \
+  a = _mm256_add_epi32(_mm256_add_epi32(a, b), y); \
+  d = B2S_ROTR8_256(_mm256_xor_si256(d, a)); \
+  c = _mm256_add_epi32(c, d); \
+  b = B2S_ROTR7_256(_mm256_xor_si256(b, c))
+
+__attribute__((target("avx2")))
+static void blake2sp_stripes_avx2(struct blake2s leaf[BLAKE2sp_LEAVES],
+                                  const unsigned char * data,
+                                  size_t nstripes, int is_last_block)
+{
+  const __m256i r16 =
+    _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+                     2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+  const __m256i r8 =
+    _mm256_setr_epi8(1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12,
+                     1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12);
+  __m256i h[8], v[16], m[16];
+  uint32_t t[16][BLAKE2sp_LEAVES];
+  const uint8_t * sigma;
+  int i, l;
+
+  for (i = 0; i < 8; i++)
+    for (l = 0; l < BLAKE2sp_LEAVES; l++) t[i][l] = leaf[l].h[i];
+  memcpy(h, t, sizeof(h));
+  for (; nstripes > 0; nstripes--, data += BLAKE2sp_STRIPE) {
+    for (l = 0; l < BLAKE2sp_LEAVES; l++) {
+      leaf[l].len[0] += BLAKE2s_BLOCKSIZE;
+      if (leaf[l].len[0] < BLAKE2s_BLOCKSIZE) leaf[l].len[1]++; /* carry */
+      t[12][l] = leaf[l].len[0];
+      t[13][l] = leaf[l].len[1];
+    }
+    memcpy(&v[12], t[12], sizeof(__m256i));
+    memcpy(&v[13], t[13], sizeof(__m256i));
+    /* Transpose the blocks so that [m[i]] contains word [i] of all leaves */
+    for (l = 0; l < BLAKE2sp_LEAVES; l++)
+      for (i = 0; i < 16; i++)
+        t[i][l] = U8TO32LE(data + l * BLAKE2s_BLOCKSIZE + 4 * i);
+    memcpy(m, t, sizeof(m));
+    for (i = 0; i < 8; i++) v[i] = h[i];
+    for (i = 0; i < 4; i++) v[8 + i] = _mm256_set1_epi32(blake2s_iv[i]);
+    v[12] = _mm256_xor_si256(v[12], _mm256_set1_epi32(blake2s_iv[4]));
+    v[13] = _mm256_xor_si256(v[13], _mm256_set1_epi32(blake2s_iv[5]));
+    v[14] = _mm256_set1_epi32(is_last_block ? ~ blake2s_iv[6] : blake2s_iv[6]);
+    v[15] = _mm256_set1_epi32(blake2s_iv[7]);
+    for (i = 0; i < 10; i++) {
+      sigma = BLAKE2_sigma[i];
+      B2S_G_256(v[0], v[4], v[8],  v[12], m[sigma[0]], m[sigma[1]]);
+      B2S_G_256(v[1], v[5], v[9],  v[13], m[sigma[2]], m[sigma[3]]);
+      B2S_G_256(v[2], v[6], v[10], v[14], m[sigma[4]], m[sigma[5]]);
+      B2S_G_256(v[3], v[7], v[11], v[15], m[sigma[6]], m[sigma[7]]);
+      B2S_G_256(v[0], v[5], v[10], v[15], m[sigma[8]],  m[sigma[9]]);
+      B2S_G_256(v[1], v[6], v[11], v[12], m[sigma[10]], m[sigma[11]]);
+      B2S_G_256(v[2], v[7], v[8],  v[13], m[sigma[12]], m[sigma[13]]);
+      B2S_G_256(v[3], v[4], v[9],  v[14], m[sigma[14]], m[sigma[15]]);
+    }
+    for (i = 0; i < 8; i++)
+      h[i] = _mm256_xor_si256(h[i], _mm256_xor_si256(v[i], v[i + 8]));
+  }
+  memcpy(t, h, sizeof(h));
+  for (i = 0; i < 8; i++)
+    for (l = 0; l < BLAKE2sp_LEAVES; l++) leaf[l].h[i] = t[i][l];
+}
+
+#endif
+
+/* Process [nstripes] stripes that contain no final block of a leaf */
+
+static void blake2bp_stripes(struct blake2bp * s,
+                             const unsigned char * data, size_t nstripes)
+{
+  int l;
+  /* The key blocks, if any, are not the final blocks of the leaves */
+  for (l = 0; l < BLAKE2bp_LEAVES; l++) {
+    if (s->leaf[l].numbytes > 0) {
+      blake2b_compress(&s->leaf[l], s->leaf[l].buffer, 1, BLAKE2b_BLOCKSIZE, 0);
+      s->leaf[l].numbytes = 0;
+    }
+  }
+#ifdef HAVE_X86_DISPATCH
+  if (cpu_features() & CPU_AVX2) {
+    blake2bp_stripes_avx2(s->leaf, data, nstripes); return;
+  }
+#endif
+  for (; nstripes > 0; nstripes--, data += BLAKE2bp_STRIPE)
+    for (l = 0; l < BLAKE2bp_LEAVES; l++)
+      blake2b_compress(&s->leaf[l], data + l * BLAKE2b_BLOCKSIZE,
+                       1, BLAKE2b_BLOCKSIZE, 0);
+}
+
+EXPORT void blake2bp_init(struct blake2bp * s,
+                          int hashlen, int keylen, unsigned char * key)
+{
+  struct blake2_tree t = { BLAKE2bp_LEAVES, 2, 0, 0, 0, 64, 0 };
+  int l;
+  for (l = 0; l < BLAKE2bp_LEAVES; l++) {
+    t.node_offset = l;
+    t.last_node = (l == BLAKE2bp_LEAVES - 1);
+    blake2b_init(&s->leaf[l], hashlen, keylen, key, &t);
+  }
+  s->keylen = keylen;
+  s->numbytes = 0;
+}
+
+/* A stripe can be processed once the input extends past the first block
+   of the next stripe for every leaf, that is, past the last block of
+   the next stripe. */
+
+EXPORT void blake2bp_add_data(struct blake2bp * s,
+                              unsigned char * data, size_t len)
+{
+  const size_t limit = 2 * BLAKE2bp_STRIPE - BLAKE2b_BLOCKSIZE;
+  size_t n;
+
+  while (1) {
+    if (s->numbytes >= BLAKE2bp_STRIPE && s->numbytes + len > limit) {
+      blake2bp_stripes(s, s->buffer, 1);
+      s->numbytes -= BLAKE2bp_STRIPE;
+      memmove(s->buffer, s->buffer + BLAKE2bp_STRIPE, s->numbytes);
+      continue;
+    }
+    if (len == 0) return;
+    /* Process stripes directly from [data] */
+    if (s->numbytes == 0 && len > limit) {
+      n = (len - limit + BLAKE2bp_STRIPE - 1) / BLAKE2bp_STRIPE;
+      blake2bp_stripes(s, data, n);
+      data += n * BLAKE2bp_STRIPE; len -= n * BLAKE2bp_STRIPE;
+    }
+    n = sizeof(s->buffer) - s->numbytes;
+    if (n > len) n = len;
+    memcpy(s->buffer + s->numbytes, data, n);
+    s->numbytes += n;
+    data += n; len -= n;
+  }
+}
+
+EXPORT void blake2bp_final(struct blake2bp * s,
+                           int hashlen, unsigned char * hash)
+{
+  struct blake2_tree t = { BLAKE2bp_LEAVES, 2, 0, 0, 1, 64, 1 };
+  unsigned char leaves[BLAKE2bp_LEAVES * 64];
+  struct blake2b root;
+  int l, p, n;
+
+  for (l = 0; l < BLAKE2bp_LEAVES; l++) {
+    for (p = l * BLAKE2b_BLOCKSIZE; p < s->numbytes; p += BLAKE2bp_STRIPE) {
+      n = s->numbytes - p;
+      if (n > BLAKE2b_BLOCKSIZE) n = BLAKE2b_BLOCKSIZE;
+      blake2b_add_data(&s->leaf[l], s->buffer + p, n);
+    }
+    blake2b_final(&s->leaf[l], 64, leaves + 64 * l);
+  }
+  blake2b_init(&root, hashlen, s->keylen, NULL, &t);
+  blake2b_add_data(&root, leaves, sizeof(leaves));
+  blake2b_final(&root, hashlen, hash);
+  memset(leaves, 0, sizeof(leaves));
+}
+
+static void blake2sp_stripes(struct blake2sp * s,
+                             const unsigned char * data, size_t nstripes)
+{
+  int l;
+  /* The key blocks, if any, are not the final blocks of the leaves */
+  for (l = 0; l < BLAKE2sp_LEAVES; l++) {
+    if (s->leaf[l].numbytes > 0) {
+      blake2s_compress(&s->leaf[l], s->leaf[l].buffer, 1, BLAKE2s_BLOCKSIZE, 0);
+      s->leaf[l].numbytes = 0;
+    }
+  }
+#ifdef HAVE_X86_DISPATCH
+  if (cpu_features() & CPU_AVX2) {
+    blake2sp_stripes_avx2(s->leaf, data, nstripes, 0); return;
+  }
+#endif
+  for (; nstripes > 0; nstripes--, data += BLAKE2sp_STRIPE)
+    for (l = 0; l < BLAKE2sp_LEAVES; l++)
+      blake2s_compress(&s->leaf[l], data + l * BLAKE2s_BLOCKSIZE,
+                       1, BLAKE2s_BLOCKSIZE, 0);
+}
+
+EXPORT void blake2sp_init(struct blake2sp * s,
+                          int hashlen, int keylen, unsigned char * key)
+{
+  struct blake2_tree t = { BLAKE2sp_LEAVES, 2, 0, 0, 0, 32, 0 };
+  int l;
+  for (l = 0; l < BLAKE2sp_LEAVES; l++) {
+    t.node_offset = l;
+    t.last_node = (l == BLAKE2sp_LEAVES - 1);
+    blake2s_init(&s->leaf[l], hashlen, keylen, key, &t);
+  }
+  s->keylen = keylen;
+  s->numbytes = 0;
+}
+
+EXPORT void blake2sp_add_data(struct blake2sp * s,
+                              unsigned char * data, size_t len)
+{
+  const size_t limit = 2 * BLAKE2sp_STRIPE - BLAKE2s_BLOCKSIZE;
+  size_t n;
+
+  while (1) {
+    if (s->numbytes >= BLAKE2sp_STRIPE && s->numbytes + len > limit) {
+      blake2sp_stripes(s, s->buffer, 1);
+      s->numbytes -= BLAKE2sp_STRIPE;
+      memmove(s->buffer, s->buffer + BLAKE2sp_STRIPE, s->numbytes);
+      continue;
+    }
+    if (len == 0) return;
+    /* Process stripes directly from [data] */
+    if (s->numbytes == 0 && len > limit) {
+      n = (len - limit + BLAKE2sp_STRIPE - 1) / BLAKE2sp_STRIPE;
+      blake2sp_stripes(s, data, n);
+      data += n * BLAKE2sp_STRIPE; len -= n * BLAKE2sp_STRIPE;
+    }
+    n = sizeof(s->buffer) - s->numbytes;
+    if (n > len) n = len;
+    memcpy(s->buffer + s->numbytes, data, n);
+    s->numbytes += n;
+    data += n; len -= n;
+  }
+}
+
+EXPORT void blake2sp_final(struct blake2sp * s,
+                           int hashlen, unsigned char * hash)
+{
+  struct blake2_tree t = { BLAKE2sp_LEAVES, 2, 0, 0, 1, 32, 1 };
+  unsigned char leaves[BLAKE2sp_LEAVES * 32];
+  struct blake2s root;
+  int l, p, n;
+
+  for (l = 0; l < BLAKE2sp_LEAVES; l++) {
+    for (p = l * BLAKE2s_BLOCKSIZE; p < s->numbytes; p += BLAKE2sp_STRIPE) {
+      n = s->numbytes - p;
+      if (n > BLAKE2s_BLOCKSIZE) n = BLAKE2s_BLOCKSIZE;
+      blake2s_add_data(&s->leaf[l], s->buffer + p, n);
+    }
+    blake2s_final(&s->leaf[l], 32, leaves + 32 * l);
+  }
+  blake2s_init(&root, hashlen, s->keylen, NULL, &t);
+  blake2s_add_data(&root, leaves, sizeof(leaves));
+  blake2s_final(&root, hashlen, hash);
+  memset(leaves, 0, sizeof(leaves));
+}
+
+/* Fixed-length hashing: BLAKE2s-256 of exactly 64 bytes, in a single
+   compression.  With AVX2, 8 consecutive inputs are hashed at once as
+   one stripe of BLAKE2sp. */
+
+static void blake2s_64to32_output(const struct blake2s * s,
+                                  unsigned char * out)
+{
+  int i;
+  for (i = 0; i < 32; i++) out[i] = s->h[i / 4] >> (8 * (i % 4));
+}
+
+EXPORT void blake2s_64to32(const unsigned char * in, size_t n,
+                           unsigned char * out)
+{
+  struct blake2s s[BLAKE2sp_LEAVES];
+
+#ifdef HAVE_X86_DISPATCH
+  if (cpu_features() & CPU_AVX2) {
+    int l;
+    for (; n >= BLAKE2sp_LEAVES; n -= BLAKE2sp_LEAVES) {
+      for (l = 0; l < BLAKE2sp_LEAVES; l++)
+        blake2s_init(&s[l], 32, 0, NULL, NULL);
+      blake2sp_stripes_avx2(s, in, 1, 1);
+      for (l = 0; l < BLAKE2sp_LEAVES; l++)
+        blake2s_64to32_output(&s[l], out + 32 * l);
+      in += BLAKE2sp_STRIPE; out += 32 * BLAKE2sp_LEAVES;
+    }
+  }
+#endif
+  for (; n > 0; n--, in += BLAKE2s_BLOCKSIZE, out += 32) {
+    blake2s_init(&s[0], 32, 0, NULL, NULL);
+    blake2s_compress(&s[0], in, 1, BLAKE2s_BLOCKSIZE, 1);
+    blake2s_64to32_output(&s[0], out);
+  }
+}
+
+/* BLAKE2Xb and BLAKE2Xs.  The input is hashed into a root hash [H0],
+   whose parameter block contains the output length.  Each block of
+   output is the hash of [H0] with node offset the block number. */
+
+EXPORT void blake2xb_init(struct blake2b * s, uint32_t outlen,
+                          int keylen, unsigned char * key)
+{
+  struct blake2_tree t = { 1, 1, 0, 0, 0, 0, 0 };
+  t.node_offset = (uint64_t) outlen << 32;
+  blake2b_init(s, 64, keylen, key, &t);
+}
+
+EXPORT void blake2xb_final(struct blake2b * s, uint32_t outlen,
+                           unsigned char * out)
+{
+  struct blake2_tree t = { 0, 0, 64, 0, 0, 64, 0 };
+  unsigned char h0[64];
+  struct blake2b b;
+  uint32_t i, n, pos;
+
+  blake2b_final(s, 64, h0);
+  for (i = 0, pos = 0; pos < outlen; i++, pos += n) {
+    n = outlen - pos < 64 ? outlen - pos : 64;
+    t.node_offset = ((uint64_t) outlen << 32) | i;
+    blake2b_init(&b, n, 0, NULL, &t);
+    blake2b_add_data(&b, h0, 64);
+    blake2b_final(&b, n, out + pos);
+  }
+  memset(h0, 0, sizeof(h0));
+}
+
+EXPORT void blake2xs_init(struct blake2s * s, uint32_t outlen,
+                          int keylen, unsigned char * key)
+{
+  struct blake2_tree t = { 1, 1, 0, 0, 0, 0, 0 };
+  assert (outlen <= 0xFFFF);
+  t.node_offset = (uint64_t) outlen << 32;
+  blake2s_init(s, 32, keylen, key, &t);
+}
+
+EXPORT void blake2xs_final(struct blake2s * s, uint32_t outlen,
+                           unsigned char * out)
+{
+  struct blake2_tree t = { 0, 0, 32, 0, 0, 32, 0 };
+  unsigned char h0[32];
+  struct blake2s b;
+  uint32_t i, n, pos;
+
+  blake2s_final(s, 32, h0);
+  for (i = 0, pos = 0; pos < outlen; i++, pos += n) {
+    n = outlen - pos < 32 ? outlen - pos : 32;
+    t.node_offset = ((uint64_t) outlen << 32) | i;
+    blake2s_init(&b, n, 0, NULL, &t);
+    blake2s_add_data(&b, h0, 32);
+    blake2s_final(&b, n, out + pos);
+  }
+  memset(h0, 0, sizeof(h0));
+}
@@ -11,6 +11,19 @@
 /*                                                                     */
 /***********************************************************************/
 
+/* Parameters for tree hashing and extendable output.  A null pointer
+   stands for the sequential mode (fanout = depth = 1, other fields 0).
+   For BLAKE2X, [node_offset] also contains the output length,
+   shifted left by 32 bits. */
+
+struct blake2_tree {
+  int fanout, depth;
+  uint32_t leaf_length;
+  uint64_t node_offset;
+  int node_depth, inner_length;
+  int last_node;
+};
+
 /* BLAKE2b hashing */
 
 #define BLAKE2b_BLOCKSIZE 128
@@ -19,11 +32,13 @@ struct blake2b {
   uint64_t h[8];
   uint64_t len[2];
   int numbytes;
+  int last_node;
   unsigned char buffer[BLAKE2b_BLOCKSIZE];
 };
 
 EXPORT void blake2b_init(struct blake2b * s,
-                         int hashlen, int keylen, unsigned char * key);
+                         int hashlen, int keylen, unsigned char * key,
+                         const struct blake2_tree * t);
 EXPORT void blake2b_add_data(struct blake2b * s,
                              unsigned char * data, size_t len);
 EXPORT void blake2b_final(struct blake2b * s,
@@ -35,13 +50,72 @@ struct blake2s {
   uint32_t h[8];
   uint32_t len[2];
   int numbytes;
+  int last_node;
   unsigned char buffer[BLAKE2s_BLOCKSIZE];
 };
 
 EXPORT void blake2s_init(struct blake2s * s,
-                         int hashlen, int keylen, unsigned char * key);
+                         int hashlen, int keylen, unsigned char * key,
+                         const struct blake2_tree * t);
 EXPORT void blake2s_add_data(struct blake2s * s,
                              unsigned char * data, size_t len);
 EXPORT void blake2s_final(struct blake2s * s,
                           int hashlen, unsigned char * hash);
 
+/* BLAKE2bp and BLAKE2sp: 4 (resp. 8) leaves hashing interleaved blocks
+   of the input, and a root hashing the leaves.  The last two stripes
+   of blocks are buffered, since they may contain the final blocks
+   of the leaves. */
+
+#define BLAKE2bp_LEAVES 4
+#define BLAKE2bp_STRIPE (BLAKE2bp_LEAVES * BLAKE2b_BLOCKSIZE)
+
+struct blake2bp {
+  struct blake2b leaf[BLAKE2bp_LEAVES];
+  int keylen;
+  int numbytes;
+  unsigned char buffer[2 * BLAKE2bp_STRIPE];
+};
+
+EXPORT void blake2bp_init(struct blake2bp * s,
+                          int hashlen, int keylen, unsigned char * key);
+EXPORT void blake2bp_add_data(struct blake2bp * s,
+                              unsigned char * data, size_t len);
+EXPORT void blake2bp_final(struct blake2bp * s,
+                           int hashlen, unsigned char * hash);
+
+#define BLAKE2sp_LEAVES 8
+#define BLAKE2sp_STRIPE (BLAKE2sp_LEAVES * BLAKE2s_BLOCKSIZE)
+
+struct blake2sp {
+  struct blake2s leaf[BLAKE2sp_LEAVES];
+  int keylen;
+  int numbytes;
+  unsigned char buffer[2 * BLAKE2sp_STRIPE];
+};
+
+EXPORT void blake2sp_init(struct blake2sp * s,
+                          int hashlen, int keylen, unsigned char * key);
+EXPORT void blake2sp_add_data(struct blake2sp * s,
+                              unsigned char * data, size_t len);
+EXPORT void blake2sp_final(struct blake2sp * s,
+                           int hashlen, unsigned char * hash);
+
+/* BLAKE2Xb and BLAKE2Xs: extendable output of [outlen] bytes,
+   at most 2^32 - 2 (resp. 2^16 - 2), the maximal value being reserved
+   for outputs of unknown length.  The input is hashed with
+   blake2b_add_data (resp. blake2s_add_data). */
+
+EXPORT void blake2xb_init(struct blake2b * s, uint32_t outlen,
+                          int keylen, unsigned char * key);
+EXPORT void blake2xb_final(struct blake2b * s, uint32_t outlen,
+                           unsigned char * out);
+EXPORT void blake2xs_init(struct blake2s * s, uint32_t outlen,
+                          int keylen, unsigned char * key);
+EXPORT void blake2xs_final(struct blake2s * s, uint32_t outlen,
+                           unsigned char * out);
+
+/* Fixed-length hashing: BLAKE2s-256 of [n] consecutive 64-byte inputs,
+   digests stored consecutively in [out] */
+EXPORT void blake2s_64to32(const unsigned char * in, size_t n,
+                           unsigned char * out);
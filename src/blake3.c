@@ -261,11 +261,49 @@ INLINE size_t compress_parents_parallel(const uint8_t *child_chaining_values,
 // Why not just have the caller split the input on the first update(), instead
 // of implementing this special rule? Because we don't want to limit SIMD or
 // multi-threading parallelism for that update().
+//
+// Cryptokit: with [threads] > 1, large subtrees are split between several
+// POSIX threads, each hashing one half of the subtree.
+static size_t blake3_compress_subtree_wide(const uint8_t *input,
+                                           size_t input_len,
+                                           const uint32_t key[8],
+                                           uint64_t chunk_counter,
+                                           uint8_t flags, uint8_t *out,
+                                           int threads);
+
+#if defined(HAVE_PTHREAD)
+#include <pthread.h>
+
+// Subtrees smaller than this are not worth starting a thread for.
+#define BLAKE3_THREAD_MIN_LEN (256 * 1024)
+
+typedef struct {
+  const uint8_t *input;
+  size_t input_len;
+  const uint32_t *key;
+  uint64_t chunk_counter;
+  uint8_t flags;
+  uint8_t *out;
+  int threads;
+  size_t num_cvs;
+} subtree_job;
+
+static void *subtree_job_run(void *arg) {
+  subtree_job *job = (subtree_job *)arg;
+  job->num_cvs =
+      blake3_compress_subtree_wide(job->input, job->input_len, job->key,
+                                   job->chunk_counter, job->flags, job->out,
+                                   job->threads);
+  return NULL;
+}
+#endif
+
 static size_t blake3_compress_subtree_wide(const uint8_t *input,
                                            size_t input_len,
                                            const uint32_t key[8],
                                            uint64_t chunk_counter,
-                                           uint8_t flags, uint8_t *out) {
+                                           uint8_t flags, uint8_t *out,
+                                           int threads) {
   // Note that the single chunk case does *not* bump the SIMD degree up to 2
   // when it is 1. If this implementation adds multi-threading in the future,
   // this gives us the option of multi-threading even the 2-chunk case, which
@@ -299,12 +337,33 @@ static size_t blake3_compress_subtree_wide(const uint8_t *input,
   }
   uint8_t *right_cvs = &cv_array[degree * BLAKE3_OUT_LEN];
 
-  // Recurse! If this implementation adds multi-threading support in the
-  // future, this is where it will go.
-  size_t left_n = blake3_compress_subtree_wide(input, left_input_len, key,
-                                               chunk_counter, flags, cv_array);
-  size_t right_n = blake3_compress_subtree_wide(
-      right_input, right_input_len, key, right_chunk_counter, flags, right_cvs);
+  // Recurse! With several threads available, the left subtree is hashed
+  // on a new thread while this thread hashes the right subtree.
+  size_t left_n, right_n;
+  bool left_done = false;
+#if defined(HAVE_PTHREAD)
+  if (threads > 1 && left_input_len >= BLAKE3_THREAD_MIN_LEN) {
+    subtree_job job = {input, left_input_len, key, chunk_counter,
+                       flags, cv_array, threads / 2, 0};
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, subtree_job_run, &job) == 0) {
+      right_n = blake3_compress_subtree_wide(right_input, right_input_len, key,
+                                             right_chunk_counter, flags,
+                                             right_cvs, threads - threads / 2);
+      pthread_join(thread, NULL);
+      left_n = job.num_cvs;
+      left_done = true;
+    }
+  }
+#endif
+  if (!left_done) {
+    left_n = blake3_compress_subtree_wide(input, left_input_len, key,
+                                          chunk_counter, flags, cv_array,
+                                          threads);
+    right_n = blake3_compress_subtree_wide(right_input, right_input_len, key,
+                                           right_chunk_counter, flags,
+                                           right_cvs, threads);
+  }
 
   // The special case again. If simd_degree=1, then we'll have left_n=1 and
   // right_n=1. Rather than compressing them into a single output, return
@@ -332,14 +391,16 @@ static size_t blake3_compress_subtree_wide(const uint8_t *input,
 // chunk or less. That's a different codepath.
 INLINE void compress_subtree_to_parent_node(
     const uint8_t *input, size_t input_len, const uint32_t key[8],
-    uint64_t chunk_counter, uint8_t flags, uint8_t out[2 * BLAKE3_OUT_LEN]) {
+    uint64_t chunk_counter, uint8_t flags, uint8_t out[2 * BLAKE3_OUT_LEN],
+    int threads) {
 #if defined(BLAKE3_TESTING)
   assert(input_len > BLAKE3_CHUNK_LEN);
 #endif
 
   uint8_t cv_array[MAX_SIMD_DEGREE_OR_2 * BLAKE3_OUT_LEN];
   size_t num_cvs = blake3_compress_subtree_wide(input, input_len, key,
-                                                chunk_counter, flags, cv_array);
+                                                chunk_counter, flags, cv_array,
+                                                threads);
   assert(num_cvs <= MAX_SIMD_DEGREE_OR_2);
 
   // If MAX_SIMD_DEGREE is greater than 2 and there's enough input,
@@ -452,8 +513,8 @@ INLINE void hasher_push_cv(blake3_hasher *self, uint8_t new_cv[BLAKE3_OUT_LEN],
   self->cv_stack_len += 1;
 }
 
-EXPORT void blake3_hasher_update(blake3_hasher *self, const void *input,
-                          size_t input_len) {
+static void hasher_update_base(blake3_hasher *self, const void *input,
+                               size_t input_len, int threads) {
   // Explicitly checking for zero avoids causing UB by passing a null pointer
   // to memcpy. This comes up in practice with things like:
   //   std::vector<uint8_t> v;
@@ -539,7 +600,7 @@ EXPORT void blake3_hasher_update(blake3_hasher *self, const void *input,
       uint8_t cv_pair[2 * BLAKE3_OUT_LEN];
       compress_subtree_to_parent_node(input_bytes, subtree_len, self->key,
                                       self->chunk.chunk_counter,
-                                      self->chunk.flags, cv_pair);
+                                      self->chunk.flags, cv_pair, threads);
       hasher_push_cv(self, cv_pair, self->chunk.chunk_counter);
       hasher_push_cv(self, &cv_pair[BLAKE3_OUT_LEN],
                      self->chunk.chunk_counter + (subtree_chunks / 2));
@@ -561,6 +622,18 @@ EXPORT void blake3_hasher_update(blake3_hasher *self, const void *input,
   }
 }
 
+EXPORT void blake3_hasher_update(blake3_hasher *self, const void *input,
+                          size_t input_len) {
+  hasher_update_base(self, input, input_len, 1);
+}
+
+// Cryptokit: same as blake3_hasher_update, using up to [threads] threads.
+EXPORT void blake3_hasher_update_parallel(blake3_hasher *self,
+                                          const void *input, size_t input_len,
+                                          int threads) {
+  hasher_update_base(self, input, input_len, threads);
+}
+
 EXPORT void blake3_hasher_finalize(const blake3_hasher *self, uint8_t *out,
                             size_t out_len) {
   blake3_hasher_finalize_seek(self, 0, out, out_len);
@@ -47,6 +47,9 @@ EXPORT void blake3_hasher_init_derive_key_raw(blake3_hasher *self, const void *c
                                               size_t context_len);
 EXPORT void blake3_hasher_update(blake3_hasher *self, const void *input,
                                  size_t input_len);
+EXPORT void blake3_hasher_update_parallel(blake3_hasher *self,
+                                          const void *input, size_t input_len,
+                                          int threads);
 EXPORT void blake3_hasher_finalize(const blake3_hasher *self, uint8_t *out,
                                    size_t out_len);
 EXPORT void blake3_hasher_finalize_seek(const blake3_hasher *self, uint64_t seek,
@@ -212,69 +212,71 @@ EXPORT void blake3_hash_many_portable(const uint8_t *const *inputs, size_t num_i
                                       uint8_t flags, uint8_t flags_start,
                                       uint8_t flags_end, uint8_t *out);
 
+// The SIMD implementations are compiled as separate files, with their own
+// instruction set flags, hence are not declared EXPORT.
 #if defined(IS_X86)
 #if !defined(BLAKE3_NO_SSE2)
-EXPORT void blake3_compress_in_place_sse2(uint32_t cv[8],
-                                          const uint8_t block[BLAKE3_BLOCK_LEN],
-                                          uint8_t block_len, uint64_t counter,
-                                          uint8_t flags);
-EXPORT void blake3_compress_xof_sse2(const uint32_t cv[8],
-                                     const uint8_t block[BLAKE3_BLOCK_LEN],
-                                     uint8_t block_len, uint64_t counter,
-                                     uint8_t flags, uint8_t out[64]);
-EXPORT void blake3_hash_many_sse2(const uint8_t *const *inputs, size_t num_inputs,
-                                  size_t blocks, const uint32_t key[8],
-                                  uint64_t counter, bool increment_counter,
-                                  uint8_t flags, uint8_t flags_start,
-                                  uint8_t flags_end, uint8_t *out);
+void blake3_compress_in_place_sse2(uint32_t cv[8],
+                                   const uint8_t block[BLAKE3_BLOCK_LEN],
+                                   uint8_t block_len, uint64_t counter,
+                                   uint8_t flags);
+void blake3_compress_xof_sse2(const uint32_t cv[8],
+                              const uint8_t block[BLAKE3_BLOCK_LEN],
+                              uint8_t block_len, uint64_t counter,
+                              uint8_t flags, uint8_t out[64]);
+void blake3_hash_many_sse2(const uint8_t *const *inputs, size_t num_inputs,
+                           size_t blocks, const uint32_t key[8],
+                           uint64_t counter, bool increment_counter,
+                           uint8_t flags, uint8_t flags_start,
+                           uint8_t flags_end, uint8_t *out);
 #endif
 #if !defined(BLAKE3_NO_SSE41)
-EXPORT void blake3_compress_in_place_sse41(uint32_t cv[8],
-                                           const uint8_t block[BLAKE3_BLOCK_LEN],
-                                           uint8_t block_len, uint64_t counter,
-                                           uint8_t flags);
-EXPORT void blake3_compress_xof_sse41(const uint32_t cv[8],
-                                      const uint8_t block[BLAKE3_BLOCK_LEN],
-                                      uint8_t block_len, uint64_t counter,
-                                      uint8_t flags, uint8_t out[64]);
-EXPORT void blake3_hash_many_sse41(const uint8_t *const *inputs, size_t num_inputs,
-                                   size_t blocks, const uint32_t key[8],
-                                   uint64_t counter, bool increment_counter,
-                                   uint8_t flags, uint8_t flags_start,
-                                   uint8_t flags_end, uint8_t *out);
+void blake3_compress_in_place_sse41(uint32_t cv[8],
+                                    const uint8_t block[BLAKE3_BLOCK_LEN],
+                                    uint8_t block_len, uint64_t counter,
+                                    uint8_t flags);
+void blake3_compress_xof_sse41(const uint32_t cv[8],
+                               const uint8_t block[BLAKE3_BLOCK_LEN],
+                               uint8_t block_len, uint64_t counter,
+                               uint8_t flags, uint8_t out[64]);
+void blake3_hash_many_sse41(const uint8_t *const *inputs, size_t num_inputs,
+                            size_t blocks, const uint32_t key[8],
+                            uint64_t counter, bool increment_counter,
+                            uint8_t flags, uint8_t flags_start,
+                            uint8_t flags_end, uint8_t *out);
 #endif
 #if !defined(BLAKE3_NO_AVX2)
-EXPORT void blake3_hash_many_avx2(const uint8_t *const *inputs, size_t num_inputs,
-                                  size_t blocks, const uint32_t key[8],
-                                  uint64_t counter, bool increment_counter,
-                                  uint8_t flags, uint8_t flags_start,
-                                  uint8_t flags_end, uint8_t *out);
+void blake3_hash_many_avx2(const uint8_t *const *inputs, size_t num_inputs,
+                           size_t blocks, const uint32_t key[8],
+                           uint64_t counter, bool increment_counter,
+                           uint8_t flags, uint8_t flags_start,
+                           uint8_t flags_end, uint8_t *out);
 #endif
 #if !defined(BLAKE3_NO_AVX512)
-EXPORT void blake3_compress_in_place_avx512(uint32_t cv[8],
-                                            const uint8_t block[BLAKE3_BLOCK_LEN],
-                                            uint8_t block_len, uint64_t counter,
-                                            uint8_t flags);
-
-EXPORT void blake3_compress_xof_avx512(const uint32_t cv[8],
-                                       const uint8_t block[BLAKE3_BLOCK_LEN],
-                                       uint8_t block_len, uint64_t counter,
-                                       uint8_t flags, uint8_t out[64]);
-
-EXPORT void blake3_hash_many_avx512(const uint8_t *const *inputs, size_t num_inputs,
-                                    size_t blocks, const uint32_t key[8],
-                                    uint64_t counter, bool increment_counter,
-                                    uint8_t flags, uint8_t flags_start,
-                                    uint8_t flags_end, uint8_t *out);
+void blake3_compress_in_place_avx512(uint32_t cv[8],
+                                     const uint8_t block[BLAKE3_BLOCK_LEN],
+                                     uint8_t block_len, uint64_t counter,
+                                     uint8_t flags);
+
+void blake3_compress_xof_avx512(const uint32_t cv[8],
+                                const uint8_t block[BLAKE3_BLOCK_LEN],
+                                uint8_t block_len, uint64_t counter,
+                                uint8_t flags, uint8_t out[64]);
+
+void blake3_hash_many_avx512(const uint8_t *const *inputs, size_t num_inputs,
+                             size_t blocks, const uint32_t key[8],
+                             uint64_t counter, bool increment_counter,
+                             uint8_t flags, uint8_t flags_start,
+                             uint8_t flags_end, uint8_t *out);
 #endif
 #endif
 
 #if BLAKE3_USE_NEON == 1
-EXPORT void blake3_hash_many_neon(const uint8_t *const *inputs, size_t num_inputs,
-                                  size_t blocks, const uint32_t key[8],
-                                  uint64_t counter, bool increment_counter,
-                                  uint8_t flags, uint8_t flags_start,
-                                  uint8_t flags_end, uint8_t *out);
+void blake3_hash_many_neon(const uint8_t *const *inputs, size_t num_inputs,
+                           size_t blocks, const uint32_t key[8],
+                           uint64_t counter, bool increment_counter,
+                           uint8_t flags, uint8_t flags_start,
+                           uint8_t flags_end, uint8_t *out);
 #endif
 
 
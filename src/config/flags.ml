@@ -32,6 +32,32 @@ let () = Configurator.main ~name:"cryptokit" @@ fun cfg ->
     | Auto -> (architecture = "amd64" || architecture = "i386")
               && test ~cfg ~c_flags:[ "-maes"; "-mpclmul" ] ~link_flags:[]
   in
+  (* Run-time selection of SIMD implementations of hash functions:
+     requires per-function target attributes in the C compiler *)
+  let x86_dispatch =
+    hardware_support
+    && Configurator.c_test cfg ~c_flags:[] ~link_flags:[]
+         "__attribute__((target(\"sha,sse4.1\"))) static int f(void) { return 0; }\n\
+          __attribute__((target(\"avx2\"))) static int g(void) { return 0; }\n\
+          __attribute__((target(\"avx512f\"))) static int h(void) { return 0; }\n\
+          int main() { return f() + g() + h(); }\n"
+  in
+  (* The SIMD implementations of BLAKE3 are compiled separately,
+     each with its own instruction set flags *)
+  let blake3_simd =
+    hardware_support
+    && test ~cfg ~c_flags:[ "-msse4.1"; "-mavx2"; "-mavx512f"; "-mavx512vl" ]
+            ~link_flags:[]
+  in
+  (* POSIX threads, for multi-threaded hashing of large inputs *)
+  let has_pthread =
+    os_type <> "Win32"
+    && Configurator.c_test cfg ~c_flags:[] ~link_flags:[ "-lpthread" ]
+         "#include <pthread.h>\n\
+          static void * f(void * arg) { return arg; }\n\
+          int main() { pthread_t t; pthread_create(&t, 0, f, 0);\n\
+                       return pthread_join(t, 0); }\n"
+  in
   let has_getentropy =
     provides ~cfg ~c_flags:[] ~link_flags:[]
              ~headers:["unistd.h"] ~functions:["getentropy"]
@@ -43,21 +69,40 @@ let () = Configurator.main ~name:"cryptokit" @@ fun cfg ->
     |> append_if zlib "-DHAVE_ZLIB"
     |> append_if hardware_support "-maes"
     |> append_if hardware_support "-mpclmul"
+    |> append_if x86_dispatch "-DHAVE_X86_DISPATCH"
+    |> append_if has_pthread "-DHAVE_PTHREAD"
+    |> append_if (not blake3_simd) "-DBLAKE3_NO_SSE2"
+    |> append_if (not blake3_simd) "-DBLAKE3_NO_SSE41"
+    |> append_if (not blake3_simd) "-DBLAKE3_NO_AVX2"
+    |> append_if (not blake3_simd) "-DBLAKE3_NO_AVX512"
   in
+  let blake3_flags f = if blake3_simd then f else [] in
   let library_flags =
     []
     |> append_if (zlib && (system = "win32" || system = "win64")) "zlib.lib"
     |> append_if (zlib && system <> "win32" && system <> "win64") "-lz"
+    |> append_if has_pthread "-lpthread"
     |> append_if (system = "win32" || system = "win64") "advapi32.lib"
     |> append_if (system = "mingw" || system = "mingw64") "-ladvapi32"
   in
   Configurator.Flags.write_sexp "flags.sexp" flags;
   Configurator.Flags.write_sexp "library_flags.sexp" library_flags;
+  Configurator.Flags.write_sexp "blake3_sse2_flags.sexp"
+    (blake3_flags [ "-msse2" ]);
+  Configurator.Flags.write_sexp "blake3_sse41_flags.sexp"
+    (blake3_flags [ "-msse4.1" ]);
+  Configurator.Flags.write_sexp "blake3_avx2_flags.sexp"
+    (blake3_flags [ "-mavx2" ]);
+  Configurator.Flags.write_sexp "blake3_avx512_flags.sexp"
+    (blake3_flags [ "-mavx512f"; "-mavx512vl" ]);
   let describe_bool = function
     | true -> "enabled"
     | false -> "disabled"
   in
   printf "ZLib: ............................... %s\n" (describe_bool zlib);
   printf "Hardware support for AES and GCM: ... %s\n" (describe_bool hardware_support);
+  printf "SIMD hashing: ....................... %s\n" (describe_bool x86_dispatch);
+  printf "SIMD BLAKE3: ........................ %s\n" (describe_bool blake3_simd);
+  printf "Multi-threaded hashing: ............. %s\n" (describe_bool has_pthread);
   printf "getentropy():........................ %s\n" (describe_bool has_getentropy)
 
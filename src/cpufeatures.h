@@ -0,0 +1,74 @@
+/***********************************************************************/
+/*                                                                     */
+/*                      The Cryptokit library                          */
+/*                                                                     */
+/*            Xavier Leroy, Collège de France and Inria                */
+/*                                                                     */
+/*  Copyright 2026 Institut National de Recherche en Informatique et   */
+/*  en Automatique.  All rights reserved.  This file is distributed    */
+/*  under the terms of the GNU Library General Public License, with    */
+/*  the special exception on linking described in file LICENSE.        */
+/*                                                                     */
+/***********************************************************************/
+
+/* Run-time detection of x86 instruction set extensions.
+
+   HAVE_X86_DISPATCH is defined by the configuration script when
+   the C compiler supports per-function target attributes, such as
+   __attribute__((target("avx2"))).  The code using these extensions
+   is then compiled along with the portable code, and selected at
+   run-time according to [cpu_features()]. */
+
+#ifndef CRYPTOKIT_CPUFEATURES_H
+#define CRYPTOKIT_CPUFEATURES_H
+
+#define CPU_SSE41   1
+#define CPU_SHA     2
+#define CPU_AVX2    4
+#define CPU_AVX512  8   /* AVX-512 F, BW and VL */
+
+#ifdef HAVE_X86_DISPATCH
+
+#include <cpuid.h>
+
+static inline unsigned int cpu_xgetbv(void)
+{
+  unsigned int eax, edx;
+  __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return eax;
+}
+
+static inline int cpu_features(void)
+{
+  static int features = -1;
+  unsigned int eax, ebx, ecx, edx, maxleaf, xcr0 = 0;
+  int f;
+
+  if (features >= 0) return features;
+  f = 0;
+  maxleaf = __get_cpuid_max(0, 0);
+  if (maxleaf >= 1) {
+    __cpuid(1, eax, ebx, ecx, edx);
+    if (ecx & (1U << 19)) f |= CPU_SSE41;
+    /* OSXSAVE: the OS saves extended registers on context switches */
+    if (ecx & (1U << 27)) xcr0 = cpu_xgetbv();
+  }
+  if (maxleaf >= 7) {
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    if ((f & CPU_SSE41) && (ebx & (1U << 29))) f |= CPU_SHA;
+    if ((xcr0 & 6) == 6 && (ebx & (1U << 5))) f |= CPU_AVX2;
+    if ((f & CPU_AVX2) && (xcr0 & 0xE6) == 0xE6
+        && (ebx & (1U << 16)) && (ebx & (1U << 30)) && (ebx & (1U << 31)))
+      f |= CPU_AVX512;
+  }
+  features = f;
+  return f;
+}
+
+#else
+
+static inline int cpu_features(void) { return 0; }
+
+#endif
+
+#endif
@@ -65,6 +65,7 @@ type error =
   | Entropy_source_closed
   | Compression_not_supported
   | Invalid_point
+  | Authentication_failure
 
 let describe_error = function
   | Wrong_key_size -> "wrong key size"
@@ -83,6 +84,7 @@ let describe_error = function
   | Entropy_source_closed -> "entropy source closed"
   | Compression_not_supported -> "compression not supported"
   | Invalid_point -> "point is not on elliptic curve"
+  | Authentication_failure -> "authentication failure"
 
 exception Error of error
 
@@ -102,6 +104,7 @@ external aes_cook_encrypt_key : string -> bytes = "caml_aes_cook_encrypt_key"
 external aes_cook_decrypt_key : string -> bytes = "caml_aes_cook_decrypt_key"
 external aes_encrypt : bytes -> bytes -> int -> bytes -> int -> unit = "caml_aes_encrypt"
 external aes_decrypt : bytes -> bytes -> int -> bytes -> int -> unit = "caml_aes_decrypt"
+external aes_cmac_many: bytes -> string array -> bytes -> int -> unit = "caml_aes_cmac_many"
 external blowfish_cook_key : string -> bytes = "caml_blowfish_cook_key"
 external blowfish_encrypt : bytes -> bytes -> int -> bytes -> int -> unit = "caml_blowfish_encrypt"
 external blowfish_decrypt : bytes -> bytes -> int -> bytes -> int -> unit = "caml_blowfish_decrypt"
@@ -115,38 +118,115 @@ external chacha20_extract : bytes -> bytes -> int -> int -> unit = "caml_chacha2
 
 external sha1_init: unit -> bytes = "caml_sha1_init"
 external sha1_update: bytes -> bytes -> int -> int -> unit = "caml_sha1_update"
-external sha1_final: bytes -> string = "caml_sha1_final"
+external sha1_add_byte: bytes -> int -> unit = "caml_sha1_add_byte"
+external sha1_final: bytes -> bytes -> int -> unit = "caml_sha1_final"
+external sha1_reset: bytes -> unit = "caml_sha1_reset"
+external sha1_many: string array -> bytes -> int -> unit = "caml_sha1_many"
+external sha1_hmac_many: bytes -> string array -> bytes -> int -> unit = "caml_sha1_hmac_many"
+external sha1_valid_state: string -> bool = "caml_sha1_valid_state"
 external sha256_init: unit -> bytes = "caml_sha256_init"
 external sha224_init: unit -> bytes = "caml_sha224_init"
 external sha256_update: bytes -> bytes -> int -> int -> unit = "caml_sha256_update"
-external sha256_final: bytes -> string = "caml_sha256_final"
-external sha224_final: bytes -> string = "caml_sha224_final"
+external sha256_add_byte: bytes -> int -> unit = "caml_sha256_add_byte"
+external sha256_final: bytes -> int -> bytes -> int -> unit = "caml_sha256_final"
+external sha256_reset: bytes -> int -> unit = "caml_sha256_reset"
+external sha256_many: int -> string array -> bytes -> int -> unit = "caml_sha256_many"
+external sha256_hmac_many: int -> bytes -> string array -> bytes -> int -> unit = "caml_sha256_hmac_many"
+external sha256_64to32: string -> bytes -> unit = "caml_sha256_64to32"
+external sha256d_64to32: string -> bytes -> unit = "caml_sha256d_64to32"
+external sha256_oneshot: string -> bool -> string = "caml_sha256_oneshot"
+external sha256_valid_state: string -> bool = "caml_sha256_valid_state"
 external sha512_init: unit -> bytes = "caml_sha512_init"
 external sha384_init: unit -> bytes = "caml_sha384_init"
 external sha512_256_init: unit -> bytes = "caml_sha512_256_init"
 external sha512_224_init: unit -> bytes = "caml_sha512_224_init"
 external sha512_update: bytes -> bytes -> int -> int -> unit = "caml_sha512_update"
-external sha512_final: bytes -> string = "caml_sha512_final"
-external sha384_final: bytes -> string = "caml_sha384_final"
-external sha512_256_final: bytes -> string = "caml_sha512_256_final"
-external sha512_224_final: bytes -> string = "caml_sha512_224_final"
+external sha512_add_byte: bytes -> int -> unit = "caml_sha512_add_byte"
+external sha512_final: bytes -> int -> bytes -> int -> unit = "caml_sha512_final"
+external sha512_reset: bytes -> int -> unit = "caml_sha512_reset"
+external sha512_valid_state: string -> bool = "caml_sha512_valid_state"
+external sha512_many: int -> string array -> bytes -> int -> unit = "caml_sha512_many"
+external sha512_hmac_many: int -> bytes -> string array -> bytes -> int -> unit = "caml_sha512_hmac_many"
 type sha3_context
 external sha3_init: int -> sha3_context = "caml_sha3_init"
 external sha3_absorb: sha3_context -> bytes -> int -> int -> unit = "caml_sha3_absorb"
-external sha3_extract: bool -> sha3_context -> string = "caml_sha3_extract"
+external sha3_add_byte: sha3_context -> int -> unit = "caml_sha3_add_byte"
+external sha3_extract: bool -> sha3_context -> bytes -> int -> unit = "caml_sha3_extract"
+external sha3_reset: sha3_context -> unit = "caml_sha3_reset"
 external sha3_wipe: sha3_context -> unit = "caml_sha3_wipe"
+external sha3_copy: sha3_context -> sha3_context = "caml_sha3_copy"
+external sha3_save: sha3_context -> string = "caml_sha3_save"
+external sha3_valid_state: string -> int -> bool = "caml_sha3_valid_state"
+external sha3_restore: string -> sha3_context = "caml_sha3_restore"
+external sha3_many: int -> bool -> string array -> bytes -> int -> unit = "caml_sha3_many"
+external shake_init: int -> sha3_context = "caml_shake_init"
+external sha3_pad: sha3_context -> int -> unit = "caml_sha3_pad"
+external sha3_squeeze: sha3_context -> bytes -> int -> int -> unit = "caml_sha3_squeeze"
+external cshake_many: int -> string -> string -> int -> string array -> bytes -> int -> unit = "caml_cshake_many_bytecode" "caml_cshake_many"
+external k12_init: unit -> bytes = "caml_k12_init"
+external k12_absorb: bytes -> bytes -> int -> int -> unit = "caml_k12_absorb"
+external k12_add_byte: bytes -> int -> unit = "caml_k12_add_byte"
+external k12_reset: bytes -> unit = "caml_k12_reset"
+external k12_absorb_parallel: bytes -> bytes -> int -> int -> int -> unit = "caml_k12_absorb_parallel"
+external k12_pad: bytes -> string -> unit = "caml_k12_pad"
+external k12_squeeze: bytes -> bytes -> int -> int -> unit = "caml_k12_squeeze"
+external k12_many: string -> int -> string array -> bytes -> int -> unit = "caml_k12_many"
 external ripemd160_init: unit -> bytes = "caml_ripemd160_init"
 external ripemd160_update: bytes -> bytes -> int -> int -> unit = "caml_ripemd160_update"
-external ripemd160_final: bytes -> string = "caml_ripemd160_final"
+external ripemd160_add_byte: bytes -> int -> unit = "caml_ripemd160_add_byte"
+external ripemd160_final: bytes -> bytes -> int -> unit = "caml_ripemd160_final"
+external ripemd160_reset: bytes -> unit = "caml_ripemd160_reset"
+external ripemd160_many: string array -> bytes -> int -> unit = "caml_ripemd160_many"
+external ripemd160_hmac_many: bytes -> string array -> bytes -> int -> unit = "caml_ripemd160_hmac_many"
+external ripemd160_32to20: string -> string = "caml_ripemd160_32to20"
+external ripemd160_valid_state: string -> bool = "caml_ripemd160_valid_state"
 external md5_init: unit -> bytes = "caml_md5_init"
 external md5_update: bytes -> bytes -> int -> int -> unit = "caml_md5_update"
-external md5_final: bytes -> string = "caml_md5_final"
+external md5_add_byte: bytes -> int -> unit = "caml_md5_add_byte"
+external md5_final: bytes -> bytes -> int -> unit = "caml_md5_final"
+external md5_reset: bytes -> unit = "caml_md5_reset"
+external md5_many: string array -> bytes -> int -> unit = "caml_md5_many"
+external md5_hmac_many: bytes -> string array -> bytes -> int -> unit = "caml_md5_hmac_many"
+external md5_valid_state: string -> bool = "caml_md5_valid_state"
 external blake2b_init: int -> string -> bytes = "caml_blake2b_init"
 external blake2b_update: bytes -> bytes -> int -> int -> unit = "caml_blake2b_update"
-external blake2b_final: bytes -> int -> string = "caml_blake2b_final"
+external blake2b_add_byte: bytes -> int -> unit = "caml_blake2b_add_byte"
+external blake2b_final: bytes -> int -> bytes -> int -> unit = "caml_blake2b_final"
+external blake2b_reset: bytes -> int -> string -> unit = "caml_blake2b_reset"
+external blake2b_valid_state: string -> bool = "caml_blake2b_valid_state"
+external blake2b_key_absorbed: bytes -> bool = "caml_blake2b_key_absorbed"
+external blake2b_save: bytes -> string = "caml_blake2b_save"
+external blake2b_many: int -> string -> string array -> bytes -> int -> unit = "caml_blake2b_many"
 external blake2s_init: int -> string -> bytes = "caml_blake2s_init"
 external blake2s_update: bytes -> bytes -> int -> int -> unit = "caml_blake2s_update"
-external blake2s_final: bytes -> int -> string = "caml_blake2s_final"
+external blake2s_add_byte: bytes -> int -> unit = "caml_blake2s_add_byte"
+external blake2s_final: bytes -> int -> bytes -> int -> unit = "caml_blake2s_final"
+external blake2s_reset: bytes -> int -> string -> unit = "caml_blake2s_reset"
+external blake2s_valid_state: string -> bool = "caml_blake2s_valid_state"
+external blake2s_key_absorbed: bytes -> bool = "caml_blake2s_key_absorbed"
+external blake2s_save: bytes -> string = "caml_blake2s_save"
+external blake2s_many: int -> string -> string array -> bytes -> int -> unit = "caml_blake2s_many"
+external blake2s_64to32: string -> bytes -> unit = "caml_blake2s_64to32"
+external blake2bp_init: int -> string -> bytes = "caml_blake2bp_init"
+external blake2bp_update: bytes -> bytes -> int -> int -> unit = "caml_blake2bp_update"
+external blake2bp_add_byte: bytes -> int -> unit = "caml_blake2bp_add_byte"
+external blake2bp_final: bytes -> int -> bytes -> int -> unit = "caml_blake2bp_final"
+external blake2bp_reset: bytes -> int -> string -> unit = "caml_blake2bp_reset"
+external blake2bp_many: int -> string -> string array -> bytes -> int -> unit = "caml_blake2bp_many"
+external blake2sp_init: int -> string -> bytes = "caml_blake2sp_init"
+external blake2sp_update: bytes -> bytes -> int -> int -> unit = "caml_blake2sp_update"
+external blake2sp_add_byte: bytes -> int -> unit = "caml_blake2sp_add_byte"
+external blake2sp_final: bytes -> int -> bytes -> int -> unit = "caml_blake2sp_final"
+external blake2sp_reset: bytes -> int -> string -> unit = "caml_blake2sp_reset"
+external blake2sp_many: int -> string -> string array -> bytes -> int -> unit = "caml_blake2sp_many"
+external blake2xb_init: int -> string -> bytes = "caml_blake2xb_init"
+external blake2xb_final: bytes -> int -> bytes -> int -> unit = "caml_blake2xb_final"
+external blake2xb_reset: bytes -> int -> string -> unit = "caml_blake2xb_reset"
+external blake2xb_many: int -> string -> string array -> bytes -> int -> unit = "caml_blake2xb_many"
+external blake2xs_init: int -> string -> bytes = "caml_blake2xs_init"
+external blake2xs_final: bytes -> int -> bytes -> int -> unit = "caml_blake2xs_final"
+external blake2xs_reset: bytes -> int -> string -> unit = "caml_blake2xs_reset"
+external blake2xs_many: int -> string -> string array -> bytes -> int -> unit = "caml_blake2xs_many"
 type ghash_context
 external ghash_init: bytes -> ghash_context = "caml_ghash_init"
 external ghash_mult: ghash_context -> bytes -> unit = "caml_ghash_mult"
@@ -155,12 +235,53 @@ external poly1305_update: bytes -> bytes -> int -> int -> unit = "caml_poly1305_
 external poly1305_final: bytes -> string = "caml_poly1305_final"
 external siphash_init: string -> int -> bytes = "caml_siphash_init"
 external siphash_update: bytes -> bytes -> int -> int -> unit = "caml_siphash_update"
-external siphash_final: bytes -> int -> string = "caml_siphash_final"
+external siphash_add_byte: bytes -> int -> unit = "caml_siphash_add_byte"
+external siphash_final: bytes -> int -> bytes -> int -> unit = "caml_siphash_final"
+external siphash_reset: bytes -> string -> int -> unit = "caml_siphash_reset"
+external siphash_many: string -> int -> string array -> bytes -> int -> unit = "caml_siphash_many"
 type blake3_context
 external blake3_init: string -> blake3_context = "caml_blake3_init"
 external blake3_update: blake3_context -> bytes -> int -> int -> unit = "caml_blake3_update"
+external blake3_add_byte: blake3_context -> int -> unit = "caml_blake3_add_byte"
+external blake3_reset: blake3_context -> unit = "caml_blake3_reset"
+external blake3_many: string -> int -> string array -> bytes -> int -> unit = "caml_blake3_many"
 external blake3_final: blake3_context -> int -> string = "caml_blake3_extract"
 external blake3_wipe: blake3_context -> unit = "caml_blake3_wipe"
+external blake3_copy: blake3_context -> blake3_context = "caml_blake3_copy"
+external blake3_save: blake3_context -> string = "caml_blake3_save"
+external blake3_valid_state: string -> bool = "caml_blake3_valid_state"
+external blake3_restore: string -> blake3_context = "caml_blake3_restore"
+external blake3_extract_seek: blake3_context -> int64 -> bytes -> int -> int -> unit = "caml_blake3_extract_seek"
+external blake3_derive_context_key: string -> string = "caml_blake3_derive_context_key"
+external blake3_init_derive_key: string -> blake3_context = "caml_blake3_init_derive_key"
+external blake3_update_parallel: blake3_context -> bytes -> int -> int -> int -> unit = "caml_blake3_update_parallel"
+external blake3_update_bigarray: blake3_context -> (char, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t -> int -> int -> int -> unit = "caml_blake3_update_bigarray"
+external blake3_update_file: blake3_context -> string -> int -> unit = "caml_blake3_update_file"
+external bao_outboard: string -> string * string = "caml_bao_outboard"
+external bao_outboard_file: string -> int64 -> string * string = "caml_bao_outboard_file"
+external bao_chunk_cv: bytes -> int -> int -> int -> bool -> string = "caml_bao_chunk_cv"
+external bao_parent_cv: bytes -> int -> bool -> string = "caml_bao_parent_cv"
+external bao_parents_cv: string -> bytes -> unit = "caml_bao_parents_cv"
+external aes_gcm_cook_key: string -> bytes = "caml_aes_gcm_cook_key"
+external aes_gcm_seal: bytes -> string -> string -> bytes -> int -> bytes -> int -> int -> unit = "caml_aes_gcm_seal_bytecode" "caml_aes_gcm_seal"
+external aes_gcm_open: bytes -> string -> string -> bytes -> int -> bytes -> int -> int -> bool = "caml_aes_gcm_open_bytecode" "caml_aes_gcm_open"
+external chacha20_poly1305_seal: bytes -> string -> string -> bytes -> int -> bytes -> int -> int -> unit = "caml_chacha20_poly1305_seal_bytecode" "caml_chacha20_poly1305_seal"
+external chacha20_poly1305_open: bytes -> string -> string -> bytes -> int -> bytes -> int -> int -> bool = "caml_chacha20_poly1305_open_bytecode" "caml_chacha20_poly1305_open"
+external aes_gcm_seal_bigarray: bytes -> string -> string -> (char, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t -> int -> int -> unit = "caml_aes_gcm_seal_bigarray_bytecode" "caml_aes_gcm_seal_bigarray"
+external aes_gcm_open_bigarray: bytes -> string -> string -> (char, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t -> int -> int -> bool = "caml_aes_gcm_open_bigarray_bytecode" "caml_aes_gcm_open_bigarray"
+external chacha20_poly1305_seal_bigarray: bytes -> string -> string -> (char, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t -> int -> int -> unit = "caml_chacha20_poly1305_seal_bigarray_bytecode" "caml_chacha20_poly1305_seal_bigarray"
+external chacha20_poly1305_open_bigarray: bytes -> string -> string -> (char, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t -> int -> int -> bool = "caml_chacha20_poly1305_open_bigarray_bytecode" "caml_chacha20_poly1305_open_bigarray"
+external aes_gcm_seal_many: bytes array -> string array -> string array -> bytes array -> unit = "caml_aes_gcm_seal_many"
+external aes_gcm_open_many: bytes array -> string array -> string array -> bytes array -> bytes -> unit = "caml_aes_gcm_open_many"
+external chacha20_poly1305_seal_many: bytes array -> string array -> string array -> bytes array -> unit = "caml_chacha20_poly1305_seal_many"
+external chacha20_poly1305_open_many: bytes array -> string array -> string array -> bytes array -> bytes -> unit = "caml_chacha20_poly1305_open_many"
+external aead_seal_segments: bytes -> bool -> string -> (char, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t -> int -> int -> int -> unit = "caml_aead_seal_segments_bytecode" "caml_aead_seal_segments"
+external aead_open_segments: bytes -> bool -> string -> (char, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t -> int -> int -> int -> bool = "caml_aead_open_segments_bytecode" "caml_aead_open_segments"
+external blit_bytes_to_bigarray: bytes -> int -> (char, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t -> int -> int -> unit = "caml_blit_bytes_to_bigarray"
+external blit_bigarray_to_bytes: (char, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t -> int -> bytes -> int -> int -> unit = "caml_blit_bigarray_to_bytes"
+external sha256_64to32_merkle: (char, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t -> int -> int -> int -> int -> unit = "caml_sha256_64to32_merkle"
+external blake2s_64to32_merkle: (char, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t -> int -> int -> int -> int -> unit = "caml_blake2s_64to32_merkle"
+external blake3_parent_merkle: (char, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t -> int -> int -> int -> int -> unit = "caml_blake3_parent_merkle"
 
 (* Abstract transform type *)
 
@@ -254,16 +375,38 @@ class compose (tr1 : transform) (tr2 : transform) =
 let compose tr1 tr2 = new compose tr1 tr2
 
 class type hash =
-  object
+  object('self)
     method hash_size: int
     method add_substring: bytes -> int -> int -> unit
     method add_string: string -> unit
     method add_char: char -> unit
     method add_byte: int -> unit
     method result: string
+    method result_into: bytes -> int -> unit
+    method reset: unit
+    method copy: 'self
+    method serialize: string
+    method wipe: unit
+  end
+
+class type xof =
+  object('self)
+    method add_substring: bytes -> int -> int -> unit
+    method add_string: string -> unit
+    method add_char: char -> unit
+    method add_byte: int -> unit
+    method squeeze: int -> string
+    method squeeze_into: bytes -> int -> int -> unit
+    method reset: unit
+    method copy: 'self
     method wipe: unit
   end
 
+let hash_result h =
+  let res = Bytes.create h#hash_size in
+  h#result_into res 0;
+  Bytes.unsafe_to_string res
+
 let hash_string hash s =
   hash#add_string s;
   let r = hash#result in
@@ -317,6 +460,13 @@ class type authenticated_transform =
     method wipe: unit
   end
 
+class type authenticated_transform_with_header =
+  object
+    inherit authenticated_transform
+    method put_header_substring: bytes -> int -> int -> unit
+    method put_header_string: string -> unit
+  end
+
 let auth_transform_string_detached tr s =
   tr#put_string s;
   let tag = tr#finish_and_get_tag in
@@ -395,6 +545,47 @@ class buffered_output initial_buffer_size =
       wipe_bytes obuf
   end
 
+(* A buffer of precomputed keystream, for stream ciphers and counter mode.
+   The keystream is in [ks] between [kbeg] and [kend], and is wiped
+   as soon as it is consumed. *)
+
+class keystream_buffer =
+  object
+    val mutable ks = Bytes.empty
+    val mutable kbeg = 0
+    val mutable kend = 0
+
+    method available_keystream = kend - kbeg
+
+    (* Make room for [n] more bytes of keystream at [kend] *)
+    method private keystream_reserve n =
+      let avail = kend - kbeg in
+      if kend + n > Bytes.length ks then begin
+        if avail + n <= Bytes.length ks then begin
+          Bytes.blit ks kbeg ks 0 avail;
+          Bytes.fill ks avail (Bytes.length ks - avail) '\000'
+        end else begin
+          let nks = Bytes.create (max (avail + n) (2 * Bytes.length ks)) in
+          Bytes.blit ks kbeg nks 0 avail;
+          wipe_bytes ks;
+          ks <- nks
+        end;
+        kbeg <- 0;
+        kend <- avail
+      end
+
+    (* Xor the next [len] bytes of keystream into [dst], and wipe them *)
+    method private keystream_xor dst dst_ofs len =
+      xor_bytes ks kbeg dst dst_ofs len;
+      Bytes.fill ks kbeg len '\000';
+      kbeg <- kbeg + len
+
+    method private keystream_wipe =
+      wipe_bytes ks;
+      kbeg <- 0;
+      kend <- 0
+  end
+
 (* Combining a transform and a hash to get an authenticated transform *)
 
 class transform_then_hash (tr: transform) (h: hash) =
@@ -791,6 +982,42 @@ class ctr ?iv:iv_init ?inc (cipher : block_cipher) =
       wipe_bytes out
   end
 
+class ctr_prefetch ?iv:iv_init ?inc (cipher : block_cipher) =
+  let blocksize = cipher#blocksize in
+  let nincr =
+    match inc with
+    | None -> blocksize
+    | Some n -> assert (n > 0 && n <= blocksize); n in
+  object(self)
+    inherit keystream_buffer
+    val iv = make_initial_iv blocksize iv_init
+    val mutable max_transf =
+      if nincr < 8 then Int64.(shift_left 1L (nincr * 8)) else 0L
+    method blocksize = blocksize
+    method prefetch n =
+      let avail = kend - kbeg in
+      if n > avail then begin
+        let nblocks = (n - avail + blocksize - 1) / blocksize in
+        self#keystream_reserve (nblocks * blocksize);
+        while kend - kbeg < n do
+          let m = Int64.pred max_transf in
+          if m = 0L then raise (Error Message_too_long);
+          max_transf <- m;
+          cipher#transform iv 0 ks kend;
+          increment_counter iv (blocksize - nincr) (blocksize - 1);
+          kend <- kend + blocksize
+        done
+      end
+    method transform src src_off dst dst_off =
+      if kend - kbeg < blocksize then self#prefetch blocksize;
+      Bytes.blit src src_off dst dst_off blocksize;
+      self#keystream_xor dst dst_off blocksize
+    method wipe =
+      cipher#wipe;
+      wipe_bytes iv;
+      self#keystream_wipe
+  end
+
 (* Wrapping of a block cipher as a transform *)
 
 class cipher (cipher : block_cipher) =
@@ -944,12 +1171,25 @@ class mac ?iv:iv_init ?(pad: Padding.scheme option) (cipher : block_cipher) =
     method add_byte b =
       self#add_char (Char.unsafe_chr b)
 
+    method reset =
+      begin match iv_init with
+        None -> Bytes.fill iv 0 blocksize '\000'
+      | Some s -> Bytes.blit_string s 0 iv 0 blocksize
+      end;
+      used <- 0
+
+    method copy = {< iv = Bytes.copy iv; buffer = Bytes.copy buffer >}
+
+    method serialize: string = invalid_arg "mac#serialize"
+
     method wipe =
       cipher#wipe;
       wipe_bytes buffer;
       wipe_bytes iv
 
-    method result =
+    method result_into dst ofs =
+      if ofs < 0 || ofs > Bytes.length dst - blocksize
+      then invalid_arg "mac#result_into";
       if used = blocksize then begin
         xor_bytes iv 0 buffer 0 blocksize;
         cipher#transform buffer 0 iv 0;
@@ -964,7 +1204,9 @@ class mac ?iv:iv_init ?(pad: Padding.scheme option) (cipher : block_cipher) =
           cipher#transform buffer 0 iv 0;
           used <- 0
       end;
-      Bytes.to_string iv
+      Bytes.blit iv 0 dst ofs blocksize
+
+    method result = hash_result self
   end
 
 class mac_final_triple ?iv ?pad (cipher1 : block_cipher)
@@ -975,11 +1217,10 @@ class mac_final_triple ?iv ?pad (cipher1 : block_cipher)
           then raise(Error Incompatible_block_size) in
   object
     inherit mac ?iv ?pad cipher1 as super
-    method result =
-      let r = Bytes.of_string super#result in
-      cipher2#transform r 0 r 0;
-      cipher3#transform r 0 r 0;
-      Bytes.unsafe_to_string r
+    method result_into dst ofs =
+      super#result_into dst ofs;
+      cipher2#transform dst ofs dst ofs;
+      cipher3#transform dst ofs dst ofs
     method wipe =
       super#wipe; cipher2#wipe; cipher3#wipe
   end
@@ -990,15 +1231,17 @@ class cmac ?iv:iv_init (cipher : block_cipher) k1 k2 =
   object (self)
     inherit mac ?iv:iv_init cipher as super
 
-    method result =
+    method result_into dst ofs =
       let blocksize = cipher#blocksize in
+      if ofs < 0 || ofs > Bytes.length dst - blocksize
+      then invalid_arg "cmac#result_into";
       let k' =
         if used = blocksize then k1 else (Padding._8000#pad buffer used; k2) in
       xor_bytes iv 0 buffer 0 blocksize;
       xor_bytes k' 0 buffer 0 blocksize;
       cipher#transform buffer 0 iv 0;
       used <- 0; (* really useful? *)
-      Bytes.to_string iv
+      Bytes.blit iv 0 dst ofs blocksize
 
     method wipe =
       super#wipe;
@@ -1033,20 +1276,22 @@ class arcfour key =
       wipe_bytes ckey
   end
 
+let chacha20_key iv ctr key =
+  if not (String.length key = 16 || String.length key = 32)
+  then raise (Error Wrong_key_size);
+  let iv =
+    match iv with
+    | None -> Bytes.make 8 '\000'
+    | Some s ->
+        if String.length s = 8
+        || String.length s = 12 && ctr < 0x1_000_000L
+        then Bytes.of_string s
+        else raise (Error Wrong_IV_size) in
+  chacha20_cook_key key iv ctr
+
 class chacha20 ?iv ?(ctr = 0L) key =
   object
-    val ckey =
-      if not (String.length key = 16 || String.length key = 32)
-      then raise (Error Wrong_key_size);
-      let iv =
-        match iv with
-        | None -> Bytes.make 8 '\000'
-        | Some s ->
-            if String.length s = 8
-            || String.length s = 12 && ctr < 0x1_000_000L
-            then Bytes.of_string s
-            else raise (Error Wrong_IV_size) in
-      chacha20_cook_key key iv ctr
+    val ckey = chacha20_key iv ctr key
     method transform src src_ofs dst dst_ofs len =
       if len < 0
       || src_ofs < 0 || src_ofs > Bytes.length src - len
@@ -1057,6 +1302,30 @@ class chacha20 ?iv ?(ctr = 0L) key =
       wipe_bytes ckey
   end
 
+class chacha20_prefetch ?iv ?(ctr = 0L) key =
+  object(self)
+    inherit keystream_buffer
+    val ckey = chacha20_key iv ctr key
+    method prefetch n =
+      let avail = kend - kbeg in
+      if n > avail then begin
+        self#keystream_reserve (n - avail);
+        chacha20_extract ckey ks kend (n - avail);
+        kend <- kend + (n - avail)
+      end
+    method transform src src_ofs dst dst_ofs len =
+      if len < 0
+      || src_ofs < 0 || src_ofs > Bytes.length src - len
+      || dst_ofs < 0 || dst_ofs > Bytes.length dst - len
+      then invalid_arg "chacha20_prefetch#transform";
+      if kend - kbeg < len then self#prefetch len;
+      Bytes.blit src src_ofs dst dst_ofs len;
+      self#keystream_xor dst dst_ofs len
+    method wipe =
+      wipe_bytes ckey;
+      self#keystream_wipe
+  end
+
 (* Wrapping of a stream cipher as a cipher *)
 
 class cipher (cipher : stream_cipher) =
@@ -1099,6 +1368,22 @@ end
 
 module Hash = struct
 
+(* Serialized states: a format version, the platform (the contexts are
+   C structures, whose layout depends on the word size and endianness),
+   the algorithm tag, and the context itself. *)
+
+let state_version = 1
+let state_platform = Sys.word_size + (if Sys.big_endian then 1 else 0)
+
+let serialize_state tag ctx =
+  let b = Buffer.create (3 + String.length tag + String.length ctx) in
+  Buffer.add_char b (Char.chr state_version);
+  Buffer.add_char b (Char.chr state_platform);
+  Buffer.add_char b (Char.chr (String.length tag));
+  Buffer.add_string b tag;
+  Buffer.add_string b ctx;
+  Buffer.contents b
+
 class sha1 =
   object(self)
     val context = sha1_init()
@@ -1110,11 +1395,18 @@ class sha1 =
     method add_string src =
       sha1_update context (Bytes.unsafe_of_string src) 0 (String.length src)
     method add_char c =
-      self#add_string (String.make 1 c)
+      sha1_add_byte context (Char.code c)
     method add_byte b =
-      self#add_char (Char.unsafe_chr b)
-    method result =
-      sha1_final context
+      sha1_add_byte context b
+    method result_into dst ofs =
+      if ofs < 0 || ofs > Bytes.length dst - 20
+      then invalid_arg "sha1#result_into";
+      sha1_final context dst ofs
+    method result = hash_result self
+    method reset = sha1_reset context
+    method copy = {< context = Bytes.copy context >}
+    method serialize =
+      serialize_state "sha1" (Bytes.unsafe_to_string context)
     method wipe =
       wipe_bytes context
   end
@@ -1124,7 +1416,7 @@ let sha1 () = new sha1
 class sha224 =
   object(self)
     val context = sha224_init()
-    method hash_size = 24
+    method hash_size = 28
     method add_substring src ofs len =
       if ofs < 0 || len < 0 || ofs > Bytes.length src - len
       then invalid_arg "sha224#add_substring";
@@ -1132,11 +1424,18 @@ class sha224 =
     method add_string src =
       sha256_update context (Bytes.unsafe_of_string src) 0 (String.length src)
     method add_char c =
-      self#add_string (String.make 1 c)
+      sha256_add_byte context (Char.code c)
     method add_byte b =
-      self#add_char (Char.unsafe_chr b)
-    method result =
-      sha224_final context
+      sha256_add_byte context b
+    method result_into dst ofs =
+      if ofs < 0 || ofs > Bytes.length dst - 28
+      then invalid_arg "sha224#result_into";
+      sha256_final context 224 dst ofs
+    method result = hash_result self
+    method reset = sha256_reset context 224
+    method copy = {< context = Bytes.copy context >}
+    method serialize =
+      serialize_state "sha224" (Bytes.unsafe_to_string context)
     method wipe =
       wipe_bytes context
   end
@@ -1154,11 +1453,18 @@ class sha256 =
     method add_string src =
       sha256_update context (Bytes.unsafe_of_string src) 0 (String.length src)
     method add_char c =
-      self#add_string (String.make 1 c)
+      sha256_add_byte context (Char.code c)
     method add_byte b =
-      self#add_char (Char.unsafe_chr b)
-    method result =
-      sha256_final context
+      sha256_add_byte context b
+    method result_into dst ofs =
+      if ofs < 0 || ofs > Bytes.length dst - 32
+      then invalid_arg "sha256#result_into";
+      sha256_final context 256 dst ofs
+    method result = hash_result self
+    method reset = sha256_reset context 256
+    method copy = {< context = Bytes.copy context >}
+    method serialize =
+      serialize_state "sha256" (Bytes.unsafe_to_string context)
     method wipe =
       wipe_bytes context
   end
@@ -1176,11 +1482,18 @@ class sha384 =
     method add_string src =
       sha512_update context (Bytes.unsafe_of_string src) 0 (String.length src)
     method add_char c =
-      self#add_string (String.make 1 c)
+      sha512_add_byte context (Char.code c)
     method add_byte b =
-      self#add_char (Char.unsafe_chr b)
-    method result =
-      sha384_final context
+      sha512_add_byte context b
+    method result_into dst ofs =
+      if ofs < 0 || ofs > Bytes.length dst - 48
+      then invalid_arg "sha384#result_into";
+      sha512_final context 384 dst ofs
+    method result = hash_result self
+    method reset = sha512_reset context 384
+    method copy = {< context = Bytes.copy context >}
+    method serialize =
+      serialize_state "sha384" (Bytes.unsafe_to_string context)
     method wipe =
       wipe_bytes context
   end
@@ -1198,11 +1511,18 @@ class sha512 =
     method add_string src =
       sha512_update context (Bytes.unsafe_of_string src) 0 (String.length src)
     method add_char c =
-      self#add_string (String.make 1 c)
+      sha512_add_byte context (Char.code c)
     method add_byte b =
-      self#add_char (Char.unsafe_chr b)
-    method result =
-      sha512_final context
+      sha512_add_byte context b
+    method result_into dst ofs =
+      if ofs < 0 || ofs > Bytes.length dst - 64
+      then invalid_arg "sha512#result_into";
+      sha512_final context 512 dst ofs
+    method result = hash_result self
+    method reset = sha512_reset context 512
+    method copy = {< context = Bytes.copy context >}
+    method serialize =
+      serialize_state "sha512" (Bytes.unsafe_to_string context)
     method wipe =
       wipe_bytes context
   end
@@ -1220,11 +1540,18 @@ class sha512_256 =
     method add_string src =
       sha512_update context (Bytes.unsafe_of_string src) 0 (String.length src)
     method add_char c =
-      self#add_string (String.make 1 c)
+      sha512_add_byte context (Char.code c)
     method add_byte b =
-      self#add_char (Char.unsafe_chr b)
-    method result =
-      sha512_256_final context
+      sha512_add_byte context b
+    method result_into dst ofs =
+      if ofs < 0 || ofs > Bytes.length dst - 32
+      then invalid_arg "sha512_256#result_into";
+      sha512_final context 256 dst ofs
+    method result = hash_result self
+    method reset = sha512_reset context 256
+    method copy = {< context = Bytes.copy context >}
+    method serialize =
+      serialize_state "sha512_256" (Bytes.unsafe_to_string context)
     method wipe =
       wipe_bytes context
   end
@@ -1242,11 +1569,18 @@ class sha512_224 =
     method add_string src =
       sha512_update context (Bytes.unsafe_of_string src) 0 (String.length src)
     method add_char c =
-      self#add_string (String.make 1 c)
+      sha512_add_byte context (Char.code c)
     method add_byte b =
-      self#add_char (Char.unsafe_chr b)
-    method result =
-      sha512_224_final context
+      sha512_add_byte context b
+    method result_into dst ofs =
+      if ofs < 0 || ofs > Bytes.length dst - 28
+      then invalid_arg "sha512_224#result_into";
+      sha512_final context 224 dst ofs
+    method result = hash_result self
+    method reset = sha512_reset context 224
+    method copy = {< context = Bytes.copy context >}
+    method serialize =
+      serialize_state "sha512_224" (Bytes.unsafe_to_string context)
     method wipe =
       wipe_bytes context
   end
@@ -1275,10 +1609,21 @@ class sha3 sz official =
     method add_string src =
       sha3_absorb context (Bytes.unsafe_of_string src) 0 (String.length src)
     method add_char c =
-      self#add_string (String.make 1 c)
+      sha3_add_byte context (Char.code c)
     method add_byte b =
-      self#add_char (Char.unsafe_chr b)
-    method result = sha3_extract official context
+      sha3_add_byte context b
+    method result_into dst ofs =
+      if ofs < 0 || ofs > Bytes.length dst - sz / 8
+      then invalid_arg ((if official then "sha3" else "keccak")^"#result_into");
+      sha3_extract official context dst ofs
+    method result = hash_result self
+    method reset = sha3_reset context
+    method copy = {< context = sha3_copy context >}
+    method serialize =
+      let st = sha3_save context in
+      if st = "" then invalid_arg ((if official then "sha3" else "keccak")^"#serialize");
+      serialize_state
+        ((if official then "sha3-" else "keccak-") ^ string_of_int sz) st
     method wipe =
       sha3_wipe context
   end
@@ -1287,10 +1632,152 @@ let sha3 sz = new sha3 sz true
 
 let keccak sz = new sha3 sz false
 
+(* The encodings of NIST SP 800-185, used by cSHAKE and KMAC *)
+
+let encode_int n =
+  let rec enc n = if n = 0 then "" else enc (n lsr 8) ^ String.make 1 (Char.chr (n land 0xFF)) in
+  if n = 0 then "\000" else enc n
+
+let left_encode n =
+  let s = encode_int n in String.make 1 (Char.chr (String.length s)) ^ s
+
+let right_encode n =
+  let s = encode_int n in s ^ String.make 1 (Char.chr (String.length s))
+
+let encode_string s = left_encode (8 * String.length s) ^ s
+
+let bytepad s w =
+  let s = left_encode w ^ s in
+  let r = String.length s mod w in
+  if r = 0 then s else s ^ String.make (w - r) '\000'
+
+(* SHAKE128 and SHAKE256, and the constructions built on them:
+   [prefix] is absorbed before the input, [suffix] after,
+   then the sponge is padded with [padding]. *)
+
+class keccak_xof name level prefix suffix padding =
+  object(self)
+    val context = shake_init level
+    val mutable squeezing = false
+    initializer
+      sha3_absorb context (Bytes.unsafe_of_string prefix) 0 (String.length prefix)
+    method add_substring src ofs len =
+      if ofs < 0 || len < 0 || ofs > Bytes.length src - len
+      then invalid_arg (name ^ "#add_substring");
+      sha3_absorb context src ofs len
+    method add_string src =
+      sha3_absorb context (Bytes.unsafe_of_string src) 0 (String.length src)
+    method add_char c =
+      sha3_add_byte context (Char.code c)
+    method add_byte b =
+      sha3_add_byte context b
+    method squeeze_into dst ofs len =
+      if ofs < 0 || len < 0 || ofs > Bytes.length dst - len
+      then invalid_arg (name ^ "#squeeze_into");
+      if not squeezing then begin
+        self#add_string suffix;
+        sha3_pad context padding;
+        squeezing <- true
+      end;
+      sha3_squeeze context dst ofs len
+    method squeeze len =
+      if len < 0 then invalid_arg (name ^ "#squeeze");
+      let res = Bytes.create len in
+      self#squeeze_into res 0 len;
+      Bytes.unsafe_to_string res
+    method reset =
+      sha3_reset context;
+      sha3_absorb context (Bytes.unsafe_of_string prefix) 0 (String.length prefix);
+      squeezing <- false
+    method copy = {< context = sha3_copy context >}
+    method wipe =
+      sha3_wipe context
+  end
+
+let shake_rate level = 200 - level / 4
+
+let shake128 () = new keccak_xof "shake128" 128 "" "" 0x1F
+let shake256 () = new keccak_xof "shake256" 256 "" "" 0x1F
+
+let cshake name level fname custom =
+  if fname = "" && custom = ""
+  then new keccak_xof name level "" "" 0x1F
+  else new keccak_xof name level
+             (bytepad (encode_string fname ^ encode_string custom)
+                      (shake_rate level))
+             "" 0x04
+
+let cshake128 ?(name = "") ?(custom = "") () =
+  cshake "cshake128" 128 name custom
+let cshake256 ?(name = "") ?(custom = "") () =
+  cshake "cshake256" 256 name custom
+
+class k12_xof name custom =
+  object(self)
+    val context = k12_init ()
+    val mutable squeezing = false
+    method add_substring src ofs len =
+      if ofs < 0 || len < 0 || ofs > Bytes.length src - len
+      then invalid_arg (name ^ "#add_substring");
+      k12_absorb context src ofs len
+    method add_string src =
+      k12_absorb context (Bytes.unsafe_of_string src) 0 (String.length src)
+    method add_char c =
+      k12_add_byte context (Char.code c)
+    method add_byte b =
+      k12_add_byte context b
+    method squeeze_into dst ofs len =
+      if ofs < 0 || len < 0 || ofs > Bytes.length dst - len
+      then invalid_arg (name ^ "#squeeze_into");
+      if not squeezing then begin
+        k12_pad context custom;
+        squeezing <- true
+      end;
+      k12_squeeze context dst ofs len
+    method squeeze len =
+      if len < 0 then invalid_arg (name ^ "#squeeze");
+      let res = Bytes.create len in
+      self#squeeze_into res 0 len;
+      Bytes.unsafe_to_string res
+    method reset =
+      k12_reset context;
+      squeezing <- false
+    method copy = {< context = Bytes.copy context >}
+    method wipe =
+      wipe_bytes context
+  end
+
+class k12 sz custom =
+  let _ = if not (sz > 0 && sz mod 8 = 0) then raise (Error Wrong_key_size) in
+  object(self)
+    inherit k12_xof "k12" custom
+    method hash_size = sz / 8
+    method result_into dst ofs =
+      if ofs < 0 || ofs > Bytes.length dst - sz / 8
+      then invalid_arg "k12#result_into";
+      self#squeeze_into dst ofs (sz / 8)
+    method result = hash_result self
+    method serialize: string = invalid_arg "k12#serialize"
+  end
+
+let k12 ?(custom = "") sz = (new k12 sz custom :> hash)
+let k12_xof ?(custom = "") () = new k12_xof "k12_xof" custom
+
+let k12_parallel ?(threads = 0) ?(custom = "") sz s =
+  if not (sz > 0 && sz mod 8 = 0) then raise (Error Wrong_key_size);
+  let context = k12_init () in
+  k12_absorb_parallel context (Bytes.unsafe_of_string s)
+                      0 (String.length s) threads;
+  k12_pad context custom;
+  let res = Bytes.create (sz / 8) in
+  k12_squeeze context res 0 (sz / 8);
+  wipe_bytes context;
+  Bytes.unsafe_to_string res
+
 class ripemd160 =
   object(self)
     val context = ripemd160_init()
-    method hash_size = 32
+    method hash_size = 20
     method add_substring src ofs len =
       if ofs < 0 || len < 0 || ofs > Bytes.length src - len
       then invalid_arg "ripemd160#add_substring";
@@ -1298,11 +1785,18 @@ class ripemd160 =
     method add_string src =
       ripemd160_update context (Bytes.unsafe_of_string src) 0 (String.length src)
     method add_char c =
-      self#add_string (String.make 1 c)
+      ripemd160_add_byte context (Char.code c)
     method add_byte b =
-      self#add_char (Char.unsafe_chr b)
-    method result =
-      ripemd160_final context
+      ripemd160_add_byte context b
+    method result_into dst ofs =
+      if ofs < 0 || ofs > Bytes.length dst - 20
+      then invalid_arg "ripemd160#result_into";
+      ripemd160_final context dst ofs
+    method result = hash_result self
+    method reset = ripemd160_reset context
+    method copy = {< context = Bytes.copy context >}
+    method serialize =
+      serialize_state "ripemd160" (Bytes.unsafe_to_string context)
     method wipe =
       wipe_bytes context
   end
@@ -1320,11 +1814,18 @@ class md5 =
     method add_string src =
       md5_update context (Bytes.unsafe_of_string src) 0 (String.length src)
     method add_char c =
-      self#add_string (String.make 1 c)
+      md5_add_byte context (Char.code c)
     method add_byte b =
-      self#add_char (Char.unsafe_chr b)
-    method result =
-      md5_final context
+      md5_add_byte context b
+    method result_into dst ofs =
+      if ofs < 0 || ofs > Bytes.length dst - 16
+      then invalid_arg "md5#result_into";
+      md5_final context dst ofs
+    method result = hash_result self
+    method reset = md5_reset context
+    method copy = {< context = Bytes.copy context >}
+    method serialize =
+      serialize_state "md5" (Bytes.unsafe_to_string context)
     method wipe =
       wipe_bytes context
   end
@@ -1337,6 +1838,7 @@ class blake2b sz key =
       if sz >= 8 && sz <= 512 && sz mod 8 = 0 && String.length key <= 64
       then blake2b_init (sz / 8) key
       else raise (Error Wrong_key_size)
+    val keyed = key <> ""
     method hash_size = sz / 8
     method add_substring src ofs len =
       if ofs < 0 || len < 0 || ofs > Bytes.length src - len
@@ -1345,10 +1847,25 @@ class blake2b sz key =
     method add_string src =
       blake2b_update context (Bytes.unsafe_of_string src) 0 (String.length src)
     method add_char c =
-      self#add_string (String.make 1 c)
+      blake2b_add_byte context (Char.code c)
     method add_byte b =
-      self#add_char (Char.unsafe_chr b)
-    method result = blake2b_final context (sz / 8)
+      blake2b_add_byte context b
+    method result_into dst ofs =
+      if ofs < 0 || ofs > Bytes.length dst - sz / 8
+      then invalid_arg "blake2b#result_into";
+      blake2b_final context (sz / 8) dst ofs
+    method result = hash_result self
+    (* A keyed state rebuilt by [deserialize] does not know its key *)
+    method reset =
+      if keyed && key = "" then invalid_arg "blake2b#reset";
+      blake2b_reset context (sz / 8) key
+    method copy = {< context = Bytes.copy context >}
+    method serialize =
+      if keyed && not (blake2b_key_absorbed context)
+      then invalid_arg "blake2b#serialize";
+      serialize_state
+        ((if keyed then "blake2b_keyed-" else "blake2b-") ^ string_of_int sz)
+        (blake2b_save context)
     method wipe =
       wipe_bytes context
   end
@@ -1362,6 +1879,7 @@ class blake2s sz key =
       if sz >= 8 && sz <= 256 && sz mod 8 = 0 && String.length key <= 32
       then blake2s_init (sz / 8) key
       else raise (Error Wrong_key_size)
+    val keyed = key <> ""
     method hash_size = sz / 8
     method add_substring src ofs len =
       if ofs < 0 || len < 0 || ofs > Bytes.length src - len
@@ -1370,10 +1888,25 @@ class blake2s sz key =
     method add_string src =
       blake2s_update context (Bytes.unsafe_of_string src) 0 (String.length src)
     method add_char c =
-      self#add_string (String.make 1 c)
+      blake2s_add_byte context (Char.code c)
     method add_byte b =
-      self#add_char (Char.unsafe_chr b)
-    method result = blake2s_final context (sz / 8)
+      blake2s_add_byte context b
+    method result_into dst ofs =
+      if ofs < 0 || ofs > Bytes.length dst - sz / 8
+      then invalid_arg "blake2s#result_into";
+      blake2s_final context (sz / 8) dst ofs
+    method result = hash_result self
+    (* A keyed state rebuilt by [deserialize] does not know its key *)
+    method reset =
+      if keyed && key = "" then invalid_arg "blake2s#reset";
+      blake2s_reset context (sz / 8) key
+    method copy = {< context = Bytes.copy context >}
+    method serialize =
+      if keyed && not (blake2s_key_absorbed context)
+      then invalid_arg "blake2s#serialize";
+      serialize_state
+        ((if keyed then "blake2s_keyed-" else "blake2s-") ^ string_of_int sz)
+        (blake2s_save context)
     method wipe =
       wipe_bytes context
   end
@@ -1381,6 +1914,131 @@ class blake2s sz key =
 let blake2s sz = new blake2s sz ""
 let blake2s256 () = new blake2s 256 ""
 
+class blake2bp sz key =
+  object(self)
+    val context =
+      if sz >= 8 && sz <= 512 && sz mod 8 = 0 && String.length key <= 64
+      then blake2bp_init (sz / 8) key
+      else raise (Error Wrong_key_size)
+    method hash_size = sz / 8
+    method add_substring src ofs len =
+      if ofs < 0 || len < 0 || ofs > Bytes.length src - len
+      then invalid_arg "blake2bp#add_substring";
+      blake2bp_update context src ofs len
+    method add_string src =
+      blake2bp_update context (Bytes.unsafe_of_string src) 0 (String.length src)
+    method add_char c =
+      blake2bp_add_byte context (Char.code c)
+    method add_byte b =
+      blake2bp_add_byte context b
+    method result_into dst ofs =
+      if ofs < 0 || ofs > Bytes.length dst - sz / 8
+      then invalid_arg "blake2bp#result_into";
+      blake2bp_final context (sz / 8) dst ofs
+    method result = hash_result self
+    method reset = blake2bp_reset context (sz / 8) key
+    method copy = {< context = Bytes.copy context >}
+    method serialize: string = invalid_arg "blake2bp#serialize"
+    method wipe =
+      wipe_bytes context
+  end
+
+let blake2bp sz = new blake2bp sz ""
+
+class blake2sp sz key =
+  object(self)
+    val context =
+      if sz >= 8 && sz <= 256 && sz mod 8 = 0 && String.length key <= 32
+      then blake2sp_init (sz / 8) key
+      else raise (Error Wrong_key_size)
+    method hash_size = sz / 8
+    method add_substring src ofs len =
+      if ofs < 0 || len < 0 || ofs > Bytes.length src - len
+      then invalid_arg "blake2sp#add_substring";
+      blake2sp_update context src ofs len
+    method add_string src =
+      blake2sp_update context (Bytes.unsafe_of_string src) 0 (String.length src)
+    method add_char c =
+      blake2sp_add_byte context (Char.code c)
+    method add_byte b =
+      blake2sp_add_byte context b
+    method result_into dst ofs =
+      if ofs < 0 || ofs > Bytes.length dst - sz / 8
+      then invalid_arg "blake2sp#result_into";
+      blake2sp_final context (sz / 8) dst ofs
+    method result = hash_result self
+    method reset = blake2sp_reset context (sz / 8) key
+    method copy = {< context = Bytes.copy context >}
+    method serialize: string = invalid_arg "blake2sp#serialize"
+    method wipe =
+      wipe_bytes context
+  end
+
+let blake2sp sz = new blake2sp sz ""
+
+class blake2xb sz key =
+  object(self)
+    val context =
+      if sz >= 8 && sz mod 8 = 0
+      && Int64.of_int (sz / 8) < 0xFFFF_FFFFL && String.length key <= 64
+      then blake2xb_init (sz / 8) key
+      else raise (Error Wrong_key_size)
+    method hash_size = sz / 8
+    method add_substring src ofs len =
+      if ofs < 0 || len < 0 || ofs > Bytes.length src - len
+      then invalid_arg "blake2xb#add_substring";
+      blake2b_update context src ofs len
+    method add_string src =
+      blake2b_update context (Bytes.unsafe_of_string src) 0 (String.length src)
+    method add_char c =
+      blake2b_add_byte context (Char.code c)
+    method add_byte b =
+      blake2b_add_byte context b
+    method result_into dst ofs =
+      if ofs < 0 || ofs > Bytes.length dst - sz / 8
+      then invalid_arg "blake2xb#result_into";
+      blake2xb_final context (sz / 8) dst ofs
+    method result = hash_result self
+    method reset = blake2xb_reset context (sz / 8) key
+    method copy = {< context = Bytes.copy context >}
+    method serialize: string = invalid_arg "blake2xb#serialize"
+    method wipe =
+      wipe_bytes context
+  end
+
+let blake2xb sz = new blake2xb sz ""
+
+class blake2xs sz key =
+  object(self)
+    val context =
+      if sz >= 8 && sz mod 8 = 0 && sz / 8 < 0xFFFF && String.length key <= 32
+      then blake2xs_init (sz / 8) key
+      else raise (Error Wrong_key_size)
+    method hash_size = sz / 8
+    method add_substring src ofs len =
+      if ofs < 0 || len < 0 || ofs > Bytes.length src - len
+      then invalid_arg "blake2xs#add_substring";
+      blake2s_update context src ofs len
+    method add_string src =
+      blake2s_update context (Bytes.unsafe_of_string src) 0 (String.length src)
+    method add_char c =
+      blake2s_add_byte context (Char.code c)
+    method add_byte b =
+      blake2s_add_byte context b
+    method result_into dst ofs =
+      if ofs < 0 || ofs > Bytes.length dst - sz / 8
+      then invalid_arg "blake2xs#result_into";
+      blake2xs_final context (sz / 8) dst ofs
+    method result = hash_result self
+    method reset = blake2xs_reset context (sz / 8) key
+    method copy = {< context = Bytes.copy context >}
+    method serialize: string = invalid_arg "blake2xs#serialize"
+    method wipe =
+      wipe_bytes context
+  end
+
+let blake2xs sz = new blake2xs sz ""
+
 class blake3 key sz =
   object(self)
     val context =
@@ -1396,16 +2054,268 @@ class blake3 key sz =
     method add_string src =
       blake3_update context (Bytes.unsafe_of_string src) 0 (String.length src)
     method add_char c =
-      self#add_string (String.make 1 c)
+      blake3_add_byte context (Char.code c)
     method add_byte b =
-      self#add_char (Char.unsafe_chr b)
-    method result = blake3_final context (sz / 8)
+      blake3_add_byte context b
+    method result_into dst ofs =
+      if ofs < 0 || ofs > Bytes.length dst - sz / 8
+      then invalid_arg "blake3#result_into";
+      blake3_extract_seek context 0L dst ofs (sz / 8)
+    method result = hash_result self
+    method reset = blake3_reset context
+    method copy = {< context = blake3_copy context >}
+    method serialize =
+      let st = blake3_save context in
+      if st = "" then invalid_arg "blake3#serialize";
+      serialize_state ("blake3-" ^ string_of_int sz) st
     method wipe = blake3_wipe context
   end
 
 let blake3 sz = new blake3 "" sz
 let blake3_256 () = new blake3 "" 256
 
+class blake3_xof key =
+  object(self)
+    val context =
+      if String.length key = 0 || String.length key = 32
+      then blake3_init key
+      else raise (Error Wrong_key_size)
+    val mutable pos = 0L
+    method add_substring src ofs len =
+      if ofs < 0 || len < 0 || ofs > Bytes.length src - len
+      then invalid_arg "blake3_xof#add_substring";
+      blake3_update context src ofs len
+    method add_string src =
+      blake3_update context (Bytes.unsafe_of_string src) 0 (String.length src)
+    method add_char c =
+      blake3_add_byte context (Char.code c)
+    method add_byte b =
+      blake3_add_byte context b
+    method squeeze_into dst ofs len =
+      if ofs < 0 || len < 0 || ofs > Bytes.length dst - len
+      then invalid_arg "blake3_xof#squeeze_into";
+      blake3_extract_seek context pos dst ofs len;
+      pos <- Int64.add pos (Int64.of_int len)
+    method squeeze len =
+      if len < 0 then invalid_arg "blake3_xof#squeeze";
+      let res = Bytes.create len in
+      self#squeeze_into res 0 len;
+      Bytes.unsafe_to_string res
+    method seek p =
+      if p < 0L then invalid_arg "blake3_xof#seek";
+      pos <- p
+    method position = pos
+    method reset =
+      blake3_reset context;
+      pos <- 0L
+    method copy = {< context = blake3_copy context >}
+    method wipe = blake3_wipe context
+  end
+
+let blake3_xof ?(key = "") () = new blake3_xof key
+
+let deserialize st =
+  let n = String.length st in
+  if n < 3
+  || Char.code st.[0] <> state_version
+  || Char.code st.[1] <> state_platform
+  || n < 3 + Char.code st.[2]
+  then raise (Error Bad_encoding);
+  let tag = String.sub st 3 (Char.code st.[2]) in
+  let ctx = String.sub st (3 + String.length tag) (n - 3 - String.length tag) in
+  let (name, sz) =
+    match String.index_opt tag '-' with
+    | None -> (tag, 0)
+    | Some i ->
+        match int_of_string_opt
+                (String.sub tag (i + 1) (String.length tag - i - 1)) with
+        | Some sz when sz > 0 && sz mod 8 = 0 -> (String.sub tag 0 i, sz)
+        | _ -> raise (Error Bad_encoding) in
+  let check valid = if not (valid ctx) then raise (Error Bad_encoding) in
+  let bytes_context valid = check valid; Bytes.of_string ctx in
+  match name, sz with
+  | "sha1", 0 ->
+      let c = bytes_context sha1_valid_state in
+      (object inherit sha1 val! context = c end :> hash)
+  | "sha224", 0 ->
+      let c = bytes_context sha256_valid_state in
+      (object inherit sha224 val! context = c end :> hash)
+  | "sha256", 0 ->
+      let c = bytes_context sha256_valid_state in
+      (object inherit sha256 val! context = c end :> hash)
+  | "sha384", 0 ->
+      let c = bytes_context sha512_valid_state in
+      (object inherit sha384 val! context = c end :> hash)
+  | "sha512", 0 ->
+      let c = bytes_context sha512_valid_state in
+      (object inherit sha512 val! context = c end :> hash)
+  | "sha512_256", 0 ->
+      let c = bytes_context sha512_valid_state in
+      (object inherit sha512_256 val! context = c end :> hash)
+  | "sha512_224", 0 ->
+      let c = bytes_context sha512_valid_state in
+      (object inherit sha512_224 val! context = c end :> hash)
+  | "ripemd160", 0 ->
+      let c = bytes_context ripemd160_valid_state in
+      (object inherit ripemd160 val! context = c end :> hash)
+  | "md5", 0 ->
+      let c = bytes_context md5_valid_state in
+      (object inherit md5 val! context = c end :> hash)
+  | ("sha3" | "keccak"), (224 | 256 | 384 | 512) ->
+      check (fun ctx -> sha3_valid_state ctx sz);
+      let c = sha3_restore ctx in
+      (object inherit sha3 sz (name = "sha3") val! context = c end :> hash)
+  | ("blake2b" | "blake2b_keyed"), _ when sz > 0 && sz <= 512 ->
+      let c = bytes_context blake2b_valid_state
+      and k = name = "blake2b_keyed" in
+      (object inherit blake2b sz "" val! context = c val! keyed = k end
+       :> hash)
+  | ("blake2s" | "blake2s_keyed"), _ when sz > 0 && sz <= 256 ->
+      let c = bytes_context blake2s_valid_state
+      and k = name = "blake2s_keyed" in
+      (object inherit blake2s sz "" val! context = c val! keyed = k end
+       :> hash)
+  | "blake3", _ when sz > 0 ->
+      check blake3_valid_state;
+      let c = blake3_restore ctx in
+      (object inherit blake3 "" sz val! context = c end :> hash)
+  | _ -> raise (Error Bad_encoding)
+
+let blake3_oneshot key sz update =
+  if not (sz > 0 && sz mod 8 = 0
+          && (String.length key = 0 || String.length key = 32))
+  then raise (Error Wrong_key_size);
+  let context = blake3_init key in
+  update context;
+  let res = blake3_final context (sz / 8) in
+  blake3_wipe context;
+  res
+
+let blake3_parallel ?(threads = 0) ?(key = "") sz s =
+  blake3_oneshot key sz (fun context ->
+    blake3_update_parallel context (Bytes.unsafe_of_string s)
+                           0 (String.length s) threads)
+
+let blake3_parallel_bigarray ?(threads = 0) ?(key = "") sz ba =
+  blake3_oneshot key sz (fun context ->
+    blake3_update_bigarray context ba 0 (Bigarray.Array1.dim ba) threads)
+
+let blake3_file ?(threads = 0) ?(key = "") sz filename =
+  blake3_oneshot key sz (fun context ->
+    blake3_update_file context filename threads)
+
+let hash_many hash_size hash msgs =
+  let n = Array.length msgs in
+  let res = Bytes.create (n * hash_size) in
+  hash msgs res 0;
+  Array.init n (fun i -> Bytes.sub_string res (i * hash_size) hash_size)
+
+let check_many name hash_size msgs dst ofs =
+  if ofs < 0 || ofs > Bytes.length dst - Array.length msgs * hash_size
+  then invalid_arg name
+
+type algo =
+  | SHA1 | SHA224 | SHA256 | SHA384 | SHA512 | SHA512_256 | SHA512_224
+  | RIPEMD160 | MD5
+  | SHA3 of int | Keccak of int | K12 of int * string
+  | BLAKE2b of int | BLAKE2s of int | BLAKE2bp of int | BLAKE2sp of int
+  | BLAKE2Xb of int | BLAKE2Xs of int | BLAKE3 of int
+
+let digest_size = function
+  | SHA1 | RIPEMD160 -> 20
+  | SHA224 | SHA512_224 -> 28
+  | SHA256 | SHA512_256 -> 32
+  | SHA384 -> 48
+  | SHA512 -> 64
+  | MD5 -> 16
+  | SHA3 sz | Keccak sz ->
+      if sz = 224 || sz = 256 || sz = 384 || sz = 512
+      then sz / 8
+      else raise (Error Wrong_key_size)
+  | BLAKE2b sz | BLAKE2bp sz ->
+      if sz >= 8 && sz <= 512 && sz mod 8 = 0
+      then sz / 8
+      else raise (Error Wrong_key_size)
+  | BLAKE2s sz | BLAKE2sp sz ->
+      if sz >= 8 && sz <= 256 && sz mod 8 = 0
+      then sz / 8
+      else raise (Error Wrong_key_size)
+  | BLAKE2Xb sz ->
+      if sz >= 8 && sz mod 8 = 0 && Int64.of_int (sz / 8) < 0xFFFF_FFFFL
+      then sz / 8
+      else raise (Error Wrong_key_size)
+  | BLAKE2Xs sz ->
+      if sz >= 8 && sz mod 8 = 0 && sz / 8 < 0xFFFF
+      then sz / 8
+      else raise (Error Wrong_key_size)
+  | BLAKE3 sz | K12 (sz, _) ->
+      if sz > 0 && sz mod 8 = 0
+      then sz / 8
+      else raise (Error Wrong_key_size)
+
+let digest_many_into algo msgs dst ofs =
+  check_many "Hash.digest_many_into" (digest_size algo) msgs dst ofs;
+  match algo with
+  | SHA1 -> sha1_many msgs dst ofs
+  | SHA224 -> sha256_many 224 msgs dst ofs
+  | SHA256 -> sha256_many 256 msgs dst ofs
+  | SHA384 -> sha512_many 384 msgs dst ofs
+  | SHA512 -> sha512_many 512 msgs dst ofs
+  | SHA512_256 -> sha512_many 256 msgs dst ofs
+  | SHA512_224 -> sha512_many 224 msgs dst ofs
+  | RIPEMD160 -> ripemd160_many msgs dst ofs
+  | MD5 -> md5_many msgs dst ofs
+  | SHA3 sz -> sha3_many sz true msgs dst ofs
+  | Keccak sz -> sha3_many sz false msgs dst ofs
+  | K12 (sz, custom) -> k12_many custom (sz / 8) msgs dst ofs
+  | BLAKE2b sz -> blake2b_many (sz / 8) "" msgs dst ofs
+  | BLAKE2s sz -> blake2s_many (sz / 8) "" msgs dst ofs
+  | BLAKE2bp sz -> blake2bp_many (sz / 8) "" msgs dst ofs
+  | BLAKE2sp sz -> blake2sp_many (sz / 8) "" msgs dst ofs
+  | BLAKE2Xb sz -> blake2xb_many (sz / 8) "" msgs dst ofs
+  | BLAKE2Xs sz -> blake2xs_many (sz / 8) "" msgs dst ofs
+  | BLAKE3 sz -> blake3_many "" (sz / 8) msgs dst ofs
+
+let digest_many algo msgs =
+  hash_many (digest_size algo) (digest_many_into algo) msgs
+
+let sha1_many msgs = digest_many SHA1 msgs
+let sha224_many msgs = digest_many SHA224 msgs
+let sha256_many msgs = digest_many SHA256 msgs
+let ripemd160_many msgs = digest_many RIPEMD160 msgs
+let md5_many msgs = digest_many MD5 msgs
+let sha3_many sz msgs = digest_many (SHA3 sz) msgs
+let keccak_many sz msgs = digest_many (Keccak sz) msgs
+
+let two_to_one name f s =
+  let n = String.length s in
+  if n mod 64 <> 0 then invalid_arg name;
+  let res = Bytes.create (n / 2) in
+  f s res;
+  Bytes.unsafe_to_string res
+
+let sha256_64to32_level s =
+  two_to_one "Hash.sha256_64to32_level" sha256_64to32 s
+let sha256d_64to32_level s =
+  two_to_one "Hash.sha256d_64to32_level" sha256d_64to32 s
+let blake2s_64to32_level s =
+  two_to_one "Hash.blake2s_64to32_level" blake2s_64to32 s
+let blake3_parent_level s =
+  two_to_one "Hash.blake3_parent_level" bao_parents_cv s
+
+let sha256_64to32 s =
+  if String.length s <> 64 then invalid_arg "Hash.sha256_64to32";
+  sha256_64to32_level s
+let blake2s_64to32 s =
+  if String.length s <> 64 then invalid_arg "Hash.blake2s_64to32";
+  blake2s_64to32_level s
+let blake3_parent ?(root = false) s =
+  if String.length s <> 64 then invalid_arg "Hash.blake3_parent";
+  bao_parent_cv (Bytes.unsafe_of_string s) 0 root
+
+let sha256d s = sha256_oneshot s true
+let hash160 s = ripemd160_32to20 (sha256_oneshot s false)
+
 end
 
 (* High-level entry points for ciphers *)
@@ -1475,34 +2385,96 @@ let chacha20 ?iv ?ctr key dir =
 
 end
 
-(* The hmac construction *)
-
-module HMAC(H: sig class h: hash  val blocksize: int end) =
+(* The hmac construction.  The contexts obtained after hashing the
+   key XOR-ed with the inner and outer pads are computed once per key;
+   each MAC computation starts from a copy of them. *)
+
+module HMAC(H: sig
+              val blocksize: int
+              val hash_size: int
+              val init: unit -> bytes
+              val update: bytes -> bytes -> int -> int -> unit
+              val add_byte: bytes -> int -> unit
+              val final: bytes -> bytes -> int -> unit
+              val hmac_many: bytes -> string array -> bytes -> int -> unit
+            end) =
   struct
-    let hmac_pad key byte =
-      let key =
-        if String.length key > H.blocksize
-        then hash_string (new H.h) key
-        else key in
-      let r = Bytes.make H.blocksize (Char.chr byte) in
-      xor_string key 0 r 0 (String.length key);
-      r
-    class hmac key =
-      object(self)
-        inherit H.h as super
-        initializer
-          (let b = hmac_pad key 0x36 in
-           self#add_substring b 0 (Bytes.length b);
-           wipe_bytes b)
-        method result =
-          let h' = new H.h in
-          let b = hmac_pad key 0x5C in
-          h'#add_substring b 0 (Bytes.length b);
-          wipe_bytes b;
-          h'#add_string (super#result);
-          let r = h'#result in
-          h'#wipe;
+    (* The inner context followed by the outer context *)
+    type key = bytes
+
+    let hash_size = H.hash_size
+    let hmac_many = H.hmac_many
+
+    let prepare key =
+      let k =
+        if String.length key > H.blocksize then begin
+          let c = H.init () in
+          H.update c (Bytes.unsafe_of_string key) 0 (String.length key);
+          let r = Bytes.create H.hash_size in
+          H.final c r 0;
+          wipe_bytes c;
           r
+        end else Bytes.of_string key in
+      let pad byte =
+        let r = Bytes.make H.blocksize (Char.chr byte) in
+        xor_bytes k 0 r 0 (Bytes.length k);
+        let c = H.init () in
+        H.update c r 0 H.blocksize;
+        wipe_bytes r;
+        c in
+      let ipad = pad 0x36 and opad = pad 0x5C in
+      let res = Bytes.cat ipad opad in
+      wipe_bytes k; wipe_bytes ipad; wipe_bytes opad;
+      res
+
+    let wipe_key k = wipe_bytes k
+
+    class hmac_of_key k =
+      object(self)
+        val prepared = k
+        val context = Bytes.sub k 0 (Bytes.length k / 2)
+        val inner = Bytes.create H.hash_size
+        method hash_size = H.hash_size
+        method add_substring src ofs len =
+          if ofs < 0 || len < 0 || ofs > Bytes.length src - len
+          then invalid_arg "hmac#add_substring";
+          H.update context src ofs len
+        method add_string src =
+          H.update context (Bytes.unsafe_of_string src) 0 (String.length src)
+        method add_char c =
+          H.add_byte context (Char.code c)
+        method add_byte b =
+          H.add_byte context b
+        method result_into dst ofs =
+          if ofs < 0 || ofs > Bytes.length dst - H.hash_size
+          then invalid_arg "hmac#result_into";
+          H.final context inner 0;
+          Bytes.blit prepared (Bytes.length context)
+                     context 0 (Bytes.length context);
+          H.update context inner 0 H.hash_size;
+          wipe_bytes inner;
+          H.final context dst ofs
+        method result = hash_result self
+        method reset =
+          Bytes.blit prepared 0 context 0 (Bytes.length context)
+        method copy =
+          {< context = Bytes.copy context; inner = Bytes.create H.hash_size >}
+        method serialize: string = invalid_arg "hmac#serialize"
+        method wipe =
+          wipe_bytes context
+      end
+
+    (* The prepared key belongs to the object, and is wiped with it.
+       Each copy gets its own. *)
+
+    class hmac key =
+      object
+        inherit hmac_of_key (prepare key) as super
+        method! copy =
+          {< context = Bytes.copy context; inner = Bytes.create H.hash_size;
+             prepared = Bytes.copy prepared >}
+        method! wipe =
+          super#wipe; wipe_key prepared
       end
   end
 
@@ -1511,17 +2483,50 @@ module HMAC(H: sig class h: hash  val blocksize: int end) =
 module MAC = struct
 
 module HMAC_SHA1 =
-  HMAC(struct class h = Hash.sha1  let blocksize = 64 end)
+  HMAC(struct
+         let blocksize = 64  let hash_size = 20
+         let init = sha1_init  let update = sha1_update
+         let add_byte = sha1_add_byte  let final = sha1_final
+         let hmac_many = sha1_hmac_many
+       end)
 module HMAC_SHA256 =
-  HMAC(struct class h = Hash.sha256  let blocksize = 64 end)
+  HMAC(struct
+         let blocksize = 64  let hash_size = 32
+         let init = sha256_init  let update = sha256_update
+         let add_byte = sha256_add_byte
+         let final ctx dst ofs = sha256_final ctx 256 dst ofs
+         let hmac_many = sha256_hmac_many 256
+       end)
 module HMAC_SHA384 =
-  HMAC(struct class h = Hash.sha384  let blocksize = 128 end)
+  HMAC(struct
+         let blocksize = 128  let hash_size = 48
+         let init = sha384_init  let update = sha512_update
+         let add_byte = sha512_add_byte
+         let final ctx dst ofs = sha512_final ctx 384 dst ofs
+         let hmac_many = sha512_hmac_many 384
+       end)
 module HMAC_SHA512 =
-  HMAC(struct class h = Hash.sha512  let blocksize = 128 end)
-module HMAC_RIPEMD160 = 
-  HMAC(struct class h = Hash.ripemd160  let blocksize = 64 end)
+  HMAC(struct
+         let blocksize = 128  let hash_size = 64
+         let init = sha512_init  let update = sha512_update
+         let add_byte = sha512_add_byte
+         let final ctx dst ofs = sha512_final ctx 512 dst ofs
+         let hmac_many = sha512_hmac_many 512
+       end)
+module HMAC_RIPEMD160 =
+  HMAC(struct
+         let blocksize = 64  let hash_size = 20
+         let init = ripemd160_init  let update = ripemd160_update
+         let add_byte = ripemd160_add_byte  let final = ripemd160_final
+         let hmac_many = ripemd160_hmac_many
+       end)
 module HMAC_MD5 =
-  HMAC(struct class h = Hash.md5  let blocksize = 64 end)
+  HMAC(struct
+         let blocksize = 64  let hash_size = 16
+         let init = md5_init  let update = md5_update
+         let add_byte = md5_add_byte  let final = md5_final
+         let hmac_many = md5_hmac_many
+       end)
 
 let hmac_sha1 key = new HMAC_SHA1.hmac key
 let hmac_sha256 key = new HMAC_SHA256.hmac key
@@ -1530,12 +2535,84 @@ let hmac_sha512 key = new HMAC_SHA512.hmac key
 let hmac_ripemd160 key = new HMAC_RIPEMD160.hmac key
 let hmac_md5 key = new HMAC_MD5.hmac key
 
+type hmac_key =
+  | HMAC_SHA1_key of HMAC_SHA1.key
+  | HMAC_SHA256_key of HMAC_SHA256.key
+  | HMAC_SHA384_key of HMAC_SHA384.key
+  | HMAC_SHA512_key of HMAC_SHA512.key
+  | HMAC_RIPEMD160_key of HMAC_RIPEMD160.key
+  | HMAC_MD5_key of HMAC_MD5.key
+
+let hmac_sha1_key key = HMAC_SHA1_key (HMAC_SHA1.prepare key)
+let hmac_sha256_key key = HMAC_SHA256_key (HMAC_SHA256.prepare key)
+let hmac_sha384_key key = HMAC_SHA384_key (HMAC_SHA384.prepare key)
+let hmac_sha512_key key = HMAC_SHA512_key (HMAC_SHA512.prepare key)
+let hmac_ripemd160_key key = HMAC_RIPEMD160_key (HMAC_RIPEMD160.prepare key)
+let hmac_md5_key key = HMAC_MD5_key (HMAC_MD5.prepare key)
+
+let hmac_of_key = function
+  | HMAC_SHA1_key k -> (new HMAC_SHA1.hmac_of_key k :> hash)
+  | HMAC_SHA256_key k -> (new HMAC_SHA256.hmac_of_key k :> hash)
+  | HMAC_SHA384_key k -> (new HMAC_SHA384.hmac_of_key k :> hash)
+  | HMAC_SHA512_key k -> (new HMAC_SHA512.hmac_of_key k :> hash)
+  | HMAC_RIPEMD160_key k -> (new HMAC_RIPEMD160.hmac_of_key k :> hash)
+  | HMAC_MD5_key k -> (new HMAC_MD5.hmac_of_key k :> hash)
+
+let wipe_hmac_key = function
+  | HMAC_SHA1_key k -> HMAC_SHA1.wipe_key k
+  | HMAC_SHA256_key k -> HMAC_SHA256.wipe_key k
+  | HMAC_SHA384_key k -> HMAC_SHA384.wipe_key k
+  | HMAC_SHA512_key k -> HMAC_SHA512.wipe_key k
+  | HMAC_RIPEMD160_key k -> HMAC_RIPEMD160.wipe_key k
+  | HMAC_MD5_key k -> HMAC_MD5.wipe_key k
+
 let blake2b sz key = new Hash.blake2b sz key
 let blake2b512 key = new Hash.blake2b 512 key
 
 let blake2s sz key = new Hash.blake2s sz key
 let blake2s256 key = new Hash.blake2s 256 key
 
+let blake2bp sz key = new Hash.blake2bp sz key
+let blake2sp sz key = new Hash.blake2sp sz key
+
+let blake2xb sz key = new Hash.blake2xb sz key
+let blake2xs sz key = new Hash.blake2xs sz key
+
+(* KMAC (NIST SP 800-185) is cSHAKE with function name "KMAC",
+   the padded key prepended to the input, and the output length
+   in bits (0 for the XOF variant) appended to it. *)
+
+let kmac_prefix level custom key =
+  let rate = Hash.shake_rate level in
+  Hash.bytepad (Hash.encode_string "KMAC" ^ Hash.encode_string custom) rate
+  ^ Hash.bytepad (Hash.encode_string key) rate
+
+class kmac name level sz custom key =
+  let _ = if not (sz > 0 && sz mod 8 = 0) then raise (Error Wrong_key_size) in
+  object(self)
+    inherit Hash.keccak_xof name level
+              (kmac_prefix level custom key) (Hash.right_encode sz) 0x04
+    method hash_size = sz / 8
+    method result_into dst ofs =
+      if ofs < 0 || ofs > Bytes.length dst - sz / 8
+      then invalid_arg (name ^ "#result_into");
+      self#squeeze_into dst ofs (sz / 8)
+    method result = hash_result self
+    method serialize: string = invalid_arg (name ^ "#serialize")
+  end
+
+let kmac128 ?(custom = "") sz key =
+  (new kmac "kmac128" 128 sz custom key :> hash)
+let kmac256 ?(custom = "") sz key =
+  (new kmac "kmac256" 256 sz custom key :> hash)
+
+let kmac128_xof ?(custom = "") key =
+  (new Hash.keccak_xof "kmac128_xof" 128
+         (kmac_prefix 128 custom key) (Hash.right_encode 0) 0x04 :> xof)
+let kmac256_xof ?(custom = "") key =
+  (new Hash.keccak_xof "kmac256_xof" 256
+         (kmac_prefix 256 custom key) (Hash.right_encode 0) 0x04 :> xof)
+
 let blake3 sz key = new Hash.blake3 key sz
 let blake3_256 key = new Hash.blake3 key 256
 
@@ -1586,10 +2663,17 @@ class siphash sz key =
     method add_string src =
       siphash_update context (Bytes.unsafe_of_string src) 0 (String.length src)
     method add_char c =
-      self#add_string (String.make 1 c)
+      siphash_add_byte context (Char.code c)
     method add_byte b =
-      self#add_char (Char.unsafe_chr b)
-    method result = siphash_final context (sz / 8)
+      siphash_add_byte context b
+    method result_into dst ofs =
+      if ofs < 0 || ofs > Bytes.length dst - sz / 8
+      then invalid_arg "siphash#result_into";
+      siphash_final context (sz / 8) dst ofs
+    method result = hash_result self
+    method reset = siphash_reset context key (sz / 8)
+    method copy = {< context = Bytes.copy context >}
+    method serialize: string = invalid_arg "siphash#serialize"
     method wipe =
       wipe_bytes context
   end
@@ -1597,6 +2681,102 @@ class siphash sz key =
 let siphash key = new siphash 64 key
 let siphash128 key = new siphash 128 key
 
+(* Batch computation of MACs *)
+
+type algo =
+  | HMAC of hmac_key
+  | BLAKE2b of int * string
+  | BLAKE2s of int * string
+  | BLAKE2bp of int * string
+  | BLAKE2sp of int * string
+  | BLAKE2Xb of int * string
+  | BLAKE2Xs of int * string
+  | BLAKE3 of int * string
+  | KMAC128 of int * string * string
+  | KMAC256 of int * string * string
+  | AES_CMAC of string
+  | SipHash of int * string
+
+let digest_size = function
+  | HMAC (HMAC_SHA1_key _) -> HMAC_SHA1.hash_size
+  | HMAC (HMAC_SHA256_key _) -> HMAC_SHA256.hash_size
+  | HMAC (HMAC_SHA384_key _) -> HMAC_SHA384.hash_size
+  | HMAC (HMAC_SHA512_key _) -> HMAC_SHA512.hash_size
+  | HMAC (HMAC_RIPEMD160_key _) -> HMAC_RIPEMD160.hash_size
+  | HMAC (HMAC_MD5_key _) -> HMAC_MD5.hash_size
+  | BLAKE2b (sz, key) ->
+      if String.length key <= 64
+      then Hash.digest_size (Hash.BLAKE2b sz)
+      else raise (Error Wrong_key_size)
+  | BLAKE2s (sz, key) ->
+      if String.length key <= 32
+      then Hash.digest_size (Hash.BLAKE2s sz)
+      else raise (Error Wrong_key_size)
+  | BLAKE2bp (sz, key) ->
+      if String.length key <= 64
+      then Hash.digest_size (Hash.BLAKE2bp sz)
+      else raise (Error Wrong_key_size)
+  | BLAKE2sp (sz, key) ->
+      if String.length key <= 32
+      then Hash.digest_size (Hash.BLAKE2sp sz)
+      else raise (Error Wrong_key_size)
+  | BLAKE2Xb (sz, key) ->
+      if String.length key <= 64
+      then Hash.digest_size (Hash.BLAKE2Xb sz)
+      else raise (Error Wrong_key_size)
+  | BLAKE2Xs (sz, key) ->
+      if String.length key <= 32
+      then Hash.digest_size (Hash.BLAKE2Xs sz)
+      else raise (Error Wrong_key_size)
+  | BLAKE3 (sz, key) ->
+      if String.length key = 0 || String.length key = 32
+      then Hash.digest_size (Hash.BLAKE3 sz)
+      else raise (Error Wrong_key_size)
+  | KMAC128 (sz, _, _) | KMAC256 (sz, _, _) ->
+      if sz > 0 && sz mod 8 = 0
+      then sz / 8
+      else raise (Error Wrong_key_size)
+  | AES_CMAC key ->
+      let kl = String.length key in
+      if kl = 16 || kl = 24 || kl = 32
+      then 16
+      else raise (Error Wrong_key_size)
+  | SipHash (sz, key) ->
+      if String.length key = 16 && (sz = 64 || sz = 128)
+      then sz / 8
+      else raise (Error Wrong_key_size)
+
+let kmac_many level sz key custom msgs dst ofs =
+  cshake_many level (kmac_prefix level custom key) (Hash.right_encode sz)
+              (sz / 8) msgs dst ofs
+
+let digest_many_into algo msgs dst ofs =
+  Hash.check_many "MAC.digest_many_into" (digest_size algo) msgs dst ofs;
+  match algo with
+  | HMAC (HMAC_SHA1_key k) -> HMAC_SHA1.hmac_many k msgs dst ofs
+  | HMAC (HMAC_SHA256_key k) -> HMAC_SHA256.hmac_many k msgs dst ofs
+  | HMAC (HMAC_SHA384_key k) -> HMAC_SHA384.hmac_many k msgs dst ofs
+  | HMAC (HMAC_SHA512_key k) -> HMAC_SHA512.hmac_many k msgs dst ofs
+  | HMAC (HMAC_RIPEMD160_key k) -> HMAC_RIPEMD160.hmac_many k msgs dst ofs
+  | HMAC (HMAC_MD5_key k) -> HMAC_MD5.hmac_many k msgs dst ofs
+  | BLAKE2b (sz, key) -> blake2b_many (sz / 8) key msgs dst ofs
+  | BLAKE2s (sz, key) -> blake2s_many (sz / 8) key msgs dst ofs
+  | BLAKE2bp (sz, key) -> blake2bp_many (sz / 8) key msgs dst ofs
+  | BLAKE2sp (sz, key) -> blake2sp_many (sz / 8) key msgs dst ofs
+  | BLAKE2Xb (sz, key) -> blake2xb_many (sz / 8) key msgs dst ofs
+  | BLAKE2Xs (sz, key) -> blake2xs_many (sz / 8) key msgs dst ofs
+  | BLAKE3 (sz, key) -> blake3_many key (sz / 8) msgs dst ofs
+  | KMAC128 (sz, key, custom) -> kmac_many 128 sz key custom msgs dst ofs
+  | KMAC256 (sz, key, custom) -> kmac_many 256 sz key custom msgs dst ofs
+  | AES_CMAC key ->
+      let ckey = aes_cook_encrypt_key key in
+      aes_cmac_many ckey msgs dst ofs;
+      wipe_bytes ckey
+  | SipHash (sz, key) -> siphash_many key (sz / 8) msgs dst ofs
+
+let digest_many algo msgs =
+  Hash.hash_many (digest_size algo) (digest_many_into algo) msgs
+
 end
 
 (* Authenticated encryption with associated data *)
@@ -1642,6 +2822,28 @@ let ghash_string h msg =
   if !i < l then ghash_block_s h mac msg !i (l - !i);
   mac
 
+(* Incremental hashing of the associated data.  Full blocks are hashed
+   as soon as they are available.  The last, partial block is kept
+   in [hbuf] and hashed, padded with zeros, by [ghash_header_flush]
+   just before the first block of encrypted data is hashed. *)
+
+let ghash_header_add h mac hbuf hused src ofs len =
+  let ofs = ref ofs and len = ref len in
+  if !hused > 0 then begin
+    let n = min !len (16 - !hused) in
+    Bytes.blit src !ofs hbuf !hused n;
+    hused := !hused + n; ofs := !ofs + n; len := !len - n;
+    if !hused = 16 then begin ghash_block h mac hbuf 0 16; hused := 0 end
+  end;
+  while !len >= 16 do
+    ghash_block h mac src !ofs 16;
+    ofs := !ofs + 16; len := !len - 16
+  done;
+  if !len > 0 then begin Bytes.blit src !ofs hbuf 0 !len; hused := !len end
+
+let ghash_header_flush h mac hbuf hused =
+  if !hused > 0 then begin ghash_block h mac hbuf 0 !hused; hused := 0 end
+
 (* Produce the final authentication tag *)
 
 let ghash_final h mac headerlen cipherlen e0 =
@@ -1694,9 +2896,14 @@ class aes_gcm_encrypt ?(header = "") ~iv key =
   let e0 = enc_initial_counter aes ctr in
   (* The current MAC, initialized with the header
      (the non-encrypted authenticated data) *)
-  let mac = ghash_string h header in
+  let mac = Bytes.make 16 '\000'
+  and hbuf = Bytes.create 16 and hused = ref 0 in
+  let () =
+    ghash_header_add h mac hbuf hused
+      (Bytes.unsafe_of_string header) 0 (String.length header) in
   (* Lengths of the authenticated data and the encrypted data *)
-  let headerlen = Int64.of_int (String.length header)
+  let headerlen = ref (Int64.of_int (String.length header))
+  and header_done = ref false
   and cipherlen = ref 0L in
   (* A wrapper around the block cipher that 
      - performs encryption in CTR mode
@@ -1708,17 +2915,33 @@ class aes_gcm_encrypt ?(header = "") ~iv key =
       method blocksize = 16
       method wipe = aes#wipe
       method transform src soff dst doff =
+        ghash_header_flush h mac hbuf hused;
         ctr_enc_dec aes ctr buf src soff dst doff 16;
         ghash_block h mac dst doff 16;
         cipherlen := Int64.(add !cipherlen 16L);
         if !cipherlen > 0xfffffffe0L then raise (Error Message_too_long)
     end in
   object(self)
-    inherit (Block.cipher enc_wrapped)
+    inherit (Block.cipher enc_wrapped) as super
     method input_block_size = 1
     method output_block_size = 1
     method tag_size = 16
+    method put_substring src ofs len =
+      header_done := true;
+      super#put_substring src ofs len
+    method put_char c =
+      header_done := true;
+      super#put_char c
+    method put_header_substring src ofs len =
+      if ofs < 0 || len < 0 || ofs > Bytes.length src - len || !header_done
+      then invalid_arg "aes_gcm#put_header_substring";
+      ghash_header_add h mac hbuf hused src ofs len;
+      headerlen := Int64.(add !headerlen (of_int len))
+    method put_header_string s =
+      self#put_header_substring (Bytes.unsafe_of_string s) 0 (String.length s)
     method finish_and_get_tag =
+      header_done := true;
+      ghash_header_flush h mac hbuf hused;
       if used > 0 then begin
         let buf = Bytes.create 16 in
         (* Encrypt final block *)
@@ -1731,7 +2954,7 @@ class aes_gcm_encrypt ?(header = "") ~iv key =
         if !cipherlen > 0xfffffffe0L then raise (Error Message_too_long)
       end;
       (* Produce authentication tag *)
-      ghash_final h mac headerlen !cipherlen e0
+      ghash_final h mac !headerlen !cipherlen e0
   end
 
 class aes_gcm_decrypt ?(header = "") ~iv key =
@@ -1745,9 +2968,14 @@ class aes_gcm_decrypt ?(header = "") ~iv key =
   let e0 = enc_initial_counter aes ctr in
   (* The current MAC, initialized with the header
      (the non-encrypted authenticated data) *)
-  let mac = ghash_string h header in
+  let mac = Bytes.make 16 '\000'
+  and hbuf = Bytes.create 16 and hused = ref 0 in
+  let () =
+    ghash_header_add h mac hbuf hused
+      (Bytes.unsafe_of_string header) 0 (String.length header) in
   (* Lengths of the authenticated data and the encrypted data *)
-  let headerlen = Int64.of_int (String.length header)
+  let headerlen = ref (Int64.of_int (String.length header))
+  and header_done = ref false
   and cipherlen = ref 0L in
   (* A wrapper around the block cipher that 
      - updates the MAC
@@ -1759,16 +2987,32 @@ class aes_gcm_decrypt ?(header = "") ~iv key =
       method blocksize = 16
       method wipe = aes#wipe
       method transform src soff dst doff =
+        ghash_header_flush h mac hbuf hused;
         ghash_block h mac src soff 16;
         ctr_enc_dec aes ctr buf src soff dst doff 16;
         cipherlen := Int64.(add !cipherlen 16L)
     end in
   object(self)
-    inherit (Block.cipher dec_wrapped)
+    inherit (Block.cipher dec_wrapped) as super
     method input_block_size = 1
     method output_block_size = 1
     method tag_size = 16
+    method put_substring src ofs len =
+      header_done := true;
+      super#put_substring src ofs len
+    method put_char c =
+      header_done := true;
+      super#put_char c
+    method put_header_substring src ofs len =
+      if ofs < 0 || len < 0 || ofs > Bytes.length src - len || !header_done
+      then invalid_arg "aes_gcm#put_header_substring";
+      ghash_header_add h mac hbuf hused src ofs len;
+      headerlen := Int64.(add !headerlen (of_int len))
+    method put_header_string s =
+      self#put_header_substring (Bytes.unsafe_of_string s) 0 (String.length s)
     method finish_and_get_tag =
+      header_done := true;
+      ghash_header_flush h mac hbuf hused;
       if used > 0 then begin
         let buf = Bytes.create 16 in
         (* Hash final block padded with zeros *)
@@ -1780,7 +3024,7 @@ class aes_gcm_decrypt ?(header = "") ~iv key =
         cipherlen := Int64.(add !cipherlen (of_int used))
       end;
       (* Produce authentication tag *)
-      ghash_final h mac headerlen !cipherlen e0
+      ghash_final h mac !headerlen !cipherlen e0
   end
 
 let aes_gcm ?header ~iv key dir =
@@ -1788,6 +3032,15 @@ let aes_gcm ?header ~iv key dir =
   | Encrypt -> (new aes_gcm_encrypt ?header ~iv key :> authenticated_transform)
   | Decrypt -> (new aes_gcm_decrypt ?header ~iv key :> authenticated_transform)
 
+let aes_gcm_with_header ?header ~iv key dir =
+  match dir with
+  | Encrypt ->
+      (new aes_gcm_encrypt ?header ~iv key
+         :> authenticated_transform_with_header)
+  | Decrypt ->
+      (new aes_gcm_decrypt ?header ~iv key
+         :> authenticated_transform_with_header)
+
 (* Chacha20-Poly1305 *)
 
 let poly1305_update_pad h n =
@@ -1800,10 +3053,16 @@ let poly1305_init_hash cha header =
   let h = poly1305_init buf in  (* only the first 32 bytes are used *)
   wipe_bytes buf;
   poly1305_update h (Bytes.unsafe_of_string header) 0 (String.length header);
-  (* Pad header to a multiple of 16 bytes *)
-  poly1305_update_pad h (String.length header land 0xF);
+  (* The header is padded to a multiple of 16 bytes by
+     [poly1305_header_end], once all of it has been hashed. *)
   h
 
+let poly1305_header_end h header_done headerlen =
+  if not !header_done then begin
+    poly1305_update_pad h Int64.(to_int (logand headerlen 0xFL));
+    header_done := true
+  end
+
 let poly1305_finish_and_get_tag h headerlen cipherlen =
   (* Pad ciphertext to a multiple of 16 bytes *)
   poly1305_update_pad h Int64.(to_int (logand cipherlen 0xFL));
@@ -1821,7 +3080,8 @@ class chapoly_encrypt ?(header = "") ~iv key =
   (* The Poly1305 hash *)
   let h = poly1305_init_hash cha header in
   (* Lengths of the authenticated data and the encrypted data *)
-  let headerlen = Int64.of_int (String.length header)
+  let headerlen = ref (Int64.of_int (String.length header))
+  and header_done = ref false
   and cipherlen = ref 0L in
   (* Maximum length for encrypted data *)
   let maxlen =
@@ -1829,6 +3089,7 @@ class chapoly_encrypt ?(header = "") ~iv key =
   (* The stream cipher that wraps Chacha20 with hash updates *)
   let enc = object
     method transform src soff dst doff len =
+      poly1305_header_end h header_done !headerlen;
       cha#transform src soff dst doff len;
       poly1305_update h dst doff len;
       cipherlen := Int64.(add !cipherlen (of_int len));
@@ -1837,12 +3098,26 @@ class chapoly_encrypt ?(header = "") ~iv key =
       cha#wipe; wipe_bytes h
   end in
   object(self)
-    inherit (Stream.cipher enc)
+    inherit (Stream.cipher enc) as super
     method input_block_size = 1
     method output_block_size = 1
     method tag_size = 16
+    method put_substring src ofs len =
+      poly1305_header_end h header_done !headerlen;
+      super#put_substring src ofs len
+    method put_char c =
+      poly1305_header_end h header_done !headerlen;
+      super#put_char c
+    method put_header_substring src ofs len =
+      if ofs < 0 || len < 0 || ofs > Bytes.length src - len || !header_done
+      then invalid_arg "chacha20_poly1305#put_header_substring";
+      poly1305_update h src ofs len;
+      headerlen := Int64.(add !headerlen (of_int len))
+    method put_header_string s =
+      self#put_header_substring (Bytes.unsafe_of_string s) 0 (String.length s)
     method finish_and_get_tag =
-      poly1305_finish_and_get_tag h headerlen !cipherlen
+      poly1305_header_end h header_done !headerlen;
+      poly1305_finish_and_get_tag h !headerlen !cipherlen
   end
 
 class chapoly_decrypt ?(header = "") ~iv key =
@@ -1851,11 +3126,13 @@ class chapoly_decrypt ?(header = "") ~iv key =
   (* The Poly1305 hash *)
   let h = poly1305_init_hash cha header in
   (* Lengths of the authenticated data and the encrypted data *)
-  let headerlen = Int64.of_int (String.length header)
+  let headerlen = ref (Int64.of_int (String.length header))
+  and header_done = ref false
   and cipherlen = ref 0L in
   (* The stream cipher that wraps Chacha20 with hash updates *)
   let enc = object
     method transform src soff dst doff len =
+      poly1305_header_end h header_done !headerlen;
       poly1305_update h src soff len;
       cha#transform src soff dst doff len;
       cipherlen := Int64.(add !cipherlen (of_int len))
@@ -1863,12 +3140,26 @@ class chapoly_decrypt ?(header = "") ~iv key =
       cha#wipe; wipe_bytes h
   end in
   object(self)
-    inherit (Stream.cipher enc)
+    inherit (Stream.cipher enc) as super
     method input_block_size = 1
     method output_block_size = 1
     method tag_size = 16
+    method put_substring src ofs len =
+      poly1305_header_end h header_done !headerlen;
+      super#put_substring src ofs len
+    method put_char c =
+      poly1305_header_end h header_done !headerlen;
+      super#put_char c
+    method put_header_substring src ofs len =
+      if ofs < 0 || len < 0 || ofs > Bytes.length src - len || !header_done
+      then invalid_arg "chacha20_poly1305#put_header_substring";
+      poly1305_update h src ofs len;
+      headerlen := Int64.(add !headerlen (of_int len))
+    method put_header_string s =
+      self#put_header_substring (Bytes.unsafe_of_string s) 0 (String.length s)
     method finish_and_get_tag =
-      poly1305_finish_and_get_tag h headerlen !cipherlen
+      poly1305_header_end h header_done !headerlen;
+      poly1305_finish_and_get_tag h !headerlen !cipherlen
   end
 
 let chacha20_poly1305 ?header ~iv key dir =
@@ -1876,6 +3167,192 @@ let chacha20_poly1305 ?header ~iv key dir =
   | Encrypt -> (new chapoly_encrypt ?header ~iv key :> authenticated_transform)
   | Decrypt -> (new chapoly_decrypt ?header ~iv key :> authenticated_transform)
 
+let chacha20_poly1305_with_header ?header ~iv key dir =
+  match dir with
+  | Encrypt ->
+      (new chapoly_encrypt ?header ~iv key
+         :> authenticated_transform_with_header)
+  | Decrypt ->
+      (new chapoly_decrypt ?header ~iv key
+         :> authenticated_transform_with_header)
+
+(* One-shot encryption and decryption, performed entirely in C *)
+
+type key =
+  | AES_GCM_key of bytes
+  | Chacha20_Poly1305_key of bytes
+
+let aes_gcm_key key =
+  let kl = String.length key in
+  if kl = 16 || kl = 24 || kl = 32
+  then AES_GCM_key (aes_gcm_cook_key key)
+  else raise (Error Wrong_key_size)
+
+let chacha20_poly1305_key key =
+  let kl = String.length key in
+  if kl = 16 || kl = 32
+  then Chacha20_Poly1305_key (Bytes.of_string key)
+  else raise (Error Wrong_key_size)
+
+let wipe_key = function
+  | AES_GCM_key k | Chacha20_Poly1305_key k -> wipe_bytes k
+
+let tag_size = 16
+
+let check_iv_and_length key iv len =
+  match key with
+  | AES_GCM_key _ ->
+      if Int64.of_int len > 0xfffffffe0L then raise (Error Message_too_long)
+  | Chacha20_Poly1305_key _ ->
+      let il = String.length iv in
+      if il <> 8 && il <> 12 then raise (Error Wrong_IV_size);
+      if il = 12 && Int64.of_int len > 0x4000000000L
+      then raise (Error Message_too_long)
+
+let seal_into ?(header = "") ~iv key src src_ofs len dst dst_ofs =
+  if len < 0
+  || src_ofs < 0 || src_ofs > Bytes.length src - len
+  || dst_ofs < 0 || dst_ofs > Bytes.length dst - len - tag_size
+  then invalid_arg "AEAD.seal_into";
+  check_iv_and_length key iv len;
+  match key with
+  | AES_GCM_key ck ->
+      aes_gcm_seal ck iv header src src_ofs dst dst_ofs len
+  | Chacha20_Poly1305_key ck ->
+      chacha20_poly1305_seal ck iv header src src_ofs dst dst_ofs len
+
+let open_into ?(header = "") ~iv key src src_ofs len dst dst_ofs =
+  if len < tag_size then raise (Error Wrong_data_length);
+  let len = len - tag_size in
+  if src_ofs < 0 || src_ofs > Bytes.length src - len - tag_size
+  || dst_ofs < 0 || dst_ofs > Bytes.length dst - len
+  then invalid_arg "AEAD.open_into";
+  check_iv_and_length key iv len;
+  match key with
+  | AES_GCM_key ck ->
+      aes_gcm_open ck iv header src src_ofs dst dst_ofs len
+  | Chacha20_Poly1305_key ck ->
+      chacha20_poly1305_open ck iv header src src_ofs dst dst_ofs len
+
+let seal ?header ~iv key msg =
+  let len = String.length msg in
+  let res = Bytes.create (len + tag_size) in
+  seal_into ?header ~iv key (Bytes.unsafe_of_string msg) 0 len res 0;
+  Bytes.unsafe_to_string res
+
+let open_ ?header ~iv key msg =
+  let len = String.length msg - tag_size in
+  if len < 0 then raise (Error Wrong_data_length);
+  let res = Bytes.create len in
+  if open_into ?header ~iv key (Bytes.unsafe_of_string msg) 0
+                               (String.length msg) res 0
+  then Some (Bytes.unsafe_to_string res)
+  else None
+
+(* In-place encryption and decryption.  Decryption authenticates
+   the ciphertext first, and decrypts it only if the tag is correct. *)
+
+let seal_in_place ?(header = "") ~iv key buf ofs len =
+  if len < 0 || ofs < 0 || ofs > Bytes.length buf - len - tag_size
+  then invalid_arg "AEAD.seal_in_place";
+  check_iv_and_length key iv len;
+  match key with
+  | AES_GCM_key ck ->
+      aes_gcm_seal ck iv header buf ofs buf ofs len
+  | Chacha20_Poly1305_key ck ->
+      chacha20_poly1305_seal ck iv header buf ofs buf ofs len
+
+let open_in_place ?(header = "") ~iv key buf ofs len =
+  if len < tag_size then raise (Error Wrong_data_length);
+  let len = len - tag_size in
+  if ofs < 0 || ofs > Bytes.length buf - len - tag_size
+  then invalid_arg "AEAD.open_in_place";
+  check_iv_and_length key iv len;
+  match key with
+  | AES_GCM_key ck ->
+      aes_gcm_open ck iv header buf ofs buf ofs len
+  | Chacha20_Poly1305_key ck ->
+      chacha20_poly1305_open ck iv header buf ofs buf ofs len
+
+type bigbytes =
+  (char, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t
+
+let seal_in_place_bigarray ?(header = "") ~iv key buf ofs len =
+  if len < 0 || ofs < 0 || ofs > Bigarray.Array1.dim buf - len - tag_size
+  then invalid_arg "AEAD.seal_in_place_bigarray";
+  check_iv_and_length key iv len;
+  match key with
+  | AES_GCM_key ck ->
+      aes_gcm_seal_bigarray ck iv header buf ofs len
+  | Chacha20_Poly1305_key ck ->
+      chacha20_poly1305_seal_bigarray ck iv header buf ofs len
+
+let open_in_place_bigarray ?(header = "") ~iv key buf ofs len =
+  if len < tag_size then raise (Error Wrong_data_length);
+  let len = len - tag_size in
+  if ofs < 0 || ofs > Bigarray.Array1.dim buf - len - tag_size
+  then invalid_arg "AEAD.open_in_place_bigarray";
+  check_iv_and_length key iv len;
+  match key with
+  | AES_GCM_key ck ->
+      aes_gcm_open_bigarray ck iv header buf ofs len
+  | Chacha20_Poly1305_key ck ->
+      chacha20_poly1305_open_bigarray ck iv header buf ofs len
+
+(* Batch encryption and decryption.  Packets are grouped by algorithm,
+   and each group is processed by one C call, which interleaves
+   the processing of up to 4 packets. *)
+
+let batch_check name opening ?headers ~ivs keys bufs =
+  let n = Array.length bufs in
+  if Array.length ivs <> n || Array.length keys <> n then invalid_arg name;
+  let headers =
+    match headers with
+    | None -> Array.make n ""
+    | Some h -> if Array.length h <> n then invalid_arg name; h in
+  for i = 0 to n - 1 do
+    let len = Bytes.length bufs.(i) - tag_size in
+    if len < 0 then
+      if opening then raise (Error Wrong_data_length) else invalid_arg name;
+    check_iv_and_length keys.(i) ivs.(i) len
+  done;
+  headers
+
+let batch_run gcm chapoly keys ivs headers bufs status =
+  let n = Array.length bufs in
+  let gcm_idx = ref [] and chapoly_idx = ref [] in
+  for i = n - 1 downto 0 do
+    match keys.(i) with
+    | AES_GCM_key _ -> gcm_idx := i :: !gcm_idx
+    | Chacha20_Poly1305_key _ -> chapoly_idx := i :: !chapoly_idx
+  done;
+  let run f idx =
+    let idx = Array.of_list idx in
+    let m = Array.length idx in
+    let sel a = if m = n then a else Array.map (fun i -> a.(i)) idx in
+    if m > 0 then begin
+      let st = Bytes.make m '\000' in
+      f (sel (Array.map (function AES_GCM_key k
+                                | Chacha20_Poly1305_key k -> k) keys))
+        (sel ivs) (sel headers) (sel bufs) st;
+      Array.iteri (fun j i -> status.(i) <- Bytes.get st j <> '\000') idx
+    end in
+  run gcm !gcm_idx;
+  run chapoly !chapoly_idx
+
+let seal_batch ?headers ~ivs keys bufs =
+  let headers = batch_check "AEAD.seal_batch" false ?headers ~ivs keys bufs in
+  batch_run (fun k iv h b _ -> aes_gcm_seal_many k iv h b)
+            (fun k iv h b _ -> chacha20_poly1305_seal_many k iv h b)
+            keys ivs headers bufs (Array.make (Array.length bufs) true)
+
+let open_batch ?headers ~ivs keys bufs =
+  let headers = batch_check "AEAD.open_batch" true ?headers ~ivs keys bufs in
+  let status = Array.make (Array.length bufs) false in
+  batch_run aes_gcm_open_many chacha20_poly1305_open_many
+            keys ivs headers bufs status;
+  status
+
 end
 
 (* Random number generation *)
@@ -2055,8 +3532,9 @@ let kdf3 (h: unit -> hash) ?(otherinfo = "") secret len =
   derive fn len 0l
 
 let pbkdf2 (keyed_hash: string -> hash) pwd salt count len =
+  let h = keyed_hash pwd in
   let prf s =
-    hash_string (keyed_hash pwd) s in
+    h#reset; h#add_string s; h#result in
   let rec iterate u r n =
     if n <= 0 then Bytes.to_string r else begin
       let u = prf u in
@@ -2067,7 +3545,374 @@ let pbkdf2 (keyed_hash: string -> hash) pwd salt count len =
     let u = prf (salt ^ int2bytes ctr) in
     let r = Bytes.of_string u in
     iterate u r (count - 1) in
-  derive fn len 1l
+  let res = derive fn len 1l in
+  h#wipe;
+  res
+
+let blake3_derive_key ~context =
+  let context_key = blake3_derive_context_key context in
+  fun material len ->
+    if len < 0 then invalid_arg "KD.blake3_derive_key";
+    let ctx = blake3_init_derive_key context_key in
+    blake3_update ctx (Bytes.unsafe_of_string material)
+                  0 (String.length material);
+    let res = blake3_final ctx len in
+    blake3_wipe ctx;
+    res
+
+end
+
+(* Verified streaming of BLAKE3-hashed data, in the Bao format *)
+
+module Bao = struct
+
+let chunk_size = 1024
+let header_size = 8
+let parent_size = 64
+
+let outboard s = bao_outboard s
+
+let outboard_file filename =
+  let ic = open_in_bin filename in
+  let len = LargeFile.in_channel_length ic in
+  close_in ic;
+  if Int64.div len 16L > Int64.of_int Sys.max_string_length
+  then raise (Error Message_too_long);
+  bao_outboard_file filename len
+
+(* The tree has the same shape as the BLAKE3 tree: the left subtree of a
+   node covering [len > chunk_size] bytes covers the largest power of 2
+   number of chunks that leaves at least one byte for the right subtree.
+   The nodes are numbered in pre-order, so that the right child of
+   parent node number [i] is parent node number [i + left_len / chunk_size]. *)
+
+let left_len len =
+  let full_chunks = (len - 1) / chunk_size in
+  let rec pow2 p = if 2 * p <= full_chunks then pow2 (2 * p) else p in
+  pow2 1 * chunk_size
+
+let outboard_size content_len =
+  let nchunks =
+    if content_len <= 0 then 1 else (content_len - 1) / chunk_size + 1 in
+  header_size + parent_size * (nchunks - 1)
+
+let decode_header buf ofs =
+  let n = Bytes.get_int64_le buf ofs in
+  if n < 0L || n > Int64.of_int max_int then raise (Error Bad_encoding);
+  Int64.to_int n
+
+(* A slice contains all the chunks that overlap the requested range.
+   An empty range is treated as a range of length 1, and a range
+   starting at or past the end of the content selects the last chunk,
+   so that the content length is always authenticated. *)
+
+let slice_bounds content_len start len =
+  if start >= content_len then (max 0 (content_len - 1), content_len)
+  else if len >= content_len - start then (start, content_len)
+  else (start, start + max len 1)
+
+let content_length outboard =
+  if String.length outboard < header_size then raise (Error Bad_encoding);
+  let content_len = decode_header (Bytes.unsafe_of_string outboard) 0 in
+  if String.length outboard <> outboard_size content_len
+  then raise (Error Bad_encoding);
+  content_len
+
+let extract ~outboard read start len =
+  if start < 0 || len < 0 then invalid_arg "Bao.slice";
+  let content_len = content_length outboard in
+  let (s, e) = slice_bounds content_len start len in
+  let res = Buffer.create (e - s + 2 * chunk_size) in
+  Buffer.add_substring res outboard 0 header_size;
+  let rec walk pos len idx =
+    if len <= chunk_size then
+      Buffer.add_string res (read pos len)
+    else begin
+      Buffer.add_substring res outboard
+                           (header_size + parent_size * idx) parent_size;
+      let l = left_len len in
+      if s < pos + l then walk pos l (idx + 1);
+      if e > pos + l then walk (pos + l) (len - l) (idx + l / chunk_size)
+    end in
+  walk 0 content_len 0;
+  Buffer.contents res
+
+let slice ~outboard data start len =
+  if String.length data <> content_length outboard
+  then raise (Error Wrong_data_length);
+  extract ~outboard (String.sub data) start len
+
+let slice_channel ~outboard ic start len =
+  extract ~outboard
+    (fun pos len -> seek_in ic pos; really_input_string ic len)
+    start len
+
+(* Nodes that remain to be verified: position and length of the subtree,
+   expected chaining value, and whether it is the root of the tree *)
+
+type node = { pos: int; len: int; cv: string; root: bool }
+
+class slice_decoder hash start len =
+  let stop = if len > max_int - start then max_int else start + len in
+  object(self)
+    val ibuf = Bytes.create chunk_size
+    val mutable used = 0
+    val mutable content_len = -1
+    val mutable bounds = (0, 0)
+    val mutable todo = ([] : node list)
+
+    inherit buffered_output 1024 as output_buffer
+
+    method input_block_size = 1
+    method output_block_size = 1
+
+    method private started = content_len >= 0
+
+    method private needed =
+      match todo with
+      | [] -> header_size
+      | n :: _ -> if n.len <= chunk_size then n.len else parent_size
+
+    method private verify_chunk n =
+      let cv = bao_chunk_cv ibuf 0 n.len (n.pos / chunk_size) n.root in
+      if not (string_equal cv n.cv) then raise (Error Authentication_failure);
+      let a = max n.pos start and b = min (n.pos + n.len) stop in
+      if a < b then begin
+        self#ensure_capacity (b - a);
+        Bytes.blit ibuf (a - n.pos) obuf oend (b - a);
+        oend <- oend + b - a
+      end
+
+    method private verify_parent n rest =
+      let cv = bao_parent_cv ibuf 0 n.root in
+      if not (string_equal cv n.cv) then raise (Error Authentication_failure);
+      let (s, e) = bounds in
+      let l = left_len n.len in
+      let rest =
+        if e > n.pos + l then
+          { pos = n.pos + l; len = n.len - l;
+            cv = Bytes.sub_string ibuf 32 32; root = false } :: rest
+        else rest in
+      if s < n.pos + l then
+        { pos = n.pos; len = l; cv = Bytes.sub_string ibuf 0 32; root = false }
+        :: rest
+      else rest
+
+    (* Verify the nodes that are complete.  Empty chunks are complete
+       as soon as they are expected. *)
+    method private verify =
+      if not self#started then begin
+        if used = header_size then begin
+          content_len <- decode_header ibuf 0;
+          bounds <- slice_bounds content_len start len;
+          todo <- [ { pos = 0; len = content_len; cv = hash; root = true } ];
+          used <- 0;
+          self#verify
+        end
+      end else begin
+        match todo with
+        | [] -> ()
+        | n :: rest ->
+            if used = self#needed then begin
+              if n.len <= chunk_size
+              then (self#verify_chunk n; todo <- rest)
+              else todo <- self#verify_parent n rest;
+              used <- 0;
+              self#verify
+            end
+      end
+
+    method put_substring src ofs len =
+      if len > 0 then begin
+        if self#started && todo = [] then raise (Error Wrong_data_length);
+        let n = min len (self#needed - used) in
+        Bytes.blit src ofs ibuf used n;
+        used <- used + n;
+        self#verify;
+        self#put_substring src (ofs + n) (len - n)
+      end
+
+    method put_string s =
+      self#put_substring (Bytes.unsafe_of_string s) 0 (String.length s)
+
+    method put_char c = self#put_string (String.make 1 c)
+
+    method put_byte b = self#put_char (Char.chr b)
+
+    method flush = ()
+
+    method finish =
+      if not self#started || todo <> [] then raise (Error Wrong_data_length)
+
+    method wipe =
+      output_buffer#wipe;
+      wipe_bytes ibuf
+  end
+
+let decode_slice ~hash start len =
+  if String.length hash <> 32 || start < 0 || len < 0
+  then invalid_arg "Bao.decode_slice";
+  (new slice_decoder hash start len :> transform)
+
+end
+
+(* Merkle trees *)
+
+module Merkle = struct
+
+(* The nodes are stored level by level in a single Bigarray, from the
+   leaves to the root.  If level [k] has [w] nodes, level [k + 1] has
+   [(w + 1) / 2] nodes: node [i] of level [k + 1] is the hash of nodes
+   [2i] and [2i + 1] of level [k], or a copy of node [2i] if node
+   [2i + 1] does not exist.  Modified leaves are recorded in [dirty],
+   and their ancestors are recomputed when the root or a proof is
+   requested, one level at a time.  The pairs of a level are hashed
+   in C, split into ranges hashed by several threads, without the
+   runtime lock. *)
+
+type hash = SHA256 | BLAKE2s | BLAKE3
+
+let node_size = 32
+
+type t = {
+  hash: hash;
+  threads: int;
+  nodes: (char, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t;
+  width: int array;                     (* number of nodes of each level *)
+  base: int array;                      (* position of each level *)
+  mutable dirty: int list               (* modified leaves *)
+}
+
+(* [hash_pairs h b src n dst threads] hashes the [n] pairs of nodes at
+   position [src] of [b] into the [n] nodes at position [dst] *)
+
+let hash_pairs = function
+  | SHA256 -> sha256_64to32_merkle
+  | BLAKE2s -> blake2s_64to32_merkle
+  | BLAKE3 -> blake3_parent_merkle
+
+let hash_pair = function
+  | SHA256 -> Hash.sha256_64to32
+  | BLAKE2s -> Hash.blake2s_64to32
+  | BLAKE3 -> (fun s -> Hash.blake3_parent s)
+
+let node t k i =
+  let b = Bytes.create node_size in
+  blit_bigarray_to_bytes t.nodes (t.base.(k) + node_size * i) b 0 node_size;
+  Bytes.unsafe_to_string b
+
+let blit_nodes src srcofs dst dstofs len =
+  Bigarray.Array1.(blit (sub src srcofs len) (sub dst dstofs len))
+
+(* Copy the last node of level [k] to level [k + 1] if it has no sibling *)
+
+let promote t k =
+  let w = t.width.(k) in
+  if w land 1 = 1 then
+    blit_nodes t.nodes (t.base.(k) + node_size * (w - 1))
+               t.nodes (t.base.(k + 1) + node_size * (w / 2)) node_size
+
+let create ?(threads = 0) hash leaves =
+  let n = Array.length leaves in
+  if n = 0 then invalid_arg "Merkle.create";
+  let rec widths w = if w = 1 then [1] else w :: widths ((w + 1) / 2) in
+  let width = Array.of_list (widths n) in
+  let levels = Array.length width in
+  let base = Array.make levels 0 in
+  for k = 1 to levels - 1 do
+    base.(k) <- base.(k - 1) + node_size * width.(k - 1)
+  done;
+  let nodes =
+    Bigarray.(Array1.create char c_layout (base.(levels - 1) + node_size)) in
+  Array.iteri
+    (fun i l ->
+      if String.length l <> node_size then invalid_arg "Merkle.create";
+      blit_bytes_to_bigarray (Bytes.unsafe_of_string l) 0
+                             nodes (node_size * i) node_size)
+    leaves;
+  let t = { hash; threads; nodes; width; base; dirty = [] } in
+  for k = 0 to levels - 2 do
+    hash_pairs hash nodes base.(k) (width.(k) / 2) base.(k + 1) threads;
+    promote t k
+  done;
+  t
+
+let length t = t.width.(0)
+
+let leaf t i =
+  if i < 0 || i >= length t then invalid_arg "Merkle.leaf";
+  node t 0 i
+
+let set_leaf t i l =
+  if i < 0 || i >= length t || String.length l <> node_size
+  then invalid_arg "Merkle.set_leaf";
+  blit_bytes_to_bigarray (Bytes.unsafe_of_string l) 0
+                         t.nodes (node_size * i) node_size;
+  t.dirty <- i :: t.dirty
+
+(* Recompute the ancestors of the modified leaves.  The parents of
+   the modified nodes of a level are hashed together, each parent once
+   even if both of its children were modified.  The pairs to hash are
+   gathered in a scratch Bigarray, followed by room for their hashes. *)
+
+let flush t =
+  if t.dirty <> [] then begin
+    let modified = ref (List.sort_uniq compare t.dirty) in
+    t.dirty <- [];
+    for k = 0 to Array.length t.width - 2 do
+      let w = t.width.(k) in
+      let parents =
+        List.sort_uniq compare (List.map (fun i -> i / 2) !modified) in
+      let pairs = List.filter (fun p -> 2 * p + 1 < w) parents in
+      let npairs = List.length pairs in
+      if npairs > 0 then begin
+        let hofs = 2 * node_size * npairs in
+        let buf =
+          Bigarray.(Array1.create char c_layout (3 * node_size * npairs)) in
+        List.iteri
+          (fun j p ->
+            blit_nodes t.nodes (t.base.(k) + 2 * node_size * p)
+                       buf (2 * node_size * j) (2 * node_size))
+          pairs;
+        hash_pairs t.hash buf 0 npairs hofs t.threads;
+        List.iteri
+          (fun j p ->
+            blit_nodes buf (hofs + node_size * j)
+                       t.nodes (t.base.(k + 1) + node_size * p) node_size)
+          pairs
+      end;
+      if List.length parents > npairs then promote t k;
+      modified := parents
+    done
+  end
+
+let root t =
+  flush t;
+  node t (Array.length t.width - 1) 0
+
+let proof t i =
+  if i < 0 || i >= length t then invalid_arg "Merkle.proof";
+  flush t;
+  let rec siblings k i =
+    if k = Array.length t.width - 1 then []
+    else if i lxor 1 < t.width.(k)
+    then node t k (i lxor 1) :: siblings (k + 1) (i / 2)
+    else siblings (k + 1) (i / 2) in
+  siblings 0 i
+
+let verify hash ~leaves ~index ~leaf proof root =
+  let hash = hash_pair hash in
+  let rec check w i h proof =
+    if w = 1 then proof = [] && string_equal h root
+    else if i lxor 1 >= w then check ((w + 1) / 2) (i / 2) h proof
+    else match proof with
+      | [] -> false
+      | s :: proof ->
+          String.length s = node_size
+          && check ((w + 1) / 2) (i / 2)
+                   (hash (if i land 1 = 0 then h ^ s else s ^ h)) proof in
+  0 <= index && index < leaves && String.length leaf = node_size
+  && check leaves index leaf proof
 
 end
 
@@ -2748,6 +4593,623 @@ let uncompress ?(expect_zlib_header = false) () = new uncompress expect_zlib_hea
 
 end
 
+(* Segmented streaming authenticated encryption *)
+
+module Streaming_AEAD = struct
+
+type algorithm = AES_GCM | Chacha20_Poly1305
+
+(* Layout of the header:
+     0       format version (1)
+     1       algorithm (1 = AES-GCM, 2 = Chacha20-Poly1305)
+     2       flags (bit 0: the plaintext is Zlib-compressed)
+     3       reserved, 0
+     4-7     plaintext size of a segment, big-endian
+     8-23    random salt for key derivation
+     24-30   random prefix for segment nonces
+   The nonce for segment number [i] is the 7-byte prefix, followed by
+   [i] as a 4-byte big-endian number, followed by 1 for the last segment
+   and 0 for the other segments.
+   The segment key is HMAC-SHA256 of bytes 0-23 of the header followed
+   by the associated data, keyed with the master key, and truncated to the
+   length of the master key. *)
+
+let header_size = 31
+let tag_size = 16
+let default_segment_size = 65536
+let max_segment_size = 0x400_0000
+
+type segment_key = {
+  key: AEAD.key;
+  prefix: string;
+  segment_size: int;
+  compressed: bool
+}
+
+let segment_size sk = sk.segment_size
+let compressed sk = sk.compressed
+
+let make_segment_key algo key associated_data hdr =
+  let kl = String.length key in
+  begin match algo with
+  | AES_GCM ->
+      if kl <> 16 && kl <> 24 && kl <> 32 then raise (Error Wrong_key_size)
+  | Chacha20_Poly1305 ->
+      if kl <> 16 && kl <> 32 then raise (Error Wrong_key_size)
+  end;
+  let h = MAC.hmac_sha256 key in
+  h#add_substring (Bytes.unsafe_of_string hdr) 0 24;
+  h#add_string associated_data;
+  let dk = h#result in
+  h#wipe;
+  let k = String.sub dk 0 kl in
+  { key = (match algo with
+           | AES_GCM -> AEAD.aes_gcm_key k
+           | Chacha20_Poly1305 -> AEAD.chacha20_poly1305_key k);
+    prefix = String.sub hdr 24 7;
+    segment_size = Bytes.get_int32_be (Bytes.unsafe_of_string hdr) 4
+                   |> Int32.to_int;
+    compressed = Char.code hdr.[2] land 1 <> 0 }
+
+let algorithm_code = function AES_GCM -> 1 | Chacha20_Poly1305 -> 2
+
+let encrypt_header ?(segment_size = default_segment_size) ?(compress = false)
+                   ?(associated_data = "") ?(rng = Random.secure_rng)
+                   algo key =
+  if segment_size <= 0 || segment_size > max_segment_size
+  then invalid_arg "Streaming_AEAD.encrypt_header";
+  let hdr = Bytes.make header_size '\000' in
+  Bytes.set hdr 0 '\001';
+  Bytes.set hdr 1 (Char.chr (algorithm_code algo));
+  Bytes.set hdr 2 (if compress then '\001' else '\000');
+  Bytes.set_int32_be hdr 4 (Int32.of_int segment_size);
+  rng#random_bytes hdr 8 (header_size - 8);
+  let hdr = Bytes.unsafe_to_string hdr in
+  (hdr, make_segment_key algo key associated_data hdr)
+
+let decrypt_header ?(associated_data = "") algo key hdr =
+  if String.length hdr <> header_size
+  || hdr.[0] <> '\001'
+  || Char.code hdr.[1] <> algorithm_code algo
+  || Char.code hdr.[2] land 0xFE <> 0
+  || hdr.[3] <> '\000'
+  || (let n = Bytes.get_int32_be (Bytes.unsafe_of_string hdr) 4 in
+      n <= 0l || Int32.to_int n > max_segment_size)
+  then raise (Error Bad_encoding);
+  make_segment_key algo key associated_data hdr
+
+let segment_nonce sk index last =
+  if index < 0 || index > 0xFFFF_FFFF then raise (Error Message_too_long);
+  let n = Bytes.create 12 in
+  Bytes.blit_string sk.prefix 0 n 0 7;
+  Bytes.set_int32_be n 7 (Int32.of_int index);
+  Bytes.set n 11 (if last then '\001' else '\000');
+  Bytes.unsafe_to_string n
+
+let seal_segment sk ~index ~last data =
+  if String.length data > sk.segment_size
+  || (not last && String.length data <> sk.segment_size)
+  then invalid_arg "Streaming_AEAD.seal_segment";
+  AEAD.seal ~iv:(segment_nonce sk index last) sk.key data
+
+let open_segment sk ~index ~last data =
+  if String.length data > sk.segment_size + tag_size
+  || (not last && String.length data <> sk.segment_size + tag_size)
+  then None
+  else AEAD.open_ ~iv:(segment_nonce sk index last) sk.key data
+
+(* Segments are encrypted and decrypted in batches, which are processed
+   by up to [threads] system threads.  A batch is kept in a Bigarray,
+   outside the OCaml heap, so that other OCaml threads can run during
+   the computation.  Segment [i] of a batch starts at offset
+   [i * (segment_size + tag_size)]. *)
+
+let batch_bytes = 0x100_0000
+
+let batch_segments threads seg =
+  if threads = 1 then 1
+  else max 1 (min 64 (batch_bytes / (seg + tag_size)))
+
+let make_batch n seg =
+  Bigarray.(Array1.create char c_layout (n * (seg + tag_size)))
+
+let wipe_batch b = Bigarray.Array1.fill b '\000'
+
+(* The nonces of segments [index] to [index + n - 1].  Only the last
+   of them can be the last segment of the stream. *)
+
+let batch_nonces sk index n last =
+  let b = Bytes.create (12 * n) in
+  for i = 0 to n - 1 do
+    Bytes.blit_string (segment_nonce sk (index + i) (last && i = n - 1)) 0
+                      b (12 * i) 12
+  done;
+  Bytes.unsafe_to_string b
+
+(* [lastlen] is the plaintext length of the last segment of the batch;
+   the other segments are full. *)
+
+let seal_batch sk threads b index n lastlen last =
+  let nonces = batch_nonces sk index n last in
+  match sk.key with
+  | AEAD.AES_GCM_key k ->
+      aead_seal_segments k false nonces b sk.segment_size lastlen threads
+  | AEAD.Chacha20_Poly1305_key k ->
+      aead_seal_segments k true nonces b sk.segment_size lastlen threads
+
+let open_batch sk threads b index n lastlen last =
+  let nonces = batch_nonces sk index n last in
+  match sk.key with
+  | AEAD.AES_GCM_key k ->
+      aead_open_segments k false nonces b sk.segment_size lastlen threads
+  | AEAD.Chacha20_Poly1305_key k ->
+      aead_open_segments k true nonces b sk.segment_size lastlen threads
+
+(* Encryption: the plaintext is accumulated in the current segment [cur]
+   of the batch.  A full segment is encrypted only when more plaintext
+   arrives, so that the last segment is known when [finish] is called. *)
+
+class segment_encrypt threads hdr sk =
+  let seg = sk.segment_size in
+  let nbatch = batch_segments threads seg in
+  object(self)
+    val batch = make_batch nbatch seg
+    val cbuf = Bytes.create 1
+    val mutable cur = 0
+    val mutable used = 0
+    val mutable index = 0
+
+    inherit buffered_output (header_size + 256) as output_buffer
+
+    initializer
+      Bytes.blit_string hdr 0 obuf 0 header_size;
+      oend <- header_size
+
+    method input_block_size = 1
+    method output_block_size = 1
+
+    method private emit last =
+      let n = cur + 1 in
+      let len = cur * (seg + tag_size) + used + tag_size in
+      seal_batch sk threads batch index n used last;
+      self#ensure_capacity len;
+      blit_bigarray_to_bytes batch 0 obuf oend len;
+      oend <- oend + len;
+      index <- index + n;
+      cur <- 0;
+      used <- 0
+
+    method put_substring src ofs len =
+      if len > 0 then begin
+        if used = seg then begin
+          if cur = nbatch - 1 then self#emit false
+          else begin cur <- cur + 1; used <- 0 end
+        end;
+        let n = min len (seg - used) in
+        blit_bytes_to_bigarray src ofs batch (cur * (seg + tag_size) + used) n;
+        used <- used + n;
+        self#put_substring src (ofs + n) (len - n)
+      end
+
+    method put_string s =
+      self#put_substring (Bytes.unsafe_of_string s) 0 (String.length s)
+
+    method put_char c =
+      Bytes.set cbuf 0 c;
+      self#put_substring cbuf 0 1
+
+    method put_byte b = self#put_char (Char.chr b)
+
+    method flush = ()
+
+    method finish = self#emit true
+
+    method wipe =
+      output_buffer#wipe;
+      wipe_batch batch;
+      AEAD.wipe_key sk.key
+  end
+
+let encrypt ?segment_size ?(compress = false) ?associated_data ?rng
+            ?(threads = 0) algo key =
+  let (hdr, sk) =
+    encrypt_header ?segment_size ~compress ?associated_data ?rng algo key in
+  let tr = (new segment_encrypt threads hdr sk :> transform) in
+  if compress then compose (Zlib.compress ()) tr else tr
+
+(* Decryption: the header is read first.  Then the ciphertext is
+   accumulated in the current segment [cur] of the batch, and a full
+   encrypted segment is decrypted only when more ciphertext arrives,
+   since it could be the last segment. *)
+
+class segment_decrypt associated_data threads algo key =
+  object(self)
+    val hbuf = Bytes.create header_size
+    val cbuf = Bytes.create 1
+    val mutable hused = 0
+    val mutable sk = (None: segment_key option)
+    val mutable batch = make_batch 0 0
+    val mutable nbatch = 0
+    val mutable cur = 0
+    val mutable used = 0
+    val mutable index = 0
+    val mutable unzip = (None: transform option)
+    val mutable zbuf = Bytes.empty
+
+    inherit buffered_output 256 as output_buffer
+
+    method input_block_size = 1
+    method output_block_size = 1
+
+    method private output ofs len =
+      match unzip with
+      | None ->
+          self#ensure_capacity len;
+          blit_bigarray_to_bytes batch ofs obuf oend len;
+          oend <- oend + len
+      | Some tr ->
+          blit_bigarray_to_bytes batch ofs zbuf 0 len;
+          tr#put_substring zbuf 0 len;
+          self#transfer tr
+
+    method private transfer (tr: transform) =
+      let (buf, ofs, len) = tr#get_substring in
+      self#ensure_capacity len;
+      Bytes.blit buf ofs obuf oend len;
+      oend <- oend + len
+
+    method private decrypt_batch k last =
+      let seg = k.segment_size in
+      let n = cur + 1 in
+      let lastlen = used - tag_size in
+      if not (open_batch k threads batch index n lastlen last)
+      then raise (Error Authentication_failure);
+      for i = 0 to n - 1 do
+        self#output (i * (seg + tag_size)) (if i = n - 1 then lastlen else seg)
+      done;
+      index <- index + n;
+      cur <- 0;
+      used <- 0
+
+    method put_substring src ofs len =
+      if len > 0 then begin
+        match sk with
+        | None ->
+            let n = min len (header_size - hused) in
+            Bytes.blit src ofs hbuf hused n;
+            hused <- hused + n;
+            if hused = header_size then begin
+              let k = decrypt_header ~associated_data algo key
+                                     (Bytes.to_string hbuf) in
+              sk <- Some k;
+              nbatch <- batch_segments threads k.segment_size;
+              batch <- make_batch nbatch k.segment_size;
+              if k.compressed then begin
+                unzip <- Some (Zlib.uncompress ());
+                zbuf <- Bytes.create k.segment_size
+              end
+            end;
+            self#put_substring src (ofs + n) (len - n)
+        | Some k ->
+            let cseg = k.segment_size + tag_size in
+            if used = cseg then begin
+              if cur = nbatch - 1 then self#decrypt_batch k false
+              else begin cur <- cur + 1; used <- 0 end
+            end;
+            let n = min len (cseg - used) in
+            blit_bytes_to_bigarray src ofs batch (cur * cseg + used) n;
+            used <- used + n;
+            self#put_substring src (ofs + n) (len - n)
+      end
+
+    method put_string s =
+      self#put_substring (Bytes.unsafe_of_string s) 0 (String.length s)
+
+    method put_char c =
+      Bytes.set cbuf 0 c;
+      self#put_substring cbuf 0 1
+
+    method put_byte b = self#put_char (Char.chr b)
+
+    method flush = ()
+
+    method finish =
+      match sk with
+      | None -> raise (Error Wrong_data_length)
+      | Some k ->
+          if used < tag_size then raise (Error Wrong_data_length);
+          self#decrypt_batch k true;
+          match unzip with
+          | None -> ()
+          | Some tr -> tr#finish; self#transfer tr
+
+    method wipe =
+      output_buffer#wipe;
+      wipe_batch batch;
+      wipe_bytes zbuf;
+      begin match sk with None -> () | Some k -> AEAD.wipe_key k.key end;
+      begin match unzip with None -> () | Some tr -> tr#wipe end
+  end
+
+let decrypt ?(associated_data = "") ?(threads = 0) algo key =
+  (new segment_decrypt associated_data threads algo key :> transform)
+
+(* Random access *)
+
+type reader = {
+  ic: in_channel;
+  start: int;                           (* position of the first segment *)
+  rkey: segment_key;
+  nsegments: int;
+  plaintext_length: int;
+  rthreads: int
+}
+
+let open_reader ?associated_data ?(threads = 0) algo key ic =
+  let hdr = really_input_string ic header_size in
+  let sk = decrypt_header ?associated_data algo key hdr in
+  if sk.compressed then
+    invalid_arg "Streaming_AEAD.open_reader: compressed stream";
+  let start = pos_in ic in
+  let ctlen = in_channel_length ic - start in
+  let cseg = sk.segment_size + tag_size in
+  let nsegments = (ctlen + cseg - 1) / cseg in
+  if nsegments = 0 || ctlen - (nsegments - 1) * cseg < tag_size
+  then raise (Error Wrong_data_length);
+  { ic; start; rkey = sk; nsegments;
+    plaintext_length = ctlen - nsegments * tag_size;
+    rthreads = threads }
+
+let plaintext_length r = r.plaintext_length
+
+let read r ofs len =
+  if ofs < 0 || len < 0 || ofs > r.plaintext_length - len
+  then invalid_arg "Streaming_AEAD.read";
+  if len = 0 then "" else begin
+    let seg = r.rkey.segment_size in
+    let cseg = seg + tag_size in
+    let first = ofs / seg and final = (ofs + len - 1) / seg in
+    let n = final - first + 1 in
+    let last = (final = r.nsegments - 1) in
+    let lastlen = if last then r.plaintext_length - final * seg else seg in
+    let ctlen = (n - 1) * cseg + lastlen + tag_size in
+    let ct = Bytes.create ctlen in
+    seek_in r.ic (r.start + first * cseg);
+    really_input r.ic ct 0 ctlen;
+    let b = make_batch n seg in
+    blit_bytes_to_bigarray ct 0 b 0 ctlen;
+    if not (open_batch r.rkey r.rthreads b first n lastlen last)
+    then raise (Error Authentication_failure);
+    let res = Bytes.create len in
+    let pos = ref ofs in
+    while !pos < ofs + len do
+      let index = !pos / seg in
+      let m = min (ofs + len - !pos) ((index + 1) * seg - !pos) in
+      blit_bigarray_to_bytes b ((index - first) * cseg + !pos - index * seg)
+                             res (!pos - ofs) m;
+      pos := !pos + m
+    done;
+    wipe_batch b;
+    Bytes.unsafe_to_string res
+  end
+
+let close_reader r =
+  AEAD.wipe_key r.rkey.key
+
+end
+
+(* Encrypted page store *)
+
+module Page_store = struct
+
+type storage = {
+  read: int -> bytes -> int -> int -> unit;
+  write: int -> bytes -> int -> int -> unit
+}
+
+let file_storage fd =
+  let rec read_at pos buf ofs len =
+    if len > 0 then begin
+      ignore (Unix.LargeFile.lseek fd (Int64.of_int pos) Unix.SEEK_SET);
+      let n = Unix.read fd buf ofs len in
+      if n = 0
+      then Bytes.fill buf ofs len '\000'   (* past end of file *)
+      else read_at (pos + n) buf (ofs + n) (len - n)
+    end in
+  let write_at pos buf ofs len =
+    ignore (Unix.LargeFile.lseek fd (Int64.of_int pos) Unix.SEEK_SET);
+    ignore (Unix.write fd buf ofs len) in
+  { read = read_at; write = write_at }
+
+let bigarray_storage (ba: AEAD.bigbytes) =
+  let check pos len =
+    if pos < 0 || len < 0 || pos > Bigarray.Array1.dim ba - len
+    then invalid_arg "Page_store: access outside of the Bigarray" in
+  { read = (fun pos buf ofs len ->
+      check pos len;
+      for i = 0 to len - 1 do
+        Bytes.unsafe_set buf (ofs + i) (Bigarray.Array1.unsafe_get ba (pos + i))
+      done);
+    write = (fun pos buf ofs len ->
+      check pos len;
+      for i = 0 to len - 1 do
+        Bigarray.Array1.unsafe_set ba (pos + i) (Bytes.unsafe_get buf (ofs + i))
+      done) }
+
+(* Each entry of the side table contains the generation number of the page
+   (4 bytes, big-endian, 0 if the page was never written), followed
+   by the authentication tag of the page. *)
+
+let tag_entry_size = 20
+
+(* The cache of decrypted pages is a hash table from page numbers to nodes
+   of a circular doubly-linked list, ordered from most recently used
+   to least recently used, with [lru] as sentinel. *)
+
+type node = {
+  mutable page: int;
+  data: bytes;
+  mutable prev: node;
+  mutable next: node
+}
+
+type t = {
+  key: AEAD.key;
+  page_size: int;
+  data_storage: storage;
+  tag_storage: storage;
+  cache: (int, node) Hashtbl.t;
+  cache_size: int;
+  lru: node;
+  scratch: bytes;                       (* ciphertext + tag *)
+  entry: bytes                          (* side table entry *)
+}
+
+let create ?(cache_size = 64) ~page_size ~data ~tags key =
+  if page_size <= 0 || cache_size < 0 then invalid_arg "Page_store.create";
+  let rec lru = { page = -1; data = Bytes.empty; prev = lru; next = lru } in
+  { key; page_size; data_storage = data; tag_storage = tags;
+    cache = Hashtbl.create (2 * cache_size + 1); cache_size; lru;
+    scratch = Bytes.create (page_size + AEAD.tag_size);
+    entry = Bytes.create tag_entry_size }
+
+let page_size t = t.page_size
+
+let unlink n =
+  n.prev.next <- n.next; n.next.prev <- n.prev
+
+let push_front t n =
+  n.next <- t.lru.next; n.prev <- t.lru;
+  t.lru.next.prev <- n; t.lru.next <- n
+
+(* Return a cache node for page [p], to be filled by the caller.
+   If the cache is full, the least recently used page is evicted,
+   and its buffer is wiped and reused. *)
+
+let cache_slot t p =
+  let n =
+    if Hashtbl.length t.cache < t.cache_size then begin
+      let data = Bytes.create t.page_size in
+      let rec n = { page = p; data; prev = n; next = n } in n
+    end else begin
+      let n = t.lru.prev in
+      unlink n;
+      Hashtbl.remove t.cache n.page;
+      wipe_bytes n.data;
+      n.page <- p;
+      n
+    end in
+  Hashtbl.replace t.cache p n;
+  push_front t n;
+  n
+
+let cache_find t p =
+  match Hashtbl.find_opt t.cache p with
+  | None -> None
+  | Some n -> unlink n; push_front t n; Some n
+
+let cache_add t p buf ofs =
+  if t.cache_size > 0 then begin
+    let n =
+      match cache_find t p with Some n -> n | None -> cache_slot t p in
+    Bytes.blit buf ofs n.data 0 t.page_size
+  end
+
+(* The nonce for a page is its number (8 bytes) followed by its
+   generation number (4 bytes), both big-endian. *)
+
+let nonce p gen =
+  let b = Bytes.create 12 in
+  Bytes.set_int64_be b 0 (Int64.of_int p);
+  Bytes.set_int32_be b 8 gen;
+  Bytes.unsafe_to_string b
+
+let read_entry t p =
+  t.tag_storage.read (p * tag_entry_size) t.entry 0 tag_entry_size;
+  Bytes.get_int32_be t.entry 0
+
+let check_page t p name =
+  if p < 0 || p > max_int / (max t.page_size tag_entry_size)
+  then invalid_arg name
+
+let write_page t p src ofs =
+  check_page t p "Page_store.write_page";
+  if ofs < 0 || ofs > Bytes.length src - t.page_size
+  then invalid_arg "Page_store.write_page";
+  let gen = Int32.succ (read_entry t p) in
+  if gen = 0l then raise (Error Message_too_long);
+  AEAD.seal_into ~iv:(nonce p gen) t.key src ofs t.page_size t.scratch 0;
+  t.data_storage.write (p * t.page_size) t.scratch 0 t.page_size;
+  Bytes.set_int32_be t.entry 0 gen;
+  Bytes.blit t.scratch t.page_size t.entry 4 AEAD.tag_size;
+  t.tag_storage.write (p * tag_entry_size) t.entry 0 tag_entry_size;
+  cache_add t p src ofs
+
+let read_page t p dst ofs =
+  check_page t p "Page_store.read_page";
+  if ofs < 0 || ofs > Bytes.length dst - t.page_size
+  then invalid_arg "Page_store.read_page";
+  match cache_find t p with
+  | Some n ->
+      Bytes.blit n.data 0 dst ofs t.page_size
+  | None ->
+      let gen = read_entry t p in
+      if gen = 0l then raise Not_found;
+      t.data_storage.read (p * t.page_size) t.scratch 0 t.page_size;
+      Bytes.blit t.entry 4 t.scratch t.page_size AEAD.tag_size;
+      if not (AEAD.open_in_place ~iv:(nonce p gen) t.key t.scratch 0
+                                 (Bytes.length t.scratch))
+      then raise (Error Authentication_failure);
+      Bytes.blit t.scratch 0 dst ofs t.page_size;
+      cache_add t p dst ofs;
+      wipe_bytes t.scratch
+
+let read_pages t pages =
+  Array.iter (fun p -> check_page t p "Page_store.read_pages") pages;
+  let res = Array.map (fun _ -> Bytes.create t.page_size) pages in
+  (* Pages not in cache are read, then decrypted in one batch *)
+  let missing = ref [] in
+  Array.iteri (fun i p ->
+    match cache_find t p with
+    | Some n -> Bytes.blit n.data 0 res.(i) 0 t.page_size
+    | None -> missing := i :: !missing)
+    pages;
+  let missing = Array.of_list (List.rev !missing) in
+  if Array.length missing > 0 then begin
+    let bufs =
+      Array.map (fun _ -> Bytes.create (t.page_size + AEAD.tag_size))
+                missing in
+    let ivs =
+      Array.mapi (fun j i ->
+        let p = pages.(i) in
+        let gen = read_entry t p in
+        if gen = 0l then raise Not_found;
+        t.data_storage.read (p * t.page_size) bufs.(j) 0 t.page_size;
+        Bytes.blit t.entry 4 bufs.(j) t.page_size AEAD.tag_size;
+        nonce p gen)
+      missing in
+    let ok =
+      AEAD.open_batch ~ivs (Array.make (Array.length missing) t.key) bufs in
+    if not (Array.for_all (fun b -> b) ok) then begin
+      Array.iter wipe_bytes bufs;
+      raise (Error Authentication_failure)
+    end;
+    Array.iteri (fun j i ->
+      Bytes.blit bufs.(j) 0 res.(i) 0 t.page_size;
+      cache_add t pages.(i) bufs.(j) 0;
+      wipe_bytes bufs.(j))
+      missing
+  end;
+  res
+
+let wipe t =
+  Hashtbl.iter (fun _ n -> wipe_bytes n.data) t.cache;
+  Hashtbl.reset t.cache;
+  t.lru.next <- t.lru; t.lru.prev <- t.lru;
+  wipe_bytes t.scratch
+
+end
+
 (* Utilities *)
 
 let xor_bytes src src_ofs dst dst_ofs len =
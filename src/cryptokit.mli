@@ -173,7 +173,7 @@ val compose: transform -> transform -> transform
 (** A {i hash} is a function that maps arbitrarily-long character
     sequences to small, fixed-size strings.  *)
 class type hash =
-  object
+  object('self)
 
     method add_substring: bytes -> int -> int -> unit
       (** [add_substring b pos len] adds [len] characters from byte array
@@ -200,15 +200,98 @@ class type hash =
           additional data.  Hence, do not call any of the [add_*] methods
           after [result]. *)
 
+    method result_into: bytes -> int -> unit
+      (** [result_into b pos] is like [result], but stores the hash value
+          in [b] starting at position [pos], without allocating a string.
+          @raise Invalid_argument if [b] does not have room for
+          [hash_size] bytes at [pos]. *)
+
+    method reset: unit
+      (** Restart the hash computation from the beginning, as if
+          no data had been added, keeping the same parameters and key.
+          A hash can thus be used for several messages in turn,
+          calling [reset] after [result] or [result_into]. *)
+
     method hash_size: int
       (** Return the size of hash values produced by this hash function,
           in bytes. *)
 
+    method copy: 'self
+      (** Return an independent copy of this hash, in the same state.
+          The copy and the original can then be given different
+          additional data.  This way, a common prefix of several
+          messages is hashed only once.
+          For MACs built from block ciphers, the copy shares the block
+          cipher with the original: wiping one of them makes the other
+          unusable.  An HMAC built from a key string gets its own copy
+          of the prepared key, and one built by
+          {!Cryptokit.MAC.hmac_of_key} shares the caller's key, which
+          its [wipe] method leaves alone. *)
+
+    method serialize: string
+      (** Return the current state of the hash computation as a string,
+          from which {!Cryptokit.Hash.deserialize} rebuilds an equivalent
+          hash.  The string identifies the hash function and is only
+          valid for the same version of Cryptokit, on a platform with
+          the same word size and endianness.
+          The state of a keyed hash (a BLAKE2 or BLAKE3 MAC) contains
+          key material and must be protected like the key itself.
+          The state of a BLAKE2 MAC does not contain the key, but that
+          of a BLAKE3 MAC does, since BLAKE3 uses the key for every
+          chunk of the message.
+          @raise Invalid_argument for hashes whose state cannot be
+          serialized: HMAC and the other MACs, BLAKE2bp, BLAKE2sp,
+          BLAKE2X and KangarooTwelve, and BLAKE2 MACs to which no
+          data has been added yet. *)
+
     method wipe: unit
       (** Erase all internal buffers and data structures of this hash,
           overwriting them with zeroes.  See {!Cryptokit.transform.wipe}. *)
   end
 
+(** An {i extendable-output function} (XOF) is a hash function whose
+    output is a stream of bytes of unbounded length, instead of a
+    fixed-size hash value.  *)
+class type xof =
+  object('self)
+    method add_substring: bytes -> int -> int -> unit
+      (** [add_substring b pos len] adds [len] characters from byte array
+          [b], starting at character number [pos], to the input. *)
+
+    method add_string: string -> unit
+      (** [add_string str] adds all characters of string [str]
+          to the input. *)
+
+    method add_char: char -> unit
+      (** [add_char c] adds character [c] to the input. *)
+
+    method add_byte: int -> unit
+      (** [add_byte b] adds the character having code [b] to the input.
+          [b] must be between [0] and [255] inclusive. *)
+
+    method squeeze: int -> string
+      (** [squeeze n] returns the next [n] bytes of output.
+          Successive calls return consecutive parts of the output stream.
+          Do not call any of the [add_*] methods after [squeeze]. *)
+
+    method squeeze_into: bytes -> int -> int -> unit
+      (** [squeeze_into b pos len] is like [squeeze len], but stores
+          the output bytes in [b] starting at position [pos]. *)
+
+    method copy: 'self
+      (** Return an independent copy of this XOF, in the same state,
+          including the position in the output stream. *)
+
+    method reset: unit
+      (** Restart from the beginning, as if no data had been added,
+          keeping the same parameters and key.  The [add_*] methods
+          can be called again after [reset]. *)
+
+    method wipe: unit
+      (** Erase all internal buffers and data structures of this XOF,
+          overwriting them with zeroes. *)
+  end
+
 val hash_string: hash -> string -> string
   (** [hash_string h s] runs the string [s] through the hash function [h]
       and returns the hash value of [s].  
@@ -285,6 +368,29 @@ class type authenticated_transform =
       (** See {!Cryptokit.transform.wipe}. *)
   end
 
+class type authenticated_transform_with_header =
+  object
+    inherit authenticated_transform
+
+    method put_header_substring: bytes -> int -> int -> unit
+      (** [put_header_substring b pos len] adds the characters at
+          positions [pos] to [pos + len - 1] of [b] to the associated data,
+          i.e. the data that is authenticated but not encrypted.
+          The associated data can be provided in several pieces,
+          but all of it must be given before the first character of
+          data to be encrypted or decrypted: calling [put_header_substring]
+          after any of the [put_*] methods raises [Invalid_argument]. *)
+
+    method put_header_string: string -> unit
+      (** [put_header_string str] adds all characters of the string [str]
+          to the associated data.  See
+          {!Cryptokit.authenticated_transform_with_header.put_header_substring}. *)
+  end
+  (** Some authenticated transforms support associated data that is
+      provided incrementally, instead of as a single string at creation
+      time.  This is useful for large associated data, which can then
+      be hashed piece by piece, e.g. as it is read from a file. *)
+
 val auth_transform_string: authenticated_transform -> string -> string
   (** [auth_transform_string t s] runs the string [s] through the
       authenticated transform [t] and returns the concatenation
@@ -701,6 +807,388 @@ module AEAD : sig
         authenticated, i.e. taken into account for computing the authentication
         tag.  If not provided, it defaults to the empty string.
     *)
+
+  val aes_gcm_with_header:
+    ?header: string -> iv: string -> string -> direction ->
+    authenticated_transform_with_header
+    (** Same as {!Cryptokit.AEAD.aes_gcm}, but the returned transform
+        also accepts associated data incrementally, via its
+        [put_header_substring] and [put_header_string] methods.
+        The associated data is the optional [header] followed by
+        all the data given to these methods. *)
+
+  val chacha20_poly1305_with_header:
+    ?header: string -> iv: string -> string -> direction ->
+    authenticated_transform_with_header
+    (** Same as {!Cryptokit.AEAD.chacha20_poly1305}, but the returned
+        transform also accepts associated data incrementally, via its
+        [put_header_substring] and [put_header_string] methods.
+        The associated data is the optional [header] followed by
+        all the data given to these methods. *)
+
+(** {2 One-shot authenticated encryption} *)
+
+(** The functions below encrypt or decrypt a whole message in a single
+    call, without going through an authenticated transform.
+    They are faster than {!Cryptokit.auth_transform_string} and
+    {!Cryptokit.auth_check_transform_string} for short messages,
+    and allow one key to be reused for many messages. *)
+
+  type key
+    (** A key for one-shot authenticated encryption, prepared once
+        and reusable for any number of messages. *)
+
+  val aes_gcm_key: string -> key
+    (** [aes_gcm_key k] prepares the AES-GCM key [k] for use with
+        {!Cryptokit.AEAD.seal} and {!Cryptokit.AEAD.open_}.
+        [k] must have length 16, 24 or 32. *)
+
+  val chacha20_poly1305_key: string -> key
+    (** [chacha20_poly1305_key k] prepares the Chacha20-Poly1305 key [k]
+        for use with {!Cryptokit.AEAD.seal} and {!Cryptokit.AEAD.open_}.
+        [k] must have length 16 or 32. *)
+
+  val wipe_key: key -> unit
+    (** Erase the given key, overwriting it with zeroes.
+        The key can no longer be used afterwards. *)
+
+  val seal: ?header: string -> iv: string -> key -> string -> string
+    (** [seal ?header ~iv key msg] encrypts [msg] and returns the
+        concatenation of the ciphertext and the 16-byte
+        authentication tag.  The result is identical to that of
+        [auth_transform_string] applied to [aes_gcm ?header ~iv k Encrypt]
+        or [chacha20_poly1305 ?header ~iv k Encrypt], as determined by [key].
+        The requirements on [iv] and the meaning of [header] are
+        as described for these functions. *)
+
+  val open_: ?header: string -> iv: string -> key -> string -> string option
+    (** [open_ ?header ~iv key msg] splits [msg] into a ciphertext and
+        a 16-byte authentication tag, and checks the tag.  If the tag
+        is correct, the ciphertext is decrypted and returned.  Otherwise,
+        [None] is returned, and no decryption is performed.
+        Raise [Error Wrong_data_length] if [msg] is shorter than 16 bytes. *)
+
+  val seal_into:
+    ?header: string -> iv: string -> key ->
+    bytes -> int -> int -> bytes -> int -> unit
+    (** [seal_into ?header ~iv key src srcofs len dst dstofs] is like
+        [seal], but encrypts the [len] bytes of [src] starting at
+        [srcofs], and stores the ciphertext followed by the authentication
+        tag in [dst], starting at [dstofs].  [len + 16] bytes are written
+        to [dst].  [src] and [dst] can be the same byte array,
+        with [srcofs = dstofs], to encrypt in place. *)
+
+  val open_into:
+    ?header: string -> iv: string -> key ->
+    bytes -> int -> int -> bytes -> int -> bool
+    (** [open_into ?header ~iv key src srcofs len dst dstofs] is like
+        [open_], but takes its input from the [len] bytes of [src]
+        starting at [srcofs], the last 16 of which are the authentication tag.
+        If the tag is correct, the [len - 16] bytes of plaintext are stored
+        in [dst] starting at [dstofs], and [true] is returned.
+        Otherwise, [false] is returned and [dst] is unchanged.
+        [src] and [dst] can be the same byte array,
+        with [srcofs = dstofs], to decrypt in place. *)
+
+(** {2 In-place authenticated encryption} *)
+
+(** The functions below encrypt or decrypt a message in place,
+    in a byte array or in a Bigarray.  They perform no allocation.
+    When decrypting, the authentication tag is checked first,
+    and decryption takes place only if the tag is correct.
+    Hence, rejecting a forged message costs only one
+    GHASH or Poly1305 pass over it, and leaves the buffer unchanged. *)
+
+  val seal_in_place:
+    ?header: string -> iv: string -> key -> bytes -> int -> int -> unit
+    (** [seal_in_place ?header ~iv key buf ofs len] encrypts the [len]
+        bytes of [buf] starting at [ofs], replacing them with the
+        ciphertext, and stores the 16-byte authentication tag just after,
+        at positions [ofs + len] to [ofs + len + 15]. *)
+
+  val open_in_place:
+    ?header: string -> iv: string -> key -> bytes -> int -> int -> bool
+    (** [open_in_place ?header ~iv key buf ofs len] checks the
+        authentication tag of the [len] bytes of [buf] starting at [ofs],
+        the last 16 of which are the tag.  If the tag is correct,
+        the first [len - 16] bytes are decrypted in place, and [true]
+        is returned.  Otherwise, [false] is returned and [buf] is unchanged.
+        Raise [Error Wrong_data_length] if [len < 16]. *)
+
+  type bigbytes =
+    (char, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t
+    (** One-dimensional Bigarrays of characters, e.g. network buffers
+        or memory-mapped files. *)
+
+  val seal_in_place_bigarray:
+    ?header: string -> iv: string -> key -> bigbytes -> int -> int -> unit
+    (** Same as {!Cryptokit.AEAD.seal_in_place}, for a Bigarray. *)
+
+  val open_in_place_bigarray:
+    ?header: string -> iv: string -> key -> bigbytes -> int -> int -> bool
+    (** Same as {!Cryptokit.AEAD.open_in_place}, for a Bigarray. *)
+
+(** {2 Batch authenticated encryption} *)
+
+(** The functions below encrypt or decrypt many independent packets
+    in one call.  The processing of several packets is interleaved,
+    so that the AES or Chacha20 computations of different packets,
+    as well as their GHASH or Poly1305 computations, run in parallel.
+    This is significantly faster than calling {!Cryptokit.AEAD.seal_into}
+    repeatedly on short packets. *)
+
+  val seal_batch:
+    ?headers: string array -> ivs: string array -> key array ->
+    bytes array -> unit
+    (** [seal_batch ?headers ~ivs keys bufs] encrypts each packet
+        [bufs.(i)] in place, with key [keys.(i)], IV [ivs.(i)]
+        and associated data [headers.(i)] (the empty string if
+        [headers] is not provided).  Each buffer [bufs.(i)] contains
+        the plaintext followed by 16 bytes of room for the authentication
+        tag; on return, it contains the ciphertext followed by the tag,
+        as produced by {!Cryptokit.AEAD.seal}.
+        All arrays must have the same length.  The same key can be
+        used for several packets, but not the same key and IV. *)
+
+  val open_batch:
+    ?headers: string array -> ivs: string array -> key array ->
+    bytes array -> bool array
+    (** [open_batch ?headers ~ivs keys bufs] checks and decrypts each
+        packet [bufs.(i)] in place, with key [keys.(i)], IV [ivs.(i)]
+        and associated data [headers.(i)].  Each buffer [bufs.(i)]
+        contains a ciphertext followed by its 16-byte authentication tag.
+        The result is an array of booleans, one per packet.
+        If it is [true], the tag of the packet is correct and the first
+        [Bytes.length bufs.(i) - 16] bytes of [bufs.(i)] now contain the
+        plaintext.  If it is [false], the packet is corrupted and
+        [bufs.(i)] is unchanged.  The processing of the other packets
+        is not affected.
+        Raise [Error Wrong_data_length] if a buffer is shorter than
+        16 bytes. *)
+end
+
+(** The [Streaming_AEAD] module implements authenticated encryption
+    of long streams of data, such as files larger than memory,
+    following the segmented "STREAM" construction used by age and Tink.
+    The plaintext is split into segments of fixed size, each of which
+    is encrypted and authenticated separately with {!Cryptokit.AEAD},
+    using a nonce derived from the segment number and a flag marking
+    the last segment.  Hence, decryption never releases plaintext
+    that has not been authenticated, detects truncation and reordering
+    of segments, and any segment can be decrypted independently of
+    the others.
+
+    The ciphertext consists of a header of {!Cryptokit.Streaming_AEAD.header_size}
+    bytes, followed by the encrypted segments, each
+    {!Cryptokit.Streaming_AEAD.tag_size} bytes longer than the
+    corresponding plaintext segment.  Each stream is encrypted with
+    its own key, derived from the master key and a random salt stored
+    in the header. *)
+module Streaming_AEAD : sig
+
+  type algorithm = AES_GCM | Chacha20_Poly1305
+    (** The authenticated encryption algorithm used for segments.
+        The master key must have length 16, 24 or 32 for AES-GCM,
+        and 16 or 32 for Chacha20-Poly1305. *)
+
+  val header_size: int
+    (** The size in bytes of the header of an encrypted stream. *)
+
+  val tag_size: int
+    (** The size in bytes of the authentication tag of each segment. *)
+
+  val default_segment_size: int
+    (** The default size of plaintext segments: 64 Kbytes. *)
+
+  val encrypt:
+    ?segment_size: int -> ?compress: bool -> ?associated_data: string ->
+    ?rng: Random.rng -> ?threads: int -> algorithm -> string -> transform
+    (** [encrypt algo key] returns a transform that encrypts its input
+        with the master key [key], producing the header followed by the
+        encrypted segments.  It can be used with
+        {!Cryptokit.transform_channel} to encrypt a file.
+    - [segment_size] is the size of plaintext segments, between 1 byte
+      and 64 Mbytes.  Default is {!Cryptokit.Streaming_AEAD.default_segment_size}.
+    - If [compress] is [true], the plaintext is compressed with
+      {!Cryptokit.Zlib.compress} before encryption, and the
+      corresponding decryption transform decompresses it.
+      Default is [false].
+    - [associated_data] is data that is authenticated along with
+      the stream but not included in the ciphertext.  It must be given
+      again for decryption.  Default is the empty string.
+    - [rng] is used to generate the salt and the nonce prefix.
+      Default is {!Cryptokit.Random.secure_rng}.
+    - Segments are encrypted in batches of up to 16 Mbytes, by up to
+      [threads] system threads.  Other OCaml threads can run during
+      the computation.  [threads] defaults to the number of processors.
+      Threads are used only if the C compiler supports POSIX threads.
+    *)
+
+  val decrypt:
+    ?associated_data: string -> ?threads: int -> algorithm -> string ->
+    transform
+    (** [decrypt algo key] returns a transform that decrypts a stream
+        produced by [encrypt algo key].  Plaintext is output one batch
+        of segments at a time, after all of them have been authenticated.
+        Batches and [threads] are as for {!Cryptokit.Streaming_AEAD.encrypt}.
+        Raise [Error Authentication_failure] if a segment is corrupted,
+        or if the stream was truncated or reordered, and
+        [Error Bad_encoding] if the header is invalid. *)
+
+(** {2 Random access} *)
+
+  type reader
+    (** A handle for decrypting arbitrary parts of an encrypted stream
+        stored in a file. *)
+
+  val open_reader:
+    ?associated_data: string -> ?threads: int -> algorithm -> string ->
+    in_channel -> reader
+    (** [open_reader algo key ic] reads the header of the encrypted stream
+        that starts at the current position of [ic] and extends to the end
+        of [ic].  [ic] must support seeking.  Compressed streams are not
+        supported, since their plaintext positions are not known.
+        The segments read by {!Cryptokit.Streaming_AEAD.read} are decrypted
+        by up to [threads] system threads, defaulting to the number of
+        processors. *)
+
+  val plaintext_length: reader -> int
+    (** The total length of the plaintext. *)
+
+  val read: reader -> int -> int -> string
+    (** [read r pos len] returns the [len] characters of plaintext
+        starting at position [pos].  Only the segments containing these
+        characters are read and decrypted.
+        Raise [Error Authentication_failure] if one of them is corrupted. *)
+
+  val close_reader: reader -> unit
+    (** Wipe the key associated with the reader.  The input channel
+        is not closed. *)
+
+(** {2 Segment-level interface} *)
+
+(** The functions below encrypt and decrypt individual segments.
+    They do not modify any shared state, so that the segments of a stream
+    can be processed in parallel, e.g. by several domains or processes,
+    and then assembled in order: the ciphertext is the header followed
+    by the encrypted segments in increasing index order. *)
+
+  type segment_key
+    (** The key for the segments of one stream. *)
+
+  val encrypt_header:
+    ?segment_size: int -> ?compress: bool -> ?associated_data: string ->
+    ?rng: Random.rng -> algorithm -> string -> string * segment_key
+    (** [encrypt_header algo key] generates a fresh header and returns it
+        along with the corresponding segment key.  The optional arguments
+        are as for {!Cryptokit.Streaming_AEAD.encrypt}; [compress] only
+        records in the header that the plaintext is compressed. *)
+
+  val decrypt_header:
+    ?associated_data: string -> algorithm -> string -> string -> segment_key
+    (** [decrypt_header algo key hdr] returns the segment key for the
+        stream whose header is [hdr].
+        Raise [Error Bad_encoding] if the header is invalid. *)
+
+  val segment_size: segment_key -> int
+    (** The plaintext size of the segments. *)
+
+  val compressed: segment_key -> bool
+    (** Whether the plaintext was compressed before encryption. *)
+
+  val seal_segment: segment_key -> index: int -> last: bool -> string -> string
+    (** [seal_segment sk ~index ~last data] encrypts segment number [index]
+        (starting at 0) of the stream.  [last] must be [true] for the last
+        segment, and only for it.  [data] must have length
+        [segment_size sk], except for the last segment, which can be
+        shorter, and even empty.  The result is [tag_size] bytes longer
+        than [data]. *)
+
+  val open_segment:
+    segment_key -> index: int -> last: bool -> string -> string option
+    (** [open_segment sk ~index ~last data] authenticates and decrypts
+        segment number [index] of the stream.  The result is [None]
+        if the segment is corrupted, or if its index or its last flag
+        is incorrect. *)
+end
+
+(** The [Page_store] module provides encrypted storage of fixed-size
+    pages, e.g. for a database engine that keeps its pages encrypted
+    at rest.  Each page is encrypted with {!Cryptokit.AEAD} under a
+    nonce derived from the page number and from a generation number
+    that is incremented at each write, so that no nonce is ever reused.
+    The generation numbers and authentication tags are kept in a
+    side table, so that encrypted pages have the same size as plaintext
+    pages.  Decrypted pages are kept in a bounded cache, managed in
+    least-recently-used order; pages evicted from the cache are wiped.
+
+    Note: the side table must be protected against rollback by other
+    means, e.g. by authenticating it as a whole, since replacing
+    a page and its side table entry with an older version
+    of both is not detected. *)
+module Page_store : sig
+
+  type storage = {
+    read: int -> bytes -> int -> int -> unit;
+      (** [read pos buf ofs len] reads [len] bytes at position [pos]
+          of the storage into [buf] at [ofs].  Bytes never written
+          must read as zeros. *)
+    write: int -> bytes -> int -> int -> unit
+      (** [write pos buf ofs len] writes the [len] bytes of [buf] at
+          [ofs] at position [pos] of the storage. *)
+  }
+    (** The backing store for encrypted pages or for the side table. *)
+
+  val file_storage: Unix.file_descr -> storage
+    (** A storage backed by a file, which must be opened for reading
+        and writing. *)
+
+  val bigarray_storage: AEAD.bigbytes -> storage
+    (** A storage backed by a Bigarray, e.g. a region of memory or a
+        memory-mapped file obtained with [Unix.map_file]. *)
+
+  val tag_entry_size: int
+    (** The size in bytes of an entry of the side table.  The entry
+        for page [n] is at position [n * tag_entry_size]. *)
+
+  type t
+    (** An encrypted page store. *)
+
+  val create:
+    ?cache_size: int -> page_size: int -> data: storage -> tags: storage ->
+    AEAD.key -> t
+    (** [create ~page_size ~data ~tags key] returns a page store
+        whose pages are [page_size] bytes long.  The encrypted contents
+        of page [n] are stored in [data] at position [n * page_size],
+        and its side table entry is stored in [tags].
+        Pages are encrypted with [key], which must not be used for any
+        other purpose.  At most [cache_size] decrypted pages are kept in
+        the cache (default: 64). *)
+
+  val page_size: t -> int
+    (** The size of pages. *)
+
+  val write_page: t -> int -> bytes -> int -> unit
+    (** [write_page t n buf ofs] encrypts the [page_size t] bytes of [buf]
+        starting at [ofs], and stores them as page number [n]. *)
+
+  val read_page: t -> int -> bytes -> int -> unit
+    (** [read_page t n buf ofs] stores the contents of page number [n]
+        into [buf] starting at [ofs].  The page is taken from the cache,
+        or read, authenticated and decrypted.
+        Raise [Not_found] if the page was never written, and
+        [Error Authentication_failure] if it was corrupted. *)
+
+  val read_pages: t -> int array -> bytes array
+    (** [read_pages t ns] returns the contents of the pages whose
+        numbers are given in [ns].  The pages that are not in the cache
+        are authenticated and decrypted together, with
+        {!Cryptokit.AEAD.open_batch}.  Exceptions are as for [read_page]. *)
+
+  val wipe: t -> unit
+    (** Wipe the decrypted pages held in the cache and the internal
+        buffers.  The key is not wiped, since it belongs to the caller:
+        use {!Cryptokit.AEAD.wipe_key} once no store uses it. *)
 end
 
 (** The [Hash] module implements unkeyed cryptographic hashes (SHA-1,
@@ -728,6 +1216,49 @@ module Hash : sig
         uses a slightly different padding.  The parameter is the same as
         that of [sha3]. *)
 
+  val shake128: unit -> xof
+    (** SHAKE128 is the extendable-output function of the SHA-3 standard
+        (FIPS 202) with a security level of 128 bits. *)
+
+  val shake256: unit -> xof
+    (** SHAKE256 is the extendable-output function of the SHA-3 standard
+        (FIPS 202) with a security level of 256 bits. *)
+
+  val cshake128: ?name:string -> ?custom:string -> unit -> xof
+    (** cSHAKE128 (NIST SP 800-185) is SHAKE128 customized by
+        a function name [name], reserved for functions defined by NIST,
+        and a customization string [custom].  Different customizations
+        give unrelated outputs.  Both default to the empty string,
+        in which case cSHAKE128 is SHAKE128. *)
+
+  val cshake256: ?name:string -> ?custom:string -> unit -> xof
+    (** cSHAKE256 is SHAKE256 customized like {!Cryptokit.Hash.cshake128}. *)
+
+  val k12: ?custom:string -> int -> hash
+    (** KangarooTwelve (RFC 9861) is a hash function of the Keccak family
+        that uses 12 rounds of the Keccak permutation instead of 24,
+        and hashes inputs longer than 8 Kbytes as a tree, whose leaves
+        are processed 4 at a time on processors that support AVX2.
+        It is several times faster than SHA-3 on long inputs.
+        The parameter is the desired size of the hash, in bits.
+        It must be positive and a multiple of 8.
+        The optional [custom] argument is a customization string,
+        empty by default.  Different customizations give unrelated
+        hashes. *)
+
+  val k12_xof: ?custom:string -> unit -> xof
+    (** KangarooTwelve, used as an extendable-output function.
+        The first bytes of output are the hash computed by
+        {!Cryptokit.Hash.k12}. *)
+
+  val k12_parallel: ?threads:int -> ?custom:string -> int -> string -> string
+    (** [k12_parallel sz s] returns the KangarooTwelve hash of [s],
+        of [sz] bits.  The leaves of the tree are hashed in parallel
+        by up to [threads] system threads, as in
+        {!Cryptokit.Hash.blake3_parallel}.
+        [threads] defaults to the number of processors.
+        The result is the same as with {!Cryptokit.Hash.k12}. *)
+
   val sha2: int -> hash
     (** SHA-2, another NIST standard for cryptographic hashing, produces
         hashes of 224, 256, 384, or 512 bits (24, 32, 48 or 64 bytes).
@@ -768,6 +1299,32 @@ module Hash : sig
   val blake2s256: unit -> hash
     (** BLAKE2s256 is BLAKE2s specialized to 256 bit hashes (32 bytes). *)
 
+  val blake2bp: int -> hash
+    (** BLAKE2bp is the 4-way parallel variant of BLAKE2b.  The input
+        is hashed by 4 independent BLAKE2b instances, each processing
+        one 128-byte block out of 4, which run in parallel on processors
+        that support the AVX2 instruction set.  The parameter is the
+        desired size of the hash, in bits.  It must be between 8 and 512,
+        and a multiple of 8.  The hashes differ from BLAKE2b hashes. *)
+
+  val blake2sp: int -> hash
+    (** BLAKE2sp is the 8-way parallel variant of BLAKE2s, like
+        {!Cryptokit.Hash.blake2bp}.  The parameter is the
+        desired size of the hash, in bits.  It must be between 8 and 256,
+        and a multiple of 8. *)
+
+  val blake2xb: int -> hash
+    (** BLAKE2Xb is the extendable-output variant of BLAKE2b.
+        The parameter is the desired size of the hash, in bits.
+        It must be a positive multiple of 8, less than [8 * (2{^32} - 1)].
+        The output length is part of the hash computation, hence
+        hashes of different lengths are unrelated. *)
+
+  val blake2xs: int -> hash
+    (** BLAKE2Xs is the extendable-output variant of BLAKE2s.
+        The parameter is the desired size of the hash, in bits.
+        It must be a positive multiple of 8, less than [8 * (2{^16} - 1)]. *)
+
   val blake3: int -> hash
     (** The BLAKE3 hash function produces hashes of arbitrary length.
         The recommended length is 32 bytes (256 bits).
@@ -778,6 +1335,54 @@ module Hash : sig
   val blake3_256: unit -> hash
     (** The BLAKE3 hash function, specialized to 256 bit hashes (32 bytes). *)
 
+  class type blake3_xof =
+    object
+      inherit xof
+      method seek: int64 -> unit
+        (** [seek pos] sets the position in the output stream of the
+            next byte returned by [squeeze]. *)
+      method position: int64
+        (** The position in the output stream of the next byte
+            returned by [squeeze]. *)
+    end
+
+  val blake3_xof: ?key:string -> unit -> blake3_xof
+    (** The BLAKE3 hash function, used as an extendable-output function.
+        If [key] is given, it must be 32 bytes long, and the output
+        is that of the BLAKE3 keyed hash.
+        The first 32 bytes of output are the BLAKE3 hash of the input.
+        Any part of the output stream can be read, in any order,
+        using the [seek] method; each block of 64 output bytes costs
+        one compression. *)
+
+  val blake3_parallel: ?threads:int -> ?key:string -> int -> string -> string
+    (** [blake3_parallel sz s] returns the BLAKE3 hash of [s], of
+        [sz] bits.  Large strings are split along the BLAKE3 tree into
+        subtrees that are hashed in parallel by up to [threads] system
+        threads.  [threads] defaults to the number of processors.
+        If [key] is given, it must be 32 bytes long, and the BLAKE3
+        keyed hash (MAC) is computed instead.
+        The result is the same as with {!Cryptokit.Hash.blake3}.
+        Threads are used only if the C compiler supports POSIX threads.
+        The OCaml runtime system is not released during the computation;
+        use {!Cryptokit.Hash.blake3_parallel_bigarray} or
+        {!Cryptokit.Hash.blake3_file} to let other OCaml threads run. *)
+
+  val blake3_parallel_bigarray:
+    ?threads:int -> ?key:string -> int ->
+    (char, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t ->
+    string
+    (** Same as {!Cryptokit.Hash.blake3_parallel}, for a Bigarray,
+        e.g. a memory-mapped file.  Other OCaml threads can run during
+        the computation. *)
+
+  val blake3_file: ?threads:int -> ?key:string -> int -> string -> string
+    (** [blake3_file sz filename] returns the BLAKE3 hash of the contents
+        of file [filename], like {!Cryptokit.Hash.blake3_parallel}.
+        The file is read and hashed by pieces of 16 Mbytes, and other
+        OCaml threads can run during the computation.
+        @raise Sys_error if the file cannot be read. *)
+
   val ripemd160: unit -> hash
     (** RIPEMD-160 produces 160-bit hashes (20 bytes).  *)
 
@@ -795,6 +1400,133 @@ module Hash : sig
     (** MD5 is an older hash function, producing 128-bit hashes (16 bytes).
         While popular in many legacy applications, it is now known
         to be insecure.  In particular, it is not collision-resistant. *)
+
+(** {2 Hashing many messages} *)
+
+(** The following functions hash every string of the given array
+    independently, and return the array of the hashes.  For example,
+    [Hash.sha256_many msgs] is equivalent to
+    [Array.map (hash_string (Hash.sha256())) msgs], but faster,
+    especially for many short messages.  All messages are hashed by
+    a single call to C code, and, on x86 processors that support the
+    AVX2 or AVX-512 extensions, 8 or 16 messages are hashed in parallel. *)
+
+  val sha224_many: string array -> string array
+  val sha256_many: string array -> string array
+  val ripemd160_many: string array -> string array
+  val sha1_many: string array -> string array
+    [@@alert crypto "SHA1 is broken"]
+  val md5_many: string array -> string array
+    [@@alert crypto "MD5 is broken"]
+
+  val sha3_many: int -> string array -> string array
+    (** [sha3_many sz msgs] hashes every string of [msgs] with SHA-3,
+        as [Array.map (hash_string (Hash.sha3 sz)) msgs] would do.
+        [sz] is one of 224, 256, 384 or 512.  On x86 processors that
+        support AVX2, 4 messages are hashed in parallel. *)
+
+  val keccak_many: int -> string array -> string array
+    (** Same as {!Cryptokit.Hash.sha3_many}, for {!Cryptokit.Hash.keccak}. *)
+
+  type algo =
+    | SHA1 | SHA224 | SHA256 | SHA384 | SHA512 | SHA512_256 | SHA512_224
+    | RIPEMD160 | MD5
+    | SHA3 of int | Keccak of int | K12 of int * string
+    | BLAKE2b of int | BLAKE2s of int | BLAKE2bp of int | BLAKE2sp of int
+    | BLAKE2Xb of int | BLAKE2Xs of int | BLAKE3 of int
+    (** The hash functions supported by {!Cryptokit.Hash.digest_many}:
+        all the hash functions of this module.
+        The [int] argument is the size of the hash in bits, with the
+        same restrictions as for {!Cryptokit.Hash.sha3},
+        {!Cryptokit.Hash.blake2b}, etc.  The [string] argument of [K12]
+        is the customization string, as in {!Cryptokit.Hash.k12}.
+        The extendable-output functions (SHAKE, cSHAKE, [k12_xof],
+        [blake3_xof]) are not hash functions and are not supported. *)
+
+  val digest_size: algo -> int
+    (** [digest_size algo] is the size of the hashes produced by
+        [algo], in bytes.
+        @raise Error [Wrong_key_size] if the size given in [algo]
+        is not supported. *)
+
+  val digest_many: algo -> string array -> string array
+    (** [digest_many algo msgs] hashes every string of [msgs] with the
+        hash function [algo], in a single call to C code.  For example,
+        [digest_many (BLAKE2b 256) msgs] is equivalent to
+        [Array.map (hash_string (Hash.blake2b 256)) msgs], but faster
+        for many short messages, since no hash object is allocated. *)
+
+  val digest_many_into: algo -> string array -> bytes -> int -> unit
+    (** [digest_many_into algo msgs buf pos] is like
+        [digest_many algo msgs], but stores the hashes consecutively
+        in [buf], starting at position [pos].  The hash of [msgs.(i)]
+        is at position [pos + i * digest_size algo].
+        @raise Invalid_argument if [buf] is too small. *)
+
+(** {2 Fixed-length hashing} *)
+
+(** The following functions hash inputs of fixed length, as needed to
+    build Merkle trees, where each node is the hash of the concatenation
+    of its two 32-byte children.  The padding of these inputs is
+    precomputed.  The [_level] variants hash a whole level of a tree in
+    a single call to C code: their argument is the concatenation of [n]
+    nodes of 64 bytes, and their result the concatenation of the [n]
+    32-byte hashes.  They raise [Invalid_argument] if the length of
+    their argument is not a multiple of 64. *)
+
+  val sha256_64to32: string -> string
+    (** [sha256_64to32 s] is the SHA-256 hash of [s], which must be
+        exactly 64 bytes long.  Raise [Invalid_argument] otherwise. *)
+
+  val sha256_64to32_level: string -> string
+    (** Same as {!Cryptokit.Hash.sha256_64to32} for each 64-byte node
+        of the argument.  On x86 processors that support AVX2 but not
+        the SHA extensions, 8 or 16 nodes are hashed in parallel. *)
+
+  val sha256d: string -> string
+    (** [sha256d s] is SHA-256 applied twice to [s], as in Bitcoin. *)
+
+  val sha256d_64to32_level: string -> string
+    (** Same as {!Cryptokit.Hash.sha256d} for each 64-byte node of the
+        argument.  This is a level of a Bitcoin Merkle tree. *)
+
+  val hash160: string -> string
+    (** [hash160 s] is the RIPEMD-160 hash of the SHA-256 hash of [s],
+        as used by Bitcoin addresses.  The result is 20 bytes long. *)
+
+  val blake2s_64to32: string -> string
+    (** [blake2s_64to32 s] is the 256-bit BLAKE2s hash of [s], which must
+        be exactly 64 bytes long.  Raise [Invalid_argument] otherwise.
+        This is a single compression of BLAKE2s. *)
+
+  val blake2s_64to32_level: string -> string
+    (** Same as {!Cryptokit.Hash.blake2s_64to32} for each 64-byte node
+        of the argument.  On x86 processors that support AVX2, 8 nodes
+        are hashed in parallel. *)
+
+  val blake3_parent: ?root:bool -> string -> string
+    (** [blake3_parent s] is the chaining value of a parent node of the
+        BLAKE3 tree, [s] being the 64-byte concatenation of the chaining
+        values of its children.  If [root] is [true], the result is the
+        BLAKE3 hash of the whole tree instead.  The default is [false]. *)
+
+  val blake3_parent_level: string -> string
+    (** Same as {!Cryptokit.Hash.blake3_parent} for each 64-byte node
+        of the argument, none of which is a root.  Nodes are hashed
+        in parallel using the SIMD extensions of the processor. *)
+
+(** {2 Saving and restoring hash states} *)
+
+  val deserialize: string -> hash
+    (** [deserialize s] rebuilds a hash from the state [s] returned by
+        its [serialize] method.  The new hash continues the computation
+        where it stood when [serialize] was called: for example, a long
+        hash computation can be checkpointed, and resumed in another
+        process.  A BLAKE2 MAC rebuilt this way does not know its key:
+        its [reset] method raises [Invalid_argument].
+        @raise Error [Bad_encoding] if [s] is not a valid state,
+        or was produced on a different platform or by a different
+        version of Cryptokit. *)
 end
 
 (** The [MAC] module implements message authentication codes, also
@@ -855,6 +1587,34 @@ module MAC: sig
         long.  The [key] argument is the MAC key; it can have any length,
         but a minimal length of 16 bytes is recommended. *)
 
+  type hmac_key
+    (** An HMAC key, prepared once and reusable for any number of MACs.
+        The hash function is applied to the key combined with the inner
+        and outer paddings when the key is prepared, instead of
+        once for every MAC computed.  This makes HMAC of short messages
+        up to twice as fast. *)
+
+  val hmac_sha1_key: string -> hmac_key
+  val hmac_sha256_key: string -> hmac_key
+  val hmac_sha384_key: string -> hmac_key
+  val hmac_sha512_key: string -> hmac_key
+  val hmac_ripemd160_key: string -> hmac_key
+  val hmac_md5_key: string -> hmac_key
+    (** [hmac_sha256_key key] prepares the key [key] for HMAC-SHA256,
+        and similarly for the other hash functions.
+        [hmac_of_key (hmac_sha256_key key)] computes the same MACs
+        as [hmac_sha256 key]. *)
+
+  val hmac_of_key: hmac_key -> hash
+    (** [hmac_of_key k] returns a MAC based on the HMAC construction,
+        keyed with the prepared key [k].  Wiping the returned MAC
+        does not wipe [k]; [k] remains in use by the MAC and must not
+        be wiped while the MAC is in use. *)
+
+  val wipe_hmac_key: hmac_key -> unit
+    (** Erase the given prepared key, overwriting it with zeroes.
+        The key can no longer be used afterwards. *)
+
   val blake2b: int -> string -> hash
     (** [blake2b sz key] is the BLAKE2b keyed hash function.
         The returned hash values have length 1 to 64 bytes.
@@ -883,6 +1643,28 @@ module MAC: sig
         The [key] argument is the MAC key.  It must have length 32 at most.
         A length of 32 bytes is recommended. *)
 
+  val blake2bp: int -> string -> hash
+    (** [blake2bp sz key] is the BLAKE2bp keyed hash function,
+        the 4-way parallel variant of BLAKE2b
+        (see {!Cryptokit.Hash.blake2bp}).
+        [sz] and [key] are as for {!Cryptokit.MAC.blake2b}. *)
+
+  val blake2sp: int -> string -> hash
+    (** [blake2sp sz key] is the BLAKE2sp keyed hash function,
+        the 8-way parallel variant of BLAKE2s
+        (see {!Cryptokit.Hash.blake2sp}).
+        [sz] and [key] are as for {!Cryptokit.MAC.blake2s}. *)
+
+  val blake2xb: int -> string -> hash
+    (** [blake2xb sz key] is the BLAKE2Xb keyed hash function,
+        producing hashes of [sz] bits (see {!Cryptokit.Hash.blake2xb}).
+        The [key] argument is the MAC key.  It must have length 64 at most. *)
+
+  val blake2xs: int -> string -> hash
+    (** [blake2xs sz key] is the BLAKE2Xs keyed hash function,
+        producing hashes of [sz] bits (see {!Cryptokit.Hash.blake2xs}).
+        The [key] argument is the MAC key.  It must have length 32 at most. *)
+
   val blake3: int -> string -> hash
     (** [blake3 sz key] is the BLAKE3 keyed hash function.
         [key] is the MAC key.  It must have length 32.
@@ -895,6 +1677,31 @@ module MAC: sig
         to 256 bit hashes (32 bytes). 
         [key] is the MAC key.  It must have length 32. *)
 
+  val kmac128: ?custom:string -> int -> string -> hash
+    (** [kmac128 sz key] is the KMAC128 message authentication code
+        of NIST SP 800-185, based on cSHAKE128.
+        [sz] is the desired size of the MAC, in bits.  It must be positive
+        and a multiple of 8.  The size is part of the computation,
+        hence MACs of different sizes are unrelated.
+        [key] is the MAC key.  It can have any length, but should be
+        at least 16 bytes long.
+        The optional [custom] argument is a customization string,
+        empty by default. *)
+
+  val kmac256: ?custom:string -> int -> string -> hash
+    (** [kmac256 sz key] is the KMAC256 message authentication code,
+        based on cSHAKE256.  The arguments are as for
+        {!Cryptokit.MAC.kmac128}, but the key should be at least
+        32 bytes long. *)
+
+  val kmac128_xof: ?custom:string -> string -> xof
+    (** [kmac128_xof key] is KMACXOF128, the variant of KMAC128 with
+        output of arbitrary length. *)
+
+  val kmac256_xof: ?custom:string -> string -> xof
+    (** [kmac256_xof key] is KMACXOF256, the variant of KMAC256 with
+        output of arbitrary length. *)
+
   val aes_cmac: ?iv:string -> string -> hash
     (** [aes_cmac key] returns a MAC based on AES encryption in CMAC mode,
         also known as OMAC1 mode.  The input data is encrypted using
@@ -962,6 +1769,52 @@ module MAC: sig
     (** [siphash128 key] is a variant of [siphash] that returns
         hash values of length 16 bytes instead of 8 bytes. *)
 
+(** {2 Computing many MACs} *)
+
+  type algo =
+    | HMAC of hmac_key
+    | BLAKE2b of int * string
+    | BLAKE2s of int * string
+    | BLAKE2bp of int * string
+    | BLAKE2sp of int * string
+    | BLAKE2Xb of int * string
+    | BLAKE2Xs of int * string
+    | BLAKE3 of int * string
+    | KMAC128 of int * string * string
+    | KMAC256 of int * string * string
+    | AES_CMAC of string
+    | SipHash of int * string
+    (** The MACs supported by {!Cryptokit.MAC.digest_many}: HMAC with
+        a prepared key, AES-CMAC with the given key and a zero initial
+        IV, or a keyed hash function given by the size of its hashes in
+        bits, its key and, for KMAC, its customization string.
+        For example, [BLAKE2b(256, key)] stands for [MAC.blake2b 256 key],
+        [KMAC128(256, key, custom)] for [MAC.kmac128 ~custom 256 key] and
+        [SipHash(64, key)] for [MAC.siphash key].
+        The CBC-MACs [aes], [des], [triple_des] and [des_final_triple_des]
+        are not supported: their padding is an arbitrary
+        {!Cryptokit.Padding.scheme} object, which cannot be applied
+        from C code, and they are weak for messages of variable length.
+        The XOF variants of KMAC are not supported either. *)
+
+  val digest_size: algo -> int
+    (** [digest_size algo] is the size of the MACs produced by [algo],
+        in bytes.
+        @raise Error [Wrong_key_size] if the size or the key given in
+        [algo] is not supported. *)
+
+  val digest_many: algo -> string array -> string array
+    (** [digest_many algo msgs] computes the MAC of every string of
+        [msgs], in a single call to C code.  It is equivalent to, but
+        faster than, [Array.map (hash_string mac) msgs] with a fresh
+        MAC [mac] for each string. *)
+
+  val digest_many_into: algo -> string array -> bytes -> int -> unit
+    (** [digest_many_into algo msgs buf pos] is like
+        [digest_many algo msgs], but stores the MACs consecutively
+        in [buf], starting at position [pos].
+        @raise Invalid_argument if [buf] is too small. *)
+
 end
 
 (** The [KD] module provides key derivation functions.  These functions
@@ -996,6 +1849,145 @@ module KD : sig
         the running time of [pbkdf2].
         For example, WPA2 uses [pbkdf2 MAC.hacm_sha1 passphrase ssid 4096 256].
     *)
+
+  val blake3_derive_key: context:string -> string -> int -> string
+    (** [blake3_derive_key ~context material len] derives a key of
+        length [len] bytes from the key material [material], using the
+        key derivation mode of BLAKE3.  The [context] string should be
+        hardcoded, globally unique, and application-specific, for example
+        ["example.com 2026-10-18 session tokens v1"].
+        The context is hashed once when [blake3_derive_key] is partially
+        applied to it, so that [let kdf = blake3_derive_key ~context]
+        can then derive many keys quickly. *)
+end
+
+(** The [Bao] module implements verified streaming of data hashed with
+    BLAKE3, following the Bao format.  A large content is identified
+    by its 32-byte BLAKE3 hash, as computed by {!Cryptokit.Hash.blake3}.
+    The {e outboard encoding} of the content is the BLAKE3 hash tree of
+    the content, stored separately from the content itself; it is about
+    1/16th of the size of the content.  From the content and its outboard
+    encoding, a {e slice} of the content can be extracted: it contains
+    the chunks of the content that overlap a given range of bytes,
+    together with the tree nodes needed to verify them against the hash.
+    A client that knows the hash can verify the slice as it arrives,
+    and reject corrupted data as soon as it is received, without trusting
+    the server.  Chunks are 1024 bytes long, as in the reference
+    implementation of Bao. *)
+
+module Bao : sig
+  val outboard: string -> string * string
+    (** [outboard content] returns the pair [(hash, encoding)] of the
+        BLAKE3 hash of [content] and of its outboard encoding. *)
+
+  val outboard_file: string -> string * string
+    (** Same as {!Cryptokit.Bao.outboard}, for the contents of the
+        given file.  The file is read in one pass.
+        @raise Sys_error if the file cannot be read.
+        @raise End_of_file if the file becomes shorter while it is
+        being read. *)
+
+  val content_length: string -> int
+    (** Return the length of the content described by the given
+        outboard encoding.
+        @raise Error [Bad_encoding] if the outboard encoding is malformed. *)
+
+  val slice: outboard: string -> string -> int -> int -> string
+    (** [slice ~outboard content start len] extracts the slice of
+        [content] that covers the [len] bytes starting at position
+        [start].  [outboard] is the outboard encoding of [content].
+        A range of length 0 is treated as a range of length 1, and a
+        range that starts at or past the end of the content selects the
+        last chunk of the content, so that its length can be verified.
+        The slice of the whole content is the combined encoding of Bao.
+        @raise Error [Wrong_data_length] if [content] does not have the
+        length recorded in [outboard]. *)
+
+  val slice_channel: outboard: string -> in_channel -> int -> int -> string
+    (** Same as {!Cryptokit.Bao.slice}, but the content is read from
+        the given channel, which must be opened in binary mode and
+        support seeking.  Only the chunks that are part of the slice
+        are read. *)
+
+  val decode_slice: hash: string -> int -> int -> transform
+    (** [decode_slice ~hash start len] returns a transform that takes
+        as input a slice for the range of [len] bytes starting at
+        [start], as produced by {!Cryptokit.Bao.slice} with the same
+        [start] and [len], and outputs the bytes of the content in that
+        range.  Every chunk is verified against the 32-byte BLAKE3
+        [hash] before being output.  The transform raises
+        [Error Authentication_failure] as soon as it receives a chunk
+        or a tree node that does not match [hash], and
+        [Error Wrong_data_length] if the slice is truncated or followed
+        by extra data. *)
+end
+
+(** The [Merkle] module maintains Merkle trees over a sequence of
+    32-byte leaves, typically the hashes of blocks of data.  Each
+    interior node is the hash of the concatenation of its two children;
+    a node without a right sibling is moved up unchanged, so that the
+    tree has the same shape as in RFC 6962 (without the prefixes that
+    RFC 6962 adds to leaves and nodes).  Interior nodes are computed
+    with one of the two-to-one hash functions
+    {!Cryptokit.Hash.sha256_64to32}, {!Cryptokit.Hash.blake2s_64to32}
+    or {!Cryptokit.Hash.blake3_parent}.
+
+    The nodes are stored level by level in a single buffer.  The pairs
+    of nodes of a level are hashed by several threads, each hashing a
+    range of pairs, while other OCaml threads keep running.  When leaves
+    are modified, only their ancestors are recomputed, the next time the
+    root or a proof is requested, and ancestors shared by several
+    modified leaves are hashed only once. *)
+
+module Merkle : sig
+  type t
+    (** A Merkle tree.  Trees are mutable. *)
+
+  type hash =
+    | SHA256             (** {!Cryptokit.Hash.sha256_64to32} *)
+    | BLAKE2s            (** {!Cryptokit.Hash.blake2s_64to32} *)
+    | BLAKE3             (** {!Cryptokit.Hash.blake3_parent} *)
+    (** The function that hashes two nodes into their parent. *)
+
+  val create: ?threads:int -> hash -> string array -> t
+    (** [create hash leaves] builds the Merkle tree over the given leaves,
+        which must be 32 bytes long each, hashing pairs of nodes with
+        [hash].  The optional [threads] argument is the number of
+        threads that hash a level of the tree, both here and when
+        modified leaves are propagated to the root.  It defaults to 0,
+        meaning one thread per processor.  Small levels are hashed by
+        one thread.
+        Raise [Invalid_argument] if [leaves] is empty or a leaf is not
+        32 bytes long. *)
+
+  val length: t -> int
+    (** Return the number of leaves of the tree. *)
+
+  val leaf: t -> int -> string
+    (** [leaf t i] returns the leaf number [i] of [t]. *)
+
+  val set_leaf: t -> int -> string -> unit
+    (** [set_leaf t i l] replaces the leaf number [i] of [t] by [l],
+        which must be 32 bytes long.  The interior nodes are recomputed
+        lazily, so that the ancestors of a batch of modifications are
+        hashed together, one level of the tree at a time. *)
+
+  val root: t -> string
+    (** Return the root of the tree. *)
+
+  val proof: t -> int -> string list
+    (** [proof t i] returns the inclusion proof of leaf number [i]:
+        the siblings of the leaf and of its ancestors, from the bottom
+        of the tree to the top.  Nodes that have no sibling contribute
+        nothing to the proof. *)
+
+  val verify:
+    hash -> leaves: int -> index: int -> leaf: string ->
+    string list -> string -> bool
+    (** [verify hash ~leaves ~index ~leaf proof root] checks that [proof]
+        proves that [leaf] is the leaf number [index] of a tree of
+        [leaves] leaves whose root is [root].  [hash] is the hash
+        function used to build the tree. *)
 end
 
 (** {1 Elliptic curves} *)
@@ -1565,6 +2557,25 @@ module Block : sig
         The returned block cipher has the same block size as
         the underlying block cipher, and is usable both for
         encryption and decryption. *)
+
+  class ctr_prefetch: ?iv: string -> ?inc:int -> block_cipher ->
+    object
+      inherit block_cipher
+
+      method prefetch: int -> unit
+        (** [prefetch n] makes sure that at least [n] bytes of
+            keystream are precomputed and ready for use. *)
+
+      method available_keystream: int
+        (** The number of bytes of precomputed keystream. *)
+    end
+    (** Same as {!Cryptokit.Block.ctr}, with precomputation of the
+        keystream.  Since the keystream of counter mode does not depend
+        on the data, it can be computed ahead of time, e.g. while waiting
+        for data to encrypt.  Then, encrypting or decrypting a block
+        reduces to xor-ing it with precomputed keystream.  Keystream is
+        computed on demand when not enough of it was precomputed.
+        Precomputed keystream is erased as soon as it is used. *)
 end
 
 (** The [Stream] module provides classes that implement
@@ -1610,6 +2621,25 @@ module Stream : sig
         This stream cipher works by xor-ing the input with the
         output of a key-dependent pseudo random number generator.
         Thus, decryption is the same function as encryption. *)
+
+  class chacha20_prefetch: ?iv:string -> ?ctr:int64 -> string ->
+    object
+      inherit stream_cipher
+
+      method prefetch: int -> unit
+        (** [prefetch n] makes sure that at least [n] bytes of
+            keystream are precomputed and ready for use. *)
+
+      method available_keystream: int
+        (** The number of bytes of precomputed keystream. *)
+    end
+    (** Same as {!Cryptokit.Stream.chacha20}, with precomputation of the
+        keystream.  Calling [prefetch] ahead of time, e.g. while waiting
+        for data to encrypt, reduces the latency of later calls to
+        [transform], which then only xor their input with precomputed
+        keystream.  Keystream is computed on demand when not enough of it
+        was precomputed.  Precomputed keystream is erased as soon as
+        it is used. *)
 end
 
 (** {1 Encoding and compression of data} *)
@@ -1732,6 +2762,9 @@ type error =
   | Invalid_point
       (** An elliptic curve operation received a point
           that is not on the curve. *)
+  | Authentication_failure
+      (** An authenticated decryption transform received data
+          whose authentication tag is incorrect. *)
 
 exception Error of error
   (** Exception raised by functions in this library
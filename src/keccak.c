@@ -6,6 +6,7 @@
 #include <string.h>
 #include <caml/config.h>
 #include "keccak.h"
+#include "cpufeatures.h"
 
 #define KECCAK_ROUNDS 24
 
@@ -38,14 +39,15 @@ static const int keccakf_piln[24] =
 };
 #endif
 
-/* Update the state with KECCAK_ROUND rounds */
+/* Update the state with the last [rounds] of the KECCAK_ROUNDS rounds:
+   Keccak-f[1600] if [rounds] is 24, Keccak-p[1600, rounds] otherwise */
 
-static void KeccakPermutation(u64 st[25])
+static void KeccakPermutation(u64 st[25], int rounds)
 {
   int round, j;
     u64 t, bc[5];
 
-    for (round = 0; round < KECCAK_ROUNDS; round++) {
+    for (round = KECCAK_ROUNDS - rounds; round < KECCAK_ROUNDS; round++) {
 
         // Theta
 #define THETA1(i) \
@@ -98,7 +100,8 @@ static void KeccakPermutation(u64 st[25])
 
 /* Absorb the given data and permute */
 
-static void KeccakAbsorb(u64 st[25], unsigned char * p, int rsiz)
+static void KeccakAbsorb(u64 st[25], unsigned char * p, int rsiz,
+                         int rounds)
 {
   int i;
   rsiz = rsiz / 8;
@@ -109,7 +112,26 @@ static void KeccakAbsorb(u64 st[25], unsigned char * p, int rsiz)
       unsigned int h = p[4] | (p[5] << 8) | (p[6] << 16) | (p[7] << 24);
       st[i] ^= l | ((unsigned long long) h << 32);
   }
-  KeccakPermutation(st);
+  KeccakPermutation(st, rounds);
+}
+
+/* Extract [len] bytes of the state, starting at byte [pos] */
+
+static void KeccakExtract(u64 st[25], int pos, unsigned char * p, int len)
+{
+#ifndef ARCH_BIG_ENDIAN
+  /* Whole lanes are copied directly, since they are stored
+     in little-endian order */
+  for (; len > 0 && pos % 8 != 0; pos += 1, p += 1, len -= 1)
+    *p = st[pos / 8] >> (8 * (pos % 8));
+  if (len >= 8) {
+    int n = len & ~7;
+    memcpy(p, &st[pos / 8], n);
+    pos += n; p += n; len -= n;
+  }
+#endif
+  for (; len > 0; pos += 1, p += 1, len -= 1)
+    *p = st[pos / 8] >> (8 * (pos % 8));
 }
 
 /* Exported interface */
@@ -119,6 +141,19 @@ EXPORT void SHA3_init(struct SHA3Context * ctx, int hsiz)
   assert (hsiz == 224 || hsiz == 256 || hsiz == 384 || hsiz == 512);
   ctx->hsiz = hsiz / 8;
   ctx->rsiz = 200 - 2 * ctx->hsiz;
+  ctx->rounds = KECCAK_ROUNDS;
+  ctx->numbytes = 0;
+  memset(ctx->state, 0, sizeof(ctx->state));
+}
+
+/* SHAKE128 and SHAKE256: [level] is the security level, 128 or 256 */
+
+EXPORT void SHAKE_init(struct SHA3Context * ctx, int level)
+{
+  assert (level == 128 || level == 256);
+  ctx->hsiz = 0;
+  ctx->rsiz = 200 - level / 4;
+  ctx->rounds = KECCAK_ROUNDS;
   ctx->numbytes = 0;
   memset(ctx->state, 0, sizeof(ctx->state));
 }
@@ -138,13 +173,13 @@ EXPORT void SHA3_absorb(struct SHA3Context * ctx,
       return;
     }
     memcpy(ctx->buffer + ctx->numbytes, data, n);
-    KeccakAbsorb(ctx->state, ctx->buffer, ctx->rsiz);
+    KeccakAbsorb(ctx->state, ctx->buffer, ctx->rsiz, ctx->rounds);
     data += n;
     len  -= n;
   }
   /* Absorb data in blocks of [rsiz] bytes */
   while (len >= ctx->rsiz) {
-    KeccakAbsorb(ctx->state, data, ctx->rsiz);
+    KeccakAbsorb(ctx->state, data, ctx->rsiz, ctx->rounds);
     data += ctx->rsiz;
     len  -= ctx->rsiz;
   }
@@ -153,11 +188,10 @@ EXPORT void SHA3_absorb(struct SHA3Context * ctx,
   ctx->numbytes = len;
 }
 
-EXPORT void SHA3_extract(unsigned char padding,
-                  struct SHA3Context * ctx,
-                  unsigned char * output)
+EXPORT void SHA3_pad(unsigned char padding,
+                     struct SHA3Context * ctx)
 {
-  int i, j, n;
+  int n;
 
   /* Apply final padding */
   n = ctx->numbytes;
@@ -167,19 +201,438 @@ EXPORT void SHA3_extract(unsigned char padding,
   ctx->buffer[ctx->rsiz - 1] |= 0x80;
 
   /* Absorb remaining data + padding */
-  KeccakAbsorb(ctx->state, ctx->buffer, ctx->rsiz);
-
-  /* Extract hash as low bits of state */
-  for (i = 0, j = 0; j < ctx->hsiz; i += 1, j += 8) {
-    u64 st = ctx->state[i];
-    output[j] = st;
-    output[j + 1] = st >> 8;
-    output[j + 2] = st >> 16;
-    output[j + 3] = st >> 24;
-    if (j + 4 >= ctx->hsiz) break;
-    output[j + 4] = st >> 32;
-    output[j + 5] = st >> 40;
-    output[j + 6] = st >> 48;
-    output[j + 7] = st >> 56;
+  KeccakAbsorb(ctx->state, ctx->buffer, ctx->rsiz, ctx->rounds);
+  ctx->numbytes = 0;
+}
+
+/* Output is read from the first [rsiz] bytes of the state,
+   permuting the state each time they are exhausted. */
+
+EXPORT void SHA3_squeeze(struct SHA3Context * ctx,
+                         unsigned char * output,
+                         unsigned long len)
+{
+  int n;
+
+  while (len > 0) {
+    if (ctx->numbytes == ctx->rsiz) {
+      KeccakPermutation(ctx->state, ctx->rounds);
+      ctx->numbytes = 0;
+    }
+    n = ctx->rsiz - ctx->numbytes;
+    if (len < n) n = len;
+    KeccakExtract(ctx->state, ctx->numbytes, output, n);
+    ctx->numbytes += n;
+    output += n;
+    len -= n;
+  }
+}
+
+EXPORT void SHA3_extract(unsigned char padding,
+                  struct SHA3Context * ctx,
+                  unsigned char * output)
+{
+  SHA3_pad(padding, ctx);
+  /* The hash is the low bits of the state */
+  SHA3_squeeze(ctx, output, ctx->hsiz);
+}
+
+/* KangarooTwelve (RFC 9861).  The input, followed by the customization
+   string and its length, is cut into chunks of K12_CHUNK bytes.
+   The first chunk is absorbed in the final node.  Each of the following
+   chunks is a leaf, hashed separately into a chaining value that is
+   absorbed in the final node.  All sponges use TurboSHAKE128, that is,
+   SHAKE128 with the permutation reduced to 12 rounds. */
+
+#define K12_ROUNDS 12
+#define K12_RATE 168
+#define K12_CV 32
+
+static const unsigned char K12_node_separator[8] = { 3, 0, 0, 0, 0, 0, 0, 0 };
+
+static void K12_sponge_init(struct SHA3Context * ctx)
+{
+  SHAKE_init(ctx, 128);
+  ctx->rounds = K12_ROUNDS;
+}
+
+static void K12_leaf(const unsigned char * p, unsigned char cv[K12_CV])
+{
+  struct SHA3Context leaf;
+  K12_sponge_init(&leaf);
+  SHA3_absorb(&leaf, (unsigned char *) p, K12_CHUNK);
+  SHA3_pad(0x0B, &leaf);
+  SHA3_squeeze(&leaf, cv, K12_CV);
+}
+
+#ifdef HAVE_X86_DISPATCH
+
+/* AVX2 implementation: 4 leaves are hashed at once, one state per
+   64-bit lane of the vectors */
+
+typedef u64 keccak_v4 __attribute__((vector_size(32), may_alias));
+
+__attribute__((target("avx2")))
+static void KeccakPermutation_x4(keccak_v4 st[25], int rounds)
+{
+  int round, j;
+    keccak_v4 t, bc[5];
+
+    for (round = KECCAK_ROUNDS - rounds; round < KECCAK_ROUNDS; round++) {
+      THETA1(0); THETA1(1); THETA1(2); THETA1(3); THETA1(4);
+      THETA2(0); THETA2(1); THETA2(2); THETA2(3); THETA2(4);
+        t = st[1];
+        RHOPI(0, 1, 10); RHOPI(1, 3, 7); RHOPI(2, 6, 11); RHOPI(3, 10, 17);
+        RHOPI(4, 15, 18); RHOPI(5, 21, 3); RHOPI(6, 28, 5); RHOPI(7, 36, 16);
+        RHOPI(8, 45, 8); RHOPI(9, 55, 21); RHOPI(10, 2, 24); RHOPI(11, 14, 4);
+        RHOPI(12, 27, 15); RHOPI(13, 41, 23); RHOPI(14, 56, 19); RHOPI(15, 8, 13);
+        RHOPI(16, 25, 12); RHOPI(17, 43, 2); RHOPI(18, 62, 20); RHOPI(19, 18, 14);
+        RHOPI(20, 39, 22); RHOPI(21, 61, 9); RHOPI(22, 20, 6); RHOPI(23, 44, 1);
+        for (j = 0; j < 25; j += 5) {
+          CHI1(0,j); CHI1(1,j); CHI1(2,j); CHI1(3,j); CHI1(4,j);
+          CHI2(0,j); CHI2(1,j); CHI2(2,j); CHI2(3,j); CHI2(4,j);
+        }
+        st[0] ^= keccakf_rndc[round];
+    }
+}
+
+/* The x86 is little-endian */
+
+__attribute__((target("avx2")))
+static inline keccak_v4 K12_load_x4(const unsigned char * p)
+{
+  u64 a, b, c, d;
+  memcpy(&a, p, 8);
+  memcpy(&b, p + K12_CHUNK, 8);
+  memcpy(&c, p + 2 * K12_CHUNK, 8);
+  memcpy(&d, p + 3 * K12_CHUNK, 8);
+  return (keccak_v4) { a, b, c, d };
+}
+
+__attribute__((target("avx2")))
+static void K12_leaves_x4_avx2(const unsigned char * p,
+                               unsigned char cv[4 * K12_CV])
+{
+  keccak_v4 st[25];
+  u64 w;
+  int i, j, k;
+
+  memset(st, 0, sizeof(st));
+  for (i = 0; i + K12_RATE <= K12_CHUNK; i += K12_RATE) {
+    for (j = 0; j < K12_RATE / 8; j++) st[j] ^= K12_load_x4(p + i + 8 * j);
+    KeccakPermutation_x4(st, K12_ROUNDS);
+  }
+  /* Last, partial block and padding */
+  for (j = 0; i + 8 * j < K12_CHUNK; j++) st[j] ^= K12_load_x4(p + i + 8 * j);
+  st[j] ^= (u64) 0x0B;
+  st[K12_RATE / 8 - 1] ^= (u64) 0x80 << 56;
+  KeccakPermutation_x4(st, K12_ROUNDS);
+  for (k = 0; k < 4; k++) {
+    for (j = 0; j < K12_CV / 8; j++) {
+      w = st[j][k];
+      memcpy(cv + K12_CV * k + 8 * j, &w, 8);
+    }
+  }
+}
+
+#endif
+
+/* Chaining values of [n] consecutive leaves */
+
+static void K12_leaves(const unsigned char * p, size_t n, unsigned char * cv)
+{
+#ifdef HAVE_X86_DISPATCH
+  if (cpu_features() & CPU_AVX2) {
+    for (; n >= 4; n -= 4, p += 4 * K12_CHUNK, cv += 4 * K12_CV)
+      K12_leaves_x4_avx2(p, cv);
+  }
+#endif
+  for (; n > 0; n -= 1, p += K12_CHUNK, cv += K12_CV)
+    K12_leaf(p, cv);
+}
+
+/* With [threads] > 1, the leaves are split between several POSIX
+   threads. */
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+
+/* Fewer leaves than this are not worth starting a thread for */
+#define K12_THREAD_MIN_LEAVES 32
+#define K12_MAX_THREADS 256
+
+struct K12_job {
+  const unsigned char * p;
+  size_t n;
+  unsigned char * cv;
+};
+
+static void * K12_job_run(void * arg)
+{
+  struct K12_job * job = arg;
+  K12_leaves(job->p, job->n, job->cv);
+  return NULL;
+}
+#endif
+
+static void K12_leaves_parallel(const unsigned char * p, size_t n,
+                                unsigned char * cv, int threads)
+{
+#ifdef HAVE_PTHREAD
+  struct K12_job jobs[K12_MAX_THREADS];
+  pthread_t tids[K12_MAX_THREADS];
+  int started[K12_MAX_THREADS];
+  size_t m;
+  int i, t;
+
+  if (threads > K12_MAX_THREADS) threads = K12_MAX_THREADS;
+  if (threads > 1 && n >= 2 * K12_THREAD_MIN_LEAVES) {
+    /* Leaves per thread, a multiple of 4 for the AVX2 implementation */
+    m = (n + threads - 1) / threads;
+    if (m < K12_THREAD_MIN_LEAVES) m = K12_THREAD_MIN_LEAVES;
+    m = (m + 3) & ~(size_t) 3;
+    for (t = 0; n > m; t++, p += m * K12_CHUNK, cv += m * K12_CV, n -= m) {
+      jobs[t].p = p;
+      jobs[t].n = m;
+      jobs[t].cv = cv;
+      started[t] = pthread_create(&tids[t], NULL, K12_job_run, &jobs[t]) == 0;
+      if (! started[t]) K12_job_run(&jobs[t]);
+    }
+    K12_leaves(p, n, cv);
+    for (i = 0; i < t; i++)
+      if (started[i]) pthread_join(tids[i], NULL);
+    return;
+  }
+#endif
+  K12_leaves(p, n, cv);
+}
+
+static void K12_end_leaf(struct K12Context * s)
+{
+  unsigned char cv[K12_CV];
+  SHA3_pad(0x0B, &s->leaf);
+  SHA3_squeeze(&s->leaf, cv, K12_CV);
+  SHA3_absorb(&s->node, cv, K12_CV);
+  s->numleaves++;
+  s->chunkpos = 0;
+}
+
+/* Big-endian encoding of [x] on as few bytes as possible,
+   followed by the number of bytes */
+
+static int K12_length_encode(u64 x, unsigned char out[9])
+{
+  int i, n = 0;
+  for (i = 56; i >= 0; i -= 8)
+    if (n > 0 || (x >> i) != 0) out[n++] = x >> i;
+  out[n] = n;
+  return n + 1;
+}
+
+EXPORT void K12_init(struct K12Context * s)
+{
+  K12_sponge_init(&s->node);
+  s->tree = 0;
+  s->numleaves = 0;
+  s->chunkpos = 0;
+}
+
+/* Leaves entirely contained in [data] are hashed directly from it,
+   by batches of K12_BATCH, using up to [threads] threads */
+
+#define K12_BATCH 1024
+
+EXPORT void K12_absorb(struct K12Context * s,
+                       const unsigned char * data, size_t len, int threads)
+{
+  unsigned char cvs[K12_BATCH * K12_CV];
+  size_t n;
+
+  if (! s->tree) {
+    n = K12_CHUNK - s->chunkpos;
+    if (len <= n) {
+      SHA3_absorb(&s->node, (unsigned char *) data, len);
+      s->chunkpos += len;
+      return;
+    }
+    /* More than one chunk: the final node starts with the first chunk
+       and a separator, followed by the chaining values of the leaves */
+    SHA3_absorb(&s->node, (unsigned char *) data, n);
+    SHA3_absorb(&s->node, (unsigned char *) K12_node_separator, 8);
+    s->tree = 1;
+    s->chunkpos = 0;
+    data += n;
+    len -= n;
+  }
+  while (len > 0) {
+    if (s->chunkpos == 0 && len >= K12_CHUNK) {
+      n = len / K12_CHUNK;
+      if (n > K12_BATCH) n = K12_BATCH;
+      K12_leaves_parallel(data, n, cvs, threads);
+      SHA3_absorb(&s->node, cvs, n * K12_CV);
+      s->numleaves += n;
+      data += n * K12_CHUNK;
+      len -= n * K12_CHUNK;
+    } else {
+      if (s->chunkpos == 0) K12_sponge_init(&s->leaf);
+      n = K12_CHUNK - s->chunkpos;
+      if (len < n) n = len;
+      SHA3_absorb(&s->leaf, (unsigned char *) data, n);
+      s->chunkpos += n;
+      data += n;
+      len -= n;
+      if (s->chunkpos == K12_CHUNK) K12_end_leaf(s);
+    }
+  }
+}
+
+/* Absorb the customization string and finish the final node.
+   The output is then read with K12_squeeze. */
+
+EXPORT void K12_pad(struct K12Context * s,
+                    const unsigned char * custom, size_t customlen)
+{
+  unsigned char enc[11];
+  int n;
+
+  K12_absorb(s, custom, customlen, 1);
+  n = K12_length_encode(customlen, enc);
+  K12_absorb(s, enc, n, 1);
+  if (! s->tree) {
+    SHA3_pad(0x07, &s->node);
+    return;
+  }
+  if (s->chunkpos > 0) K12_end_leaf(s);
+  n = K12_length_encode(s->numleaves, enc);
+  enc[n++] = 0xFF;
+  enc[n++] = 0xFF;
+  SHA3_absorb(&s->node, enc, n);
+  SHA3_pad(0x06, &s->node);
+}
+
+EXPORT void K12_squeeze(struct K12Context * s,
+                        unsigned char * output, size_t len)
+{
+  SHA3_squeeze(&s->node, output, len);
+}
+
+/* Hashing many messages with SHA-3 (padding 0x06) or Keccak
+   (padding 0x01).  With AVX2, 4 messages are absorbed in parallel,
+   one per lane of a 4-way state.  When the message of a lane is
+   finished, the next message is scheduled on this lane. */
+
+#ifdef HAVE_X86_DISPATCH
+
+struct SHA3_lane {
+  size_t msg;                   /* message number, or [(size_t) -1] */
+  const unsigned char * p;      /* next full block of the message */
+  size_t nfull;                 /* number of full blocks left */
+  unsigned char tail[144];      /* final block, with padding */
+};
+
+static void SHA3_lane_start(struct SHA3_lane * ln, int rsiz,
+                            unsigned char padding, size_t msg,
+                            void (*get)(void * env, size_t i,
+                                        const unsigned char ** p,
+                                        size_t * len),
+                            void * env)
+{
+  const unsigned char * p;
+  size_t len, r;
+
+  get(env, msg, &p, &len);
+  ln->msg = msg;
+  ln->p = p;
+  ln->nfull = len / rsiz;
+  r = len % rsiz;
+  memcpy(ln->tail, p + rsiz * ln->nfull, r);
+  ln->tail[r] = padding;
+  memset(ln->tail + r + 1, 0, rsiz - r - 1);
+  ln->tail[rsiz - 1] |= 0x80;
+}
+
+__attribute__((target("avx2")))
+static void SHA3_hash_many_avx2(int hsiz, unsigned char padding, size_t n,
+                                void (*get)(void * env, size_t i,
+                                            const unsigned char ** p,
+                                            size_t * len),
+                                void * env,
+                                unsigned char * output)
+{
+  keccak_v4 st[25];
+  struct SHA3_lane lane[4];
+  const unsigned char * blk[4];
+  unsigned char * out;
+  u64 w[4];
+  int rsiz = 200 - 2 * hsiz;
+  int l, j, k, active = 0;
+  size_t next = 0;
+
+  memset(st, 0, sizeof(st));
+  /* Idle lanes keep absorbing their zeroed tail */
+  memset(lane, 0, sizeof(lane));
+  for (l = 0; l < 4; l++) {
+    if (next < n) {
+      SHA3_lane_start(&lane[l], rsiz, padding, next++, get, env);
+      active++;
+    } else {
+      lane[l].msg = (size_t) -1;
+    }
+  }
+  while (active > 0) {
+    for (l = 0; l < 4; l++)
+      blk[l] = lane[l].nfull > 0 ? lane[l].p : lane[l].tail;
+    for (j = 0; j < rsiz / 8; j++) {
+      for (l = 0; l < 4; l++) memcpy(&w[l], blk[l] + 8 * j, 8);
+      st[j] ^= (keccak_v4) { w[0], w[1], w[2], w[3] };
+    }
+    KeccakPermutation_x4(st, KECCAK_ROUNDS);
+    for (l = 0; l < 4; l++) {
+      if (lane[l].nfull > 0) {
+        lane[l].p += rsiz;
+        lane[l].nfull--;
+        continue;
+      }
+      if (lane[l].msg == (size_t) -1) continue;
+      /* The final block of this lane was absorbed: extract the hash */
+      out = output + lane[l].msg * hsiz;
+      for (k = 0; k < hsiz; k++) out[k] = st[k / 8][l] >> (8 * (k % 8));
+      for (j = 0; j < 25; j++) st[j][l] = 0;
+      if (next < n) {
+        SHA3_lane_start(&lane[l], rsiz, padding, next++, get, env);
+      } else {
+        lane[l].msg = (size_t) -1;
+        active--;
+      }
+    }
+  }
+  memset(lane, 0, sizeof(lane));
+}
+
+#endif
+
+EXPORT void SHA3_hash_many(int hsiz, unsigned char padding, size_t n,
+                           void (*get)(void * env, size_t i,
+                                       const unsigned char ** p,
+                                       size_t * len),
+                           void * env,
+                           unsigned char * output)
+{
+  struct SHA3Context ctx;
+  const unsigned char * p;
+  size_t i, len;
+
+#ifdef HAVE_X86_DISPATCH
+  if (n > 1 && (cpu_features() & CPU_AVX2)) {
+    SHA3_hash_many_avx2(hsiz / 8, padding, n, get, env, output);
+    return;
+  }
+#endif
+  for (i = 0; i < n; i++) {
+    get(env, i, &p, &len);
+    SHA3_init(&ctx, hsiz);
+    SHA3_absorb(&ctx, (unsigned char *) p, len);
+    SHA3_extract(padding, &ctx, output + i * (hsiz / 8));
   }
+  memset(&ctx, 0, sizeof(ctx));
 }
@@ -4,18 +4,63 @@ typedef unsigned long long u64;
 
 struct SHA3Context {
   u64 state[25];
-  unsigned char buffer[144];
-  int numbytes;       /* number of bytes in buffer */
+  unsigned char buffer[168];
+  int numbytes;       /* number of bytes in buffer, or, once padded,
+                         number of bytes of the current output block
+                         already extracted */
   int rsiz;           /* number of message bytes processed by permutation */
   int hsiz;           /* size of hash in bytes */
+  int rounds;         /* number of rounds of the permutation */
 };
 
 EXPORT void SHA3_init(struct SHA3Context * ctx, int hsiz);
 
+EXPORT void SHAKE_init(struct SHA3Context * ctx, int level);
+
 EXPORT void SHA3_absorb(struct SHA3Context * ctx, 
                         unsigned char * data,
                         unsigned long len);
 
+EXPORT void SHA3_pad(unsigned char padding,
+                     struct SHA3Context * ctx);
+
+EXPORT void SHA3_squeeze(struct SHA3Context * ctx,
+                         unsigned char * output,
+                         unsigned long len);
+
 EXPORT void SHA3_extract(unsigned char padding,
                          struct SHA3Context * ctx,
                          unsigned char * output);
+
+/* Hash [n] messages, obtained by calling [get(env, i, &p, &len)] for
+   [i = 0 ... n-1], and store their hashes of [hsiz] bits
+   consecutively in [output] */
+EXPORT void SHA3_hash_many(int hsiz, unsigned char padding, size_t n,
+                           void (*get)(void * env, size_t i,
+                                       const unsigned char ** p,
+                                       size_t * len),
+                           void * env,
+                           unsigned char * output);
+
+/* KangarooTwelve */
+
+#define K12_CHUNK 8192
+
+struct K12Context {
+  struct SHA3Context node;      /* the final node */
+  struct SHA3Context leaf;      /* the current leaf */
+  int tree;                     /* set once the input exceeds one chunk */
+  u64 numleaves;                /* number of leaves completed */
+  size_t chunkpos;              /* bytes absorbed in the current chunk */
+};
+
+EXPORT void K12_init(struct K12Context * s);
+
+EXPORT void K12_absorb(struct K12Context * s,
+                       const unsigned char * data, size_t len, int threads);
+
+EXPORT void K12_pad(struct K12Context * s,
+                    const unsigned char * custom, size_t customlen);
+
+EXPORT void K12_squeeze(struct K12Context * s,
+                        unsigned char * output, size_t len);
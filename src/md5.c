@@ -0,0 +1,110 @@
+/***********************************************************************/
+/*                                                                     */
+/*                      The Cryptokit library                          */
+/*                                                                     */
+/*            Xavier Leroy, Collège de France and Inria                */
+/*                                                                     */
+/*  Copyright 2026 Institut National de Recherche en Informatique et   */
+/*  en Automatique.  All rights reserved.  This file is distributed    */
+/*  under the terms of the GNU Library General Public License, with    */
+/*  the special exception on linking described in file LICENSE.        */
+/*                                                                     */
+/***********************************************************************/
+
+/* MD5 hashing of many messages.  Single messages are hashed with the
+   MD5 implementation of the OCaml runtime system. */
+
+#include <string.h>
+#include <caml/mlvalues.h>
+#include "md5.h"
+#include "cpufeatures.h"
+
+/* Ref: RFC 1321 */
+
+#ifdef HAVE_X86_DISPATCH
+
+#define ROL(x,n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+#define F1(x,y,z) ((z) ^ ((x) & ((y) ^ (z))))
+#define F2(x,y,z) ((y) ^ ((z) & ((x) ^ (y))))
+#define F3(x,y,z) ((x) ^ (y) ^ (z))
+#define F4(x,y,z) ((y) ^ ((x) | ~(z)))
+
+static const u32 MD5_constants[64] = {
+  0xd76aa478U, 0xe8c7b756U, 0x242070dbU, 0xc1bdceeeU,
+  0xf57c0fafU, 0x4787c62aU, 0xa8304613U, 0xfd469501U,
+  0x698098d8U, 0x8b44f7afU, 0xffff5bb1U, 0x895cd7beU,
+  0x6b901122U, 0xfd987193U, 0xa679438eU, 0x49b40821U,
+  0xf61e2562U, 0xc040b340U, 0x265e5a51U, 0xe9b6c7aaU,
+  0xd62f105dU, 0x02441453U, 0xd8a1e681U, 0xe7d3fbc8U,
+  0x21e1cde6U, 0xc33707d6U, 0xf4d50d87U, 0x455a14edU,
+  0xa9e3e905U, 0xfcefa3f8U, 0x676f02d9U, 0x8d2a4c8aU,
+  0xfffa3942U, 0x8771f681U, 0x6d9d6122U, 0xfde5380cU,
+  0xa4beea44U, 0x4bdecfa9U, 0xf6bb4b60U, 0xbebfbc70U,
+  0x289b7ec6U, 0xeaa127faU, 0xd4ef3085U, 0x04881d05U,
+  0xd9d4d039U, 0xe6db99e5U, 0x1fa27cf8U, 0xc4ac5665U,
+  0xf4292244U, 0x432aff97U, 0xab9423a7U, 0xfc93a039U,
+  0x655b59c3U, 0x8f0ccc92U, 0xffeff47dU, 0x85845dd1U,
+  0x6fa87e4fU, 0xfe2ce6e0U, 0xa3014314U, 0x4e0811a1U,
+  0xf7537e82U, 0xbd3af235U, 0x2ad7d2bbU, 0xeb86d391U
+};
+
+/* The message word used at each step */
+static const unsigned char MD5_index[64] = {
+  0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+  1, 6, 11, 0, 5, 10, 15, 4, 9, 14, 3, 8, 13, 2, 7, 12,
+  5, 8, 11, 14, 1, 4, 7, 10, 13, 0, 3, 6, 9, 12, 15, 2,
+  0, 7, 14, 5, 12, 3, 10, 1, 8, 15, 6, 13, 4, 11, 2, 9
+};
+
+/* The rotation amount at each step */
+static const unsigned char MD5_shifts[64] = {
+  7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+  5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+  4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+  6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+#define MB_MD5
+#include "multibuf.h"
+
+#endif
+
+EXPORT void MD5_hash_many(size_t n,
+                          void (*get)(void * env, size_t i,
+                                      const unsigned char ** p,
+                                      size_t * len),
+                          void * env,
+                          unsigned char * output)
+{
+  struct MD5Context ctx;
+  const unsigned char * p;
+  size_t i, len;
+#ifdef HAVE_X86_DISPATCH
+  static const u32 MD5_iv[4] =
+    { 0x67452301U, 0xefcdab89U, 0x98badcfeU, 0x10325476U };
+  struct mb_hash h;
+
+  MB_SELECT(h, MD5_mb);
+  if (n > 1 && h.lanes > 0) {
+    h.nwords = 4;
+    h.iv = MD5_iv;
+    h.bigendian = 0;
+    h.outlen = 16;
+    mb_hash_many(&h, n, get, env, output);
+    return;
+  }
+#endif
+  for (i = 0; i < n; i++) {
+    get(env, i, &p, &len);
+    caml_MD5Init(&ctx);
+    /* caml_MD5Update takes an [unsigned] length */
+    while (len > 0x10000000) {
+      caml_MD5Update(&ctx, (unsigned char *) p, 0x10000000);
+      p += 0x10000000;
+      len -= 0x10000000;
+    }
+    caml_MD5Update(&ctx, (unsigned char *) p, len);
+    caml_MD5Final(output + i * 16, &ctx);
+  }
+}
@@ -0,0 +1,45 @@
+/***********************************************************************/
+/*                                                                     */
+/*                      The Cryptokit library                          */
+/*                                                                     */
+/*            Xavier Leroy, Collège de France and Inria                */
+/*                                                                     */
+/*  Copyright 2026 Institut National de Recherche en Informatique et   */
+/*  en Automatique.  All rights reserved.  This file is distributed    */
+/*  under the terms of the GNU Library General Public License, with    */
+/*  the special exception on linking described in file LICENSE.        */
+/*                                                                     */
+/***********************************************************************/
+
+/* MD5 hashing */
+
+#include <stddef.h>
+
+#ifndef _MSC_VER
+#include <stdint.h>
+typedef uint32_t u32;
+#else
+typedef unsigned int u32;
+#endif
+
+/* The MD5 implementation of the OCaml runtime system */
+
+struct MD5Context {
+        u32 buf[4];
+        u32 bits[2];
+        unsigned char in[64];
+};
+
+CAMLextern void caml_MD5Init (struct MD5Context *context);
+CAMLextern void caml_MD5Update (struct MD5Context *context,
+                           unsigned char *buf, unsigned len);
+CAMLextern void caml_MD5Final (unsigned char *digest, struct MD5Context *ctx);
+
+/* Hash [n] messages, obtained by calling [get(env, i, &p, &len)] for
+   [i = 0 ... n-1], and store their digests consecutively in [output] */
+EXPORT void MD5_hash_many(size_t n,
+                          void (*get)(void * env, size_t i,
+                                      const unsigned char ** p,
+                                      size_t * len),
+                          void * env,
+                          unsigned char * output);
@@ -0,0 +1,188 @@
+/***********************************************************************/
+/*                                                                     */
+/*                      The Cryptokit library                          */
+/*                                                                     */
+/*            Xavier Leroy, Collège de France and Inria                */
+/*                                                                     */
+/*  Copyright 2026 Institut National de Recherche en Informatique et   */
+/*  en Automatique.  All rights reserved.  This file is distributed    */
+/*  under the terms of the GNU Library General Public License, with    */
+/*  the special exception on linking described in file LICENSE.        */
+/*                                                                     */
+/***********************************************************************/
+
+/* Multi-buffer compression functions.  This file is included several
+   times by multibuf.h, once per target, with MB_WIDTH the number of
+   lanes, MB_TARGET the target attribute, and MB_NAME(f) the name of
+   function [f] for this target. */
+
+typedef u32 MB_NAME(mb_vec) __attribute__((vector_size(4 * MB_WIDTH)));
+
+#define MB_V MB_NAME(mb_vec)
+
+/* Load the 16 words of the blocks, in big-endian or little-endian,
+   and transpose them so that [w[i]] contains word [i] of all lanes */
+
+MB_TARGET static inline __attribute__((always_inline))
+void MB_NAME(mb_load_words)(MB_V w[16], const unsigned char * const blk[],
+                            int bigendian)
+{
+  u32 m[16][MB_WIDTH];
+  u32 x;
+  int i, l;
+
+  for (l = 0; l < MB_WIDTH; l++) {
+    for (i = 0; i < 16; i++) {
+      memcpy(&x, blk[l] + 4 * i, 4);
+      m[i][l] = bigendian ? __builtin_bswap32(x) : x;
+    }
+  }
+  memcpy(w, m, sizeof(m));
+}
+
+#define MB_LOAD(v, p) memcpy(&(v), (p), sizeof(MB_V))
+#define MB_ADD(p, v) \
+  do { MB_V mb_tmp_; MB_LOAD(mb_tmp_, p); mb_tmp_ += (v); \
+       memcpy((p), &mb_tmp_, sizeof(MB_V)); } while (0)
+
+#ifdef MB_SHA256
+
+MB_TARGET static void MB_NAME(SHA256_mb)(u32 st[][MB_LANES],
+                                         const unsigned char * const blk[])
+{
+  int i;
+  MB_V w[16], a, b, c, d, e, f, g, h, t1, t2;
+
+  MB_NAME(mb_load_words)(w, blk, 1);
+  MB_LOAD(a, st[0]); MB_LOAD(b, st[1]); MB_LOAD(c, st[2]);
+  MB_LOAD(d, st[3]); MB_LOAD(e, st[4]); MB_LOAD(f, st[5]);
+  MB_LOAD(g, st[6]); MB_LOAD(h, st[7]);
+  for (i = 0; i < 64; i++) {
+    /* The message schedule is kept in a sliding window of 16 words */
+    if (i >= 16)
+      w[i & 15] += sigma1(w[(i - 2) & 15]) + w[(i - 7) & 15]
+                   + sigma0(w[(i - 15) & 15]);
+    t1 = h + SIGMA1(e) + CH(e, f, g) + SHA256_constants[i] + w[i & 15];
+    t2 = SIGMA0(a) + MAJ(a, b, c);
+    h = g;  g = f;  f = e;  e = d + t1;
+    d = c;  c = b;  b = a;  a = t1 + t2;
+  }
+  MB_ADD(st[0], a); MB_ADD(st[1], b); MB_ADD(st[2], c);
+  MB_ADD(st[3], d); MB_ADD(st[4], e); MB_ADD(st[5], f);
+  MB_ADD(st[6], g); MB_ADD(st[7], h);
+}
+
+#endif
+
+#ifdef MB_SHA1
+
+MB_TARGET static void MB_NAME(SHA1_mb)(u32 st[][MB_LANES],
+                                       const unsigned char * const blk[])
+{
+  int i;
+  MB_V w[16], a, b, c, d, e, t;
+
+  MB_NAME(mb_load_words)(w, blk, 1);
+  MB_LOAD(a, st[0]); MB_LOAD(b, st[1]); MB_LOAD(c, st[2]);
+  MB_LOAD(d, st[3]); MB_LOAD(e, st[4]);
+  for (i = 0; i < 80; i++) {
+    /* The message schedule is kept in a sliding window of 16 words */
+    if (i >= 16) {
+      t = w[(i - 3) & 15] ^ w[(i - 8) & 15] ^ w[(i - 14) & 15] ^ w[i & 15];
+      w[i & 15] = rol1(t);
+    }
+    if (i < 20)
+      t = F(b, c, d) + Y1;
+    else if (i < 40)
+      t = H(b, c, d) + Y2;
+    else if (i < 60)
+      t = G(b, c, d) + Y3;
+    else
+      t = H(b, c, d) + Y4;
+    t += rol5(a) + e + w[i & 15];
+    e = d; d = c; c = rol30(b); b = a; a = t;
+  }
+  MB_ADD(st[0], a); MB_ADD(st[1], b); MB_ADD(st[2], c);
+  MB_ADD(st[3], d); MB_ADD(st[4], e);
+}
+
+#endif
+
+#ifdef MB_MD5
+
+MB_TARGET static void MB_NAME(MD5_mb)(u32 st[][MB_LANES],
+                                      const unsigned char * const blk[])
+{
+  int i;
+  MB_V w[16], a, b, c, d, f, t;
+
+  MB_NAME(mb_load_words)(w, blk, 0);
+  MB_LOAD(a, st[0]); MB_LOAD(b, st[1]);
+  MB_LOAD(c, st[2]); MB_LOAD(d, st[3]);
+  for (i = 0; i < 64; i++) {
+    switch (i >> 4) {
+    case 0: f = F1(b, c, d); break;
+    case 1: f = F2(b, c, d); break;
+    case 2: f = F3(b, c, d); break;
+    default: f = F4(b, c, d); break;
+    }
+    t = a + f + MD5_constants[i] + w[MD5_index[i]];
+    a = d; d = c; c = b;
+    b = b + ROL(t, MD5_shifts[i]);
+  }
+  MB_ADD(st[0], a); MB_ADD(st[1], b);
+  MB_ADD(st[2], c); MB_ADD(st[3], d);
+}
+
+#endif
+
+#ifdef MB_RIPEMD160
+
+MB_TARGET static void MB_NAME(RIPEMD160_mb)(u32 st[][MB_LANES],
+                                            const unsigned char * const blk[])
+{
+  int i;
+  MB_V w[16], a, b, c, d, e, aa, bb, cc, dd, ee, f, t;
+
+  MB_NAME(mb_load_words)(w, blk, 0);
+  MB_LOAD(a, st[0]); MB_LOAD(b, st[1]); MB_LOAD(c, st[2]);
+  MB_LOAD(d, st[3]); MB_LOAD(e, st[4]);
+  aa = a; bb = b; cc = c; dd = d; ee = e;
+  for (i = 0; i < 80; i++) {
+    /* Left and right lines, interleaved */
+    switch (i >> 4) {
+    case 0: f = F(b, c, d); break;
+    case 1: f = G(b, c, d); break;
+    case 2: f = H(b, c, d); break;
+    case 3: f = I(b, c, d); break;
+    default: f = J(b, c, d); break;
+    }
+    t = a + f + w[RIPEMD160_left_index[i]] + RIPEMD160_left_constants[i >> 4];
+    t = ROL(t, RIPEMD160_left_shifts[i]) + e;
+    a = e; e = d; d = ROL(c, 10); c = b; b = t;
+    switch (i >> 4) {
+    case 0: f = J(bb, cc, dd); break;
+    case 1: f = I(bb, cc, dd); break;
+    case 2: f = H(bb, cc, dd); break;
+    case 3: f = G(bb, cc, dd); break;
+    default: f = F(bb, cc, dd); break;
+    }
+    t = aa + f + w[RIPEMD160_right_index[i]]
+        + RIPEMD160_right_constants[i >> 4];
+    t = ROL(t, RIPEMD160_right_shifts[i]) + ee;
+    aa = ee; ee = dd; dd = ROL(cc, 10); cc = bb; bb = t;
+  }
+  /* Combine the two lines with the chaining values */
+  MB_LOAD(t, st[1]); t += c + dd;
+  MB_LOAD(f, st[2]); f += d + ee; memcpy(st[1], &f, sizeof(MB_V));
+  MB_LOAD(f, st[3]); f += e + aa; memcpy(st[2], &f, sizeof(MB_V));
+  MB_LOAD(f, st[4]); f += a + bb; memcpy(st[3], &f, sizeof(MB_V));
+  MB_LOAD(f, st[0]); f += b + cc; memcpy(st[4], &f, sizeof(MB_V));
+  memcpy(st[0], &t, sizeof(MB_V));
+}
+
+#endif
+
+#undef MB_LOAD
+#undef MB_ADD
+#undef MB_V
@@ -0,0 +1,186 @@
+/***********************************************************************/
+/*                                                                     */
+/*                      The Cryptokit library                          */
+/*                                                                     */
+/*            Xavier Leroy, Collège de France and Inria                */
+/*                                                                     */
+/*  Copyright 2026 Institut National de Recherche en Informatique et   */
+/*  en Automatique.  All rights reserved.  This file is distributed    */
+/*  under the terms of the GNU Library General Public License, with    */
+/*  the special exception on linking described in file LICENSE.        */
+/*                                                                     */
+/***********************************************************************/
+
+/* Multi-buffer hashing for the Merkle-Damgard hash functions with
+   64-byte blocks and 32-bit words (MD5, SHA-1, SHA-256, RIPEMD-160).
+
+   Many independent messages are hashed in parallel, one message per
+   lane of a SIMD compression function.  When the message of a lane is
+   finished, the next message is scheduled on this lane, so that
+   messages of different lengths keep all lanes busy.
+
+   The file implementing a hash function defines one of MB_MD5, MB_SHA1,
+   MB_SHA256 or MB_RIPEMD160, then includes this file after its own
+   definitions of the round functions and constants. */
+
+#ifndef CRYPTOKIT_MULTIBUF_H
+#define CRYPTOKIT_MULTIBUF_H
+
+#include <string.h>
+#include <stddef.h>
+
+/* Access to message number [i] */
+typedef void (*mb_get_message)(void * env, size_t i,
+                               const unsigned char ** p, size_t * len);
+
+#ifdef HAVE_X86_DISPATCH
+
+#define MB_LANES 16
+
+/* A compression function: compresses block [blk[l]] into the state
+   [st[0][l]], ..., [st[nwords - 1][l]] of lane [l], for all lanes */
+typedef void (*mb_kernel)(u32 st[][MB_LANES],
+                          const unsigned char * const blk[MB_LANES]);
+
+struct mb_hash {
+  int nwords;             /* number of 32-bit words of state */
+  const u32 * iv;         /* initial state */
+  int bigendian;          /* 1: big-endian words and length (SHA)
+                             0: little-endian (MD5, RIPEMD-160) */
+  int outlen;             /* digest size in bytes */
+  int lanes;              /* number of lanes of the compression function */
+  mb_kernel kernel;
+};
+
+struct mb_lane {
+  size_t msg;                   /* message number, or [(size_t) -1] */
+  const unsigned char * p;      /* next full block of the message */
+  size_t nfull;                 /* number of full blocks left */
+  int ntail, tailpos;           /* number of final blocks, next one */
+  unsigned char tail[128];      /* final blocks, with padding */
+};
+
+static void mb_start(const struct mb_hash * h, u32 st[][MB_LANES], int l,
+                     struct mb_lane * ln, size_t msg,
+                     mb_get_message get, void * env)
+{
+  const unsigned char * p;
+  size_t len, r;
+  unsigned long long bits;
+  int i, end;
+
+  get(env, msg, &p, &len);
+  ln->msg = msg;
+  ln->p = p;
+  ln->nfull = len / 64;
+  r = len % 64;
+  memcpy(ln->tail, p + 64 * ln->nfull, r);
+  ln->tail[r] = 0x80;
+  ln->ntail = r < 56 ? 1 : 2;
+  ln->tailpos = 0;
+  end = 64 * ln->ntail;
+  memset(ln->tail + r + 1, 0, end - 8 - (r + 1));
+  bits = (unsigned long long) len << 3;
+  for (i = 0; i < 8; i++) {
+    ln->tail[h->bigendian ? end - 1 - i : end - 8 + i] =
+      (unsigned char) (bits >> (8 * i));
+  }
+  for (i = 0; i < h->nwords; i++) st[i][l] = h->iv[i];
+}
+
+static void mb_hash_many(const struct mb_hash * h, size_t n,
+                         mb_get_message get, void * env,
+                         unsigned char * out)
+{
+  static const unsigned char zero_block[64] = { 0 };
+  u32 st[8][MB_LANES];
+  const unsigned char * blk[MB_LANES];
+  struct mb_lane lane[MB_LANES];
+  size_t next = 0;
+  int active = 0;
+  int i, l;
+  u32 x;
+  unsigned char * o;
+
+  for (l = 0; l < h->lanes; l++) {
+    if (next < n) {
+      mb_start(h, st, l, &lane[l], next++, get, env);
+      active++;
+    } else {
+      lane[l].msg = (size_t) -1;
+    }
+  }
+  while (active > 0) {
+    for (l = 0; l < h->lanes; l++) {
+      struct mb_lane * ln = &lane[l];
+      if (ln->msg == (size_t) -1)
+        blk[l] = zero_block;
+      else if (ln->nfull > 0)
+        blk[l] = ln->p;
+      else
+        blk[l] = ln->tail + 64 * ln->tailpos;
+    }
+    h->kernel(st, blk);
+    for (l = 0; l < h->lanes; l++) {
+      struct mb_lane * ln = &lane[l];
+      if (ln->msg == (size_t) -1) continue;
+      if (ln->nfull > 0) {
+        ln->nfull--; ln->p += 64;
+        continue;
+      }
+      if (++ln->tailpos < ln->ntail) continue;
+      /* This message is finished: output its digest */
+      o = out + ln->msg * h->outlen;
+      for (i = 0; i < h->outlen / 4; i++) {
+        x = st[i][l];
+        if (h->bigendian) x = __builtin_bswap32(x);
+        memcpy(o + 4 * i, &x, 4);
+      }
+      /* Schedule the next message on this lane */
+      if (next < n) {
+        mb_start(h, st, l, ln, next++, get, env);
+      } else {
+        ln->msg = (size_t) -1;
+        active--;
+      }
+    }
+  }
+}
+
+/* Instantiate the compression functions for AVX-512 (16 lanes) and
+   AVX2 (8 lanes).  With narrower vectors, hashing the messages one
+   after the other is as fast. */
+
+#define MB_WIDTH 16
+#define MB_TARGET __attribute__((target("avx512f")))
+#define MB_NAME(f) f##_avx512
+#include "multibuf-kernels.h"
+#undef MB_WIDTH
+#undef MB_TARGET
+#undef MB_NAME
+
+#define MB_WIDTH 8
+#define MB_TARGET __attribute__((target("avx2")))
+#define MB_NAME(f) f##_avx2
+#include "multibuf-kernels.h"
+#undef MB_WIDTH
+#undef MB_TARGET
+#undef MB_NAME
+
+/* Select the widest compression function supported by the processor.
+   [lanes] is set to 0 if there is none. */
+#define MB_SELECT(h, name) \
+  do { \
+    int mb_features_ = cpu_features(); \
+    if (mb_features_ & CPU_AVX512) { \
+      (h).lanes = 16; (h).kernel = name##_avx512; \
+    } else if (mb_features_ & CPU_AVX2) { \
+      (h).lanes = 8; (h).kernel = name##_avx2; \
+    } else { \
+      (h).lanes = 0; (h).kernel = NULL; \
+    } \
+  } while (0)
+
+#endif
+
+#endif
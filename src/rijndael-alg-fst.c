@@ -806,6 +806,7 @@ EXPORT int rijndaelKeySetupEnc(u32 rk[/*4*(Nr + 1)*/], const u8 cipherKey[], int
 	return 0;
 }
 
+#ifndef AES_ENCRYPT_ONLY
 /**
  * Expand the cipher key into the decryption key schedule.
  *
@@ -851,6 +852,8 @@ EXPORT int rijndaelKeySetupDec(u32 rk[/*4*(Nr + 1)*/], const u8 cipherKey[], int
 	return Nr;
 }
 
+#endif
+
 EXPORT void rijndaelEncrypt(const u32 rk[/*4*(Nr + 1)*/], int Nr, const u8 pt[16], u8 ct[16]) {
 	u32 s0, s1, s2, s3, t0, t1, t2, t3;
 #ifndef FULL_UNROLL
@@ -1032,6 +1035,7 @@ EXPORT void rijndaelEncrypt(const u32 rk[/*4*(Nr + 1)*/], int Nr, const u8 pt[16
 	PUTU32(ct + 12, s3);
 }
 
+#ifndef AES_ENCRYPT_ONLY
 EXPORT void rijndaelDecrypt(const u32 rk[/*4*(Nr + 1)*/], int Nr, const u8 ct[16], u8 pt[16]) {
 	u32 s0, s1, s2, s3, t0, t1, t2, t3;
 #ifndef FULL_UNROLL
@@ -1212,6 +1216,7 @@ EXPORT void rijndaelDecrypt(const u32 rk[/*4*(Nr + 1)*/], int Nr, const u8 ct[16
    		rk[3];
 	PUTU32(pt + 12, s3);
 }
+#endif
 
 #ifdef INTERMEDIATE_VALUE_KAT
 
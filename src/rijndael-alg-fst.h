@@ -35,9 +35,13 @@ typedef unsigned short	u16;
 typedef unsigned int	u32;
 
 EXPORT int rijndaelKeySetupEnc(u32 rk[/*4*(Nr + 1)*/], const u8 cipherKey[], int keyBits);
+#ifndef AES_ENCRYPT_ONLY
 EXPORT int rijndaelKeySetupDec(u32 rk[/*4*(Nr + 1)*/], const u8 cipherKey[], int keyBits);
+#endif
 EXPORT void rijndaelEncrypt(const u32 rk[/*4*(Nr + 1)*/], int Nr, const u8 pt[16], u8 ct[16]);
+#ifndef AES_ENCRYPT_ONLY
 EXPORT void rijndaelDecrypt(const u32 rk[/*4*(Nr + 1)*/], int Nr, const u8 ct[16], u8 pt[16]);
+#endif
 
 #ifdef INTERMEDIATE_VALUE_KAT
 EXPORT void rijndaelEncryptRound(const u32 rk[/*4*(Nr + 1)*/], int Nr, u8 block[16], int rounds);
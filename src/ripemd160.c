@@ -16,6 +16,7 @@
 #include <string.h>
 #include <caml/config.h>
 #include "ripemd160.h"
+#include "cpufeatures.h"
 
 /* Refs:
    - The reference implementation written by Antoon Bosselaers, 
@@ -388,3 +389,107 @@ EXPORT void RIPEMD160_finish(struct RIPEMD160Context * ctx, unsigned char output
   /* Final hash value is in ctx->state modulo little-endian conversion */
   RIPEMD160_copy_and_swap(ctx->state, output, 5);
 }
+
+/* Multi-buffer hashing */
+
+#ifdef HAVE_X86_DISPATCH
+
+/* The message words, rotation amounts and constants for the 80 steps
+   of the left and right lines, in table form */
+
+static const unsigned char RIPEMD160_left_index[80] = {
+  0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+  7, 4, 13, 1, 10, 6, 15, 3, 12, 0, 9, 5, 2, 14, 11, 8,
+  3, 10, 14, 4, 9, 15, 8, 1, 2, 7, 0, 6, 13, 11, 5, 12,
+  1, 9, 11, 10, 0, 8, 12, 4, 13, 3, 7, 15, 14, 5, 6, 2,
+  4, 0, 5, 9, 7, 12, 2, 10, 14, 1, 3, 8, 11, 6, 15, 13
+};
+
+static const unsigned char RIPEMD160_right_index[80] = {
+  5, 14, 7, 0, 9, 2, 11, 4, 13, 6, 15, 8, 1, 10, 3, 12,
+  6, 11, 3, 7, 0, 13, 5, 10, 14, 15, 8, 12, 4, 9, 1, 2,
+  15, 5, 1, 3, 7, 14, 6, 9, 11, 8, 12, 2, 10, 0, 4, 13,
+  8, 6, 4, 1, 3, 11, 15, 0, 5, 12, 2, 13, 9, 7, 10, 14,
+  12, 15, 10, 4, 1, 5, 8, 7, 6, 2, 13, 14, 0, 3, 9, 11
+};
+
+static const unsigned char RIPEMD160_left_shifts[80] = {
+  11, 14, 15, 12, 5, 8, 7, 9, 11, 13, 14, 15, 6, 7, 9, 8,
+  7, 6, 8, 13, 11, 9, 7, 15, 7, 12, 15, 9, 11, 7, 13, 12,
+  11, 13, 6, 7, 14, 9, 13, 15, 14, 8, 13, 6, 5, 12, 7, 5,
+  11, 12, 14, 15, 14, 15, 9, 8, 9, 14, 5, 6, 8, 6, 5, 12,
+  9, 15, 5, 11, 6, 8, 13, 12, 5, 12, 13, 14, 11, 8, 5, 6
+};
+
+static const unsigned char RIPEMD160_right_shifts[80] = {
+  8, 9, 9, 11, 13, 15, 15, 5, 7, 7, 8, 11, 14, 14, 12, 6,
+  9, 13, 15, 7, 12, 8, 9, 11, 7, 7, 12, 7, 6, 15, 13, 11,
+  9, 7, 15, 11, 8, 6, 6, 14, 12, 13, 5, 14, 13, 13, 7, 5,
+  15, 5, 8, 11, 14, 14, 6, 14, 6, 9, 12, 9, 12, 5, 15, 8,
+  8, 5, 12, 9, 12, 5, 14, 6, 8, 13, 6, 5, 15, 13, 11, 11
+};
+
+static const u32 RIPEMD160_left_constants[5] = {
+  0, 0x5a827999U, 0x6ed9eba1U, 0x8f1bbcdcU, 0xa953fd4eU
+};
+
+static const u32 RIPEMD160_right_constants[5] = {
+  0x50a28be6U, 0x5c4dd124U, 0x6d703ef3U, 0x7a6d76e9U, 0
+};
+
+#define MB_RIPEMD160
+#include "multibuf.h"
+
+#endif
+
+EXPORT void RIPEMD160_hash_many(size_t n,
+                                void (*get)(void * env, size_t i,
+                                            const unsigned char ** p,
+                                            size_t * len),
+                                void * env,
+                                unsigned char * output)
+{
+  struct RIPEMD160Context ctx;
+  const unsigned char * p;
+  size_t i, len;
+#ifdef HAVE_X86_DISPATCH
+  struct mb_hash h;
+
+  MB_SELECT(h, RIPEMD160_mb);
+  if (n > 1 && h.lanes > 0) {
+    RIPEMD160_init(&ctx);
+    h.nwords = 5;
+    h.iv = ctx.state;
+    h.bigendian = 0;
+    h.outlen = 20;
+    mb_hash_many(&h, n, get, env, output);
+    return;
+  }
+#endif
+  for (i = 0; i < n; i++) {
+    get(env, i, &p, &len);
+    RIPEMD160_init(&ctx);
+    RIPEMD160_add_data(&ctx, (unsigned char *) p, len);
+    RIPEMD160_finish(&ctx, output + i * 20);
+  }
+}
+
+/* Hash exactly 32 bytes, e.g. a SHA-256 digest, in one block whose
+   padding is constant */
+
+static const unsigned char RIPEMD160_pad32[32] = {
+  0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0x00, 0x01, 0, 0, 0, 0, 0, 0
+};
+
+EXPORT void RIPEMD160_32to20(const unsigned char in[32],
+                             unsigned char out[20])
+{
+  struct RIPEMD160Context ctx;
+
+  RIPEMD160_init(&ctx);
+  memcpy(ctx.buffer, in, 32);
+  memcpy(ctx.buffer + 32, RIPEMD160_pad32, 32);
+  RIPEMD160_compress(&ctx);
+  RIPEMD160_copy_and_swap(ctx.state, out, 5);
+}
@@ -15,6 +15,8 @@
 
 /* RIPEMD160 hashing */
 
+#include <stddef.h>
+
 typedef unsigned int u32;
 
 struct RIPEMD160Context {
@@ -30,3 +32,16 @@ EXPORT void RIPEMD160_add_data(struct RIPEMD160Context * ctx,
                                unsigned long len);
 EXPORT void RIPEMD160_finish(struct RIPEMD160Context * ctx, 
                              unsigned char output[20]);
+
+/* Hash [n] messages, obtained by calling [get(env, i, &p, &len)] for
+   [i = 0 ... n-1], and store their digests consecutively in [output] */
+EXPORT void RIPEMD160_hash_many(size_t n,
+                                void (*get)(void * env, size_t i,
+                                            const unsigned char ** p,
+                                            size_t * len),
+                                void * env,
+                                unsigned char * output);
+
+/* Hash exactly 32 bytes */
+EXPORT void RIPEMD160_32to20(const unsigned char in[32],
+                             unsigned char out[20]);
@@ -16,6 +16,7 @@
 #include <string.h>
 #include <caml/config.h>
 #include "sha1.h"
+#include "cpufeatures.h"
 
 /* Ref: Handbook of Applied Cryptography, section 9.4.2, algorithm 9.53 */
 
@@ -50,52 +51,184 @@ static void SHA1_copy_and_swap(void * src, void * dst, int numwords)
 #define Y3 0x8F1BBCDCU
 #define Y4 0xCA62C1D6U
 
-static void SHA1_transform(struct SHA1Context * ctx)
+#define U8TO32_BE(p) \
+  (((u32)((p)[0]) << 24) | ((u32)((p)[1]) << 16) | \
+   ((u32)((p)[2]) << 8) | (u32)((p)[3]))
+
+/* Perform the 80 rounds on the expanded message [w[0]], [w[stride]],
+   [w[2*stride]], ... and update the chaining values */
+
+static inline void SHA1_rounds(u32 state[5], const u32 * w, int stride)
 {
   int i;
   register u32 a, b, c, d, e, t;
-  u32 data[80];
-
-  /* Convert buffer data to 16 big-endian integers */
-  SHA1_copy_and_swap(ctx->buffer, data, 16);
-
-  /* Expand into 80 integers */
-  for (i = 16; i < 80; i++) {
-    t = data[i-3] ^ data[i-8] ^ data[i-14] ^ data[i-16];
-    data[i] = rol1(t);
-  }
 
   /* Initialize working variables */
-  a = ctx->state[0];
-  b = ctx->state[1];
-  c = ctx->state[2];
-  d = ctx->state[3];
-  e = ctx->state[4];
+  a = state[0];
+  b = state[1];
+  c = state[2];
+  d = state[3];
+  e = state[4];
 
   /* Perform rounds */
   for (i = 0; i < 20; i++) {
-    t = F(b, c, d) + Y1 + rol5(a) + e + data[i];
+    t = F(b, c, d) + Y1 + rol5(a) + e + w[i * stride];
     e = d; d = c; c = rol30(b); b = a; a = t;
   }
   for (/*nothing*/; i < 40; i++) {
-    t = H(b, c, d) + Y2 + rol5(a) + e + data[i];
+    t = H(b, c, d) + Y2 + rol5(a) + e + w[i * stride];
     e = d; d = c; c = rol30(b); b = a; a = t;
   }
   for (/*nothing*/; i < 60; i++) {
-    t = G(b, c, d) + Y3 + rol5(a) + e + data[i];
+    t = G(b, c, d) + Y3 + rol5(a) + e + w[i * stride];
     e = d; d = c; c = rol30(b); b = a; a = t;
   }
   for (/*nothing*/; i < 80; i++) {
-    t = H(b, c, d) + Y4 + rol5(a) + e + data[i];
+    t = H(b, c, d) + Y4 + rol5(a) + e + w[i * stride];
     e = d; d = c; c = rol30(b); b = a; a = t;
   }
 
   /* Update chaining values */
-  ctx->state[0] += a;
-  ctx->state[1] += b;
-  ctx->state[2] += c;
-  ctx->state[3] += d;
-  ctx->state[4] += e;
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+}
+
+/* Portable implementation */
+
+static void SHA1_blocks_generic(u32 state[5],
+                                const unsigned char * p, size_t nblocks)
+{
+  int i;
+  u32 t, data[80];
+
+  for (; nblocks > 0; nblocks--, p += 64) {
+    /* Convert block to 16 big-endian integers */
+    for (i = 0; i < 16; i++) data[i] = U8TO32_BE(p + 4 * i);
+    /* Expand into 80 integers */
+    for (i = 16; i < 80; i++) {
+      t = data[i-3] ^ data[i-8] ^ data[i-14] ^ data[i-16];
+      data[i] = rol1(t);
+    }
+    SHA1_rounds(state, data, 1);
+  }
+}
+
+#ifdef HAVE_X86_DISPATCH
+
+#include <immintrin.h>
+
+/* AVX2 implementation.  The message schedule does not depend on the
+   chaining values, so it is computed for 8 consecutive blocks at once,
+   one block per 32-bit lane.  The rounds remain scalar. */
+
+typedef u32 sha1_v8 __attribute__((vector_size(32), may_alias));
+
+__attribute__((target("avx2")))
+static void SHA1_blocks_avx2(u32 state[5],
+                             const unsigned char * p, size_t nblocks)
+{
+  int i, j, n;
+  sha1_v8 t, w[80];
+
+  while (nblocks >= 4) {
+    n = nblocks < 8 ? nblocks : 8;
+    for (i = 0; i < 16; i++) {
+      for (j = 0; j < n; j++) w[i][j] = U8TO32_BE(p + 64 * j + 4 * i);
+      for (/*nothing*/; j < 8; j++) w[i][j] = 0;
+    }
+    for (i = 16; i < 80; i++) {
+      t = w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16];
+      w[i] = rol1(t);
+    }
+    for (j = 0; j < n; j++) SHA1_rounds(state, (const u32 *) w + j, 8);
+    p += 64 * n;
+    nblocks -= n;
+  }
+  SHA1_blocks_generic(state, p, nblocks);
+}
+
+/* Implementation using the SHA extensions (SHA-NI) */
+
+__attribute__((target("sha,sse4.1")))
+static void SHA1_blocks_shani(u32 state[5],
+                              const unsigned char * p, size_t nblocks)
+{
+  __m128i abcd, abcd_save, e0, e1, e_save;
+  __m128i m0, m1, m2, m3;
+  const __m128i mask =
+    _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+  abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) state), 0x1B);
+  e0 = _mm_set_epi32(state[4], 0, 0, 0);
+
+  /* Four rounds using message words [wi] and the E value [ei],
+     saving the state in [enext] for the next four rounds.  The next
+     message words are computed in [wnext] and later message words
+     in [wprev] and [wprev2]. */
+#define QUAD(i, wi, wprev2, wprev, wnext, ei, enext) \
+    if ((i) < 4) \
+      wi = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + 16 * (i))), \
+                            mask); \
+    if ((i) == 0) ei = _mm_add_epi32(ei, wi); \
+    else ei = _mm_sha1nexte_epu32(ei, wi); \
+    enext = abcd; \
+    if ((i) >= 3 && (i) <= 18) wnext = _mm_sha1msg2_epu32(wnext, wi); \
+    abcd = _mm_sha1rnds4_epu32(abcd, ei, (i) / 5); \
+    if ((i) >= 1 && (i) <= 16) wprev = _mm_sha1msg1_epu32(wprev, wi); \
+    if ((i) >= 2 && (i) <= 17) wprev2 = _mm_xor_si128(wprev2, wi)
+
+  for (; nblocks > 0; nblocks--, p += 64) {
+    abcd_save = abcd;
+    e_save = e0;
+    QUAD(0, m0, m2, m3, m1, e0, e1);
+    QUAD(1, m1, m3, m0, m2, e1, e0);
+    QUAD(2, m2, m0, m1, m3, e0, e1);
+    QUAD(3, m3, m1, m2, m0, e1, e0);
+    QUAD(4, m0, m2, m3, m1, e0, e1);
+    QUAD(5, m1, m3, m0, m2, e1, e0);
+    QUAD(6, m2, m0, m1, m3, e0, e1);
+    QUAD(7, m3, m1, m2, m0, e1, e0);
+    QUAD(8, m0, m2, m3, m1, e0, e1);
+    QUAD(9, m1, m3, m0, m2, e1, e0);
+    QUAD(10, m2, m0, m1, m3, e0, e1);
+    QUAD(11, m3, m1, m2, m0, e1, e0);
+    QUAD(12, m0, m2, m3, m1, e0, e1);
+    QUAD(13, m1, m3, m0, m2, e1, e0);
+    QUAD(14, m2, m0, m1, m3, e0, e1);
+    QUAD(15, m3, m1, m2, m0, e1, e0);
+    QUAD(16, m0, m2, m3, m1, e0, e1);
+    QUAD(17, m1, m3, m0, m2, e1, e0);
+    QUAD(18, m2, m0, m1, m3, e0, e1);
+    QUAD(19, m3, m1, m2, m0, e1, e0);
+    e0 = _mm_sha1nexte_epu32(e0, e_save);
+    abcd = _mm_add_epi32(abcd, abcd_save);
+  }
+#undef QUAD
+
+  abcd = _mm_shuffle_epi32(abcd, 0x1B);
+  _mm_storeu_si128((__m128i *) state, abcd);
+  state[4] = _mm_extract_epi32(e0, 3);
+}
+
+#endif
+
+/* Process [nblocks] 64-byte blocks, read directly from [p] */
+
+static void SHA1_blocks(u32 state[5], const unsigned char * p, size_t nblocks)
+{
+#ifdef HAVE_X86_DISPATCH
+  int features = cpu_features();
+  if (features & CPU_SHA) {
+    SHA1_blocks_shani(state, p, nblocks); return;
+  }
+  if (features & CPU_AVX2) {
+    SHA1_blocks_avx2(state, p, nblocks); return;
+  }
+#endif
+  SHA1_blocks_generic(state, p, nblocks);
 }
 
 EXPORT void SHA1_init(struct SHA1Context * ctx)
@@ -130,16 +263,15 @@ EXPORT void SHA1_add_data(struct SHA1Context * ctx, unsigned char * data,
       return;
     }
     memcpy(ctx->buffer + ctx->numbytes, data, t);
-    SHA1_transform(ctx);
+    SHA1_blocks(ctx->state, ctx->buffer, 1);
     data += t;
     len -= t;
   }
-  /* Munge data in 64-byte chunks */
-  while (len >= 64) {
-    memcpy(ctx->buffer, data, 64);
-    SHA1_transform(ctx);
-    data += 64;
-    len -= 64;
+  /* Munge data in 64-byte chunks, directly from the input */
+  if (len >= 64) {
+    SHA1_blocks(ctx->state, data, len / 64);
+    data += len & ~63UL;
+    len &= 63;
   }
   /* Save remaining data */
   memcpy(ctx->buffer, data, len);
@@ -156,7 +288,7 @@ EXPORT void SHA1_finish(struct SHA1Context * ctx, unsigned char output[20])
      with zeroes and munge the data block */
   if (i > 56) {
     memset(ctx->buffer + i, 0, 64 - i);
-    SHA1_transform(ctx);
+    SHA1_blocks(ctx->state, ctx->buffer, 1);
     i = 0;
   }
   /* Pad to byte 56 with zeroes */
@@ -164,7 +296,42 @@ EXPORT void SHA1_finish(struct SHA1Context * ctx, unsigned char output[20])
   /* Add length in big-endian */
   SHA1_copy_and_swap(ctx->length, ctx->buffer + 56, 2);
   /* Munge the final block */
-  SHA1_transform(ctx);
+  SHA1_blocks(ctx->state, ctx->buffer, 1);
   /* Final hash value is in ctx->state modulo big-endian conversion */
   SHA1_copy_and_swap(ctx->state, output, 5);
 }
+
+/* Multi-buffer hashing */
+
+#define MB_SHA1
+#include "multibuf.h"
+
+EXPORT void SHA1_hash_many(size_t n, mb_get_message get, void * env,
+                           unsigned char * output)
+{
+  struct SHA1Context ctx;
+  const unsigned char * p;
+  size_t i, len;
+#ifdef HAVE_X86_DISPATCH
+  struct mb_hash h;
+
+  /* One SHA-NI stream is faster than 8 AVX2 lanes, but not than
+     16 AVX-512 lanes */
+  MB_SELECT(h, SHA1_mb);
+  if (n > 1 && h.lanes > 0 && (h.lanes == 16 || ! (cpu_features() & CPU_SHA))) {
+    SHA1_init(&ctx);
+    h.nwords = 5;
+    h.iv = ctx.state;
+    h.bigendian = 1;
+    h.outlen = 20;
+    mb_hash_many(&h, n, get, env, output);
+    return;
+  }
+#endif
+  for (i = 0; i < n; i++) {
+    get(env, i, &p, &len);
+    SHA1_init(&ctx);
+    SHA1_add_data(&ctx, (unsigned char *) p, len);
+    SHA1_finish(&ctx, output + i * 20);
+  }
+}
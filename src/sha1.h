@@ -15,6 +15,8 @@
 
 /* SHA-1 hashing */
 
+#include <stddef.h>
+
 typedef unsigned int u32;
 
 struct SHA1Context {
@@ -28,3 +30,12 @@ EXPORT void SHA1_init(struct SHA1Context * ctx);
 EXPORT void SHA1_add_data(struct SHA1Context * ctx, unsigned char * data,
                           unsigned long len);
 EXPORT void SHA1_finish(struct SHA1Context * ctx, unsigned char output[20]);
+
+/* Hash [n] messages, obtained by calling [get(env, i, &p, &len)] for
+   [i = 0 ... n-1], and store their digests consecutively in [output] */
+EXPORT void SHA1_hash_many(size_t n,
+                           void (*get)(void * env, size_t i,
+                                       const unsigned char ** p,
+                                       size_t * len),
+                           void * env,
+                           unsigned char * output);
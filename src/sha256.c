@@ -16,6 +16,7 @@
 #include <string.h>
 #include <caml/config.h>
 #include "sha256.h"
+#include "cpufeatures.h"
 
 /* Ref: FIPS publication 180-2 */
 
@@ -65,41 +66,31 @@ static u32 SHA256_constants[64] = {
   0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
 };
 
-static void SHA256_transform(struct SHA256Context * ctx)
+#define U8TO32_BE(p) \
+  (((u32)((p)[0]) << 24) | ((u32)((p)[1]) << 16) | \
+   ((u32)((p)[2]) << 8) | (u32)((p)[3]))
+
+/* Perform the 64 rounds and update the chaining values.  [w[i * stride]]
+   is the expanded message word number [i] plus round constant number [i]. */
+
+static inline void SHA256_rounds(u32 state[8], const u32 * w, int stride)
 {
   int i;
   register u32 a, b, c, d, e, f, g, h, t1, t2;
-  u32 data[80];
-
-  /* Convert buffer data to 16 big-endian integers */
-  SHA256_copy_and_swap(ctx->buffer, data, 16);
-
-  /* Expand into 80 integers */
-  for (i = 16; i < 80; i++) {
-    data[i] = sigma1(data[i-2]) + data[i-7] + sigma0(data[i-15]) + data[i-16];
-  }
 
   /* Initialize working variables */
-  a = ctx->state[0];
-  b = ctx->state[1];
-  c = ctx->state[2];
-  d = ctx->state[3];
-  e = ctx->state[4];
-  f = ctx->state[5];
-  g = ctx->state[6];
-  h = ctx->state[7];
+  a = state[0];
+  b = state[1];
+  c = state[2];
+  d = state[3];
+  e = state[4];
+  f = state[5];
+  g = state[6];
+  h = state[7];
 
   /* Perform rounds */
-#if 0
-  for (i = 0; i < 64; i++) {
-    t1 = h + SIGMA1(e) + CH(e, f, g) + SHA256_constants[i] + data[i];
-    t2 = SIGMA0(a) + MAJ(a, b, c);
-    h = g;  g = f;  f = e;  e = d + t1;
-    d = c;  c = b;  b = a;  a = t1 + t2;
-  }
-#else
 #define STEP(a,b,c,d,e,f,g,h,i) \
-    t1 = h + SIGMA1(e) + CH(e, f, g) + SHA256_constants[i] + data[i]; \
+    t1 = h + SIGMA1(e) + CH(e, f, g) + w[(i) * stride]; \
     t2 = SIGMA0(a) + MAJ(a, b, c); \
     d = d + t1; \
     h = t1 + t2
@@ -114,17 +105,159 @@ static void SHA256_transform(struct SHA256Context * ctx)
     STEP(c,d,e,f,g,h,a,b,i+6);
     STEP(b,c,d,e,f,g,h,a,i+7);
   }
-#endif
+#undef STEP
 
   /* Update chaining values */
-  ctx->state[0] += a;
-  ctx->state[1] += b;
-  ctx->state[2] += c;
-  ctx->state[3] += d;
-  ctx->state[4] += e;
-  ctx->state[5] += f;
-  ctx->state[6] += g;
-  ctx->state[7] += h;
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+  state[5] += f;
+  state[6] += g;
+  state[7] += h;
+}
+
+/* Portable implementation */
+
+static void SHA256_blocks_generic(u32 state[8],
+                                  const unsigned char * p, size_t nblocks)
+{
+  int i;
+  u32 data[64];
+
+  for (; nblocks > 0; nblocks--, p += 64) {
+    /* Convert block to 16 big-endian integers */
+    for (i = 0; i < 16; i++) data[i] = U8TO32_BE(p + 4 * i);
+    /* Expand into 64 integers */
+    for (i = 16; i < 64; i++) {
+      data[i] = sigma1(data[i-2]) + data[i-7] + sigma0(data[i-15]) + data[i-16];
+    }
+    for (i = 0; i < 64; i++) data[i] += SHA256_constants[i];
+    SHA256_rounds(state, data, 1);
+  }
+}
+
+#ifdef HAVE_X86_DISPATCH
+
+#include <immintrin.h>
+
+/* AVX2 implementation.  The message schedule does not depend on the
+   chaining values, so it is computed for 8 consecutive blocks at once,
+   one block per 32-bit lane.  The rounds remain scalar. */
+
+typedef u32 sha256_v8 __attribute__((vector_size(32), may_alias));
+
+__attribute__((target("avx2")))
+static void SHA256_blocks_avx2(u32 state[8],
+                               const unsigned char * p, size_t nblocks)
+{
+  int i, j, n;
+  sha256_v8 w[64];
+
+  while (nblocks >= 4) {
+    n = nblocks < 8 ? nblocks : 8;
+    for (i = 0; i < 16; i++) {
+      for (j = 0; j < n; j++) w[i][j] = U8TO32_BE(p + 64 * j + 4 * i);
+      for (/*nothing*/; j < 8; j++) w[i][j] = 0;
+    }
+    for (i = 16; i < 64; i++) {
+      w[i] = sigma1(w[i-2]) + w[i-7] + sigma0(w[i-15]) + w[i-16];
+    }
+    for (i = 0; i < 64; i++) w[i] += SHA256_constants[i];
+    for (j = 0; j < n; j++) SHA256_rounds(state, (const u32 *) w + j, 8);
+    p += 64 * n;
+    nblocks -= n;
+  }
+  SHA256_blocks_generic(state, p, nblocks);
+}
+
+/* Implementation using the SHA extensions (SHA-NI) */
+
+__attribute__((target("sha,sse4.1")))
+static void SHA256_blocks_shani(u32 state[8],
+                                const unsigned char * p, size_t nblocks)
+{
+  __m128i state0, state1, abef, cdgh, msg, tmp;
+  __m128i m0, m1, m2, m3;
+  const __m128i mask =
+    _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+  /* Rearrange the chaining values as ABEF and CDGH */
+  tmp = _mm_loadu_si128((const __m128i *) &state[0]);
+  state1 = _mm_loadu_si128((const __m128i *) &state[4]);
+  tmp = _mm_shuffle_epi32(tmp, 0xB1);
+  state1 = _mm_shuffle_epi32(state1, 0x1B);
+  state0 = _mm_alignr_epi8(tmp, state1, 8);
+  state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+  /* Four rounds using message words [wi], computing the next message
+     words in [wnext] and starting the computation of later message
+     words in [wprev] */
+#define QUAD(i, wi, wprev, wnext) \
+    if ((i) < 4) \
+      wi = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + 16 * (i))), \
+                            mask); \
+    msg = _mm_add_epi32(wi, \
+            _mm_loadu_si128((const __m128i *) &SHA256_constants[4 * (i)])); \
+    state1 = _mm_sha256rnds2_epu32(state1, state0, msg); \
+    if ((i) >= 3 && (i) <= 14) { \
+      wnext = _mm_add_epi32(wnext, _mm_alignr_epi8(wi, wprev, 4)); \
+      wnext = _mm_sha256msg2_epu32(wnext, wi); \
+    } \
+    msg = _mm_shuffle_epi32(msg, 0x0E); \
+    state0 = _mm_sha256rnds2_epu32(state0, state1, msg); \
+    if ((i) >= 1 && (i) <= 12) wprev = _mm_sha256msg1_epu32(wprev, wi)
+
+  for (; nblocks > 0; nblocks--, p += 64) {
+    abef = state0;
+    cdgh = state1;
+    QUAD(0, m0, m3, m1);
+    QUAD(1, m1, m0, m2);
+    QUAD(2, m2, m1, m3);
+    QUAD(3, m3, m2, m0);
+    QUAD(4, m0, m3, m1);
+    QUAD(5, m1, m0, m2);
+    QUAD(6, m2, m1, m3);
+    QUAD(7, m3, m2, m0);
+    QUAD(8, m0, m3, m1);
+    QUAD(9, m1, m0, m2);
+    QUAD(10, m2, m1, m3);
+    QUAD(11, m3, m2, m0);
+    QUAD(12, m0, m3, m1);
+    QUAD(13, m1, m0, m2);
+    QUAD(14, m2, m1, m3);
+    QUAD(15, m3, m2, m0);
+    state0 = _mm_add_epi32(state0, abef);
+    state1 = _mm_add_epi32(state1, cdgh);
+  }
+#undef QUAD
+
+  /* Back to ABCD and EFGH */
+  tmp = _mm_shuffle_epi32(state0, 0x1B);
+  state1 = _mm_shuffle_epi32(state1, 0xB1);
+  state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+  state1 = _mm_alignr_epi8(state1, tmp, 8);
+  _mm_storeu_si128((__m128i *) &state[0], state0);
+  _mm_storeu_si128((__m128i *) &state[4], state1);
+}
+
+#endif
+
+/* Process [nblocks] 64-byte blocks, read directly from [p] */
+
+static void SHA256_blocks(u32 state[8], const unsigned char * p, size_t nblocks)
+{
+#ifdef HAVE_X86_DISPATCH
+  int features = cpu_features();
+  if (features & CPU_SHA) {
+    SHA256_blocks_shani(state, p, nblocks); return;
+  }
+  if (features & CPU_AVX2) {
+    SHA256_blocks_avx2(state, p, nblocks); return;
+  }
+#endif
+  SHA256_blocks_generic(state, p, nblocks);
 }
 
 EXPORT void SHA256_init(struct SHA256Context * ctx, int bitsize)
@@ -181,16 +314,15 @@ EXPORT void SHA256_add_data(struct SHA256Context * ctx, unsigned char * data,
       return;
     }
     memcpy(ctx->buffer + ctx->numbytes, data, t);
-    SHA256_transform(ctx);
+    SHA256_blocks(ctx->state, ctx->buffer, 1);
     data += t;
     len -= t;
   }
-  /* Munge data in 64-byte chunks */
-  while (len >= 64) {
-    memcpy(ctx->buffer, data, 64);
-    SHA256_transform(ctx);
-    data += 64;
-    len -= 64;
+  /* Munge data in 64-byte chunks, directly from the input */
+  if (len >= 64) {
+    SHA256_blocks(ctx->state, data, len / 64);
+    data += len - len % 64;
+    len &= 63;
   }
   /* Save remaining data */
   memcpy(ctx->buffer, data, len);
@@ -208,7 +340,7 @@ EXPORT void SHA256_finish(struct SHA256Context * ctx, int bitsize,
      with zeroes and munge the data block */
   if (i > 56) {
     memset(ctx->buffer + i, 0, 64 - i);
-    SHA256_transform(ctx);
+    SHA256_blocks(ctx->state, ctx->buffer, 1);
     i = 0;
   }
   /* Pad to byte 56 with zeroes */
@@ -216,7 +348,7 @@ EXPORT void SHA256_finish(struct SHA256Context * ctx, int bitsize,
   /* Add length in big-endian */
   SHA256_copy_and_swap(ctx->length, ctx->buffer + 56, 2);
   /* Munge the final block */
-  SHA256_transform(ctx);
+  SHA256_blocks(ctx->state, ctx->buffer, 1);
   /* Final hash value is in ctx->state modulo big-endian conversion */
   switch (bitsize) {
   case 256:
@@ -228,3 +360,195 @@ EXPORT void SHA256_finish(struct SHA256Context * ctx, int bitsize,
   /* default: The bit size is wrong.  Produce no output. */
   }
 }
+
+/* Multi-buffer hashing */
+
+#define MB_SHA256
+#include "multibuf.h"
+
+EXPORT void SHA256_hash_many(int bitsize, size_t n,
+                             mb_get_message get, void * env,
+                             unsigned char * output)
+{
+  struct SHA256Context ctx;
+  const unsigned char * p;
+  size_t i, len;
+#ifdef HAVE_X86_DISPATCH
+  struct mb_hash h;
+
+  /* One SHA-NI stream is faster than 16 AVX-512 lanes */
+  MB_SELECT(h, SHA256_mb);
+  if (n > 1 && h.lanes > 0 && ! (cpu_features() & CPU_SHA)) {
+    SHA256_init(&ctx, bitsize);
+    h.nwords = 8;
+    h.iv = ctx.state;
+    h.bigendian = 1;
+    h.outlen = bitsize / 8;
+    mb_hash_many(&h, n, get, env, output);
+    return;
+  }
+#endif
+  for (i = 0; i < n; i++) {
+    get(env, i, &p, &len);
+    SHA256_init(&ctx, bitsize);
+    SHA256_add_data(&ctx, (unsigned char *) p, len);
+    SHA256_finish(&ctx, bitsize, output + i * (bitsize / 8));
+  }
+}
+
+/* Fixed-length hashing, for Merkle trees and double hashing */
+
+static const u32 SHA256_iv[8] = {
+  0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+  0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+/* The padding block of a 64-byte message */
+static const unsigned char SHA256_pad64[64] = {
+  0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x02, 0x00
+};
+
+/* Its expanded message schedule, plus the round constants */
+static const u32 SHA256_pad64_schedule[64] = {
+  0xc28a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+  0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf374,
+  0x649b69c1, 0xf0fe4786, 0x0fe1edc6, 0x240cf254,
+  0x4fe9346f, 0x6cc984be, 0x61b9411e, 0x16f988fa,
+  0xf2c65152, 0xa88e5a6d, 0xb019fc65, 0xb9d99ec7,
+  0x9a1231c3, 0xe70eeaa0, 0xfdb1232b, 0xc7353eb0,
+  0x3069bad5, 0xcb976d5f, 0x5a0f118f, 0xdc1eeefd,
+  0x0a35b689, 0xde0b7a04, 0x58f4ca9d, 0xe15d5b16,
+  0x007f3e86, 0x37088980, 0xa507ea32, 0x6fab9537,
+  0x17406110, 0x0d8cd6f1, 0xcdaa3b6d, 0xc0bbbe37,
+  0x83613bda, 0xdb48a363, 0x0b02e931, 0x6fd15ca7,
+  0x521afaca, 0x31338431, 0x6ed41a95, 0x6d437890,
+  0xc39c91f2, 0x9eccabbd, 0xb5c9a0e6, 0x532fb63c,
+  0xd2c741c6, 0x07237ea3, 0xa4954b68, 0x4c191d76
+};
+
+/* The padding of a 32-byte message: the second half of its only block */
+static const unsigned char SHA256_pad32[32] = {
+  0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x01, 0x00
+};
+
+/* Hash exactly 64 bytes: one data block, then the constant padding
+   block, whose message schedule needs not be computed */
+
+static void SHA256_64to32_one(const unsigned char in[64],
+                              unsigned char out[32])
+{
+  u32 state[8];
+
+  memcpy(state, SHA256_iv, sizeof(state));
+  SHA256_blocks(state, in, 1);
+#ifdef HAVE_X86_DISPATCH
+  if (cpu_features() & CPU_SHA)
+    SHA256_blocks_shani(state, SHA256_pad64, 1);
+  else
+#endif
+    SHA256_rounds(state, SHA256_pad64_schedule, 1);
+  SHA256_copy_and_swap(state, out, 8);
+}
+
+/* Hash exactly 32 bytes, in one block.  [in] and [out] may be equal. */
+
+static void SHA256_32to32_one(const unsigned char in[32],
+                              unsigned char out[32])
+{
+  u32 state[8];
+  unsigned char block[64];
+
+  memcpy(block, in, 32);
+  memcpy(block + 32, SHA256_pad32, 32);
+  memcpy(state, SHA256_iv, sizeof(state));
+  SHA256_blocks(state, block, 1);
+  SHA256_copy_and_swap(state, out, 8);
+}
+
+#ifdef HAVE_X86_DISPATCH
+
+/* Access to the [n] consecutive messages of [size] bytes for mb_hash_many */
+
+struct SHA256_fixed {
+  const unsigned char * p;
+  size_t size;
+};
+
+static void SHA256_fixed_get(void * env, size_t i,
+                             const unsigned char ** p, size_t * len)
+{
+  struct SHA256_fixed * f = env;
+  *p = f->p + i * f->size;
+  *len = f->size;
+}
+
+#endif
+
+/* Hash the [n] consecutive [size]-byte messages at [in] with the
+   multi-buffer code, if it is available and faster than SHA-NI.
+   Return 0 if it is not. */
+
+static int SHA256_fixed_mb(const unsigned char * in, size_t size, size_t n,
+                           unsigned char * out)
+{
+#ifdef HAVE_X86_DISPATCH
+  struct mb_hash h;
+  struct SHA256_fixed f;
+
+  MB_SELECT(h, SHA256_mb);
+  if (n <= 1 || h.lanes == 0 || (cpu_features() & CPU_SHA)) return 0;
+  h.nwords = 8;
+  h.iv = SHA256_iv;
+  h.bigendian = 1;
+  h.outlen = 32;
+  f.p = in;
+  f.size = size;
+  mb_hash_many(&h, n, SHA256_fixed_get, &f, out);
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+EXPORT void SHA256_64to32(const unsigned char * in, size_t n,
+                          unsigned char * out)
+{
+  size_t i;
+
+  if (SHA256_fixed_mb(in, 64, n, out)) return;
+  for (i = 0; i < n; i++) SHA256_64to32_one(in + 64 * i, out + 32 * i);
+}
+
+EXPORT void SHA256d_64to32(const unsigned char * in, size_t n,
+                           unsigned char * out)
+{
+  size_t i;
+
+  /* The second pass hashes the digests in place: a message is read
+     when it is scheduled on a lane, before its digest is written. */
+  if (SHA256_fixed_mb(in, 64, n, out)) {
+    SHA256_fixed_mb(out, 32, n, out);
+    return;
+  }
+  for (i = 0; i < n; i++) {
+    SHA256_64to32_one(in + 64 * i, out + 32 * i);
+    SHA256_32to32_one(out + 32 * i, out + 32 * i);
+  }
+}
+
+EXPORT void SHA256d(const unsigned char * data, size_t len,
+                    unsigned char out[32])
+{
+  struct SHA256Context ctx;
+
+  SHA256_init(&ctx, 256);
+  SHA256_add_data(&ctx, (unsigned char *) data, len);
+  SHA256_finish(&ctx, 256, out);
+  SHA256_32to32_one(out, out);
+}
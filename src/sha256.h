@@ -15,6 +15,8 @@
 
 /* SHA-256 hashing */
 
+#include <stddef.h>
+
 #ifndef _MSC_VER
 #include <stdint.h>
 typedef uint32_t u32;
@@ -35,3 +37,23 @@ EXPORT void SHA256_add_data(struct SHA256Context * ctx, unsigned char * data,
 EXPORT void SHA256_finish(struct SHA256Context * ctx, 
                           int bitsize,
                           unsigned char * output);
+
+/* Hash [n] messages, obtained by calling [get(env, i, &p, &len)] for
+   [i = 0 ... n-1], and store their digests consecutively in [output] */
+EXPORT void SHA256_hash_many(int bitsize, size_t n,
+                             void (*get)(void * env, size_t i,
+                                         const unsigned char ** p,
+                                         size_t * len),
+                             void * env,
+                             unsigned char * output);
+
+/* Fixed-length hashing.  [SHA256_64to32] hashes [n] consecutive 64-byte
+   inputs and stores their digests consecutively in [out];
+   [SHA256d_64to32] does the same with SHA-256 applied twice.
+   [SHA256d] is SHA-256 applied twice to an input of any length. */
+EXPORT void SHA256_64to32(const unsigned char * in, size_t n,
+                          unsigned char * out);
+EXPORT void SHA256d_64to32(const unsigned char * in, size_t n,
+                           unsigned char * out);
+EXPORT void SHA256d(const unsigned char * data, size_t len,
+                    unsigned char out[32]);
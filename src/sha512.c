@@ -16,6 +16,7 @@
 #include <string.h>
 #include <caml/config.h>
 #include "sha512.h"
+#include "cpufeatures.h"
 
 /* Ref: FIPS publication 180-2 */
 
@@ -135,41 +136,33 @@ static u64 SHA512_constants[80] = {
   UINT64_C(0x6c44198c4a475817)
 };
 
-static void SHA512_transform(struct SHA512Context * ctx)
+#define U8TO64_BE(p) \
+  (((u64)((p)[0]) << 56) | ((u64)((p)[1]) << 48) | \
+   ((u64)((p)[2]) << 40) | ((u64)((p)[3]) << 32) | \
+   ((u64)((p)[4]) << 24) | ((u64)((p)[5]) << 16) | \
+   ((u64)((p)[6]) << 8) | (u64)((p)[7]))
+
+/* Perform the 80 rounds and update the chaining values.  [w[i * stride]]
+   is the expanded message word number [i] plus round constant number [i]. */
+
+static inline void SHA512_rounds(u64 state[8], const u64 * w, int stride)
 {
   int i;
   register u64 a, b, c, d, e, f, g, h, t1, t2;
-  u64 data[80];
-
-  /* Convert buffer data to 16 big-endian integers */
-  SHA512_copy_and_swap(ctx->buffer, data, 16);
-
-  /* Expand into 80 integers */
-  for (i = 16; i < 80; i++) {
-    data[i] = sigma1(data[i-2]) + data[i-7] + sigma0(data[i-15]) + data[i-16];
-  }
 
   /* Initialize working variables */
-  a = ctx->state[0];
-  b = ctx->state[1];
-  c = ctx->state[2];
-  d = ctx->state[3];
-  e = ctx->state[4];
-  f = ctx->state[5];
-  g = ctx->state[6];
-  h = ctx->state[7];
+  a = state[0];
+  b = state[1];
+  c = state[2];
+  d = state[3];
+  e = state[4];
+  f = state[5];
+  g = state[6];
+  h = state[7];
 
   /* Perform rounds */
-#if 0
-  for (i = 0; i < 80; i++) {
-    t1 = h + SIGMA1(e) + CH(e, f, g) + SHA512_constants[i] + data[i];
-    t2 = SIGMA0(a) + MAJ(a, b, c);
-    h = g;  g = f;  f = e;  e = d + t1;
-    d = c;  c = b;  b = a;  a = t1 + t2;
-  }
-#else
 #define STEP(a,b,c,d,e,f,g,h,i) \
-    t1 = h + SIGMA1(e) + CH(e, f, g) + SHA512_constants[i] + data[i]; \
+    t1 = h + SIGMA1(e) + CH(e, f, g) + w[(i) * stride]; \
     t2 = SIGMA0(a) + MAJ(a, b, c); \
     d = d + t1; \
     h = t1 + t2
@@ -184,17 +177,83 @@ static void SHA512_transform(struct SHA512Context * ctx)
     STEP(c,d,e,f,g,h,a,b,i+6);
     STEP(b,c,d,e,f,g,h,a,i+7);
   }
-#endif
+#undef STEP
 
   /* Update chaining values */
-  ctx->state[0] += a;
-  ctx->state[1] += b;
-  ctx->state[2] += c;
-  ctx->state[3] += d;
-  ctx->state[4] += e;
-  ctx->state[5] += f;
-  ctx->state[6] += g;
-  ctx->state[7] += h;
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+  state[5] += f;
+  state[6] += g;
+  state[7] += h;
+}
+
+/* Portable implementation */
+
+static void SHA512_blocks_generic(u64 state[8],
+                                  const unsigned char * p, size_t nblocks)
+{
+  int i;
+  u64 data[80];
+
+  for (; nblocks > 0; nblocks--, p += 128) {
+    /* Convert block to 16 big-endian integers */
+    for (i = 0; i < 16; i++) data[i] = U8TO64_BE(p + 8 * i);
+    /* Expand into 80 integers */
+    for (i = 16; i < 80; i++) {
+      data[i] = sigma1(data[i-2]) + data[i-7] + sigma0(data[i-15]) + data[i-16];
+    }
+    for (i = 0; i < 80; i++) data[i] += SHA512_constants[i];
+    SHA512_rounds(state, data, 1);
+  }
+}
+
+#ifdef HAVE_X86_DISPATCH
+
+/* AVX2 implementation.  The message schedule does not depend on the
+   chaining values, so it is computed for 4 consecutive blocks at once,
+   one block per 64-bit lane.  The rounds remain scalar. */
+
+typedef u64 sha512_v4 __attribute__((vector_size(32), may_alias));
+
+__attribute__((target("avx2")))
+static void SHA512_blocks_avx2(u64 state[8],
+                               const unsigned char * p, size_t nblocks)
+{
+  int i, j, n;
+  sha512_v4 w[80];
+
+  while (nblocks >= 2) {
+    n = nblocks < 4 ? nblocks : 4;
+    for (i = 0; i < 16; i++) {
+      for (j = 0; j < n; j++) w[i][j] = U8TO64_BE(p + 128 * j + 8 * i);
+      for (/*nothing*/; j < 4; j++) w[i][j] = 0;
+    }
+    for (i = 16; i < 80; i++) {
+      w[i] = sigma1(w[i-2]) + w[i-7] + sigma0(w[i-15]) + w[i-16];
+    }
+    for (i = 0; i < 80; i++) w[i] += SHA512_constants[i];
+    for (j = 0; j < n; j++) SHA512_rounds(state, (const u64 *) w + j, 4);
+    p += 128 * n;
+    nblocks -= n;
+  }
+  SHA512_blocks_generic(state, p, nblocks);
+}
+
+#endif
+
+/* Process [nblocks] 128-byte blocks, read directly from [p] */
+
+static void SHA512_blocks(u64 state[8], const unsigned char * p, size_t nblocks)
+{
+#ifdef HAVE_X86_DISPATCH
+  if (cpu_features() & CPU_AVX2) {
+    SHA512_blocks_avx2(state, p, nblocks); return;
+  }
+#endif
+  SHA512_blocks_generic(state, p, nblocks);
 }
 
 EXPORT void SHA512_init(struct SHA512Context * ctx, int bitsize)
@@ -271,16 +330,15 @@ EXPORT void SHA512_add_data(struct SHA512Context * ctx, unsigned char * data,
       return;
     }
     memcpy(ctx->buffer + ctx->numbytes, data, l);
-    SHA512_transform(ctx);
+    SHA512_blocks(ctx->state, ctx->buffer, 1);
     data += l;
     len -= l;
   }
-  /* Munge data in 128-byte chunks */
-  while (len >= 128) {
-    memcpy(ctx->buffer, data, 128);
-    SHA512_transform(ctx);
-    data += 128;
-    len -= 128;
+  /* Munge data in 128-byte chunks, directly from the input */
+  if (len >= 128) {
+    SHA512_blocks(ctx->state, data, len / 128);
+    data += len - len % 128;
+    len &= 127;
   }
   /* Save remaining data */
   memcpy(ctx->buffer, data, len);
@@ -298,7 +356,7 @@ EXPORT void SHA512_finish(struct SHA512Context * ctx, int bitsize,
      with zeroes and munge the data block */
   if (i > 112) {
     memset(ctx->buffer + i, 0, 128 - i);
-    SHA512_transform(ctx);
+    SHA512_blocks(ctx->state, ctx->buffer, 1);
     i = 0;
   }
   /* Pad to byte 112 with zeroes */
@@ -306,7 +364,7 @@ EXPORT void SHA512_finish(struct SHA512Context * ctx, int bitsize,
   /* Add length in big-endian */
   SHA512_copy_and_swap(ctx->length, ctx->buffer + 112, 2);
   /* Munge the final block */
-  SHA512_transform(ctx);
+  SHA512_blocks(ctx->state, ctx->buffer, 1);
   /* Final hash value is in ctx->state modulo big-endian conversion */
   switch (bitsize) {
   case 512:
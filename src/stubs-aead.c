@@ -0,0 +1,400 @@
+/***********************************************************************/
+/*                                                                     */
+/*                      The Cryptokit library                          */
+/*                                                                     */
+/*            Xavier Leroy, Collège de France and Inria                */
+/*                                                                     */
+/*  Copyright 2026 Institut National de Recherche en Informatique et   */
+/*  en Automatique.  All rights reserved.  This file is distributed    */
+/*  under the terms of the GNU Library General Public License, with    */
+/*  the special exception on linking described in file LICENSE.        */
+/*                                                                     */
+/***********************************************************************/
+
+/* Stub code for one-shot authenticated encryption */
+
+#include <stdint.h>
+#include <string.h>
+#ifdef HAVE_PTHREAD
+#include <unistd.h>
+#endif
+/* Only AES encryption is needed by GCM mode */
+#define AES_ENCRYPT_ONLY
+#include "rijndael-alg-fst.c"
+#include "aesni.c"
+#include "ghash.c"
+#include "pclmul.c"
+#include "chacha20.c"
+#include "poly1305-donna.c"
+#include "aead.c"
+
+#include <caml/mlvalues.h>
+#include <caml/alloc.h>
+#include <caml/memory.h>
+#include <caml/bigarray.h>
+#include <caml/signals.h>
+
+#define Gcm_key_val(v) ((struct aes_gcm_key *) String_val(v))
+
+CAMLprim value caml_aes_gcm_cook_key(value key)
+{
+  CAMLparam1(key);
+  value ckey = caml_alloc_string(sizeof(struct aes_gcm_key));
+  aes_gcm_init_key(Gcm_key_val(ckey),
+                   &Byte_u(key, 0), caml_string_length(key));
+  CAMLreturn(ckey);
+}
+
+/* The tag is written just after the ciphertext, at [dst + dst_ofs + len] */
+
+CAMLprim value caml_aes_gcm_seal(value ckey, value iv, value hdr,
+                                 value src, value src_ofs,
+                                 value dst, value dst_ofs, value len)
+{
+  size_t l = Long_val(len);
+  aes_gcm_encrypt(Gcm_key_val(ckey),
+                  &Byte_u(iv, 0), caml_string_length(iv),
+                  &Byte_u(hdr, 0), caml_string_length(hdr),
+                  &Byte_u(src, Long_val(src_ofs)),
+                  &Byte_u(dst, Long_val(dst_ofs)), l,
+                  &Byte_u(dst, Long_val(dst_ofs) + l));
+  return Val_unit;
+}
+
+CAMLprim value caml_aes_gcm_seal_bytecode(value * argv, int argc)
+{
+  return caml_aes_gcm_seal(argv[0], argv[1], argv[2], argv[3],
+                           argv[4], argv[5], argv[6], argv[7]);
+}
+
+/* The expected tag is read just after the ciphertext,
+   at [src + src_ofs + len] */
+
+CAMLprim value caml_aes_gcm_open(value ckey, value iv, value hdr,
+                                 value src, value src_ofs,
+                                 value dst, value dst_ofs, value len)
+{
+  size_t l = Long_val(len);
+  return Val_bool(
+    aes_gcm_decrypt(Gcm_key_val(ckey),
+                    &Byte_u(iv, 0), caml_string_length(iv),
+                    &Byte_u(hdr, 0), caml_string_length(hdr),
+                    &Byte_u(src, Long_val(src_ofs)),
+                    &Byte_u(dst, Long_val(dst_ofs)), l,
+                    &Byte_u(src, Long_val(src_ofs) + l)));
+}
+
+CAMLprim value caml_aes_gcm_open_bytecode(value * argv, int argc)
+{
+  return caml_aes_gcm_open(argv[0], argv[1], argv[2], argv[3],
+                           argv[4], argv[5], argv[6], argv[7]);
+}
+
+CAMLprim value caml_chacha20_poly1305_seal(value key, value iv, value hdr,
+                                           value src, value src_ofs,
+                                           value dst, value dst_ofs, value len)
+{
+  size_t l = Long_val(len);
+  chacha20_poly1305_encrypt(&Byte_u(key, 0), caml_string_length(key),
+                            &Byte_u(iv, 0), caml_string_length(iv),
+                            &Byte_u(hdr, 0), caml_string_length(hdr),
+                            &Byte_u(src, Long_val(src_ofs)),
+                            &Byte_u(dst, Long_val(dst_ofs)), l,
+                            &Byte_u(dst, Long_val(dst_ofs) + l));
+  return Val_unit;
+}
+
+CAMLprim value caml_chacha20_poly1305_seal_bytecode(value * argv, int argc)
+{
+  return caml_chacha20_poly1305_seal(argv[0], argv[1], argv[2], argv[3],
+                                     argv[4], argv[5], argv[6], argv[7]);
+}
+
+CAMLprim value caml_chacha20_poly1305_open(value key, value iv, value hdr,
+                                           value src, value src_ofs,
+                                           value dst, value dst_ofs, value len)
+{
+  size_t l = Long_val(len);
+  return Val_bool(
+    chacha20_poly1305_decrypt(&Byte_u(key, 0), caml_string_length(key),
+                              &Byte_u(iv, 0), caml_string_length(iv),
+                              &Byte_u(hdr, 0), caml_string_length(hdr),
+                              &Byte_u(src, Long_val(src_ofs)),
+                              &Byte_u(dst, Long_val(dst_ofs)), l,
+                              &Byte_u(src, Long_val(src_ofs) + l)));
+}
+
+CAMLprim value caml_chacha20_poly1305_open_bytecode(value * argv, int argc)
+{
+  return caml_chacha20_poly1305_open(argv[0], argv[1], argv[2], argv[3],
+                                     argv[4], argv[5], argv[6], argv[7]);
+}
+
+/* In-place encryption and decryption of a Bigarray.
+   The data is at [buf + ofs], followed by the tag. */
+
+CAMLprim value caml_aes_gcm_seal_bigarray(value ckey, value iv, value hdr,
+                                          value buf, value ofs, value len)
+{
+  uint8_t * data = (uint8_t *) Caml_ba_data_val(buf) + Long_val(ofs);
+  size_t l = Long_val(len);
+  aes_gcm_encrypt(Gcm_key_val(ckey),
+                  &Byte_u(iv, 0), caml_string_length(iv),
+                  &Byte_u(hdr, 0), caml_string_length(hdr),
+                  data, data, l, data + l);
+  return Val_unit;
+}
+
+CAMLprim value caml_aes_gcm_seal_bigarray_bytecode(value * argv, int argc)
+{
+  return caml_aes_gcm_seal_bigarray(argv[0], argv[1], argv[2], argv[3],
+                                    argv[4], argv[5]);
+}
+
+CAMLprim value caml_aes_gcm_open_bigarray(value ckey, value iv, value hdr,
+                                          value buf, value ofs, value len)
+{
+  uint8_t * data = (uint8_t *) Caml_ba_data_val(buf) + Long_val(ofs);
+  size_t l = Long_val(len);
+  return Val_bool(
+    aes_gcm_decrypt(Gcm_key_val(ckey),
+                    &Byte_u(iv, 0), caml_string_length(iv),
+                    &Byte_u(hdr, 0), caml_string_length(hdr),
+                    data, data, l, data + l));
+}
+
+CAMLprim value caml_aes_gcm_open_bigarray_bytecode(value * argv, int argc)
+{
+  return caml_aes_gcm_open_bigarray(argv[0], argv[1], argv[2], argv[3],
+                                    argv[4], argv[5]);
+}
+
+CAMLprim value caml_chacha20_poly1305_seal_bigarray(value key, value iv,
+                                                    value hdr, value buf,
+                                                    value ofs, value len)
+{
+  uint8_t * data = (uint8_t *) Caml_ba_data_val(buf) + Long_val(ofs);
+  size_t l = Long_val(len);
+  chacha20_poly1305_encrypt(&Byte_u(key, 0), caml_string_length(key),
+                            &Byte_u(iv, 0), caml_string_length(iv),
+                            &Byte_u(hdr, 0), caml_string_length(hdr),
+                            data, data, l, data + l);
+  return Val_unit;
+}
+
+CAMLprim value caml_chacha20_poly1305_seal_bigarray_bytecode(value * argv,
+                                                             int argc)
+{
+  return caml_chacha20_poly1305_seal_bigarray(argv[0], argv[1], argv[2],
+                                              argv[3], argv[4], argv[5]);
+}
+
+CAMLprim value caml_chacha20_poly1305_open_bigarray(value key, value iv,
+                                                    value hdr, value buf,
+                                                    value ofs, value len)
+{
+  uint8_t * data = (uint8_t *) Caml_ba_data_val(buf) + Long_val(ofs);
+  size_t l = Long_val(len);
+  return Val_bool(
+    chacha20_poly1305_decrypt(&Byte_u(key, 0), caml_string_length(key),
+                              &Byte_u(iv, 0), caml_string_length(iv),
+                              &Byte_u(hdr, 0), caml_string_length(hdr),
+                              data, data, l, data + l));
+}
+
+CAMLprim value caml_chacha20_poly1305_open_bigarray_bytecode(value * argv,
+                                                             int argc)
+{
+  return caml_chacha20_poly1305_open_bigarray(argv[0], argv[1], argv[2],
+                                              argv[3], argv[4], argv[5]);
+}
+
+/* Batch processing of independent packets.  [keys], [ivs], [hdrs] and
+   [bufs] are arrays of the same length.  Each buffer contains the data,
+   followed by room for the tag (sealing) or by the tag (opening). */
+
+static int aead_batch_group(value keys, value ivs, value hdrs, value bufs,
+                            mlsize_t first, struct aead_packet * p)
+{
+  mlsize_t len = Wosize_val(bufs);
+  int n;
+  for (n = 0; n < AEAD_LANES && first + n < len; n++) {
+    value key = Field(keys, first + n), iv = Field(ivs, first + n),
+          hdr = Field(hdrs, first + n), buf = Field(bufs, first + n);
+    p[n].key = String_val(key);
+    p[n].keylen = caml_string_length(key);
+    p[n].iv = &Byte_u(iv, 0);
+    p[n].ivlen = caml_string_length(iv);
+    p[n].hdr = &Byte_u(hdr, 0);
+    p[n].hdrlen = caml_string_length(hdr);
+    p[n].data = &Byte_u(buf, 0);
+    p[n].len = caml_string_length(buf) - 16;
+    p[n].tag = &Byte_u(buf, p[n].len);
+  }
+  return n;
+}
+
+CAMLprim value caml_aes_gcm_seal_many(value keys, value ivs, value hdrs,
+                                      value bufs)
+{
+  struct aead_packet p[AEAD_LANES];
+  mlsize_t i;
+  int n;
+  for (i = 0; i < Wosize_val(bufs); i += n) {
+    n = aead_batch_group(keys, ivs, hdrs, bufs, i, p);
+    aes_gcm_encrypt_lanes(p, n);
+  }
+  return Val_unit;
+}
+
+/* [status] receives 1 for each packet that was successfully authenticated
+   and decrypted, 0 otherwise. */
+
+CAMLprim value caml_aes_gcm_open_many(value keys, value ivs, value hdrs,
+                                      value bufs, value status)
+{
+  struct aead_packet p[AEAD_LANES];
+  int ok[AEAD_LANES];
+  mlsize_t i;
+  int n, j;
+  for (i = 0; i < Wosize_val(bufs); i += n) {
+    n = aead_batch_group(keys, ivs, hdrs, bufs, i, p);
+    aes_gcm_decrypt_lanes(p, n, ok);
+    for (j = 0; j < n; j++) Byte_u(status, i + j) = ok[j];
+  }
+  return Val_unit;
+}
+
+CAMLprim value caml_chacha20_poly1305_seal_many(value keys, value ivs,
+                                                value hdrs, value bufs)
+{
+  struct aead_packet p[AEAD_LANES];
+  mlsize_t i;
+  int n;
+  for (i = 0; i < Wosize_val(bufs); i += n) {
+    n = aead_batch_group(keys, ivs, hdrs, bufs, i, p);
+    chacha20_poly1305_encrypt_lanes(p, n);
+  }
+  return Val_unit;
+}
+
+CAMLprim value caml_chacha20_poly1305_open_many(value keys, value ivs,
+                                                value hdrs, value bufs,
+                                                value status)
+{
+  struct aead_packet p[AEAD_LANES];
+  int ok[AEAD_LANES];
+  mlsize_t i;
+  int n, j;
+  for (i = 0; i < Wosize_val(bufs); i += n) {
+    n = aead_batch_group(keys, ivs, hdrs, bufs, i, p);
+    chacha20_poly1305_decrypt_lanes(p, n, ok);
+    for (j = 0; j < n; j++) Byte_u(status, i + j) = ok[j];
+  }
+  return Val_unit;
+}
+
+/* Segments of a Streaming_AEAD stream, held in a Bigarray.
+   [key] is a cooked AES-GCM key if [chapoly] is false, and a Chacha20
+   key otherwise.  [nonces] contains the 12-byte nonce of each segment.
+   The key and the nonces are copied out of the OCaml heap, so that
+   the runtime system can be released while the segments are processed
+   by several threads. */
+
+static int caml_aead_threads(value vthreads)
+{
+  long n = Long_val(vthreads);
+  if (n <= 0) {
+#if defined(HAVE_PTHREAD) && defined(_SC_NPROCESSORS_ONLN)
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (n <= 0) n = 1;
+  }
+  if (n > 256) n = 256;
+  return n;
+}
+
+static int caml_aead_segments(value key, value chapoly, value nonces,
+                              value buf, value seglen, value lastlen,
+                              value threads, int decrypt)
+{
+  CAMLparam4(key, chapoly, nonces, buf);
+  struct aead_segments s;
+  size_t keylen = caml_string_length(key);
+  size_t nlen = caml_string_length(nonces);
+  int n = caml_aead_threads(threads);
+  void * k = caml_stat_alloc(keylen);
+  uint8_t * iv = caml_stat_alloc(nlen);
+  int ok = 1;
+
+  memcpy(k, String_val(key), keylen);
+  memcpy(iv, String_val(nonces), nlen);
+  s.key = k;
+  s.keylen = Bool_val(chapoly) ? keylen : 0;
+  s.nonces = iv;
+  s.buf = Caml_ba_data_val(buf);
+  s.seglen = Long_val(seglen);
+  s.lastlen = Long_val(lastlen);
+  s.n = nlen / 12;
+  caml_enter_blocking_section();
+  if (decrypt)
+    ok = aead_open_segments(&s, n);
+  else
+    aead_seal_segments(&s, n);
+  caml_leave_blocking_section();
+  memset(k, 0, keylen);
+  caml_stat_free(k);
+  caml_stat_free(iv);
+  CAMLreturnT(int, ok);
+}
+
+CAMLprim value caml_aead_seal_segments(value key, value chapoly,
+                                       value nonces, value buf,
+                                       value seglen, value lastlen,
+                                       value threads)
+{
+  caml_aead_segments(key, chapoly, nonces, buf, seglen, lastlen, threads, 0);
+  return Val_unit;
+}
+
+CAMLprim value caml_aead_seal_segments_bytecode(value * argv, int argc)
+{
+  return caml_aead_seal_segments(argv[0], argv[1], argv[2], argv[3],
+                                 argv[4], argv[5], argv[6]);
+}
+
+CAMLprim value caml_aead_open_segments(value key, value chapoly,
+                                       value nonces, value buf,
+                                       value seglen, value lastlen,
+                                       value threads)
+{
+  return Val_bool(caml_aead_segments(key, chapoly, nonces, buf,
+                                     seglen, lastlen, threads, 1));
+}
+
+CAMLprim value caml_aead_open_segments_bytecode(value * argv, int argc)
+{
+  return caml_aead_open_segments(argv[0], argv[1], argv[2], argv[3],
+                                 argv[4], argv[5], argv[6]);
+}
+
+/* Copying between byte sequences and Bigarrays */
+
+CAMLprim value caml_blit_bytes_to_bigarray(value src, value src_ofs,
+                                           value dst, value dst_ofs,
+                                           value len)
+{
+  memcpy((unsigned char *) Caml_ba_data_val(dst) + Long_val(dst_ofs),
+         &Byte_u(src, Long_val(src_ofs)), Long_val(len));
+  return Val_unit;
+}
+
+CAMLprim value caml_blit_bigarray_to_bytes(value src, value src_ofs,
+                                           value dst, value dst_ofs,
+                                           value len)
+{
+  memcpy(&Byte_u(dst, Long_val(dst_ofs)),
+         (unsigned char *) Caml_ba_data_val(src) + Long_val(src_ofs),
+         Long_val(len));
+  return Val_unit;
+}
@@ -13,12 +13,14 @@
 
 /* Stub code for AES */
 
+#include <string.h>
 #include "rijndael-alg-fst.c"
 #include "aesni.c"
 
 #include <caml/mlvalues.h>
 #include <caml/alloc.h>
 #include <caml/memory.h>
+#include "stubs-hash-many.h"
 
 #define Cooked_key_NR_offset ((4 * (MAXNR + 1)) * sizeof(u32))
 #define Cooked_key_size (Cooked_key_NR_offset + 1)
@@ -93,3 +95,58 @@ CAMLprim value caml_aes_decrypt(value ckey, value src, value src_ofs,
   return Val_unit;
 }
 
+
+/* AES-CMAC of all the strings of an OCaml array, with the encryption key
+   [ckey] and a zero initial IV */
+
+static void caml_aes_encrypt_block(value ckey, const u8 * in, u8 * out)
+{
+  if (aesni_available == 1)
+    aesniEncrypt((const u8 *) String_val(ckey),
+                 Byte(ckey, Cooked_key_NR_offset), in, out);
+  else
+    rijndaelEncrypt((const u32 *) String_val(ckey),
+                    Byte(ckey, Cooked_key_NR_offset), in, out);
+}
+
+/* Multiplication by x in GF(2^128), for the CMAC subkeys */
+
+static void cmac_double(const u8 * in, u8 * out)
+{
+  int i;
+  u8 carry = in[0] >> 7;
+  for (i = 0; i < 15; i++) out[i] = (in[i] << 1) | (in[i + 1] >> 7);
+  out[15] = (in[15] << 1) ^ (carry ? 0x87 : 0);
+}
+
+CAMLprim value caml_aes_cmac_many(value ckey, value msgs,
+                                  value dst, value ofs)
+{
+  u8 k1[16], k2[16], x[16];
+  unsigned char * out = &Byte_u(dst, Long_val(ofs));
+  unsigned char * p;
+  size_t len;
+  int j;
+
+  memset(x, 0, 16);
+  caml_aes_encrypt_block(ckey, x, x);
+  cmac_double(x, k1);
+  cmac_double(k1, k2);
+  CAML_HASH_MANY(msgs, p, len, out, 16,
+    memset(x, 0, 16);
+    for (; len > 16; p += 16, len -= 16) {
+      for (j = 0; j < 16; j++) x[j] ^= p[j];
+      caml_aes_encrypt_block(ckey, x, x);
+    }
+    /* Final block: complete, or padded with 0x80 00 ... 00 */
+    if (len == 16) {
+      for (j = 0; j < 16; j++) x[j] ^= p[j] ^ k1[j];
+    } else {
+      for (j = 0; j < (int) len; j++) x[j] ^= p[j];
+      x[len] ^= 0x80;
+      for (j = 0; j < 16; j++) x[j] ^= k2[j];
+    }
+    caml_aes_encrypt_block(ckey, x, out));
+  memset(k1, 0, 16); memset(k2, 0, 16); memset(x, 0, 16);
+  return Val_unit;
+}
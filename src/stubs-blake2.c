@@ -18,6 +18,8 @@
 #include <caml/mlvalues.h>
 #include <caml/memory.h>
 #include <caml/alloc.h>
+#include "stubs-hash-many.h"
+#include "stubs-merkle.h"
 
 #define blake2b_val(v) ((struct blake2b *) String_val(v))
 
@@ -27,7 +29,7 @@ CAMLprim value caml_blake2b_init(value hashlen, value key)
   value ctx = caml_alloc_string(sizeof(struct blake2b));
   blake2b_init(blake2b_val(ctx),
                Int_val(hashlen),
-               caml_string_length(key), &Byte_u(key, 0));
+               caml_string_length(key), &Byte_u(key, 0), NULL);
   CAMLreturn(ctx);
 }
 
@@ -38,14 +40,55 @@ CAMLprim value caml_blake2b_update(value ctx, value src, value ofs, value len)
   return Val_unit;
 }
 
-CAMLprim value caml_blake2b_final(value ctx, value hashlen)
+CAMLprim value caml_blake2b_add_byte(value ctx, value b)
 {
-  CAMLparam1(ctx);
-  CAMLlocal1(res);
-  int len = Int_val(hashlen);
-  res = caml_alloc_string(len);
-  blake2b_final(blake2b_val(ctx), len, &Byte_u(res, 0));
-  CAMLreturn(res);
+  unsigned char c = Int_val(b);
+  blake2b_add_data(blake2b_val(ctx), &c, 1);
+  return Val_unit;
+}
+
+CAMLprim value caml_blake2b_final(value ctx, value hashlen,
+                                  value dst, value ofs)
+{
+  blake2b_final(blake2b_val(ctx), Int_val(hashlen),
+                &Byte_u(dst, Long_val(ofs)));
+  return Val_unit;
+}
+
+CAMLprim value caml_blake2b_reset(value ctx, value hashlen, value key)
+{
+  blake2b_init(blake2b_val(ctx),
+               Int_val(hashlen),
+               caml_string_length(key), &Byte_u(key, 0), NULL);
+  return Val_unit;
+}
+
+CAMLprim value caml_blake2b_valid_state(value ctx)
+{
+  return Val_bool(caml_string_length(ctx) == sizeof(struct blake2b)
+                  && blake2b_val(ctx)->numbytes >= 0
+                  && blake2b_val(ctx)->numbytes <= BLAKE2b_BLOCKSIZE);
+}
+
+/* The padded key is the first block of a keyed hash.  It stays in the
+   buffer until message data follows it, and the part of the buffer
+   past [numbytes] can still hold some of it afterwards. */
+
+CAMLprim value caml_blake2b_key_absorbed(value ctx)
+{
+  return Val_bool(blake2b_val(ctx)->len[0] != 0
+                  || blake2b_val(ctx)->len[1] != 0);
+}
+
+CAMLprim value caml_blake2b_save(value ctx)
+{
+  struct blake2b s;
+  value res;
+  memcpy(&s, String_val(ctx), sizeof(s));
+  memset(s.buffer + s.numbytes, 0, BLAKE2b_BLOCKSIZE - s.numbytes);
+  res = caml_alloc_initialized_string(sizeof(s), (const char *) &s);
+  memset(&s, 0, sizeof(s));
+  return res;
 }
 
 #define blake2s_val(v) ((struct blake2s *) String_val(v))
@@ -56,7 +99,7 @@ CAMLprim value caml_blake2s_init(value hashlen, value key)
   value ctx = caml_alloc_string(sizeof(struct blake2s));
   blake2s_init(blake2s_val(ctx),
                Int_val(hashlen),
-               caml_string_length(key), &Byte_u(key, 0));
+               caml_string_length(key), &Byte_u(key, 0), NULL);
   CAMLreturn(ctx);
 }
 
@@ -67,12 +110,307 @@ CAMLprim value caml_blake2s_update(value ctx, value src, value ofs, value len)
   return Val_unit;
 }
 
-CAMLprim value caml_blake2s_final(value ctx, value hashlen)
+CAMLprim value caml_blake2s_add_byte(value ctx, value b)
+{
+  unsigned char c = Int_val(b);
+  blake2s_add_data(blake2s_val(ctx), &c, 1);
+  return Val_unit;
+}
+
+CAMLprim value caml_blake2s_final(value ctx, value hashlen,
+                                  value dst, value ofs)
+{
+  blake2s_final(blake2s_val(ctx), Int_val(hashlen),
+                &Byte_u(dst, Long_val(ofs)));
+  return Val_unit;
+}
+
+CAMLprim value caml_blake2s_reset(value ctx, value hashlen, value key)
+{
+  blake2s_init(blake2s_val(ctx),
+               Int_val(hashlen),
+               caml_string_length(key), &Byte_u(key, 0), NULL);
+  return Val_unit;
+}
+
+CAMLprim value caml_blake2s_valid_state(value ctx)
+{
+  return Val_bool(caml_string_length(ctx) == sizeof(struct blake2s)
+                  && blake2s_val(ctx)->numbytes >= 0
+                  && blake2s_val(ctx)->numbytes <= BLAKE2s_BLOCKSIZE);
+}
+
+/* The padded key is the first block of a keyed hash.  It stays in the
+   buffer until message data follows it, and the part of the buffer
+   past [numbytes] can still hold some of it afterwards. */
+
+CAMLprim value caml_blake2s_key_absorbed(value ctx)
+{
+  return Val_bool(blake2s_val(ctx)->len[0] != 0
+                  || blake2s_val(ctx)->len[1] != 0);
+}
+
+CAMLprim value caml_blake2s_save(value ctx)
+{
+  struct blake2s s;
+  value res;
+  memcpy(&s, String_val(ctx), sizeof(s));
+  memset(s.buffer + s.numbytes, 0, BLAKE2s_BLOCKSIZE - s.numbytes);
+  res = caml_alloc_initialized_string(sizeof(s), (const char *) &s);
+  memset(&s, 0, sizeof(s));
+  return res;
+}
+
+CAMLprim value caml_blake2b_many(value hashlen, value key, value msgs,
+                                 value dst, value ofs)
+{
+  struct blake2b ctx;
+  int len = Int_val(hashlen);
+  unsigned char * out = &Byte_u(dst, Long_val(ofs));
+  unsigned char * p;
+  size_t plen;
+
+  CAML_HASH_MANY(msgs, p, plen, out, len,
+    blake2b_init(&ctx, len, caml_string_length(key), &Byte_u(key, 0), NULL);
+    blake2b_add_data(&ctx, p, plen);
+    blake2b_final(&ctx, len, out));
+  memset(&ctx, 0, sizeof(ctx));
+  return Val_unit;
+}
+
+CAMLprim value caml_blake2s_many(value hashlen, value key, value msgs,
+                                 value dst, value ofs)
+{
+  struct blake2s ctx;
+  int len = Int_val(hashlen);
+  unsigned char * out = &Byte_u(dst, Long_val(ofs));
+  unsigned char * p;
+  size_t plen;
+
+  CAML_HASH_MANY(msgs, p, plen, out, len,
+    blake2s_init(&ctx, len, caml_string_length(key), &Byte_u(key, 0), NULL);
+    blake2s_add_data(&ctx, p, plen);
+    blake2s_final(&ctx, len, out));
+  memset(&ctx, 0, sizeof(ctx));
+  return Val_unit;
+}
+
+CAMLprim value caml_blake2bp_many(value hashlen, value key, value msgs,
+                                  value dst, value ofs)
 {
-  CAMLparam1(ctx);
-  CAMLlocal1(res);
+  struct blake2bp ctx;
   int len = Int_val(hashlen);
-  res = caml_alloc_string(len);
-  blake2s_final(blake2s_val(ctx), len, &Byte_u(res, 0));
-  CAMLreturn(res);
+  unsigned char * out = &Byte_u(dst, Long_val(ofs));
+  unsigned char * p;
+  size_t plen;
+
+  CAML_HASH_MANY(msgs, p, plen, out, len,
+    blake2bp_init(&ctx, len, caml_string_length(key), &Byte_u(key, 0));
+    blake2bp_add_data(&ctx, p, plen);
+    blake2bp_final(&ctx, len, out));
+  memset(&ctx, 0, sizeof(ctx));
+  return Val_unit;
+}
+
+CAMLprim value caml_blake2sp_many(value hashlen, value key, value msgs,
+                                  value dst, value ofs)
+{
+  struct blake2sp ctx;
+  int len = Int_val(hashlen);
+  unsigned char * out = &Byte_u(dst, Long_val(ofs));
+  unsigned char * p;
+  size_t plen;
+
+  CAML_HASH_MANY(msgs, p, plen, out, len,
+    blake2sp_init(&ctx, len, caml_string_length(key), &Byte_u(key, 0));
+    blake2sp_add_data(&ctx, p, plen);
+    blake2sp_final(&ctx, len, out));
+  memset(&ctx, 0, sizeof(ctx));
+  return Val_unit;
+}
+
+#define blake2bp_val(v) ((struct blake2bp *) String_val(v))
+
+CAMLprim value caml_blake2bp_init(value hashlen, value key)
+{
+  CAMLparam1(key);
+  value ctx = caml_alloc_string(sizeof(struct blake2bp));
+  blake2bp_init(blake2bp_val(ctx),
+                Int_val(hashlen),
+                caml_string_length(key), &Byte_u(key, 0));
+  CAMLreturn(ctx);
+}
+
+CAMLprim value caml_blake2bp_update(value ctx, value src, value ofs, value len)
+{
+  blake2bp_add_data(blake2bp_val(ctx),
+                    &Byte_u(src, Long_val(ofs)), Long_val(len));
+  return Val_unit;
+}
+
+CAMLprim value caml_blake2bp_add_byte(value ctx, value b)
+{
+  unsigned char c = Int_val(b);
+  blake2bp_add_data(blake2bp_val(ctx), &c, 1);
+  return Val_unit;
+}
+
+CAMLprim value caml_blake2bp_final(value ctx, value hashlen,
+                                   value dst, value ofs)
+{
+  blake2bp_final(blake2bp_val(ctx), Int_val(hashlen),
+                 &Byte_u(dst, Long_val(ofs)));
+  return Val_unit;
+}
+
+CAMLprim value caml_blake2bp_reset(value ctx, value hashlen, value key)
+{
+  blake2bp_init(blake2bp_val(ctx),
+                Int_val(hashlen),
+                caml_string_length(key), &Byte_u(key, 0));
+  return Val_unit;
+}
+
+#define blake2sp_val(v) ((struct blake2sp *) String_val(v))
+
+CAMLprim value caml_blake2sp_init(value hashlen, value key)
+{
+  CAMLparam1(key);
+  value ctx = caml_alloc_string(sizeof(struct blake2sp));
+  blake2sp_init(blake2sp_val(ctx),
+                Int_val(hashlen),
+                caml_string_length(key), &Byte_u(key, 0));
+  CAMLreturn(ctx);
+}
+
+CAMLprim value caml_blake2sp_update(value ctx, value src, value ofs, value len)
+{
+  blake2sp_add_data(blake2sp_val(ctx),
+                    &Byte_u(src, Long_val(ofs)), Long_val(len));
+  return Val_unit;
+}
+
+CAMLprim value caml_blake2sp_add_byte(value ctx, value b)
+{
+  unsigned char c = Int_val(b);
+  blake2sp_add_data(blake2sp_val(ctx), &c, 1);
+  return Val_unit;
+}
+
+CAMLprim value caml_blake2sp_final(value ctx, value hashlen,
+                                   value dst, value ofs)
+{
+  blake2sp_final(blake2sp_val(ctx), Int_val(hashlen),
+                 &Byte_u(dst, Long_val(ofs)));
+  return Val_unit;
+}
+
+CAMLprim value caml_blake2sp_reset(value ctx, value hashlen, value key)
+{
+  blake2sp_init(blake2sp_val(ctx),
+                Int_val(hashlen),
+                caml_string_length(key), &Byte_u(key, 0));
+  return Val_unit;
+}
+
+/* BLAKE2X contexts are BLAKE2b/BLAKE2s contexts, updated with
+   caml_blake2b_update and caml_blake2s_update. */
+
+CAMLprim value caml_blake2xb_init(value outlen, value key)
+{
+  CAMLparam1(key);
+  value ctx = caml_alloc_string(sizeof(struct blake2b));
+  blake2xb_init(blake2b_val(ctx),
+                (uint32_t) Long_val(outlen),
+                caml_string_length(key), &Byte_u(key, 0));
+  CAMLreturn(ctx);
+}
+
+CAMLprim value caml_blake2xb_final(value ctx, value outlen,
+                                   value dst, value ofs)
+{
+  blake2xb_final(blake2b_val(ctx), (uint32_t) Long_val(outlen),
+                 &Byte_u(dst, Long_val(ofs)));
+  return Val_unit;
+}
+
+CAMLprim value caml_blake2xb_reset(value ctx, value outlen, value key)
+{
+  blake2xb_init(blake2b_val(ctx),
+                (uint32_t) Long_val(outlen),
+                caml_string_length(key), &Byte_u(key, 0));
+  return Val_unit;
+}
+
+CAMLprim value caml_blake2xs_init(value outlen, value key)
+{
+  CAMLparam1(key);
+  value ctx = caml_alloc_string(sizeof(struct blake2s));
+  blake2xs_init(blake2s_val(ctx),
+                (uint32_t) Long_val(outlen),
+                caml_string_length(key), &Byte_u(key, 0));
+  CAMLreturn(ctx);
+}
+
+CAMLprim value caml_blake2xs_final(value ctx, value outlen,
+                                   value dst, value ofs)
+{
+  blake2xs_final(blake2s_val(ctx), (uint32_t) Long_val(outlen),
+                 &Byte_u(dst, Long_val(ofs)));
+  return Val_unit;
+}
+
+CAMLprim value caml_blake2xs_reset(value ctx, value outlen, value key)
+{
+  blake2xs_init(blake2s_val(ctx),
+                (uint32_t) Long_val(outlen),
+                caml_string_length(key), &Byte_u(key, 0));
+  return Val_unit;
+}
+
+CAMLprim value caml_blake2xb_many(value outlen, value key, value msgs,
+                                  value dst, value ofs)
+{
+  struct blake2b ctx;
+  uint32_t len = Long_val(outlen);
+  unsigned char * out = &Byte_u(dst, Long_val(ofs));
+  unsigned char * p;
+  size_t plen;
+
+  CAML_HASH_MANY(msgs, p, plen, out, len,
+    blake2xb_init(&ctx, len, caml_string_length(key), &Byte_u(key, 0));
+    blake2b_add_data(&ctx, p, plen);
+    blake2xb_final(&ctx, len, out));
+  memset(&ctx, 0, sizeof(ctx));
+  return Val_unit;
+}
+
+CAMLprim value caml_blake2xs_many(value outlen, value key, value msgs,
+                                  value dst, value ofs)
+{
+  struct blake2s ctx;
+  uint32_t len = Long_val(outlen);
+  unsigned char * out = &Byte_u(dst, Long_val(ofs));
+  unsigned char * p;
+  size_t plen;
+
+  CAML_HASH_MANY(msgs, p, plen, out, len,
+    blake2xs_init(&ctx, len, caml_string_length(key), &Byte_u(key, 0));
+    blake2s_add_data(&ctx, p, plen);
+    blake2xs_final(&ctx, len, out));
+  memset(&ctx, 0, sizeof(ctx));
+  return Val_unit;
+}
+
+CAMLprim value caml_blake2s_64to32(value src, value dst)
+{
+  blake2s_64to32(&Byte_u(src, 0), caml_string_length(src) / 64,
+                 &Byte_u(dst, 0));
+  return Val_unit;
+}
+
+CAMLprim value caml_blake2s_64to32_merkle(value nodes, value src, value n,
+                                          value dst, value threads)
+{
+  return caml_merkle_level(blake2s_64to32, nodes, src, n, dst, threads);
 }
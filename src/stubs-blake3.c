@@ -16,11 +16,24 @@
 #include "blake3.c"
 #include "blake3_portable.c"
 #include "blake3_dispatch.c"
+#include "bao.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#ifdef HAVE_PTHREAD
+#include <unistd.h>
+#endif
 
 #include <caml/mlvalues.h>
 #include <caml/memory.h>
 #include <caml/alloc.h>
+#include "stubs-hash-many.h"
 #include <caml/custom.h>
+#include <caml/fail.h>
+#include <caml/signals.h>
+#include <caml/bigarray.h>
+#include "stubs-merkle.h"
 
 #define Context_val(v) (*((blake3_hasher **) Data_custom_val(v)))
 
@@ -66,6 +79,21 @@ CAMLprim value caml_blake3_update(value ctx,
   return Val_unit;
 }
 
+CAMLprim value caml_blake3_add_byte(value ctx, value b)
+{
+  unsigned char c = Int_val(b);
+  blake3_hasher_update(Context_val(ctx), &c, 1);
+  return Val_unit;
+}
+
+/* The key, if any, is kept in the context */
+
+CAMLprim value caml_blake3_reset(value ctx)
+{
+  if (Context_val(ctx) != NULL) blake3_hasher_reset(Context_val(ctx));
+  return Val_unit;
+}
+
 
 CAMLprim value caml_blake3_extract(value ctx, value vlen)
 {
@@ -77,6 +105,46 @@ CAMLprim value caml_blake3_extract(value ctx, value vlen)
   CAMLreturn(res);
 }
 
+CAMLprim value caml_blake3_extract_seek(value ctx, value seek,
+                                        value dst, value ofs, value len)
+{
+  blake3_hasher_finalize_seek(Context_val(ctx), Int64_val(seek),
+                              &Byte_u(dst, Long_val(ofs)), Long_val(len));
+  return Val_unit;
+}
+
+/* Key derivation: the context string is hashed into a context key,
+   which is then used to hash the key material */
+
+CAMLprim value caml_blake3_derive_context_key(value context)
+{
+  CAMLparam1(context);
+  CAMLlocal1(res);
+  blake3_hasher ctx;
+  hasher_init_base(&ctx, IV, DERIVE_KEY_CONTEXT);
+  blake3_hasher_update(&ctx, String_val(context), caml_string_length(context));
+  res = caml_alloc_string(BLAKE3_KEY_LEN);
+  blake3_hasher_finalize(&ctx, &Byte_u(res, 0), BLAKE3_KEY_LEN);
+  memset(&ctx, 0, sizeof(ctx));
+  CAMLreturn(res);
+}
+
+CAMLprim value caml_blake3_init_derive_key(value context_key)
+{
+  CAMLparam1(context_key);
+  blake3_hasher * ctx = caml_stat_alloc(sizeof(blake3_hasher));
+  uint32_t key_words[8];
+  value res =
+    caml_alloc_custom(&blake3_context_ops,
+                      sizeof(blake3_hasher *),
+                      0, 1);
+  load_key_words(&Byte_u(context_key, 0), key_words);
+  hasher_init_base(ctx, key_words, DERIVE_KEY_MATERIAL);
+  memset(key_words, 0, sizeof(key_words));
+  Context_val(res) = ctx;
+  CAMLreturn(res);
+}
+
 CAMLprim value caml_blake3_wipe(value ctx)
 {
   if (Context_val(ctx) != NULL)
@@ -85,3 +153,249 @@ CAMLprim value caml_blake3_wipe(value ctx)
   return Val_unit;
 }
 
+/* Duplicate a context, or restore a context saved by caml_blake3_save.
+   The data is copied before allocating, since [src] can point inside
+   an OCaml string. */
+
+static value caml_blake3_new_context(const blake3_hasher * src)
+{
+  blake3_hasher * ctx = NULL;
+  value res;
+  if (src != NULL) {
+    ctx = caml_stat_alloc(sizeof(blake3_hasher));
+    memcpy(ctx, src, sizeof(blake3_hasher));
+  }
+  res = caml_alloc_custom(&blake3_context_ops,
+                          sizeof(blake3_hasher *),
+                          0, 1);
+  Context_val(res) = ctx;
+  return res;
+}
+
+CAMLprim value caml_blake3_copy(value ctx)
+{
+  return caml_blake3_new_context(Context_val(ctx));
+}
+
+/* The saved state of a wiped context is the empty string */
+
+CAMLprim value caml_blake3_save(value ctx)
+{
+  if (Context_val(ctx) == NULL) return caml_alloc_string(0);
+  return caml_alloc_initialized_string(sizeof(blake3_hasher),
+                                       (char *) Context_val(ctx));
+}
+
+/* The CV stack is only indexed below [cv_stack_len - 2] when it holds
+   at least 2 entries, and the merges keep it within bounds as long as
+   the chunk counter fits in BLAKE3_MAX_DEPTH bits. */
+
+CAMLprim value caml_blake3_valid_state(value state)
+{
+  const blake3_hasher * s = (const blake3_hasher *) String_val(state);
+  size_t len;
+  if (caml_string_length(state) != sizeof(blake3_hasher)) return Val_false;
+  len = chunk_state_len(&s->chunk);
+  return Val_bool(s->chunk.buf_len <= BLAKE3_BLOCK_LEN
+                  && len <= BLAKE3_CHUNK_LEN
+                  && s->chunk.chunk_counter
+                     < ((uint64_t) 1 << BLAKE3_MAX_DEPTH)
+                  && s->cv_stack_len <= BLAKE3_MAX_DEPTH + 1
+                  && (s->cv_stack_len != 1
+                      || (len > 0 && s->chunk.chunk_counter > 0)));
+}
+
+CAMLprim value caml_blake3_restore(value state)
+{
+  return caml_blake3_new_context((const blake3_hasher *) String_val(state));
+}
+
+/* Multi-threaded hashing of large inputs */
+
+static int caml_blake3_threads(value vthreads)
+{
+  long n = Long_val(vthreads);
+  if (n <= 0) {
+#if defined(HAVE_PTHREAD) && defined(_SC_NPROCESSORS_ONLN)
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (n <= 0) n = 1;
+  }
+  if (n > 256) n = 256;
+  return n;
+}
+
+/* The runtime system is not released here, since the string could be
+   moved by a compaction running in another thread. */
+
+CAMLprim value caml_blake3_update_parallel(value ctx,
+                                           value src, value ofs, value len,
+                                           value threads)
+{
+  blake3_hasher_update_parallel(Context_val(ctx),
+                                &Byte_u(src, Long_val(ofs)), Long_val(len),
+                                caml_blake3_threads(threads));
+  return Val_unit;
+}
+
+CAMLprim value caml_blake3_update_bigarray(value ctx,
+                                           value src, value ofs, value len,
+                                           value threads)
+{
+  CAMLparam2(ctx, src);
+  blake3_hasher * h = Context_val(ctx);
+  unsigned char * p = (unsigned char *) Caml_ba_data_val(src) + Long_val(ofs);
+  size_t l = Long_val(len);
+  int n = caml_blake3_threads(threads);
+
+  caml_enter_blocking_section();
+  blake3_hasher_update_parallel(h, p, l, n);
+  caml_leave_blocking_section();
+  CAMLreturn(Val_unit);
+}
+
+/* Files are read by pieces of 16 Mbytes, a power of 2, so that each
+   piece is a complete subtree that can be hashed in parallel */
+#define BLAKE3_FILE_BUFFER_SIZE (16 * 1024 * 1024)
+
+CAMLprim value caml_blake3_update_file(value ctx, value filename,
+                                       value threads)
+{
+  CAMLparam2(ctx, filename);
+  blake3_hasher * h = Context_val(ctx);
+  int n = caml_blake3_threads(threads);
+  char * name = caml_stat_strdup(String_val(filename));
+  unsigned char * buf = caml_stat_alloc(BLAKE3_FILE_BUFFER_SIZE);
+  FILE * f;
+  size_t r;
+  int err = 0;
+
+  caml_enter_blocking_section();
+  f = fopen(name, "rb");
+  if (f == NULL) {
+    err = errno;
+  } else {
+    while ((r = fread(buf, 1, BLAKE3_FILE_BUFFER_SIZE, f)) > 0)
+      blake3_hasher_update_parallel(h, buf, r, n);
+    if (ferror(f)) err = errno != 0 ? errno : EIO;
+    fclose(f);
+  }
+  caml_leave_blocking_section();
+  caml_stat_free(buf);
+  caml_stat_free(name);
+  if (err != 0)
+    caml_raise_sys_error(caml_alloc_sprintf("%s: %s", String_val(filename),
+                                            strerror(err)));
+  CAMLreturn(Val_unit);
+}
+
+/* Bao verified streaming */
+
+CAMLprim value caml_bao_outboard(value data)
+{
+  CAMLparam1(data);
+  CAMLlocal3(outboard, hash, res);
+  uint64_t len = caml_string_length(data);
+  outboard = caml_alloc_string(bao_outboard_size(len));
+  hash = caml_alloc_string(BLAKE3_OUT_LEN);
+  bao_encode_outboard(&Byte_u(data, 0), NULL, len,
+                      &Byte_u(outboard, 0), &Byte_u(hash, 0));
+  res = caml_alloc_tuple(2);
+  Store_field(res, 0, hash);
+  Store_field(res, 1, outboard);
+  CAMLreturn(res);
+}
+
+CAMLprim value caml_bao_outboard_file(value filename, value vlen)
+{
+  CAMLparam2(filename, vlen);
+  CAMLlocal3(outboard, hash, res);
+  uint64_t len = Int64_val(vlen);
+  uint64_t size = bao_outboard_size(len);
+  char * name;
+  unsigned char * buf;
+  unsigned char h[BLAKE3_OUT_LEN];
+  FILE * f;
+  int err = 0, eof = 0;
+
+  buf = malloc(size);
+  if (buf == NULL) caml_raise_out_of_memory();
+  name = caml_stat_strdup(String_val(filename));
+  caml_enter_blocking_section();
+  f = fopen(name, "rb");
+  if (f == NULL) {
+    err = errno;
+  } else {
+    if (bao_encode_outboard(NULL, f, len, buf, h) != 0) {
+      if (ferror(f)) err = errno != 0 ? errno : EIO; else eof = 1;
+    }
+    fclose(f);
+  }
+  caml_leave_blocking_section();
+  caml_stat_free(name);
+  if (err != 0 || eof) {
+    free(buf);
+    if (eof) caml_raise_end_of_file();
+    caml_raise_sys_error(caml_alloc_sprintf("%s: %s", String_val(filename),
+                                            strerror(err)));
+  }
+  outboard = caml_alloc_initialized_string(size, (char *) buf);
+  free(buf);
+  hash = caml_alloc_initialized_string(BLAKE3_OUT_LEN, (char *) h);
+  res = caml_alloc_tuple(2);
+  Store_field(res, 0, hash);
+  Store_field(res, 1, outboard);
+  CAMLreturn(res);
+}
+
+CAMLprim value caml_bao_chunk_cv(value data, value ofs, value len,
+                                 value counter, value root)
+{
+  CAMLparam1(data);
+  unsigned char cv[BLAKE3_OUT_LEN];
+  bao_chunk_cv(&Byte_u(data, Long_val(ofs)), Long_val(len),
+               Long_val(counter), Bool_val(root), cv);
+  CAMLreturn(caml_alloc_initialized_string(BLAKE3_OUT_LEN, (char *) cv));
+}
+
+CAMLprim value caml_bao_parent_cv(value data, value ofs, value root)
+{
+  CAMLparam1(data);
+  unsigned char cv[BLAKE3_OUT_LEN];
+  bao_parent_cv(&Byte_u(data, Long_val(ofs)), Bool_val(root), cv);
+  CAMLreturn(caml_alloc_initialized_string(BLAKE3_OUT_LEN, (char *) cv));
+}
+
+CAMLprim value caml_bao_parents_cv(value src, value dst)
+{
+  bao_parents_cv(&Byte_u(src, 0), caml_string_length(src) / BAO_PARENT_LEN,
+                 &Byte_u(dst, 0));
+  return Val_unit;
+}
+
+CAMLprim value caml_blake3_parent_merkle(value nodes, value src, value n,
+                                         value dst, value threads)
+{
+  return caml_merkle_level(bao_parents_cv, nodes, src, n, dst, threads);
+}
+
+CAMLprim value caml_blake3_many(value optkey, value hashlen, value msgs,
+                                value dst, value ofs)
+{
+  blake3_hasher ctx;
+  int len = Int_val(hashlen);
+  unsigned char * out = &Byte_u(dst, Long_val(ofs));
+  unsigned char * p;
+  size_t plen;
+
+  CAML_HASH_MANY(msgs, p, plen, out, len,
+    if (caml_string_length(optkey) == BLAKE3_KEY_LEN) {
+      blake3_hasher_init_keyed(&ctx, &Byte_u(optkey, 0));
+    } else {
+      blake3_hasher_init(&ctx);
+    }
+    blake3_hasher_update(&ctx, p, plen);
+    blake3_hasher_finalize(&ctx, out, len));
+  memset(&ctx, 0, sizeof(ctx));
+  return Val_unit;
+}
@@ -0,0 +1,68 @@
+/***********************************************************************/
+/*                                                                     */
+/*                      The Cryptokit library                          */
+/*                                                                     */
+/*            Xavier Leroy, Collège de France and Inria                */
+/*                                                                     */
+/*  Copyright 2026 Institut National de Recherche en Informatique et   */
+/*  en Automatique.  All rights reserved.  This file is distributed    */
+/*  under the terms of the GNU Library General Public License, with    */
+/*  the special exception on linking described in file LICENSE.        */
+/*                                                                     */
+/***********************************************************************/
+
+/* Hashing of all the strings of an OCaml array in one call, the digests
+   being stored consecutively in a byte sequence.  The strings are hashed
+   in place: the hash functions do not allocate in the OCaml heap, so the
+   strings cannot move. */
+
+/* [env] points to the OCaml array */
+
+static void caml_hash_many_get(void * env, size_t i,
+                               const unsigned char ** p, size_t * len)
+{
+  value s = Field(*((value *) env), i);
+  *p = (const unsigned char *) String_val(s);
+  *len = caml_string_length(s);
+}
+
+/* Run the statements [...] on each string of the OCaml array [msgs],
+   with [p] and [len] set to its data and length, then advance [out]
+   by [outlen] bytes. */
+
+#define CAML_HASH_MANY(msgs, p, len, out, outlen, ...)                     \
+  do {                                                                     \
+    const unsigned char * caml_hash_many_p;                                \
+    mlsize_t caml_hash_many_i;                                             \
+    for (caml_hash_many_i = 0; caml_hash_many_i < Wosize_val(msgs);        \
+         caml_hash_many_i++, (out) += (outlen)) {                          \
+      caml_hash_many_get(&(msgs), caml_hash_many_i,                        \
+                         &caml_hash_many_p, &(len));                       \
+      (p) = (unsigned char *) caml_hash_many_p;                            \
+      __VA_ARGS__;                                                         \
+    }                                                                      \
+  } while (0)
+
+/* HMAC of each string of [msgs], the [hashlen]-byte MACs being stored
+   from [out] on.  [key] points to two contexts of type [ctxtype]: the
+   context after hashing the key XOR-ed with the inner pad, followed by
+   the context after hashing it XOR-ed with the outer pad.
+   [add(ctx, p, len)] adds data to a context and [finish(ctx, out)]
+   writes its hash. */
+
+#define CAML_HMAC_MANY(ctxtype, add, finish, key, msgs, out, hashlen)     \
+  do {                                                                     \
+    ctxtype caml_hmac_ctx;                                                 \
+    unsigned char caml_hmac_inner[64];                                     \
+    unsigned char * caml_hmac_p;                                           \
+    size_t caml_hmac_len;                                                  \
+    CAML_HASH_MANY(msgs, caml_hmac_p, caml_hmac_len, out, hashlen,         \
+      memcpy(&caml_hmac_ctx, (key), sizeof(ctxtype));                      \
+      add(&caml_hmac_ctx, caml_hmac_p, caml_hmac_len);                     \
+      finish(&caml_hmac_ctx, caml_hmac_inner);                             \
+      memcpy(&caml_hmac_ctx, (key) + 1, sizeof(ctxtype));                  \
+      add(&caml_hmac_ctx, caml_hmac_inner, hashlen);                       \
+      finish(&caml_hmac_ctx, out));                                        \
+    memset(&caml_hmac_ctx, 0, sizeof(ctxtype));                            \
+    memset(caml_hmac_inner, 0, sizeof(caml_hmac_inner));                   \
+  } while (0)
@@ -11,27 +11,11 @@
 /*                                                                     */
 /***********************************************************************/
 
+#include "md5.c"
 #include <caml/mlvalues.h>
 #include <caml/memory.h>
 #include <caml/alloc.h>
-
-#ifndef _MSC_VER
-#include <stdint.h>
-typedef uint32_t u32;
-#else
-typedef unsigned int u32;
-#endif
-
-struct MD5Context {
-        u32 buf[4];
-        u32 bits[2];
-        unsigned char in[64];
-};
-
-CAMLextern void caml_MD5Init (struct MD5Context *context);
-CAMLextern void caml_MD5Update (struct MD5Context *context,
-                           unsigned char *buf, unsigned len);
-CAMLextern void caml_MD5Final (unsigned char *digest, struct MD5Context *ctx);
+#include "stubs-hash-many.h"
 
 #define Context_val(v) ((struct MD5Context *) String_val(v))
 
@@ -48,13 +32,46 @@ CAMLprim value caml_md5_update(value ctx, value src, value ofs, value len)
   return Val_unit;
 }
 
-CAMLprim value caml_md5_final(value ctx)
+CAMLprim value caml_md5_add_byte(value ctx, value b)
+{
+  unsigned char c = Int_val(b);
+  caml_MD5Update(Context_val(ctx), &c, 1);
+  return Val_unit;
+}
+
+CAMLprim value caml_md5_final(value ctx, value dst, value ofs)
+{
+  caml_MD5Final(&Byte_u(dst, Long_val(ofs)), Context_val(ctx));
+  return Val_unit;
+}
+
+CAMLprim value caml_md5_reset(value ctx)
+{
+  caml_MD5Init(Context_val(ctx));
+  return Val_unit;
+}
+
+/* Check that a serialized context can be used safely */
+
+CAMLprim value caml_md5_valid_state(value ctx)
 {
-  CAMLparam1(ctx);
-  CAMLlocal1(res);
+  return Val_bool(caml_string_length(ctx) == sizeof(struct MD5Context));
+}
 
-  res = caml_alloc_string(16);
-  caml_MD5Final(&Byte_u(res, 0), Context_val(ctx));
-  CAMLreturn(res);
+CAMLprim value caml_md5_many(value msgs, value dst, value ofs)
+{
+  MD5_hash_many(Wosize_val(msgs), caml_hash_many_get, &msgs,
+                &Byte_u(dst, Long_val(ofs)));
+  return Val_unit;
 }
 
+#define MD5_finish(ctx, out) caml_MD5Final(out, ctx)
+
+CAMLprim value caml_md5_hmac_many(value key, value msgs,
+                                  value dst, value ofs)
+{
+  unsigned char * out = &Byte_u(dst, Long_val(ofs));
+  CAML_HMAC_MANY(struct MD5Context, caml_MD5Update, MD5_finish,
+                 Context_val(key), msgs, out, 16);
+  return Val_unit;
+}
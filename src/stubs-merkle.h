@@ -0,0 +1,104 @@
+/***********************************************************************/
+/*                                                                     */
+/*                      The Cryptokit library                          */
+/*                                                                     */
+/*            Xavier Leroy, Collège de France and Inria                */
+/*                                                                     */
+/*  Copyright 2026 Institut National de Recherche en Informatique et   */
+/*  en Automatique.  All rights reserved.  This file is distributed    */
+/*  under the terms of the GNU Library General Public License, with    */
+/*  the special exception on linking described in file LICENSE.        */
+/*                                                                     */
+/***********************************************************************/
+
+
+/* Hashing of a level of a Merkle tree held in a Bigarray */
+
+/* The [n] pairs of nodes at offset [src] of the Bigarray are hashed into
+   the [n] nodes at offset [dst] by up to [threads] threads, each hashing
+   a contiguous range of pairs with [f].  The runtime system is released
+   during the computation, since the data of a Bigarray cannot move. */
+
+#include <caml/bigarray.h>
+#include <caml/signals.h>
+
+typedef void (*merkle_level_fn)(const unsigned char * in, size_t n,
+                                unsigned char * out);
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#include <unistd.h>
+
+#define MERKLE_MAX_THREADS 256
+/* Smallest number of pairs worth starting a thread for */
+#define MERKLE_THREAD_MIN_PAIRS 512
+
+struct merkle_job {
+  merkle_level_fn f;
+  const unsigned char * in;
+  size_t n;
+  unsigned char * out;
+};
+
+static void * merkle_job_run(void * arg)
+{
+  struct merkle_job * j = arg;
+  j->f(j->in, j->n, j->out);
+  return NULL;
+}
+#endif
+
+static void merkle_level_parallel(merkle_level_fn f,
+                                  const unsigned char * in, size_t n,
+                                  unsigned char * out, int threads)
+{
+#ifdef HAVE_PTHREAD
+  struct merkle_job jobs[MERKLE_MAX_THREADS];
+  pthread_t tids[MERKLE_MAX_THREADS];
+  int started[MERKLE_MAX_THREADS];
+  size_t m;
+  int i, t;
+
+  if (threads > MERKLE_MAX_THREADS) threads = MERKLE_MAX_THREADS;
+  if (threads > 1 && n >= 2 * MERKLE_THREAD_MIN_PAIRS) {
+    m = (n + threads - 1) / threads;
+    if (m < MERKLE_THREAD_MIN_PAIRS) m = MERKLE_THREAD_MIN_PAIRS;
+    for (t = 0; n > m; t++, in += 64 * m, out += 32 * m, n -= m) {
+      jobs[t].f = f;
+      jobs[t].in = in;
+      jobs[t].n = m;
+      jobs[t].out = out;
+      started[t] =
+        pthread_create(&tids[t], NULL, merkle_job_run, &jobs[t]) == 0;
+      if (! started[t]) merkle_job_run(&jobs[t]);
+    }
+    f(in, n, out);
+    for (i = 0; i < t; i++)
+      if (started[i]) pthread_join(tids[i], NULL);
+    return;
+  }
+#endif
+  f(in, n, out);
+}
+
+static value caml_merkle_level(merkle_level_fn f, value nodes,
+                               value src, value n, value dst, value vthreads)
+{
+  CAMLparam1(nodes);
+  unsigned char * base = Caml_ba_data_val(nodes);
+  const unsigned char * in = base + Long_val(src);
+  unsigned char * out = base + Long_val(dst);
+  size_t npairs = Long_val(n);
+  long threads = Long_val(vthreads);
+
+  if (threads <= 0) {
+#if defined(HAVE_PTHREAD) && defined(_SC_NPROCESSORS_ONLN)
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (threads <= 0) threads = 1;
+  }
+  caml_enter_blocking_section();
+  merkle_level_parallel(f, in, npairs, out, threads);
+  caml_leave_blocking_section();
+  CAMLreturn(Val_unit);
+}
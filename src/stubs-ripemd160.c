@@ -15,6 +15,7 @@
 #include <caml/mlvalues.h>
 #include <caml/memory.h>
 #include <caml/alloc.h>
+#include "stubs-hash-many.h"
 
 #define Context_val(v) ((struct RIPEMD160Context *) String_val(v))
 
@@ -31,13 +32,53 @@ CAMLprim value caml_ripemd160_update(value ctx, value src, value ofs, value len)
   return Val_unit;
 }
 
-CAMLprim value caml_ripemd160_final(value ctx)
+CAMLprim value caml_ripemd160_add_byte(value ctx, value b)
 {
-  CAMLparam1(ctx);
-  CAMLlocal1(res);
+  unsigned char c = Int_val(b);
+  RIPEMD160_add_data(Context_val(ctx), &c, 1);
+  return Val_unit;
+}
+
+CAMLprim value caml_ripemd160_final(value ctx, value dst, value ofs)
+{
+  RIPEMD160_finish(Context_val(ctx), &Byte_u(dst, Long_val(ofs)));
+  return Val_unit;
+}
 
-  res = caml_alloc_string(20);
-  RIPEMD160_finish(Context_val(ctx), &Byte_u(res, 0));
-  CAMLreturn(res);
+CAMLprim value caml_ripemd160_reset(value ctx)
+{
+  RIPEMD160_init(Context_val(ctx));
+  return Val_unit;
 }
 
+/* Check that a serialized context can be used safely */
+
+CAMLprim value caml_ripemd160_valid_state(value ctx)
+{
+  return Val_bool(caml_string_length(ctx) == sizeof(struct RIPEMD160Context)
+                  && Context_val(ctx)->numbytes >= 0
+                  && Context_val(ctx)->numbytes < 64);
+}
+
+CAMLprim value caml_ripemd160_many(value msgs, value dst, value ofs)
+{
+  RIPEMD160_hash_many(Wosize_val(msgs), caml_hash_many_get, &msgs,
+                      &Byte_u(dst, Long_val(ofs)));
+  return Val_unit;
+}
+
+CAMLprim value caml_ripemd160_32to20(value src)
+{
+  unsigned char res[20];
+  RIPEMD160_32to20(&Byte_u(src, 0), res);
+  return caml_alloc_initialized_string(20, (char *) res);
+}
+
+CAMLprim value caml_ripemd160_hmac_many(value key, value msgs,
+                                        value dst, value ofs)
+{
+  unsigned char * out = &Byte_u(dst, Long_val(ofs));
+  CAML_HMAC_MANY(struct RIPEMD160Context, RIPEMD160_add_data,
+                 RIPEMD160_finish, Context_val(key), msgs, out, 20);
+  return Val_unit;
+}
@@ -15,6 +15,7 @@
 #include <caml/mlvalues.h>
 #include <caml/memory.h>
 #include <caml/alloc.h>
+#include "stubs-hash-many.h"
 
 #define Context_val(v) ((struct SHA1Context *) String_val(v))
 
@@ -31,13 +32,46 @@ CAMLprim value caml_sha1_update(value ctx, value src, value ofs, value len)
   return Val_unit;
 }
 
-CAMLprim value caml_sha1_final(value ctx)
+CAMLprim value caml_sha1_add_byte(value ctx, value b)
 {
-  CAMLparam1(ctx);
-  CAMLlocal1(res);
+  unsigned char c = Int_val(b);
+  SHA1_add_data(Context_val(ctx), &c, 1);
+  return Val_unit;
+}
+
+CAMLprim value caml_sha1_final(value ctx, value dst, value ofs)
+{
+  SHA1_finish(Context_val(ctx), &Byte_u(dst, Long_val(ofs)));
+  return Val_unit;
+}
+
+CAMLprim value caml_sha1_reset(value ctx)
+{
+  SHA1_init(Context_val(ctx));
+  return Val_unit;
+}
+
+/* Check that a serialized context can be used safely */
+
+CAMLprim value caml_sha1_valid_state(value ctx)
+{
+  return Val_bool(caml_string_length(ctx) == sizeof(struct SHA1Context)
+                  && Context_val(ctx)->numbytes >= 0
+                  && Context_val(ctx)->numbytes < 64);
+}
 
-  res = caml_alloc_string(20);
-  SHA1_finish(Context_val(ctx), &Byte_u(res, 0));
-  CAMLreturn(res);
+CAMLprim value caml_sha1_many(value msgs, value dst, value ofs)
+{
+  SHA1_hash_many(Wosize_val(msgs), caml_hash_many_get, &msgs,
+                 &Byte_u(dst, Long_val(ofs)));
+  return Val_unit;
 }
 
+CAMLprim value caml_sha1_hmac_many(value key, value msgs,
+                                   value dst, value ofs)
+{
+  unsigned char * out = &Byte_u(dst, Long_val(ofs));
+  CAML_HMAC_MANY(struct SHA1Context, SHA1_add_data, SHA1_finish,
+                 Context_val(key), msgs, out, 20);
+  return Val_unit;
+}
@@ -15,6 +15,8 @@
 #include <caml/mlvalues.h>
 #include <caml/memory.h>
 #include <caml/alloc.h>
+#include "stubs-hash-many.h"
+#include "stubs-merkle.h"
 
 #define Context_val(v) ((struct SHA256Context *) String_val(v))
 
@@ -38,24 +40,86 @@ CAMLprim value caml_sha256_update(value ctx, value src, value ofs, value len)
   return Val_unit;
 }
 
-CAMLprim value caml_sha256_final(value ctx)
+CAMLprim value caml_sha256_add_byte(value ctx, value b)
 {
-  CAMLparam1(ctx);
-  CAMLlocal1(res);
+  unsigned char c = Int_val(b);
+  SHA256_add_data(Context_val(ctx), &c, 1);
+  return Val_unit;
+}
 
-  res = caml_alloc_string(32);
-  SHA256_finish(Context_val(ctx), 256, &Byte_u(res, 0));
-  CAMLreturn(res);
+CAMLprim value caml_sha256_final(value ctx, value bitsize,
+                                 value dst, value ofs)
+{
+  SHA256_finish(Context_val(ctx), Int_val(bitsize),
+                &Byte_u(dst, Long_val(ofs)));
+  return Val_unit;
 }
 
-CAMLprim value caml_sha224_final(value ctx)
+CAMLprim value caml_sha256_reset(value ctx, value bitsize)
 {
-  CAMLparam1(ctx);
-  CAMLlocal1(res);
+  SHA256_init(Context_val(ctx), Int_val(bitsize));
+  return Val_unit;
+}
 
-  res = caml_alloc_string(28);
-  SHA256_finish(Context_val(ctx), 224, &Byte_u(res, 0));
-  CAMLreturn(res);
+/* Check that a serialized context can be used safely */
+
+CAMLprim value caml_sha256_valid_state(value ctx)
+{
+  return Val_bool(caml_string_length(ctx) == sizeof(struct SHA256Context)
+                  && Context_val(ctx)->numbytes >= 0
+                  && Context_val(ctx)->numbytes < 64);
 }
 
+CAMLprim value caml_sha256_many(value bitsize, value msgs, value dst, value ofs)
+{
+  SHA256_hash_many(Int_val(bitsize), Wosize_val(msgs),
+                   caml_hash_many_get, &msgs, &Byte_u(dst, Long_val(ofs)));
+  return Val_unit;
+}
+
+CAMLprim value caml_sha256_64to32(value src, value dst)
+{
+  SHA256_64to32(&Byte_u(src, 0), caml_string_length(src) / 64,
+                &Byte_u(dst, 0));
+  return Val_unit;
+}
 
+CAMLprim value caml_sha256_64to32_merkle(value nodes, value src, value n,
+                                         value dst, value threads)
+{
+  return caml_merkle_level(SHA256_64to32, nodes, src, n, dst, threads);
+}
+
+CAMLprim value caml_sha256d_64to32(value src, value dst)
+{
+  SHA256d_64to32(&Byte_u(src, 0), caml_string_length(src) / 64,
+                 &Byte_u(dst, 0));
+  return Val_unit;
+}
+
+CAMLprim value caml_sha256_oneshot(value src, value twice)
+{
+  struct SHA256Context ctx;
+  unsigned char res[32];
+
+  if (Bool_val(twice)) {
+    SHA256d(&Byte_u(src, 0), caml_string_length(src), res);
+  } else {
+    SHA256_init(&ctx, 256);
+    SHA256_add_data(&ctx, &Byte_u(src, 0), caml_string_length(src));
+    SHA256_finish(&ctx, 256, res);
+  }
+  return caml_alloc_initialized_string(32, (char *) res);
+}
+
+CAMLprim value caml_sha256_hmac_many(value bitsize, value key, value msgs,
+                                     value dst, value ofs)
+{
+  int bits = Int_val(bitsize);
+  unsigned char * out = &Byte_u(dst, Long_val(ofs));
+#define SHA256_finish_bits(ctx, out) SHA256_finish(ctx, bits, out)
+  CAML_HMAC_MANY(struct SHA256Context, SHA256_add_data, SHA256_finish_bits,
+                 Context_val(key), msgs, out, bits / 8);
+#undef SHA256_finish_bits
+  return Val_unit;
+}
@@ -13,10 +13,14 @@
 
 #include <string.h>
 #include "keccak.c"
+#ifdef HAVE_PTHREAD
+#include <unistd.h>
+#endif
 #include <caml/mlvalues.h>
 #include <caml/memory.h>
 #include <caml/alloc.h>
 #include <caml/custom.h>
+#include "stubs-hash-many.h"
 
 #define Context_val(v) (*((struct SHA3Context **) Data_custom_val(v)))
 
@@ -49,6 +53,68 @@ CAMLprim value caml_sha3_init(value vsize)
   return res;
 }
 
+CAMLprim value caml_shake_init(value vlevel)
+{
+  struct SHA3Context * ctx = caml_stat_alloc(sizeof(struct SHA3Context));
+  value res =
+    caml_alloc_custom(&SHA3_context_ops,
+                      sizeof(struct SHA3Context *),
+                      0, 1);
+  SHAKE_init(ctx, Int_val(vlevel));
+  Context_val(res) = ctx;
+  return res;
+}
+
+/* Duplicate a context, or restore a context saved by caml_sha3_save.
+   The data is copied before allocating, since [src] can point inside
+   an OCaml string. */
+
+static value caml_sha3_new_context(const struct SHA3Context * src)
+{
+  struct SHA3Context * ctx = NULL;
+  value res;
+  if (src != NULL) {
+    ctx = caml_stat_alloc(sizeof(struct SHA3Context));
+    memcpy(ctx, src, sizeof(struct SHA3Context));
+  }
+  res = caml_alloc_custom(&SHA3_context_ops,
+                          sizeof(struct SHA3Context *),
+                          0, 1);
+  Context_val(res) = ctx;
+  return res;
+}
+
+CAMLprim value caml_sha3_copy(value ctx)
+{
+  return caml_sha3_new_context(Context_val(ctx));
+}
+
+/* The saved state of a wiped context is the empty string */
+
+CAMLprim value caml_sha3_save(value ctx)
+{
+  if (Context_val(ctx) == NULL) return caml_alloc_string(0);
+  return caml_alloc_initialized_string(sizeof(struct SHA3Context),
+                                       (char *) Context_val(ctx));
+}
+
+CAMLprim value caml_sha3_valid_state(value state, value vsize)
+{
+  const struct SHA3Context * ctx = (const struct SHA3Context *) String_val(state);
+  int hsiz = Int_val(vsize) / 8;
+  return Val_bool(caml_string_length(state) == sizeof(struct SHA3Context)
+                  && ctx->hsiz == hsiz
+                  && ctx->rsiz == 200 - 2 * hsiz
+                  && ctx->rounds == KECCAK_ROUNDS
+                  && ctx->numbytes >= 0
+                  && ctx->numbytes < ctx->rsiz);
+}
+
+CAMLprim value caml_sha3_restore(value state)
+{
+  return caml_sha3_new_context((const struct SHA3Context *) String_val(state));
+}
+
 CAMLprim value caml_sha3_absorb(value ctx,
                                 value src, value ofs, value len)
 {
@@ -56,6 +122,25 @@ CAMLprim value caml_sha3_absorb(value ctx,
   return Val_unit;
 }
 
+CAMLprim value caml_sha3_add_byte(value ctx, value b)
+{
+  unsigned char c = Int_val(b);
+  SHA3_absorb(Context_val(ctx), &c, 1);
+  return Val_unit;
+}
+
+/* Return to the initial state, keeping the hash size and the rate */
+
+CAMLprim value caml_sha3_reset(value ctx)
+{
+  struct SHA3Context * c = Context_val(ctx);
+  if (c != NULL) {
+    c->numbytes = 0;
+    memset(c->state, 0, sizeof(c->state));
+  }
+  return Val_unit;
+}
+
 
 /* On page 9 of Keccak Implementation Overview (Version 3.2)
    http://keccak.noekeon.org/Keccak-implementation-3.2.pdf,
@@ -66,14 +151,35 @@ static const unsigned keccak_padding = 0x01;
    on Table 3, `0x06` is shown as the relevant padding byte. */
 static const unsigned sha3_padding = 0x06;
 
-CAMLprim value caml_sha3_extract(value official, value ctx)
+CAMLprim value caml_sha3_extract(value official, value ctx,
+                                 value dst, value ofs)
+{
+  SHA3_extract(Bool_val(official) ? sha3_padding : keccak_padding,
+               Context_val(ctx), &Byte_u(dst, Long_val(ofs)));
+  return Val_unit;
+}
+
+CAMLprim value caml_sha3_pad(value ctx, value padding)
 {
-  CAMLparam2(official, ctx);
-  CAMLlocal1(res);
+  SHA3_pad(Int_val(padding), Context_val(ctx));
+  return Val_unit;
+}
 
-  res = caml_alloc_string(Context_val(ctx)->hsiz);
-  SHA3_extract(Bool_val(official) ? sha3_padding : keccak_padding, Context_val(ctx), &Byte_u(res, 0));
-  CAMLreturn(res);
+CAMLprim value caml_sha3_squeeze(value ctx,
+                                 value dst, value ofs, value len)
+{
+  SHA3_squeeze(Context_val(ctx), &Byte_u(dst, Long_val(ofs)), Long_val(len));
+  return Val_unit;
+}
+
+CAMLprim value caml_sha3_many(value bitsize, value official,
+                              value msgs, value dst, value ofs)
+{
+  SHA3_hash_many(Int_val(bitsize),
+                 Bool_val(official) ? sha3_padding : keccak_padding,
+                 Wosize_val(msgs), caml_hash_many_get, &msgs,
+                 &Byte_u(dst, Long_val(ofs)));
+  return Val_unit;
 }
 
 CAMLprim value caml_sha3_wipe(value ctx)
@@ -86,3 +192,124 @@ CAMLprim value caml_sha3_wipe(value ctx)
   return Val_unit;
 }
 
+
+/* KangarooTwelve */
+
+#define K12_val(v) ((struct K12Context *) String_val(v))
+
+CAMLprim value caml_k12_init(value unit)
+{
+  value ctx = caml_alloc_string(sizeof(struct K12Context));
+  K12_init(K12_val(ctx));
+  return ctx;
+}
+
+CAMLprim value caml_k12_absorb(value ctx, value src, value ofs, value len)
+{
+  K12_absorb(K12_val(ctx), &Byte_u(src, Long_val(ofs)), Long_val(len), 1);
+  return Val_unit;
+}
+
+CAMLprim value caml_k12_add_byte(value ctx, value b)
+{
+  unsigned char c = Int_val(b);
+  K12_absorb(K12_val(ctx), &c, 1, 1);
+  return Val_unit;
+}
+
+CAMLprim value caml_k12_reset(value ctx)
+{
+  K12_init(K12_val(ctx));
+  return Val_unit;
+}
+
+static int caml_k12_threads(value vthreads)
+{
+  long n = Long_val(vthreads);
+  if (n <= 0) {
+#if defined(HAVE_PTHREAD) && defined(_SC_NPROCESSORS_ONLN)
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (n <= 0) n = 1;
+  }
+  if (n > 256) n = 256;
+  return n;
+}
+
+/* As for caml_blake3_update_parallel, the runtime system is not released,
+   since the string could be moved by a compaction in another thread. */
+
+CAMLprim value caml_k12_absorb_parallel(value ctx,
+                                        value src, value ofs, value len,
+                                        value threads)
+{
+  K12_absorb(K12_val(ctx), &Byte_u(src, Long_val(ofs)), Long_val(len),
+             caml_k12_threads(threads));
+  return Val_unit;
+}
+
+CAMLprim value caml_k12_pad(value ctx, value custom)
+{
+  K12_pad(K12_val(ctx), &Byte_u(custom, 0), caml_string_length(custom));
+  return Val_unit;
+}
+
+CAMLprim value caml_k12_squeeze(value ctx, value dst, value ofs, value len)
+{
+  K12_squeeze(K12_val(ctx), &Byte_u(dst, Long_val(ofs)), Long_val(len));
+  return Val_unit;
+}
+
+/* KangarooTwelve of all the strings of an OCaml array, with customization
+   string [custom] */
+
+CAMLprim value caml_k12_many(value custom, value hashlen, value msgs,
+                             value dst, value ofs)
+{
+  struct K12Context ctx;
+  size_t len = Long_val(hashlen);
+  unsigned char * out = &Byte_u(dst, Long_val(ofs));
+  unsigned char * p;
+  size_t plen;
+
+  CAML_HASH_MANY(msgs, p, plen, out, len,
+    K12_init(&ctx);
+    K12_absorb(&ctx, p, plen, 1);
+    K12_pad(&ctx, &Byte_u(custom, 0), caml_string_length(custom));
+    K12_squeeze(&ctx, out, len));
+  memset(&ctx, 0, sizeof(ctx));
+  return Val_unit;
+}
+
+/* cSHAKE of all the strings of an OCaml array, each one preceded by
+   [prefix] and followed by [suffix], as for KMAC.  The prefix is
+   absorbed only once. */
+
+CAMLprim value caml_cshake_many(value level, value prefix, value suffix,
+                                value hashlen, value msgs,
+                                value dst, value ofs)
+{
+  struct SHA3Context start, ctx;
+  size_t len = Long_val(hashlen);
+  unsigned char * out = &Byte_u(dst, Long_val(ofs));
+  unsigned char * p;
+  size_t plen;
+
+  SHAKE_init(&start, Int_val(level));
+  SHA3_absorb(&start, &Byte_u(prefix, 0), caml_string_length(prefix));
+  CAML_HASH_MANY(msgs, p, plen, out, len,
+    memcpy(&ctx, &start, sizeof(ctx));
+    SHA3_absorb(&ctx, p, plen);
+    SHA3_absorb(&ctx, &Byte_u(suffix, 0), caml_string_length(suffix));
+    SHA3_pad(0x04, &ctx);
+    SHA3_squeeze(&ctx, out, len));
+  memset(&start, 0, sizeof(start));
+  memset(&ctx, 0, sizeof(ctx));
+  return Val_unit;
+}
+
+CAMLprim value caml_cshake_many_bytecode(value * argv, int argc)
+{
+  return caml_cshake_many(argv[0], argv[1], argv[2], argv[3],
+                          argv[4], argv[5], argv[6]);
+}
@@ -15,6 +15,7 @@
 #include <caml/mlvalues.h>
 #include <caml/memory.h>
 #include <caml/alloc.h>
+#include "stubs-hash-many.h"
 
 #define Context_val(v) ((struct SHA512Context *) String_val(v))
 
@@ -52,42 +53,61 @@ CAMLprim value caml_sha512_update(value ctx, value src, value ofs, value len)
   return Val_unit;
 }
 
-CAMLprim value caml_sha512_final(value ctx)
+CAMLprim value caml_sha512_add_byte(value ctx, value b)
 {
-  CAMLparam1(ctx);
-  CAMLlocal1(res);
+  unsigned char c = Int_val(b);
+  SHA512_add_data(Context_val(ctx), &c, 1);
+  return Val_unit;
+}
 
-  res = caml_alloc_string(64);
-  SHA512_finish(Context_val(ctx), 512, &Byte_u(res, 0));
-  CAMLreturn(res);
+CAMLprim value caml_sha512_final(value ctx, value bitsize,
+                                 value dst, value ofs)
+{
+  SHA512_finish(Context_val(ctx), Int_val(bitsize),
+                &Byte_u(dst, Long_val(ofs)));
+  return Val_unit;
 }
 
-CAMLprim value caml_sha384_final(value ctx)
+CAMLprim value caml_sha512_reset(value ctx, value bitsize)
 {
-  CAMLparam1(ctx);
-  CAMLlocal1(res);
+  SHA512_init(Context_val(ctx), Int_val(bitsize));
+  return Val_unit;
+}
 
-  res = caml_alloc_string(48);
-  SHA512_finish(Context_val(ctx), 384, &Byte_u(res, 0));
-  CAMLreturn(res);
+/* Check that a serialized context can be used safely */
+
+CAMLprim value caml_sha512_valid_state(value ctx)
+{
+  return Val_bool(caml_string_length(ctx) == sizeof(struct SHA512Context)
+                  && Context_val(ctx)->numbytes >= 0
+                  && Context_val(ctx)->numbytes < 128);
 }
 
-CAMLprim value caml_sha512_256_final(value ctx)
+CAMLprim value caml_sha512_many(value bitsize, value msgs,
+                                value dst, value ofs)
 {
-  CAMLparam1(ctx);
-  CAMLlocal1(res);
+  struct SHA512Context ctx;
+  int bits = Int_val(bitsize);
+  unsigned char * out = &Byte_u(dst, Long_val(ofs));
+  unsigned char * p;
+  size_t len;
 
-  res = caml_alloc_string(32);
-  SHA512_finish(Context_val(ctx), 256, &Byte_u(res, 0));
-  CAMLreturn(res);
+  CAML_HASH_MANY(msgs, p, len, out, bits / 8,
+    SHA512_init(&ctx, bits);
+    SHA512_add_data(&ctx, p, len);
+    SHA512_finish(&ctx, bits, out));
+  memset(&ctx, 0, sizeof(ctx));
+  return Val_unit;
 }
 
-CAMLprim value caml_sha512_224_final(value ctx)
+CAMLprim value caml_sha512_hmac_many(value bitsize, value key, value msgs,
+                                     value dst, value ofs)
 {
-  CAMLparam1(ctx);
-  CAMLlocal1(res);
-
-  res = caml_alloc_string(28);
-  SHA512_finish(Context_val(ctx), 224, &Byte_u(res, 0));
-  CAMLreturn(res);
+  int bits = Int_val(bitsize);
+  unsigned char * out = &Byte_u(dst, Long_val(ofs));
+#define SHA512_finish_bits(ctx, out) SHA512_finish(ctx, bits, out)
+  CAML_HMAC_MANY(struct SHA512Context, SHA512_add_data, SHA512_finish_bits,
+                 Context_val(key), msgs, out, bits / 8);
+#undef SHA512_finish_bits
+  return Val_unit;
 }
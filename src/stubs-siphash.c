@@ -18,6 +18,7 @@
 #include <caml/mlvalues.h>
 #include <caml/memory.h>
 #include <caml/alloc.h>
+#include "stubs-hash-many.h"
 
 #define siphash_val(v) ((struct siphash *) String_val(v))
 
@@ -34,12 +35,40 @@ CAMLprim value caml_siphash_update(value ctx, value src, value ofs, value len)
   return Val_unit;
 }
 
-CAMLprim value caml_siphash_final(value ctx, value hashlen)
+CAMLprim value caml_siphash_add_byte(value ctx, value b)
 {
-  CAMLparam1(ctx);
-  CAMLlocal1(res);
+  unsigned char c = Int_val(b);
+  siphash_add(siphash_val(ctx), &c, 1);
+  return Val_unit;
+}
+
+CAMLprim value caml_siphash_final(value ctx, value hashlen,
+                                  value dst, value ofs)
+{
+  siphash_final(siphash_val(ctx), Int_val(hashlen),
+                &Byte_u(dst, Long_val(ofs)));
+  return Val_unit;
+}
+
+CAMLprim value caml_siphash_reset(value ctx, value key, value hashlen)
+{
+  siphash_init(siphash_val(ctx), &Byte_u(key, 0), Int_val(hashlen));
+  return Val_unit;
+}
+
+CAMLprim value caml_siphash_many(value key, value hashlen, value msgs,
+                                 value dst, value ofs)
+{
+  struct siphash ctx;
   int len = Int_val(hashlen);
-  res = caml_alloc_string(len);
-  siphash_final(siphash_val(ctx), len, &Byte_u(res, 0));
-  CAMLreturn(res);
+  unsigned char * out = &Byte_u(dst, Long_val(ofs));
+  unsigned char * p;
+  size_t plen;
+
+  CAML_HASH_MANY(msgs, p, plen, out, len,
+    siphash_init(&ctx, &Byte_u(key, 0), len);
+    siphash_add(&ctx, p, plen);
+    siphash_final(&ctx, len, out));
+  memset(&ctx, 0, sizeof(ctx));
+  return Val_unit;
 }
@@ -50,6 +50,20 @@ let transform tr niter blocksize () =
     tr#put_substring msg 0 blocksize; ignore(tr#get_substring)
   done
 
+let seal key niter blocksize () =
+  let msg = Bytes.create (blocksize + 16) in
+  for i = 1 to niter do
+    AEAD.seal_into ~iv:"0123456789AB" key msg 0 blocksize msg 0
+  done
+
+let seal_batch key niter batchsize blocksize () =
+  let keys = Array.make batchsize key
+  and ivs = Array.make batchsize "0123456789AB"
+  and bufs = Array.init batchsize (fun _ -> Bytes.create (blocksize + 16)) in
+  for i = 1 to niter do
+    AEAD.seal_batch ~ivs keys bufs
+  done
+
 let hash h niter blocksize () =
   let msg = Bytes.create blocksize in
   for i = 1 to niter do
@@ -57,6 +71,64 @@ let hash h niter blocksize () =
   done;
   ignore(h#result)
 
+let hash_each mkhash niter nmsgs msgsize () =
+  let msgs = Array.make nmsgs (String.make msgsize 'x') in
+  for i = 1 to niter do
+    ignore (Array.map (fun s -> hash_string (mkhash()) s) msgs)
+  done
+
+let hash_many f niter nmsgs msgsize () =
+  let msgs = Array.make nmsgs (String.make msgsize 'x') in
+  for i = 1 to niter do
+    ignore (f msgs)
+  done
+
+let merkle_level f niter nnodes () =
+  let level = String.make (64 * nnodes) 'x' in
+  for i = 1 to niter do
+    ignore (f level)
+  done
+
+let merkle_updates hash niter nleaves nupdates () =
+  let t = Merkle.create hash (Array.make nleaves (String.make 32 'x')) in
+  for i = 1 to niter do
+    for j = 1 to nupdates do
+      Merkle.set_leaf t ((i * 7919 + j * 104729) mod nleaves)
+                        (String.make 32 'y')
+    done;
+    ignore (Merkle.root t)
+  done
+
+let merkle_create threads hash niter nleaves () =
+  let leaves = Array.make nleaves (String.make 32 'x') in
+  for i = 1 to niter do
+    ignore (Merkle.create ~threads hash leaves)
+  done
+
+let hash_suffixes h niter prefixsize suffixsize () =
+  h#add_string (String.make prefixsize 'p');
+  let suffix = String.make suffixsize 's' in
+  for i = 1 to niter do
+    let h' = h#copy in
+    h'#add_string suffix;
+    ignore (h'#result)
+  done
+
+let mac_reuse h niter msgsize () =
+  let msg = String.make msgsize 'm' in
+  let buf = Bytes.create h#hash_size in
+  for i = 1 to niter do
+    h#add_string msg;
+    h#result_into buf 0;
+    h#reset
+  done
+
+let squeeze x niter blocksize () =
+  let buf = Bytes.create blocksize in
+  for i = 1 to niter do
+    x#squeeze_into buf 0 blocksize
+  done
+
 let rng r niter blocksize () =
   let buf = Bytes.create blocksize in
   for i = 1 to niter do
@@ -88,6 +160,14 @@ let _ =
     (transform (AEAD.aes_gcm ~iv:"0123456789AB" "0123456789ABCDEF" AEAD.Encrypt) 4000000 16);
   time_fn "Chacha20-Poly1305, 64_000_000 bytes"
     (transform (AEAD.chacha20_poly1305 ~iv:"0123456789AB" "0123456789ABCDEF" AEAD.Encrypt) 4000000 16);
+  time_fn "AES-GCM one-shot, 64-byte messages, 64_000_000 bytes"
+    (seal (AEAD.aes_gcm_key "0123456789ABCDEF") 1000000 64);
+  time_fn "Chacha20-Poly1305 one-shot, 64-byte messages, 64_000_000 bytes"
+    (seal (AEAD.chacha20_poly1305_key "0123456789ABCDEF") 1000000 64);
+  time_fn "AES-GCM batch of 16, 64-byte messages, 64_000_000 bytes"
+    (seal_batch (AEAD.aes_gcm_key "0123456789ABCDEF") 62500 16 64);
+  time_fn "Chacha20-Poly1305 batch of 16, 64-byte messages, 64_000_000 bytes"
+    (seal_batch (AEAD.chacha20_poly1305_key "0123456789ABCDEF") 62500 16 64);
   time_fn "Wrapped AES 128 CBC, 64_000_000 bytes"
     (transform (Cipher.aes "0123456789ABCDEF" Cipher.Encrypt) 4000000 16);
   time_fn "Wrapped AES 192 CBC, 64_000_000 bytes"
@@ -108,8 +188,14 @@ let _ =
     (hash (Hash.sha1()) 4000000 16);
   time_fn "SHA-256, 64_000_000 bytes, 16-byte chunks"
     (hash (Hash.sha256()) 4000000 16);
+  time_fn "SHA-1, 64_000_000 bytes, 4096-byte chunks"
+    (hash (Hash.sha1()) 15625 4096);
+  time_fn "SHA-256, 64_000_000 bytes, 4096-byte chunks"
+    (hash (Hash.sha256()) 15625 4096);
   time_fn "SHA-512, 64_000_000 bytes, 16-byte chunks"
     (hash (Hash.sha512()) 4000000 16);
+  time_fn "SHA-512, 64_000_000 bytes, 4096-byte chunks"
+    (hash (Hash.sha512()) 15625 4096);
   time_fn "SHA-512/256, 64_000_000 bytes, 16-byte chunks"
     (hash (Hash.sha512_256()) 4000000 16);
   time_fn "SHA-512/224, 64_000_000 bytes, 16-byte chunks"
@@ -118,16 +204,82 @@ let _ =
     (hash (Hash.sha3 256) 4000000 16);
   time_fn "SHA-3 512, 64_000_000 bytes, 16-byte chunks"
     (hash (Hash.sha3 512) 4000000 16);
+  time_fn "KangarooTwelve, 64_000_000 bytes, 16-byte chunks"
+    (hash (Hash.k12 256) 4000000 16);
+  time_fn "KangarooTwelve, 64_000_000 bytes, 4096-byte chunks"
+    (hash (Hash.k12 256) 15625 4096);
+  time_fn "SHAKE128, 64_000_000 bytes of output, 4096-byte chunks"
+    (squeeze (Hash.shake128 ()) 15625 4096);
   time_fn "BLAKE2b 512, 64_000_000 bytes, 16-byte chunks"
     (hash (Hash.blake2b 512) 4000000 16);
+  time_fn "BLAKE2b 512, 64_000_000 bytes, 4096-byte chunks"
+    (hash (Hash.blake2b 512) 15625 4096);
   time_fn "BLAKE2s 256, 64_000_000 bytes, 16-byte chunks"
     (hash (Hash.blake2s 256) 4000000 16);
+  time_fn "BLAKE2s 256, 64_000_000 bytes, 4096-byte chunks"
+    (hash (Hash.blake2s 256) 15625 4096);
+  time_fn "BLAKE2bp 512, 64_000_000 bytes, 4096-byte chunks"
+    (hash (Hash.blake2bp 512) 15625 4096);
+  time_fn "BLAKE2sp 256, 64_000_000 bytes, 4096-byte chunks"
+    (hash (Hash.blake2sp 256) 15625 4096);
   time_fn "BLAKE3, 64_000_000 bytes, 16-byte chunks"
     (hash (Hash.blake3 256) 4000000 16);
+  time_fn "BLAKE3, 64_000_000 bytes, 4096-byte chunks"
+    (hash (Hash.blake3 256) 15625 4096);
   time_fn "RIPEMD-160, 64_000_000 bytes, 16-byte chunks"
     (hash (Hash.ripemd160()) 4000000 16);
   time_fn "MD5, 64_000_000 bytes, 16-byte chunks"
     (hash (Hash.md5()) 4000000 16);
+  time_fn "SHA-256, 1000 messages of 256 bytes, one at a time, x 250"
+    (hash_each Hash.sha256 250 1000 256);
+  time_fn "SHA-256, 1000 messages of 256 bytes, sha256_many, x 250"
+    (hash_many Hash.sha256_many 250 1000 256);
+  time_fn "SHA-1, 1000 messages of 256 bytes, sha1_many, x 250"
+    (hash_many Hash.sha1_many 250 1000 256);
+  time_fn "RIPEMD-160, 1000 messages of 256 bytes, ripemd160_many, x 250"
+    (hash_many Hash.ripemd160_many 250 1000 256);
+  time_fn "MD5, 1000 messages of 256 bytes, md5_many, x 250"
+    (hash_many Hash.md5_many 250 1000 256);
+  time_fn "Keccak-256, 1000 messages of 64 bytes, one at a time, x 250"
+    (hash_each (fun () -> Hash.keccak 256) 250 1000 64);
+  time_fn "Keccak-256, 1000 messages of 64 bytes, keccak_many, x 250"
+    (hash_many (Hash.keccak_many 256) 250 1000 64);
+  time_fn "BLAKE2b-256, 1000 messages of 64 bytes, one at a time, x 250"
+    (hash_each (fun () -> Hash.blake2b 256) 250 1000 64);
+  time_fn "BLAKE2b-256, 1000 messages of 64 bytes, digest_many, x 250"
+    (hash_many (Hash.digest_many (Hash.BLAKE2b 256)) 250 1000 64);
+  time_fn "SHA-512, 1000 messages of 64 bytes, digest_many, x 250"
+    (hash_many (Hash.digest_many Hash.SHA512) 250 1000 64);
+  let k = MAC.hmac_sha256_key "0123456789ABCDEF" in
+  time_fn "HMAC-SHA256, 1000 messages of 64 bytes, digest_many, x 250"
+    (hash_many (MAC.digest_many (MAC.HMAC k)) 250 1000 64);
+  time_fn "SHA-256, 1000 nodes of 64 bytes, one at a time, x 250"
+    (hash_each Hash.sha256 250 1000 64);
+  time_fn "SHA-256, 1000 nodes of 64 bytes, sha256_64to32_level, x 250"
+    (merkle_level Hash.sha256_64to32_level 250 1000);
+  time_fn "BLAKE2s, 1000 nodes of 64 bytes, blake2s_64to32_level, x 250"
+    (merkle_level Hash.blake2s_64to32_level 250 1000);
+  time_fn "BLAKE3, 1000 nodes of 64 bytes, blake3_parent_level, x 250"
+    (merkle_level Hash.blake3_parent_level 250 1000);
+  time_fn "Merkle tree, 65536 SHA-256 leaves, 16 updates, x 1000"
+    (merkle_updates Merkle.SHA256 1000 65536 16);
+  time_fn "Merkle tree, 1M SHA-256 leaves, 1 thread, x 4"
+    (merkle_create 1 Merkle.SHA256 4 1_048_576);
+  time_fn "Merkle tree, 1M SHA-256 leaves, all processors, x 4"
+    (merkle_create 0 Merkle.SHA256 4 1_048_576);
+  time_fn "SHA-256, 4096-byte prefix, 100000 64-byte suffixes, one at a time"
+    (hash_each Hash.sha256 1 100000 (4096 + 64));
+  time_fn "SHA-256, 4096-byte prefix, 100000 64-byte suffixes, copy"
+    (hash_suffixes (Hash.sha256()) 100000 4096 64);
+  time_fn "HMAC-SHA256, 1_000_000 64-byte messages, new MAC each time"
+    (hash_each (fun () -> MAC.hmac_sha256 "0123456789ABCDEF") 1 1000000 64);
+  let k = MAC.hmac_sha256_key "0123456789ABCDEF" in
+  time_fn "HMAC-SHA256, 1_000_000 64-byte messages, prepared key"
+    (hash_each (fun () -> MAC.hmac_of_key k) 1 1000000 64);
+  time_fn "HMAC-SHA256, 1_000_000 64-byte messages, reset and result_into"
+    (mac_reuse (MAC.hmac_sha256 "0123456789ABCDEF") 1000000 64);
+  time_fn "SipHash 64, 1_000_000 64-byte messages, reset and result_into"
+    (mac_reuse (MAC.siphash "0123456789ABCDEF") 1000000 64);
   time_fn "AES CMAC, 64_000_000 bytes, 16-byte chunks"
     (hash (MAC.aes_cmac "0123456789ABCDEF") 4000000 16);
   time_fn "HMAC-SHA1, 64_000_000 bytes, 16-byte chunks"
@@ -333,7 +333,27 @@ let _ =
     incr testcnt; test !testcnt ct (cipher ^ tag);
     let d = AEAD.(aes_gcm ~header ~iv key Decrypt) in
     let pp = auth_check_transform_string d ct in
-    incr testcnt; test !testcnt pp (Some plain) in
+    incr testcnt; test !testcnt pp (Some plain);
+    let hl = String.length header in
+    let c = AEAD.(aes_gcm_with_header ~header:(String.sub header 0 (hl / 3))
+                                        ~iv key Encrypt) in
+    c#put_header_string (String.sub header (hl / 3) (hl / 3));
+    c#put_header_substring (Bytes.of_string header) (2 * (hl / 3))
+                                                    (hl - 2 * (hl / 3));
+    incr testcnt;
+    test !testcnt (auth_transform_string (c :> authenticated_transform) plain) ct;
+    let c = AEAD.(aes_gcm_with_header ~iv key Encrypt) in
+    c#put_string "";
+    incr testcnt;
+    test !testcnt (try c#put_header_string header; false
+                   with Invalid_argument _ -> true) true;
+    let k = AEAD.aes_gcm_key key in
+    incr testcnt; test !testcnt (AEAD.seal ~header ~iv k plain) ct;
+    incr testcnt; test !testcnt (AEAD.open_ ~header ~iv k ct) (Some plain);
+    let forged = Bytes.of_string ct in
+    Bytes.set forged 0 (Char.chr (Char.code (Bytes.get forged 0) lxor 1));
+    incr testcnt;
+    test !testcnt (AEAD.open_ ~header ~iv k (Bytes.to_string forged)) None in
   List.iter do_test [
     ("00000000000000000000000000000000",
       "", "",
@@ -387,7 +407,28 @@ let _ =
     incr testcnt; test !testcnt ct (cipher ^ tag);
     let d = AEAD.(chacha20_poly1305 ~header ~iv key Decrypt) in
     let pp = auth_check_transform_string d ct in
-    incr testcnt; test !testcnt pp (Some plain) in
+    incr testcnt; test !testcnt pp (Some plain);
+    let hl = String.length header in
+    let c = AEAD.(chacha20_poly1305_with_header
+                    ~header:(String.sub header 0 (hl / 3)) ~iv key Encrypt) in
+    c#put_header_string (String.sub header (hl / 3) (hl / 3));
+    c#put_header_substring (Bytes.of_string header) (2 * (hl / 3))
+                                                    (hl - 2 * (hl / 3));
+    incr testcnt;
+    test !testcnt (auth_transform_string (c :> authenticated_transform) plain) ct;
+    let c = AEAD.(chacha20_poly1305_with_header ~iv key Encrypt) in
+    c#put_string "";
+    incr testcnt;
+    test !testcnt (try c#put_header_string header; false
+                   with Invalid_argument _ -> true) true;
+    let k = AEAD.chacha20_poly1305_key key in
+    incr testcnt; test !testcnt (AEAD.seal ~header ~iv k plain) ct;
+    incr testcnt; test !testcnt (AEAD.open_ ~header ~iv k ct) (Some plain);
+    let forged = Bytes.of_string ct in
+    let last = Bytes.length forged - 1 in
+    Bytes.set forged last (Char.chr (Char.code (Bytes.get forged last) lxor 1));
+    incr testcnt;
+    test !testcnt (AEAD.open_ ~header ~iv k (Bytes.to_string forged)) None in
   List.iter do_test [
     (* From RFC 7539 *)
     ("808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f",
@@ -441,6 +482,166 @@ let _ =
      "5a6e21f4ba6dbee57380e79e79c30def")
   ]
 
+(* Batch authenticated encryption *)
+let _ =
+  testing_function "AEAD batch";
+  let gcm128 = AEAD.aes_gcm_key (hex "000102030405060708090a0b0c0d0e0f")
+  and gcm256 = AEAD.aes_gcm_key (hex "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f")
+  and chapoly = AEAD.chacha20_poly1305_key (hex "808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f") in
+  let n = 11 in
+  let keys =
+    Array.init n (fun i -> match i mod 3 with 0 -> gcm128 | 1 -> gcm256 | _ -> chapoly) in
+  let ivs = Array.init n (fun i -> Printf.sprintf "nonce%07d" i) in
+  let headers = Array.init n (fun i -> String.make i 'h') in
+  let msgs =
+    Array.init n (fun i -> String.init (i * 37) (fun j -> Char.chr ((i + j) land 0xFF))) in
+  let bufs = Array.map (fun m -> Bytes.of_string (m ^ String.make 16 '\000')) msgs in
+  AEAD.seal_batch ~headers ~ivs keys bufs;
+  test 1 (Array.map Bytes.to_string bufs)
+         (Array.init n (fun i -> AEAD.seal ~header:headers.(i) ~iv:ivs.(i) keys.(i) msgs.(i)));
+  Bytes.set bufs.(4) 3 (Char.chr (Char.code (Bytes.get bufs.(4) 3) lxor 1));
+  let corrupted = Bytes.to_string bufs.(4) in
+  test 2 (AEAD.open_batch ~headers ~ivs keys bufs) (Array.init n (fun i -> i <> 4));
+  test 3 (Array.init n (fun i ->
+            if i = 4 then Bytes.to_string bufs.(i)
+            else Bytes.sub_string bufs.(i) 0 (String.length msgs.(i))))
+         (Array.init n (fun i -> if i = 4 then corrupted else msgs.(i)))
+
+(* In-place authenticated encryption *)
+let _ =
+  testing_function "AEAD in place";
+  let msg = "Ladies and Gentlemen of the class of '99"
+  and header = "header"
+  and iv = "0123456789AB" in
+  List.iteri (fun i key ->
+    let expected = AEAD.seal ~header ~iv key msg in
+    let len = String.length msg in
+    let buf = Bytes.of_string ("xx" ^ msg ^ String.make 16 '\000' ^ "yy") in
+    AEAD.seal_in_place ~header ~iv key buf 2 len;
+    test (8*i+1) (Bytes.sub_string buf 2 (len + 16)) expected;
+    test (8*i+2) (AEAD.open_in_place ~header ~iv key buf 2 (len + 16)) true;
+    test (8*i+3) (Bytes.sub_string buf 2 len) msg;
+    AEAD.seal_in_place ~header ~iv key buf 2 len;
+    Bytes.set buf 5 (Char.chr (Char.code (Bytes.get buf 5) lxor 1));
+    let corrupted = Bytes.to_string buf in
+    test (8*i+4) (AEAD.open_in_place ~header ~iv key buf 2 (len + 16)) false;
+    test (8*i+5) (Bytes.to_string buf) corrupted;
+    let ba = Bigarray.(Array1.create char c_layout (len + 20)) in
+    for j = 0 to len - 1 do ba.{j + 4} <- msg.[j] done;
+    AEAD.seal_in_place_bigarray ~header ~iv key ba 4 len;
+    test (8*i+6) (String.init (len + 16) (fun j -> ba.{j + 4})) expected;
+    test (8*i+7) (AEAD.open_in_place_bigarray ~header ~iv key ba 4 (len + 16)) true;
+    test (8*i+8) (String.init len (fun j -> ba.{j + 4})) msg)
+  [AEAD.aes_gcm_key "0123456789ABCDEF";
+   AEAD.chacha20_poly1305_key "0123456789ABCDEF0123456789ABCDEF"]
+
+(* Segmented streaming authenticated encryption *)
+let _ =
+  testing_function "Streaming AEAD";
+  let key = "0123456789ABCDEF" in
+  let testcnt = ref 0 in
+  let roundtrip algo compress len =
+    let msg = String.init len (fun i -> Char.chr (i land 0xFF)) in
+    let ct =
+      transform_string
+        (Streaming_AEAD.encrypt ~segment_size:16 ~compress algo key) msg in
+    incr testcnt;
+    test !testcnt (transform_string (Streaming_AEAD.decrypt algo key) ct) msg;
+    ct in
+  List.iter (fun algo ->
+      List.iter (fun len -> ignore (roundtrip algo false len))
+                [0; 15; 16; 17; 100];
+      ignore (roundtrip algo true 1000))
+    Streaming_AEAD.[AES_GCM; Chacha20_Poly1305];
+  let ct = roundtrip Streaming_AEAD.AES_GCM false 64 in
+  let fails ?associated_data s =
+    try
+      ignore (transform_string
+                Streaming_AEAD.(decrypt ?associated_data AES_GCM key) s);
+      false
+    with Error Authentication_failure -> true in
+  (* Truncation at a segment boundary *)
+  test 20 (fails (String.sub ct 0 (String.length ct - 32))) true;
+  (* Corruption *)
+  let b = Bytes.of_string ct in
+  Bytes.set b 40 (Char.chr (Char.code (Bytes.get b 40) lxor 1));
+  test 21 (fails (Bytes.to_string b)) true;
+  (* Wrong associated data *)
+  test 22 (fails ~associated_data:"x" ct) true;
+  (* Random access *)
+  let msg = String.init 100 (fun i -> Char.chr (i land 0xFF)) in
+  let ct =
+    transform_string
+      Streaming_AEAD.(encrypt ~segment_size:16 Chacha20_Poly1305 key) msg in
+  let file = Filename.temp_file "cryptokit" ".enc" in
+  let oc = open_out_bin file in
+  output_string oc ct; close_out oc;
+  let ic = open_in_bin file in
+  let r = Streaming_AEAD.(open_reader Chacha20_Poly1305 key ic) in
+  test 23 (Streaming_AEAD.plaintext_length r) 100;
+  test 24 (Streaming_AEAD.read r 10 50) (String.sub msg 10 50);
+  test 25 (Streaming_AEAD.read r 90 10) (String.sub msg 90 10);
+  test 26 (Streaming_AEAD.read r 0 100) msg;
+  Streaming_AEAD.close_reader r;
+  close_in ic;
+  Sys.remove file;
+  (* Several batches of segments, processed by several threads *)
+  let msg = String.init 5000 (fun i -> Char.chr ((i * 7) land 0xFF)) in
+  let ct =
+    transform_string
+      Streaming_AEAD.(encrypt ~segment_size:16 ~threads:4 AES_GCM key) msg in
+  test 27 (transform_string
+             Streaming_AEAD.(decrypt ~threads:1 AES_GCM key) ct) msg;
+  test 28 (transform_string
+             Streaming_AEAD.(decrypt ~threads:3 AES_GCM key) ct) msg;
+  let b = Bytes.of_string ct in
+  Bytes.set b 3000 (Char.chr (Char.code (Bytes.get b 3000) lxor 1));
+  test 29 (fails (Bytes.to_string b)) true;
+  (* Character-by-character input *)
+  let c = Streaming_AEAD.(decrypt ~threads:2 AES_GCM key) in
+  String.iter c#put_char ct;
+  c#finish;
+  test 30 (c#get_string) msg
+
+(* Encrypted page store *)
+let _ =
+  testing_function "Page store";
+  let page_size = 64 in
+  let data = Bigarray.(Array1.create char c_layout (16 * page_size))
+  and tags = Bigarray.(Array1.create char c_layout (16 * Page_store.tag_entry_size)) in
+  Bigarray.Array1.fill data '\000'; Bigarray.Array1.fill tags '\000';
+  let st =
+    Page_store.create ~cache_size:2 ~page_size
+      ~data:(Page_store.bigarray_storage data)
+      ~tags:(Page_store.bigarray_storage tags)
+      (AEAD.aes_gcm_key "0123456789ABCDEF") in
+  let page n = Bytes.make page_size (Char.chr (65 + n)) in
+  for n = 0 to 7 do Page_store.write_page st n (page n) 0 done;
+  Page_store.write_page st 3 (page 10) 0;
+  let buf = Bytes.create page_size in
+  Page_store.read_page st 3 buf 0;
+  test 1 buf (page 10);
+  Page_store.read_page st 5 buf 0;
+  test 2 buf (page 5);
+  test 3 (Page_store.read_pages st [| 0; 1; 2; 3; 4; 5; 6; 7 |])
+         (Array.init 8 (fun n -> if n = 3 then page 10 else page n));
+  test 4 (try Page_store.read_page st 9 buf 0; false with Not_found -> true)
+         true;
+  data.{6 * page_size} <- 'x';
+  let st' =
+    Page_store.create ~cache_size:0 ~page_size
+      ~data:(Page_store.bigarray_storage data)
+      ~tags:(Page_store.bigarray_storage tags)
+      (AEAD.aes_gcm_key "0123456789ABCDEF") in
+  test 5 (try Page_store.read_page st' 6 buf 0; false
+          with Error Authentication_failure -> true) true;
+  test 6 (try ignore (Page_store.read_pages st' [| 5; 6 |]); false
+          with Error Authentication_failure -> true) true;
+  Page_store.wipe st; Page_store.wipe st';
+  (* Wiping the store leaves the caller's key intact *)
+  Page_store.read_page st 5 buf 0;
+  test 7 buf (page 5)
+
 (* Input message: a million 'a' *)
 let hash_million_a (h: hash) =
   for i = 1 to 10_000 do
@@ -455,6 +656,14 @@ let hash_extremely_long (h: hash) =
   done;
   h#result
 
+(* Input message: 1000 bytes, hashed in one call and in chunks of 100 bytes *)
+let hash_1000_bytes (mkhash: unit -> hash) =
+  let msg = String.init 1000 (fun i -> Char.chr ((i * 7 + 3) land 255)) in
+  let r = hash_string (mkhash()) msg in
+  let h = mkhash() in
+  for i = 0 to 9 do h#add_string (String.sub msg (i * 100) 100) done;
+  if h#result = r then r else "mismatch"
+
 (* SHA-1 *)
 let _ =
   testing_function "SHA-1";
@@ -468,6 +677,8 @@ let _ =
          (hex "84983E441C3BD26EBAAE4AA1F95129E5E54670F1");
   test 6 (hash_million_a (Hash.sha1()))
          (hex "34AA973CD4C4DAA4F61EEB2BDBAD27316534016F");
+  test 7 (hash_1000_bytes Hash.sha1)
+         (hex "4231a8a50a10fa9758db8ec71fdef855b751048a");
   if !long_tests then
   test 99 (hash_extremely_long (Hash.sha1()))
          (hex "7789f0c9 ef7bfc40 d9331114 3dfbe69e 2017f592")
@@ -497,6 +708,8 @@ let _ =
     (hex "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
   test 4 (hash_million_a (Hash.sha2 256))
     (hex "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+  test 5 (hash_1000_bytes Hash.sha256)
+    (hex "1e9bc38cbf860b9ec31918b065f9b52476c549a782e0e7990bed8ce3868d2371");
   if !long_tests then
   test 99 (hash_extremely_long (Hash.sha256()))
          (hex "50e72a0e 26442fe2 552dc393 8ac58658 228c0cbf b1d2ca87 2ae43526 6fcd055e")
@@ -528,6 +741,8 @@ let _ =
     (hex "8e959b75dae313da 8cf4f72814fc143f 8f7779c6eb9f7fa1 7299aeadb6889018 501d289e4900f7e4 331b99dec4b5433a c7d329eeb6dd2654 5e96e55b874be909");
   test 5 (hash_million_a (Hash.sha2 512))
     (hex "e718483d0ce76964 4e2e42c7bc15b463 8e1f98b13b204428 5632a803afa973eb de0ff244877ea60a 4cb0432ce577c31b eb009c5c2c49aa2e 4eadb217ad8cc09b");
+  test 6 (hash_1000_bytes Hash.sha512)
+    (hex "00e36fccf193e596 97a92b5ab24666ce 6326d7fa16bf1083 2d0991ddc591112e 9dfa6a636950ed9c 4d67344a760654c2 ff7785e1d60094d6 51038735b5dccabd");
   if !long_tests then
   test 99 (hash_extremely_long (Hash.sha2 512))
          (hex "b47c933421ea2db1 49ad6e10fce6c7f9 3d0752380180ffd7 f4629a712134831d 77be6091b819ed35 2c2967a2e2d4fa50 50723c9630691f1a 05a7281dbe6c1086")
@@ -676,6 +891,79 @@ let _ =
   test 99 (hash_extremely_long (Hash.keccak 512))
          (hex "3e122edaf3739823 1cfaca4c7c216c9d 66d5b899ec1d7ac6 17c40c7261906a45 fc01617a021e5da3 bd8d4182695b5cb7 85a28237cbb16759 0e34718e56d8aab8")
 
+(* SHAKE and cSHAKE *)
+(* The cSHAKE test cases are from NIST's "cSHAKE samples" *)
+let _ =
+  testing_function "SHAKE";
+  let input = String.init 1000 (fun i -> Char.chr (i mod 251)) in
+  let x = Hash.shake128 () in
+  x#add_string input;
+  let a = x#squeeze 10 in
+  let b = x#squeeze 300 in
+  test 1 (a ^ b)
+    (hex "a72440f7f5aa7c14c8e0187420611da7e2ba62f5bb2e88a91b9c9448cac30078\
+          cc321c13735bc6799f955dea38f171355b3ebccc9a09639b92f0f2f91ba0d6d4\
+          15d366c872dcfa18d715bb12041115850d1096489070d2febf2ffd986f53de7d\
+          b306585567056f53553d68f789766711d9a0585dda15ff0b8ade8f6de3131ffa\
+          5bec44a58bc041e1818b713e0d6613ab401da4772b05cac9ba879bff4d97e68a\
+          84716528a4b9fb7e7ad47fbb929819bd47dea3f407a8d14285e2ab4f96a07f13\
+          312d73f25c0b28a4c2a35d14aaf86a5063205f626ad69e95eaf287d48c6928af\
+          0e43acc93dc91edf7eb472aa9cab1ead68dcf8eb0ecc5178f37a3ff6d6408ec8\
+          de1d54fe35209237a8cb0df23a944822bbfc8c9617bd7aabc9a20d4e3b876c34\
+          5b768a9f29c195d8ca3e826b1591bc637a6edfa641e0");
+  x#wipe;
+  let x = Hash.shake256 () in
+  let buf = Bytes.make 68 '-' in
+  x#squeeze_into buf 2 64;
+  test 2 (Bytes.sub_string buf 2 64)
+    (hex "46b9dd2b0ba88d13233b3feb743eeb243fcd52ea62b81b82b50c27646ed5762f\
+          d75dc4ddd8c0f200cb05019d67b592f6fc821c49479ab48640292eacb3b7c4be");
+  test 3 (Bytes.sub_string buf 0 2 ^ Bytes.sub_string buf 66 2) "----";
+  x#wipe;
+  let x = Hash.cshake128 ~custom:"Email Signature" () in
+  x#add_string "\000\001\002\003";
+  test 4 (x#squeeze 32)
+    (hex "c1c36925b6409a04f1b504fcbca9d82b4017277cb5ed2b2065fc1d3814d5aaf5");
+  x#wipe;
+  let x = Hash.cshake256 ~custom:"Email Signature" () in
+  x#add_string "\000\001\002\003";
+  test 5 (x#squeeze 64)
+    (hex "d008828e2b80ac9d2218ffee1d070c48b8e4c87bff32c9699d5b6896eee0edd1\
+          64020e2be0560858d9c00c037e34a96937c561a74c412bb4c746469527281c8c");
+  x#wipe
+
+(* KangarooTwelve (test vectors from RFC 9861) *)
+let _ =
+  testing_function "KangarooTwelve";
+  let ptn n = String.init n (fun i -> Char.chr (i mod 251)) in
+  let hash ?custom s = hash_string (Hash.k12 ?custom 256) s in
+  test 1 (hash "")
+    (hex "1ac2d450fc3b4205d19da7bfca1b37513c0803577ac7167f06fe2ce1f0ef39e5");
+  let x = Hash.k12_xof () in
+  ignore (x#squeeze 10000);
+  test 2 (x#squeeze 32)
+    (hex "e8dc563642f7228c84684c898405d3a834799158c079b12880277a1d28e2ff6d");
+  x#wipe;
+  test 3 (hash (ptn 17))
+    (hex "6bf75fa2239198db4772e36478f8e19b0f371205f6a9a93a273f51df37122888");
+  test 4 (hash (ptn (17*17*17)))
+    (hex "cb552e2ec77d9910701d578b457ddf772c12e322e4ee7fe417f92c758f0d59d0");
+  test 5 (hash (ptn (17*17*17*17*17)))
+    (hex "844d610933b1b9963cbdeb5ae3b6b05cc7cbd67ceedf883eb678a0a8e0371682");
+  test 6 (Hash.k12_parallel 256 (ptn (17*17*17*17*17*17)))
+    (hex "3c390782a8a4e89fa6367f72feaaf13255c8d95878481d3cd8ce85f58e880af8");
+  test 7 (hash ~custom:(ptn 1) "")
+    (hex "fab658db63e94a246188bf7af69a133045f46ee984c56e3c3328caaf1aa1a583");
+  test 8 (hash ~custom:(ptn (41*41*41)) "\255\255\255\255\255\255\255")
+    (hex "75d2f86a2e644566726b4fbcfc5657b9dbcf070c7b0dca06450ab291d7443bcf");
+  let h = Hash.k12 256 and s = ptn (17*17*17*17) in
+  for i = 0 to String.length s / 1000 do
+    let ofs = i * 1000 in
+    h#add_string (String.sub s ofs (min 1000 (String.length s - ofs)))
+  done;
+  test 9 h#result
+    (hex "8701045e22205345ff4dda05555cbb5c3af1a771c2b89baef37db43d9998b9fe")
+
 (* BLAKE2b *)
 
 let _ =
@@ -686,7 +974,9 @@ let _ =
   test 2 (hash "abc")
          (hex "ba80a53f981c4d0d6a2797b69f12f6e94c212f14685ac4b74b12bb6fdbffa2d17d87c5392aab792dc252d5de4533cc9518d38aa8dbf1925ab92386edd4009923");
   test 3 (hash "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu")
-         (hex "ce741ac5930fe346811175c5227bb7bfcd47f42612fae46c0809514f9e0e3a11ee1773287147cdeaeedff50709aa716341fe65240f4ad6777d6bfaf9726e5e52")
+         (hex "ce741ac5930fe346811175c5227bb7bfcd47f42612fae46c0809514f9e0e3a11ee1773287147cdeaeedff50709aa716341fe65240f4ad6777d6bfaf9726e5e52");
+  test 4 (hash_1000_bytes Hash.blake2b512)
+         (hex "4bdd2c9cf31d797a81d245c989ffb7515143ca345c66f73087dd5c58bf642bf083ba16894eab79e3b08d5126404d833e7510271b50be36a7b7cbbb46f5c89fac")
 
 let _ =
   testing_function "BLAKE2b-512 (keyed)";
@@ -728,7 +1018,67 @@ let _ =
 128, "0c311f38c35a4fb90d651c289d486856cd1413df9b0677f53ece2cd9e477c60a";
 192, "5950d39a23e1545f301270aa1a12f2e6c453776e4d6355de425cc153f9818867";
 255, "3fb735061abc519dfe979e54c1ee5bfad0a9d858b3315bad34bde999efd724dd"
-    ]
+    ];
+  test 1000 (hash_1000_bytes (fun () -> MAC.blake2s256 key))
+    (hex "f79818aa3bc6f7d7aa15e75574dccc5198d22b7b370f43216cc2a8c52fe5c3f5")
+
+(* BLAKE2bp and BLAKE2sp *)
+
+let _ =
+  testing_function "BLAKE2bp-512";
+  let mkstring n = String.init n  (fun i -> Char.chr i) in
+  let key = mkstring 0x40 in
+  let hash s = hash_string (MAC.blake2bp 512 key) s in
+  List.iter
+    (fun (len, result) -> test len (hash (mkstring len)) (hex result))
+    [
+0, "9d9461073e4eb640a255357b839f394b838c6ff57c9b686a3f76107c1066728f3c9956bd785cbc3bf79dc2ab578c5a0c063b9d9c405848de1dbe821cd05c940a";
+1, "ff8e90a37b94623932c59f7559f26035029c376732cb14d41602001cbb73adb79293a2dbda5f60703025144d158e2735529596251c73c0345ca6fccb1fb1e97e";
+255, "96fbcbb60bd313b8845033e5bc058a38027438572d7e7957f3684f6268aadd3ad08d21767ed6878685331ba98571487e12470aad669326716e46667f69f8d7e8"
+    ];
+  test 1000 (hash_1000_bytes (fun () -> Hash.blake2bp 512))
+    (hex "29ca0ff4d384d8f68803bc93b98cd5dda4bd2368105c9644d9158fbc093c85de367d74618cee42f741a0c6b4b9090a15f17460f1ab9c1cc94b91117aed929983")
+
+let _ =
+  testing_function "BLAKE2sp-256";
+  let mkstring n = String.init n  (fun i -> Char.chr i) in
+  let key = mkstring 0x20 in
+  let hash s = hash_string (MAC.blake2sp 256 key) s in
+  List.iter
+    (fun (len, result) -> test len (hash (mkstring len)) (hex result))
+    [
+0, "715cb13895aeb678f6124160bff21465b30f4f6874193fc851b4621043f09cc6";
+1, "40578ffa52bf51ae1866f4284d3a157fc1bcd36ac13cbdcb0377e4d0cd0b6603";
+255, "0c8a36597d7461c63a94732821c941856c668376606c86a52de0ee4104c615db"
+    ];
+  test 1000 (hash_1000_bytes (fun () -> Hash.blake2sp 256))
+    (hex "f970123bbbae325434ca917f79d3724ce95d1074f8ce94c9038a70ab68dd419d")
+
+(* BLAKE2X *)
+
+let _ =
+  testing_function "BLAKE2Xb";
+  let input = String.init 256 (fun i -> Char.chr i) in
+  let key = String.init 0x40 (fun i -> Char.chr i) in
+  let hash sz = hash_string (MAC.blake2xb sz key) input in
+  test 1 (hash 8) (hex "64");
+  test 2 (hash 16) (hex "f457");
+  test 3 (hash 520)
+    (hex "78f0ed6e220b3da3cc9381563b2f72c8dc830cb0f39a48c6ae479a6a78dcfa94002631dec467e9e9b47cc8f0887eb680e340aec3ec009d4a33d241533c76c8ca8c");
+  test 4 (hash_string (Hash.blake2xb 800) "abc")
+    (hex "e0f82b71c07860b65be612d2633becc46596a6c12a8772b561adec35721b7a5c44a7e075e8a3bc8c4fc8390a197be2085b4aa4385c207f24e46415defc659afd73bacb288080b10849aeea386c60cd3fa04c9bcbfeebaed6e98634d696b9d5bdef0ad2c5")
+
+let _ =
+  testing_function "BLAKE2Xs";
+  let input = String.init 256 (fun i -> Char.chr i) in
+  let key = String.init 0x20 (fun i -> Char.chr i) in
+  let hash sz = hash_string (MAC.blake2xs sz key) input in
+  test 1 (hash 8) (hex "0e");
+  test 2 (hash 16) (hex "5196");
+  test 3 (hash 520)
+    (hex "cf601753ffa09fe48a8a84c37769991e96290e200bbaf1910c57760f989bd0c72e6128e294528ee861ad7eee70d589de3cf4a0c35f7197e1925a64d0133628d87d");
+  test 4 (hash_string (Hash.blake2xs 800) "abc")
+    (hex "afaabbf8422df9e7ccc56388e509db4dc68ee81a7c74a49d87cfd6a7aeac1fab1349239e468af27d468ef68ba1ac35221b66a9675a994408ab826a67a4e5d90dd7a7ab030cd52dc38fb6e4c0c5676a7f4931ef35c6bee442a5eafcf234e7f3cd9cea7a0d")
 
 (* BLAKE3 *)
 
@@ -849,6 +1199,127 @@ let _ =
       "1c35d1a5811083fd7119f5d5d1ba027b4d01c0c6c49fb6ff2cf75393ea5db4a7f9dbdd3e1d81dcbca3ba241bb18760f207710b751846faaeb9dff8262710999a59b2aa1aca298a032d94eacfadf1aa192418eb54808db23b56e34213266aa08499a16b354f018fc4967d05f8b9d2ad87a7278337be9693fc638a3bfdbe314574ee6fc4");
 ]
 
+(* BLAKE3 as an extendable-output function, and key derivation *)
+
+let _ =
+  testing_function "BLAKE3 XOF";
+  let input = String.init 1000 (fun i -> Char.chr (i mod 251)) in
+  let x = Hash.blake3_xof () in
+  x#add_string input;
+  let a = x#squeeze 10 in
+  let b = x#squeeze 100 in
+  test 1 (a ^ b)
+    (hex "b43670a52d1af24abdac5d2c3ed19ff4e62b60a618e823ad555888b1b0b91cff\
+          7ad7b31675f618e088498fc023d9c518958e2108a78e10fdf8e45c57c8d28339\
+          18a2b22bbf87f3566041a336e88b794507e905cc0600e482011682a0b697f33d\
+          dee12f099f2ad20a9a22219f39b9");
+  test 2 (String.sub a 0 10) (String.sub (hash_string (Hash.blake3 256) input) 0 10);
+  test 3 x#position 110L;
+  x#seek 1_000_000L;
+  test 4 (x#squeeze 40)
+    (hex "ef67004d8e21095dff62a82834571ced439c07f31e466c4c32bd667259ca3f65\
+          8cd91d5019cedcce");
+  x#seek (Int64.add (Int64.shift_left 64L 32) 5L);
+  let buf = Bytes.make 24 '-' in
+  x#squeeze_into buf 2 20;
+  test 5 (Bytes.sub_string buf 2 20)
+    (hex "d060e6be2937150b7f2ee94bf6821a92786cbbef");
+  test 6 (Bytes.sub_string buf 0 2 ^ Bytes.sub_string buf 22 2) "----";
+  x#wipe;
+  let x = Hash.blake3_xof ~key:"whats the Elvish word for friend" () in
+  x#add_string input;
+  test 7 (x#squeeze 70)
+    (hex "b1ffcd79d70c8ebd2a8465638b6344f909b6baa04b2e60fc551c48f5abe597e0\
+          142c1801a6788a3ec6c60e66bb481394b7beb41e34d56e33ad62f00166571d50\
+          030e25b9f8f5");
+  let kdf =
+    KD.blake3_derive_key
+      ~context:"BLAKE3 2019-12-27 16:29:52 test vectors context" in
+  test 8 (kdf input 32)
+    (hex "73d6b62abb9d081fc257061b3655e924aece0c3fe1fad6539b1ebee6cb8de5a6");
+  test 9 (kdf "secret" 64)
+    (hex "615ce3fbe72fb5b6d8c960231b9030bc6e375a3a086bac25a6a559a96b5ef3fc\
+          b66accf735b8855adce91ff26ba49c69f9a87afee00f0692faa99d0250efd2bc");
+  test 10 (String.sub (kdf input 131) 0 32) (kdf input 32)
+
+(* BLAKE3, multi-threaded *)
+
+let _ =
+  testing_function "BLAKE3 parallel";
+  let key = "whats the Elvish word for friend" in
+  let input len = String.init len (fun i -> Char.chr (i mod 251)) in
+  let s = input 3_000_001 in
+  let h = hex "a1ead512edfce7caaecf9c124bb4da104432bfd8ca640e62ab376f1d72a51428" in
+  test 1 (Hash.blake3_parallel ~threads:4 256 s) h;
+  test 2 (Hash.blake3_parallel ~threads:1 256 s) h;
+  test 3 (Hash.blake3_parallel 256 s) h;
+  test 4 (Hash.blake3_parallel ~threads:3 256 (input 102400))
+         (hash_string (Hash.blake3 256) (input 102400));
+  test 5 (Hash.blake3_parallel ~threads:4 ~key 512 s)
+         (hash_string (MAC.blake3 512 key) s);
+  let ba = Bigarray.(Array1.create char c_layout (String.length s)) in
+  String.iteri (fun i c -> ba.{i} <- c) s;
+  test 6 (Hash.blake3_parallel_bigarray ~threads:2 256 ba) h;
+  let file = Filename.temp_file "cryptokit" ".dat" in
+  let oc = open_out_bin file in
+  output_string oc s; close_out oc;
+  test 7 (Hash.blake3_file ~threads:2 256 file) h;
+  Sys.remove file;
+  test 8 (try ignore (Hash.blake3_file 256 file); false
+          with Sys_error _ -> true) true
+
+(* Bao verified streaming *)
+
+let _ =
+  testing_function "Bao";
+  let input = String.init 10000 (fun i -> Char.chr (i mod 251)) in
+  let sha256 s = hash_string (Hash.sha256()) s in
+  let (h, ob) = Bao.outboard input in
+  test 1 h (hash_string (Hash.blake3 256) input);
+  test 2 (String.length ob) 584;
+  test 3 (sha256 ob)
+    (hex "d80c60c6d72e02a2a7837b8866ec6d86672d9fc5a008f7272134ba6aabfd7d76");
+  test 4 (Bao.content_length ob) 10000;
+  let sl = Bao.slice ~outboard:ob input 3000 2500 in
+  test 5 (sha256 sl)
+    (hex "4c740c1c7a7aee694d7803dcc18954dea806165173e2c47ca367eb60e64464a1");
+  test 6 (transform_string (Bao.decode_slice ~hash:h 3000 2500) sl)
+         (String.sub input 3000 2500);
+  let fails s =
+    try
+      ignore (transform_string (Bao.decode_slice ~hash:h 3000 2500) s); ""
+    with Error Authentication_failure -> "auth"
+       | Error Wrong_data_length -> "length" in
+  let b = Bytes.of_string sl in
+  Bytes.set b 2000 (Char.chr (Char.code (Bytes.get b 2000) lxor 1));
+  test 7 (fails (Bytes.to_string b)) "auth";
+  test 8 (fails (String.sub sl 0 4000)) "length";
+  test 9 (fails (sl ^ "x")) "length";
+  let sl = Bao.slice ~outboard:ob input 20000 5 in
+  test 10 (sha256 sl)
+    (hex "989cc667b2871d468ef575290e686a4338035538764370796d2e8d2659cbf896");
+  test 11 (transform_string (Bao.decode_slice ~hash:h 20000 5) sl) "";
+  let whole = Bao.slice ~outboard:ob input 0 max_int in
+  test 12 (transform_string (Bao.decode_slice ~hash:h 0 max_int) whole) input;
+  let (h0, ob0) = Bao.outboard "" in
+  test 13 ob0 (String.make 8 '\000');
+  test 14 (transform_string (Bao.decode_slice ~hash:h0 0 0)
+                            (Bao.slice ~outboard:ob0 "" 0 0)) "";
+  let file = Filename.temp_file "cryptokit" ".dat" in
+  let oc = open_out_bin file in
+  output_string oc input; close_out oc;
+  test 15 (Bao.outboard_file file) (h, ob);
+  let ic = open_in_bin file in
+  test 16 (Bao.slice_channel ~outboard:ob ic 9000 1000)
+          (Bao.slice ~outboard:ob input 9000 1000);
+  close_in ic;
+  Sys.remove file;
+  (* A content length close to max_int must not wrap around *)
+  let big = Bytes.create 8 in
+  Bytes.set_int64_le big 0 (Int64.of_int max_int);
+  test 17 (try ignore (Bao.content_length (Bytes.to_string big)); false
+           with Error Bad_encoding -> true) true
+
 (* RIPEMD-160 *)
 let _ =
   testing_function "RIPEMD-160";
@@ -882,6 +1353,341 @@ let _ =
   test 4 (hash "message digest")
          (hex "F96B697D7CB7938D525A2F31AAF161D0")
 
+(* Multi-buffer hashing *)
+let _ =
+  testing_function "Hashing many messages";
+  let msgs =
+    Array.init 50 (fun i ->
+      String.init (i * 13) (fun j -> Char.chr ((i + j * 7) land 255))) in
+  let each mkhash = Array.map (fun s -> hash_string (mkhash()) s) msgs in
+  test 1 (Hash.sha256_many msgs) (each Hash.sha256);
+  test 2 (Hash.sha224_many msgs) (each Hash.sha224);
+  test 3 (Hash.sha1_many msgs) (each Hash.sha1);
+  test 4 (Hash.ripemd160_many msgs) (each Hash.ripemd160);
+  test 5 (Hash.md5_many msgs) (each Hash.md5);
+  test 6 (Hash.sha256_many [| "abc" |])
+    [| hex "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" |];
+  test 7 (Hash.sha256_many [||]) [||];
+  test 8 (Hash.sha3_many 256 msgs) (each (fun () -> Hash.sha3 256));
+  test 9 (Hash.sha3_many 512 msgs) (each (fun () -> Hash.sha3 512));
+  test 10 (Hash.keccak_many 256 msgs) (each (fun () -> Hash.keccak 256));
+  test 11 (Hash.keccak_many 224 msgs) (each (fun () -> Hash.keccak 224));
+  test 12 (Hash.keccak_many 256 [| "abc" |])
+    [| hex "4e03657aea45a94fc7d47ba826c8d667c0d1e6e33a64a036ec44f58fa12d6c45" |]
+
+(* Hashing many messages with any hash or MAC *)
+let _ =
+  testing_function "digest_many";
+  let msgs =
+    Array.init 50 (fun i ->
+      String.init (i * 13) (fun j -> Char.chr ((i + j * 7) land 255))) in
+  let each mkhash = Array.map (fun s -> hash_string (mkhash()) s) msgs in
+  let digests =
+    [Hash.SHA384, Hash.sha384; Hash.SHA512, Hash.sha512;
+     Hash.SHA512_256, Hash.sha512_256; Hash.SHA512_224, Hash.sha512_224;
+     Hash.BLAKE2b 512, (fun () -> Hash.blake2b 512);
+     Hash.BLAKE2b 160, (fun () -> Hash.blake2b 160);
+     Hash.BLAKE2s 256, (fun () -> Hash.blake2s 256);
+     Hash.BLAKE2bp 512, (fun () -> Hash.blake2bp 512);
+     Hash.BLAKE2sp 256, (fun () -> Hash.blake2sp 256);
+     Hash.BLAKE2Xb 1024, (fun () -> Hash.blake2xb 1024);
+     Hash.BLAKE2Xs 96, (fun () -> Hash.blake2xs 96);
+     Hash.BLAKE3 256, (fun () -> Hash.blake3 256);
+     Hash.BLAKE3 520, (fun () -> Hash.blake3 520);
+     Hash.K12 (256, ""), (fun () -> Hash.k12 256);
+     Hash.K12 (128, "abc"), (fun () -> Hash.k12 ~custom:"abc" 128)] in
+  test 1 (List.for_all
+             (fun (algo, mkhash) -> Hash.digest_many algo msgs = each mkhash)
+             digests)
+    true;
+  let buf = Bytes.make (3 + 50 * 48) '.' in
+  Hash.digest_many_into Hash.SHA384 msgs buf 3;
+  test 2 (Bytes.sub_string buf 3 (50 * 48))
+          (String.concat "" (Array.to_list (each Hash.sha384)));
+  test 3 (try Hash.digest_many_into Hash.SHA384 msgs buf 4; false
+           with Invalid_argument _ -> true) true;
+  test 4 (try ignore (Hash.digest_many (Hash.BLAKE2s 264) msgs); false
+           with Error Wrong_key_size -> true) true;
+  let key = "0123456789abcdef" and key32 = String.make 32 'k' in
+  let macs =
+    [MAC.HMAC (MAC.hmac_sha1_key key), (fun () -> MAC.hmac_sha1 key);
+     MAC.HMAC (MAC.hmac_sha256_key key), (fun () -> MAC.hmac_sha256 key);
+     MAC.HMAC (MAC.hmac_sha384_key key), (fun () -> MAC.hmac_sha384 key);
+     MAC.HMAC (MAC.hmac_sha512_key key), (fun () -> MAC.hmac_sha512 key);
+     MAC.HMAC (MAC.hmac_ripemd160_key key),
+       (fun () -> MAC.hmac_ripemd160 key);
+     MAC.HMAC (MAC.hmac_md5_key key), (fun () -> MAC.hmac_md5 key);
+     MAC.BLAKE2b (256, key), (fun () -> MAC.blake2b 256 key);
+     MAC.BLAKE2s (128, key), (fun () -> MAC.blake2s 128 key);
+     MAC.BLAKE2bp (512, key), (fun () -> MAC.blake2bp 512 key);
+     MAC.BLAKE2sp (256, key), (fun () -> MAC.blake2sp 256 key);
+     MAC.BLAKE2Xb (600, key), (fun () -> MAC.blake2xb 600 key);
+     MAC.BLAKE2Xs (200, key), (fun () -> MAC.blake2xs 200 key);
+     MAC.BLAKE3 (256, key32), (fun () -> MAC.blake3 256 key32);
+     MAC.KMAC128 (256, key, ""), (fun () -> MAC.kmac128 256 key);
+     MAC.KMAC256 (512, key32, "xyz"),
+       (fun () -> MAC.kmac256 ~custom:"xyz" 512 key32);
+     MAC.AES_CMAC key, (fun () -> MAC.aes_cmac key);
+     MAC.AES_CMAC key32, (fun () -> MAC.aes_cmac key32);
+     MAC.SipHash (64, key), (fun () -> MAC.siphash key);
+     MAC.SipHash (128, key), (fun () -> MAC.siphash128 key)] in
+  test 5 (List.for_all
+             (fun (algo, mkmac) -> MAC.digest_many algo msgs = each mkmac)
+             macs)
+    true;
+  test 6 (try ignore (MAC.digest_many (MAC.SipHash (64, key32)) msgs); false
+           with Error Wrong_key_size -> true) true;
+  test 7 (MAC.digest_many
+             (MAC.AES_CMAC (hex "2b7e151628aed2a6abf7158809cf4f3c"))
+             [| ""; hex "6bc1bee22e409f96e93d7e117393172a" |])
+          [| hex "bb1d6929e95937287fa37d129b756746";
+             hex "070a16b46b4d4144f79bdd9dd04a287c" |]
+
+(* Fixed-length hashing *)
+let _ =
+  testing_function "Fixed-length hashing";
+  let s64 = String.init 64 Char.chr in
+  let level = String.init (64 * 37) (fun i -> Char.chr ((i * 13 + 7) land 255)) in
+  let nodes = List.init 37 (fun i -> String.sub level (64 * i) 64) in
+  let each f = String.concat "" (List.map f nodes) in
+  test 1 (Hash.sha256_64to32 s64)
+    (hex "fdeab9acf3710362bd2658cdc9a29e8f9c757fcf9811603a8c447cd1d9151108");
+  test 2 (Hash.sha256_64to32_level level)
+    (each (fun s -> hash_string (Hash.sha256()) s));
+  test 3 (Hash.sha256d "abc")
+    (hex "4f8b42c22dd3729b519ba6f68d2da7cc5b2d606d05daed5ad5128cc03e6c6358");
+  test 4 (Hash.sha256d_64to32_level level) (each Hash.sha256d);
+  test 5 (Hash.hash160 "abc") (hex "bb1be98c142444d7a56aa3981c3942a978e4dc33");
+  test 6 (Hash.blake2s_64to32 s64)
+    (hex "56f34e8b96557e90c1f24b52d0c89d51086acf1b00f634cf1dde9233b8eaaa3e");
+  test 7 (Hash.blake2s_64to32_level level)
+    (each (fun s -> hash_string (Hash.blake2s 256) s));
+  test 8 (Hash.blake3_parent s64)
+    (hex "27630b0d845af03c8eb2174cb45c8982ca72d87229e230eb9f31ad5328e2b303");
+  test 9 (Hash.blake3_parent_level level)
+    (each (fun s -> Hash.blake3_parent s));
+  test 10 (Hash.sha256_64to32_level "") "";
+  test 11 (try ignore (Hash.sha256_64to32_level (String.make 65 'x')); false
+           with Invalid_argument _ -> true) true
+
+(* Merkle trees *)
+let _ =
+  testing_function "Merkle";
+  let h = Merkle.SHA256 in
+  let leaves =
+    Array.init 37 (fun i -> hash_string (Hash.sha256()) (String.make 1 (Char.chr i))) in
+  let t = Merkle.create h leaves in
+  test 1 (Merkle.root t)
+    (hex "0558b1f14b76612d5082d0c06e58320035f23534d4ae951ef32b00970228926a");
+  List.iter (fun i -> leaves.(i) <- String.make 32 (Char.chr i)) [3; 4; 36];
+  List.iter (fun i -> Merkle.set_leaf t i leaves.(i)) [36; 3; 4; 3];
+  test 2 (Merkle.root t) (Merkle.root (Merkle.create h leaves));
+  let root = Merkle.root t in
+  let ok i =
+    Merkle.verify h ~leaves:37 ~index:i ~leaf:leaves.(i) (Merkle.proof t i) root in
+  test 3 (List.for_all ok (List.init 37 (fun i -> i))) true;
+  test 4 (List.length (Merkle.proof t 36)) 2;
+  test 5 (Merkle.verify h ~leaves:37 ~index:6 ~leaf:leaves.(5)
+                        (Merkle.proof t 5) root) false;
+  test 6 (Merkle.verify h ~leaves:37 ~index:5 ~leaf:leaves.(5)
+                        (List.tl (Merkle.proof t 5)) root) false;
+  let t1 = Merkle.create Merkle.BLAKE3 [| leaves.(0) |] in
+  test 7 (Merkle.root t1) leaves.(0);
+  test 8 (Merkle.proof t1 0) [];
+  (* Levels large enough to be hashed by several threads *)
+  let rec reference level nodes =
+    let n = String.length nodes / 32 in
+    if n = 1 then nodes else begin
+      let h = level (String.sub nodes 0 (64 * (n / 2))) in
+      reference level
+        (if n land 1 = 0 then h else h ^ String.sub nodes (32 * (n - 1)) 32)
+    end in
+  let big =
+    Array.init 5001 (fun i -> hash_string (Hash.sha256()) (string_of_int i)) in
+  let t = Merkle.create ~threads:4 Merkle.BLAKE2s big in
+  test 9 (Merkle.root t)
+    (reference Hash.blake2s_64to32_level (String.concat "" (Array.to_list big)));
+  for i = 0 to 2999 do
+    big.(i) <- hash_string (Hash.sha256()) (string_of_int (-i));
+    Merkle.set_leaf t i big.(i)
+  done;
+  test 10 (Merkle.root t)
+          (Merkle.root (Merkle.create ~threads:1 Merkle.BLAKE2s big))
+
+(* Copying and serializing hash states *)
+let _ =
+  testing_function "Hash states";
+  let part1 = String.init 70001 (fun i -> Char.chr ((i * 7 + 3) land 255))
+  and part2 = String.init 3001 (fun i -> Char.chr ((i * 11) land 255)) in
+  let base = Hash.sha256() in
+  base#add_string part1;
+  let h = base#copy in
+  h#add_string part2;
+  test 1 h#result (hash_string (Hash.sha256()) (part1 ^ part2));
+  base#add_string "abc";
+  test 2 base#result (hash_string (Hash.sha256()) (part1 ^ "abc"));
+  let resume mkhash =
+    let h = mkhash() in
+    h#add_string part1;
+    let h' = Hash.deserialize h#serialize in
+    h'#add_string part2;
+    h'#result = hash_string (mkhash()) (part1 ^ part2) in
+  test 3 (List.for_all resume
+            [Hash.sha1; Hash.sha224; Hash.sha256; Hash.sha384; Hash.sha512;
+             Hash.sha512_256; Hash.sha512_224; Hash.ripemd160; Hash.md5;
+             (fun () -> Hash.sha3 256); (fun () -> Hash.keccak 384);
+             (fun () -> Hash.blake2b 512); (fun () -> Hash.blake2s 160);
+             (fun () -> Hash.blake3 256); (fun () -> Hash.blake3 512);
+             (fun () -> MAC.blake2b 256 (String.make 32 'k'));
+             (fun () -> MAC.blake3 256 (String.make 32 'k'))])
+    true;
+  let key = "0123456789abcdef" in
+  let copied mkhash =
+    let h = mkhash() in
+    h#add_string part1;
+    let h' = h#copy in
+    h'#add_string part2;
+    h'#result = hash_string (mkhash()) (part1 ^ part2) in
+  test 4 (List.for_all copied
+            [(fun () -> MAC.hmac_sha256 key); (fun () -> MAC.aes_cmac key);
+             (fun () -> MAC.siphash key); (fun () -> Hash.k12 256);
+             (fun () -> MAC.kmac128 256 key); (fun () -> Hash.blake2bp 512)])
+    true;
+  let x = Hash.shake128() in
+  x#add_string part1;
+  let y = x#copy in
+  test 5 (y#squeeze 100) (x#squeeze 100);
+  let bad s =
+    try ignore (Hash.deserialize s); false with Error Bad_encoding -> true in
+  let st = (Hash.sha256())#serialize in
+  test 6 (bad "") true;
+  test 7 (bad (String.sub st 0 (String.length st - 1))) true;
+  test 8 (bad ("\000" ^ String.sub st 1 (String.length st - 1))) true;
+  test 9 (bad (Bytes.to_string
+                 (Bytes.mapi (fun i c -> if i = 4 then 'X' else c)
+                    (Bytes.of_string st)))) true;
+  test 10 (try ignore (MAC.hmac_sha256 key)#serialize; false
+           with Invalid_argument _ -> true) true
+
+(* Reusing hashes *)
+let _ =
+  testing_function "Hash reuse";
+  let key = "0123456789abcdef" in
+  let msgs = ["abc"; String.make 1000 'x'; ""] in
+  let reused mkhash =
+    let h = mkhash() in
+    h#add_string "garbage";
+    ignore h#result;
+    h#reset;
+    List.for_all (fun m ->
+        let buf = Bytes.make (h#hash_size + 3) '.' in
+        h#add_string m;
+        h#result_into buf 3;
+        h#reset;
+        Bytes.sub_string buf 3 h#hash_size = hash_string (mkhash()) m)
+      msgs in
+  test 1 (List.for_all reused
+            [Hash.sha1; Hash.sha224; Hash.sha256; Hash.sha384; Hash.sha512;
+             Hash.sha512_256; Hash.sha512_224; Hash.ripemd160; Hash.md5;
+             (fun () -> Hash.sha3 256); (fun () -> Hash.keccak 512);
+             (fun () -> Hash.blake2b 512); (fun () -> Hash.blake2s 256);
+             (fun () -> Hash.blake2bp 512); (fun () -> Hash.blake2xs 1024);
+             (fun () -> Hash.blake3 256); (fun () -> Hash.k12 256);
+             (fun () -> MAC.hmac_sha256 key); (fun () -> MAC.aes_cmac key);
+             (fun () -> MAC.siphash key); (fun () -> MAC.kmac256 512 key);
+             (fun () -> MAC.blake2b 256 key); (fun () -> MAC.blake3 256 key)])
+    true;
+  test 2 (String.length (hash_string (Hash.sha224()) "")) (Hash.sha224())#hash_size;
+  test 3 (String.length (hash_string (Hash.ripemd160()) ""))
+         (Hash.ripemd160())#hash_size;
+  let h = Hash.sha256() in
+  String.iter h#add_char "abc";
+  h#add_byte 0x64;
+  test 4 h#result (hash_string (Hash.sha256()) "abcd");
+  test 5 (try (Hash.sha256())#result_into (Bytes.create 40) 9; false
+          with Invalid_argument _ -> true) true;
+  let x = Hash.shake256() in
+  x#add_string "garbage";
+  ignore (x#squeeze 10);
+  x#reset;
+  x#add_string "abc";
+  let y = Hash.shake256() in
+  y#add_string "abc";
+  test 6 (x#squeeze 100) (y#squeeze 100);
+  let restored_reset mkhash =
+    let h = mkhash() in
+    h#add_string "garbage";
+    let h' = Hash.deserialize h#serialize in
+    h'#reset;
+    h'#add_string "abc";
+    h'#result = hash_string (mkhash()) "abc" in
+  test 7 (restored_reset (fun () -> MAC.blake3 256 (String.make 32 'k'))) true;
+  let restored_no_reset mkhash =
+    try ignore (restored_reset mkhash); false
+    with Invalid_argument _ -> true in
+  test 8 (restored_no_reset (fun () -> MAC.blake2b 512 key)
+          && restored_no_reset (fun () -> MAC.blake2s 256 key)) true;
+  let contains s sub =
+    let n = String.length sub in
+    let rec at i =
+      i + n <= String.length s && (String.sub s i n = sub || at (i + 1)) in
+    at 0 in
+  let key_free mkhash =
+    let h = mkhash() in
+    (try ignore h#serialize; false with Invalid_argument _ -> true)
+    && (h#add_string "a"; not (contains h#serialize key)) in
+  test 9 (key_free (fun () -> MAC.blake2b 512 key)
+          && key_free (fun () -> MAC.blake2s 256 key)) true
+
+(* Prepared HMAC keys *)
+let _ =
+  testing_function "HMAC keys";
+  let msg = String.init 300 (fun i -> Char.chr (i land 255)) in
+  let same mkkey mkmac key =
+    let k = mkkey key in
+    let h = MAC.hmac_of_key k in
+    h#add_string "garbage";
+    h#reset;
+    h#add_string msg;
+    let h' = h#copy in
+    h'#add_string "x";
+    let ok = h#result = hash_string (mkmac key) msg
+             && hash_string (MAC.hmac_of_key k) "" = hash_string (mkmac key) ""
+             && h'#result = hash_string (mkmac key) (msg ^ "x") in
+    MAC.wipe_hmac_key k;
+    ok in
+  let algos =
+    [MAC.hmac_sha1_key, MAC.hmac_sha1;
+     MAC.hmac_sha256_key, MAC.hmac_sha256;
+     MAC.hmac_sha384_key, MAC.hmac_sha384;
+     MAC.hmac_sha512_key, MAC.hmac_sha512;
+     MAC.hmac_ripemd160_key, MAC.hmac_ripemd160;
+     MAC.hmac_md5_key, MAC.hmac_md5] in
+  test 1 (List.for_all (fun (mkkey, mkmac) -> same mkkey mkmac "key") algos)
+    true;
+  test 2 (List.for_all
+            (fun (mkkey, mkmac) -> same mkkey mkmac (String.make 200 'k'))
+            algos)
+    true;
+  let k = MAC.hmac_sha256_key "Jefe" in
+  let h = MAC.hmac_of_key k in
+  h#add_string "what do ya want for nothing?";
+  test 3 h#result
+    (hex "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843");
+  h#wipe;
+  test 4 (hash_string (MAC.hmac_of_key k) "what do ya want for nothing?")
+    (hex "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843");
+  let h = MAC.hmac_sha256 "Jefe" in
+  h#add_string "what do ya want ";
+  let h' = h#copy in
+  h#wipe;
+  h'#add_string "for nothing?";
+  test 5 h'#result
+    (hex "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843");
+  h'#reset;
+  test 6 (hash_string h' "what do ya want for nothing?")
+    (hex "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843")
+
 (* GHASH *)
 
 module GHash = struct
@@ -1136,6 +1942,35 @@ let _ =
   test 2 (test_overflow (256 * 8)) true;
   test 3 (test_overflow (255 * 8)) false
 
+(* Keystream precomputation *)
+
+let _ =
+  testing_function "Keystream prefetch";
+  let msg = Bytes.init 1000 (fun i -> Char.chr (i land 0xFF)) in
+  let key = "0123456789ABCDEF0123456789ABCDEF" and iv = "01234567" in
+  let expected = Bytes.create 1000 and res = Bytes.create 1000 in
+  (new Stream.chacha20 ~iv key)#transform msg 0 expected 0 1000;
+  let c = new Stream.chacha20_prefetch ~iv key in
+  c#prefetch 100;
+  test 1 c#available_keystream 100;
+  c#transform msg 0 res 0 37;
+  test 2 c#available_keystream 63;
+  c#transform msg 37 res 37 500;
+  c#prefetch 1000;
+  c#transform msg 537 res 537 463;
+  test 3 res expected;
+  let iv = "\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\253" in
+  let c1 = new Block.ctr ~iv (new Block.aes_encrypt "0123456789ABCDEF")
+  and c2 = new Block.ctr_prefetch ~iv (new Block.aes_encrypt "0123456789ABCDEF") in
+  c2#prefetch 50;
+  test 4 c2#available_keystream 64;
+  for i = 0 to 9 do
+    c1#transform msg (16 * i) expected (16 * i);
+    c2#transform msg (16 * i) res (16 * i);
+    if i = 3 then c2#prefetch 100
+  done;
+  test 5 (Bytes.sub res 0 160) (Bytes.sub expected 0 160)
+
 (* HMAC-SHA256 *)
 
 let _ =
@@ -1290,6 +2125,33 @@ let _ =
                  (String.make 50 '\221'))
     (hex "56be34521d144c88dbb8c733f0e8b3f6")
 
+(* KMAC (from NIST's "KMAC samples") *)
+let _ =
+  testing_function "KMAC";
+  let key = String.init 32 (fun i -> Char.chr (0x40 + i)) in
+  let short = "\000\001\002\003"
+  and long = String.init 200 Char.chr in
+  test 1 (hash_string (MAC.kmac128 256 key) short)
+    (hex "e5780b0d3ea6f7d3a429c5706aa43a00fadbd7d49628839e3187243f456ee14e");
+  test 2 (hash_string (MAC.kmac128 ~custom:"My Tagged Application" 256 key)
+                      short)
+    (hex "3b1fba963cd8b0b59e8c1a6d71888b7143651af8ba0a7070c0979e2811324aa5");
+  test 3 (hash_string (MAC.kmac256 ~custom:"My Tagged Application" 512 key)
+                      long)
+    (hex "b58618f71f92e1d56c1b8c55ddd7cd188b97b4ca4d99831eb2699a837da2e4d9\
+          70fbacfde50033aea585f1a2708510c32d07880801bd182898fe476876fc8965");
+  let x = MAC.kmac128_xof key in
+  x#add_string short;
+  test 4 (x#squeeze 32)
+    (hex "cd83740bbd92ccc8cf032b1481a0f4460e7ca9dd12b08a0c4031178bacd6ec35");
+  x#wipe;
+  let x = MAC.kmac256_xof ~custom:"My Tagged Application" key in
+  x#add_string long;
+  test 5 (x#squeeze 64)
+    (hex "d5be731c954ed7732846bb59dbe3a8e30f83e77a4bff4459f2f1c2b4ecebb8ce\
+          67ba01c62e8ab8578d2d499bd1bb276768781190020a306a97de281dcc30305d");
+  x#wipe
+
 (* AES-CMAC (from RFC4493) *)
 
 let _ =